@@ -12,7 +12,7 @@
 
 set -eu
 CWD="$(pwd)"
-rm -f LOG
+rm -f LOG LOG.profile.csv
 
 prepare_config() {
 	echo "### prepare_config"
@@ -23,8 +23,8 @@ prepare_config() {
 	cd $CWD/$KDIR
 	##make ARCH=i386 CC="i386-tcc" LD="i386-tcc" AS="i386-tcc" HOSTCC="i386-tcc" menuconfig
 	# autoconf.h and version.h
-	make ARCH=i386 CC="$CC" LD="$LD" AS="$AS" HOSTCC="$HOSTCC" oldconfig >/dev/null
-	make ARCH=i386 CC="$CC" LD="$LD" AS="$AS" HOSTCC="$HOSTCC" include/linux/version.h
+	profile_cmd make ARCH=i386 CC="$CC" LD="$LD" AS="$AS" HOSTCC="$HOSTCC" oldconfig >/dev/null
+	profile_cmd make ARCH=i386 CC="$CC" LD="$LD" AS="$AS" HOSTCC="$HOSTCC" include/linux/version.h
 	# slow, use pre-generated compile.h instead
 	##make ARCH=i386 CC="$CC" LD="$LD" AS="$AS" HOSTCC="$HOSTCC" dep include/linux/compile.h
 }
@@ -75,7 +75,12 @@ prepare_loader_gas() {
 	echo "### prepare_loader"
 	cd $CWD
 
-	[ -d "${KTMP}" ] && rm -rf ${KTMP} ; mkdir ${KTMP}
+	# incremental builds keep objects of previous run in ${KTMP}/temp
+	if [ ${KINCREMENTAL} = 1 ] ; then
+		mkdir -p ${KTMP}
+	else
+		[ -d "${KTMP}" ] && rm -rf ${KTMP} ; mkdir ${KTMP}
+	fi
 	cd ${KTMP}
 
 	## GNU gas or YASM confirmed
@@ -84,18 +89,18 @@ prepare_loader_gas() {
 	cp $CWD/$KDIR/arch/i386/boot/video.S video.S
 	cp $CWD/$KDIR/arch/i386/kernel/trampoline.S trampoline.S
 
-	$CC -E -P -nostdinc -nostdlib -D__BIG_KERNEL__ -I${CWD}/${KDIR}/include bootsect.S -o bootsect.s
-	$REALAS bootsect.s -o bootsect.o
-	$LD -nostdlib -static -Wl,-Ttext,0 -Wl,--oformat,binary -o bootsect.tcc bootsect.o
+	profile_cmd $CC -E -P -nostdinc -nostdlib -D__BIG_KERNEL__ -I${CWD}/${KDIR}/include bootsect.S -o bootsect.s
+	profile_cmd $REALAS bootsect.s -o bootsect.o
+	profile_cmd $LD -nostdlib -static -Wl,-Ttext,0 -Wl,--oformat,binary -o bootsect.tcc bootsect.o
 	dd if=bootsect.tcc of=bootsect bs=1 count=512 ; chmod 755 bootsect
 
-	$CC -E -P -I${CWD}/${KDIR}/include -D__ASSEMBLY__ -D__KERNEL__ -D__BIG_KERNEL__ setup.S -o setup.s
-	$REALAS setup.s -o setup.o
-	$LD -nostdlib -static -Wl,-Ttext,0 -Wl,--oformat,binary -o setup setup.o
+	profile_cmd $CC -E -P -I${CWD}/${KDIR}/include -D__ASSEMBLY__ -D__KERNEL__ -D__BIG_KERNEL__ setup.S -o setup.s
+	profile_cmd $REALAS setup.s -o setup.o
+	profile_cmd $LD -nostdlib -static -Wl,-Ttext,0 -Wl,--oformat,binary -o setup setup.o
 
 	# 16bit real-mode routines required for smp init, reconfirm inline assembly in rwlock.h 
-	$CC -E -P -I${CWD}/${KDIR}/include -D__ASSEMBLY__ -D__KERNEL__ -D__BIG_KERNEL__ trampoline.S -o trampoline.s
-	$REALAS trampoline.s -o trampoline.o
+	profile_cmd $CC -E -P -I${CWD}/${KDIR}/include -D__ASSEMBLY__ -D__KERNEL__ -D__BIG_KERNEL__ trampoline.S -o trampoline.s
+	profile_cmd $REALAS trampoline.s -o trampoline.o
 
 	#
 	TCC_LIBRARY_PATH="/lib:/usr/lib:/usr/lib/tcc" TCC_CPATH="/usr/include:/usr/lib/tcc/include" $HOSTCC \
@@ -104,51 +109,289 @@ prepare_loader_gas() {
 	cd $CWD
 }
 
+object_key() {
+	# content hash of compiler command line, source and every header tcc -MD recorded
+	local i=$1 deps d
+
+	[ -e ${KTMP}/temp/$i.d ] || return 1
+	deps=$(sed -e 's/^[^:]*://' -e 's/\\$//' ${KTMP}/temp/$i.d)
+	for d in $deps
+	do
+		[ -e $d ] || return 1
+	done
+	{ echo "$CC $KCFLAGS" ; cat $deps ; } | cksum
+}
+
+compile_object() {
+	# compile a single FILE_LIST entry into ${KTMP}/temp, output directories must exist
+	local i=$1
+
+	case $i in
+	*.o)
+		# tcc assembler does not support 16 bit real-mode asm hence trampoline.S is pre-compiled
+		cp ${i} ${KTMP}/temp/$i
+	;;
+	*)
+		# per object wall, cpu and peak rss, see profile_compile; with ktccd the
+		# forked server child records them, GNU time would only see the client
+		KTIMECMD=""
+		if [ ${KPROFILE} = 1 ] ; then
+			if [ ${KTCCD} = 1 ] ; then
+				KTIMECMD="env KTCCD_TIME=${KTMP}/prof/$i.time"
+			else
+				KTIMECMD="${KTIME} -f %e,%U,%S,%M -o ${KTMP}/prof/$i.time"
+			fi
+		fi
+
+		if [ ${KINCREMENTAL} = 1 ] ; then
+			if [ -e ${KTMP}/temp/$i.o ] && [ -e ${KTMP}/temp/$i.key ] && \
+			   [ "$(object_key $i)" = "$(cat ${KTMP}/temp/$i.key 2>/dev/null)" ] ; then
+				echo "unchanged"
+				return 0
+			fi
+			rm -f ${KTMP}/temp/$i.o ${KTMP}/temp/$i.key
+			$KTIMECMD $KCC -o ${KTMP}/temp/$i.o $KCFLAGS -MD -MF ${KTMP}/temp/$i.d -c ${CWD}/${i} || return 1
+			object_key $i >${KTMP}/temp/$i.key || rm -f ${KTMP}/temp/$i.key
+			return 0
+		fi
+
+		$KTIMECMD $KCC \
+		-o ${KTMP}/temp/$i.o \
+		$KCFLAGS $KDEPFLAGS \
+		-c ${CWD}/${i} || return 1
+	;;
+	esac
+}
+
+object_file() {
+	# object of a FILE_LIST entry in link order
+	case $1 in
+	*.o) echo ${KTMP}/temp/$1 ;;
+	*) echo ${KTMP}/temp/$1.o ;;
+	esac
+}
+
+start_ktccd() {
+	# libtcc compile server, KCC forwards the tcc options of CC to it
+	echo "### start_ktccd" | tee -a LOG
+
+	TCC_LIBRARY_PATH="/lib:/usr/lib:/usr/lib/tcc" TCC_CPATH="/usr/include:/usr/lib/tcc/include" $HOSTCC \
+	-I/usr/lib/tcc/include ${CWD}/$KDIR/tcc/ktccd.c -ltcc -ldl -o ${KTMP}/ktccd
+
+	rm -f ${KTMP}/ktccd.sock
+	# started from a subshell, so wait in compile_kernel_parallel does not wait for it
+	KTCCD_PID=$(${KTMP}/ktccd -d ${KTMP}/ktccd.sock >${KTMP}/ktccd.log 2>&1 & echo $!)
+	trap 'kill ${KTCCD_PID} 2>/dev/null || true' EXIT
+
+	local n=0
+	while [ ! -S ${KTMP}/ktccd.sock ]
+	do
+		n=$((n+1))
+		[ $n -gt 50 ] && echo "ktccd did not start" && exit 1
+		sleep 0.1
+	done
+
+	KCC="${KTMP}/ktccd -s ${KTMP}/ktccd.sock ${CC#* }"
+}
+
 compile_kernel() {
 	echo "### compile_kernel" | tee -a LOG
 	cd $CWD
+	local i dir
+
+	KCFLAGS="-fno-common -nostdinc -nostdlib -I${CWD}/${KDIR}/include -D__KERNEL__"
+	KCC="$CC"
+	KDEPFLAGS=""
 
 	rm -f ${KTMP}/vmlinux
-	[ -d ${KTMP}/temp ] && rm -rf ${KTMP}/temp ; mkdir ${KTMP}/temp
+	if [ ${KINCREMENTAL} = 1 ] ; then
+		mkdir -p ${KTMP}/temp
+	else
+		[ -d ${KTMP}/temp ] && rm -rf ${KTMP}/temp ; mkdir ${KTMP}/temp
+	fi
+
+	[ ${KTCCD} = 1 ] && start_ktccd
+
+	if [ ${KPROFILE} = 1 ] ; then
+		rm -rf ${KTMP}/prof ; mkdir ${KTMP}/prof
+		# headers per object for profile_compile, libtcc in ktccd cannot write them
+		[ ${KTCCD} = 1 ] || KDEPFLAGS="-MD"
+	fi
+
+	if [ ${KJOBS} -gt 1 ] ; then
+		compile_kernel_parallel
+	else
+		for i in $FILE_LIST
+		do
+			echo $i 2>&1 | tee -a LOG
+			dir=$(dirname $i)
+			[ ! -d ${KTMP}/temp/$dir ] && mkdir -p ${KTMP}/temp/$dir
+			[ ${KPROFILE} = 1 ] && mkdir -p ${KTMP}/prof/$dir
+
+			# compile before teeing, the exit status of a pipe is the one of tee
+			if ! compile_object $i >${KTMP}/object.log 2>&1 ; then
+				cat ${KTMP}/object.log | tee -a LOG
+				echo "### compile_kernel failed:" $i | tee -a LOG
+				exit 1
+			fi
+			cat ${KTMP}/object.log | tee -a LOG
+
+			FILE_LIST_o="$FILE_LIST_o $(object_file $i)"
+		done
+	fi
+
+	[ ${KPROFILE} = 1 ] && profile_compile
+	return 0
+}
+
+compile_kernel_parallel() {
+	# job-server with KJOBS tokens passed through a fifo, every job writes its own
+	# log which is appended to LOG in FILE_LIST order once all jobs returned
+	echo "### compile_kernel_parallel -j ${KJOBS}" | tee -a LOG
+	local n i dir token
+
+	rm -rf ${KTMP}/log ; mkdir ${KTMP}/log
+	rm -f ${KTMP}/failed ${KTMP}/jobserver
+	mkfifo ${KTMP}/jobserver
+	exec 3<>${KTMP}/jobserver
+	rm -f ${KTMP}/jobserver
+
+	n=0
+	while [ $n -lt ${KJOBS} ] ; do echo >&3 ; n=$((n+1)) ; done
 
 	for i in $FILE_LIST
 	do
-		echo $i 2>&1 | tee -a LOG
 		dir=$(dirname $i)
 		[ ! -d ${KTMP}/temp/$dir ] && mkdir -p ${KTMP}/temp/$dir
+		[ ! -d ${KTMP}/log/$dir ] && mkdir -p ${KTMP}/log/$dir
+		[ ${KPROFILE} = 1 ] && mkdir -p ${KTMP}/prof/$dir
+
+		# link order is defined by FILE_LIST and not by job completion
+		FILE_LIST_o="$FILE_LIST_o $(object_file $i)"
+
+		read token <&3
+		# do not start any further job after first failure
+		[ -e ${KTMP}/failed ] && break
+
+		(
+			if ! compile_object $i >${KTMP}/log/$i.log 2>&1 ; then
+				echo $i >>${KTMP}/failed
+			fi
+			echo >&3
+		) &
+	done
+	wait
+	exec 3>&-
 
-		case $i in
-		*.o)
-			# tcc assembler does not support 16 bit real-mode asm hence trampoline.S is pre-compiled
-			cp ${i} ${KTMP}/temp/$i
-			FILE_LIST_o="$FILE_LIST_o ${KTMP}/temp/$i"
-		;;
-		*)
-			$CC \
-			-o ${KTMP}/temp/$i.o \
-			-fno-common -nostdinc -nostdlib \
-			-I${CWD}/${KDIR}/include \
-			-D__KERNEL__ \
-			-c ${CWD}/${i} 2>&1 | tee -a LOG
-
-			FILE_LIST_o="$FILE_LIST_o ${KTMP}/temp/$i.o"
-		;;
-		esac
+	for i in $FILE_LIST
+	do
+		[ -e ${KTMP}/log/$i.log ] || break
+		echo $i 2>&1 | tee -a LOG
+		cat ${KTMP}/log/$i.log 2>&1 | tee -a LOG
 	done
+
+	if [ -e ${KTMP}/failed ] ; then
+		echo "### compile_kernel failed:" $(cat ${KTMP}/failed) | tee -a LOG
+		exit 1
+	fi
+}
+
+children_times() {
+	# user and sys seconds of all waited-for children from times builtin output
+	awk 'NR==2 { split($1,u,"m") ; split($2,s,"m") ; printf "%.2f %.2f\n", u[1]*60+u[2], s[1]*60+s[2] }' $1
+}
+
+profile_cmd() {
+	# run a command of a build phase, with KPROFILE=1 its peak rss including its
+	# waited-for children is appended to LOG.rss for profile_phase
+	if [ ${KPROFILE} = 1 ] ; then
+		${KTIME} -f %M -a -o ${CWD}/LOG.rss "$@"
+	else
+		"$@"
+	fi
+}
+
+profile_phase() {
+	# run a build phase, with KPROFILE=1 append its wall and cpu time to LOG.profile.csv
+	# and the peak rss of the largest command recorded by profile_cmd or profile_compile,
+	# concurrent -j jobs are not summed
+	if [ ${KPROFILE} != 1 ] ; then
+		"$@"
+		return
+	fi
+
+	[ -e ${CWD}/LOG.profile.csv ] || echo "kind,name,wall_s,user_s,sys_s,maxrss_kb" >${CWD}/LOG.profile.csv
+	local t0 t1 idle c0 c1 rss
+	rm -f ${CWD}/LOG.rss
+	read t0 idle </proc/uptime
+	times >${CWD}/LOG.times
+	c0=$(children_times ${CWD}/LOG.times)
+
+	"$@"
+
+	read t1 idle </proc/uptime
+	times >${CWD}/LOG.times
+	c1=$(children_times ${CWD}/LOG.times)
+	rm -f ${CWD}/LOG.times
+
+	# GNU time adds a status line for failing commands
+	rss=$(grep -x '[0-9][0-9]*' ${CWD}/LOG.rss 2>/dev/null | sort -n | tail -n 1 || true)
+	rm -f ${CWD}/LOG.rss
+
+	echo "$1 $t0 $t1 $c0 $c1 $rss" | \
+	awk '{ printf "phase,%s,%.2f,%.2f,%.2f,%s\n", $1, $3-$2, $6-$4, $7-$5, $8 }' >>${CWD}/LOG.profile.csv
+	echo "### $1 took $(tail -n 1 ${CWD}/LOG.profile.csv | cut -d, -f3)s" | tee -a ${CWD}/LOG
+}
+
+profile_compile() {
+	# append per object timings to LOG.profile.csv and print the KPROFILE_TOP slowest
+	# objects, headers are ranked by the summed wall time of all objects including
+	# them which approximates what trimming them from the kfiles list would save
+	echo "### profile_compile" | tee -a LOG
+	cd $CWD
+
+	[ -e LOG.profile.csv ] || echo "kind,name,wall_s,user_s,sys_s,maxrss_kb" >LOG.profile.csv
+	rm -f ${KTMP}/prof/files.csv ${KTMP}/prof/headers.csv
+	local i t
+
+	for i in $FILE_LIST
+	do
+		[ -e ${KTMP}/prof/$i.time ] || continue
+		# GNU time prefixes a status line for failing commands
+		t=$(tail -n 1 ${KTMP}/prof/$i.time)
+		echo "file,$i,$t" >>${KTMP}/prof/files.csv
+		echo ${t##*,} >>${CWD}/LOG.rss
+
+		[ -e ${KTMP}/temp/$i.d ] || continue
+		sed -e 's/^[^:]*://' -e 's/\\$//' ${KTMP}/temp/$i.d | tr ' ' '\n' | grep '\.h$' | \
+		sed -e "s|^${CWD}/||" -e "s|\$|,${t%%,*}|" >>${KTMP}/prof/headers.csv || true
+	done
+	[ -e ${KTMP}/prof/files.csv ] || return 0
+	cat ${KTMP}/prof/files.csv >>LOG.profile.csv
+
+	echo "### slowest ${KPROFILE_TOP} objects: file,wall_s,user_s,sys_s,maxrss_kb" | tee -a LOG
+	sort -t, -k3 -g -r ${KTMP}/prof/files.csv | head -n ${KPROFILE_TOP} | cut -d, -f2- | tee -a LOG
+
+	[ -e ${KTMP}/prof/headers.csv ] || return 0
+	awk -F, '{ n[$1]++ ; t[$1]+=$2 } END { for (h in n) printf "header,%s,%.2f,,,,%d\n", h, t[h], n[h] }' \
+	${KTMP}/prof/headers.csv | sort -t, -k3 -g -r >${KTMP}/prof/headers.sum
+	echo "### costliest ${KPROFILE_TOP} headers: header,summed wall_s of including objects,objects" | tee -a LOG
+	head -n ${KPROFILE_TOP} ${KTMP}/prof/headers.sum | cut -d, -f2,3,7 | tee -a LOG
+	cut -d, -f1-6 ${KTMP}/prof/headers.sum >>LOG.profile.csv
 }
 
 link_kernel() {
 	echo "### link_kernel" | tee -a LOG
 	cd $CWD
 
-	$LD \
+	profile_cmd $LD \
 	-o ${KTMP}/vmlinux \
 	-fno-common -nostdinc -nostdlib -static -Wl,-Ttext,0xc0100000 -Wl,--oformat,binary \
 	$FILE_LIST_o \
 	$CCLIB 2>&1 | tee -a LOG
 
 	cd ${KTMP}
-	./build -b ./bootsect ./setup vmlinux >${CWD}/linux
+	profile_cmd ./build -b ./bootsect ./setup vmlinux >${CWD}/linux
 }
 
 compilelink_kernel() {
@@ -209,17 +452,17 @@ label linux-debug
 	fi
 
 	cd ${KTMP}
-	./build -b ./bootsect ./setup vmlinux >isoroot/boot/linux
+	profile_cmd ./build -b ./bootsect ./setup vmlinux >isoroot/boot/linux
 
 	# fiddle together tccargs and usr/src/linux for final FILE_LIST on target
 	#genromfs -v -x '.git' -d /media/CACHE/TCC/linux-bellard -f ../isoroot/boot/example.romfs >/dev/null 2>&1
 
 	cd ${KTMP}
-	mkisofs -l -V LIVECD -o tccboot.iso \
+	profile_cmd mkisofs -l -V LIVECD -o tccboot.iso \
 	-b isolinux/isolinux.bin -c isolinux/boot.cat -no-emul-boot -boot-load-size 4 -boot-info-table -iso-level 4 isoroot
 
 	cp tccboot.iso tccboot-hybrid.iso
-	isohybrid -type 112 -id 0x88888888 tccboot-hybrid.iso
+	profile_cmd isohybrid -type 112 -id 0x88888888 tccboot-hybrid.iso
 
 	echo "sg lanout -c \"ncftpput 172.16.2.3 / ${KTMP}/tccboot.iso\""
 	echo "sg lanout -c \"ncftpput 172.16.2.3 / ${KTMP}/tccboot-hybrid.iso\""
@@ -238,6 +481,33 @@ KDIR="usr/src/linux"
 
 # build output
 KTMP="/var/tmp/ktmp"
+
+# parallel compile jobs for compile_kernel, -j N overrides KJOBS from environment
+KJOBS="${KJOBS:-1}"
+# incremental build, -i only recompiles objects whose source, headers or flags changed
+KINCREMENTAL="${KINCREMENTAL:-0}"
+# compile through the persistent libtcc server tcc/ktccd.c, -s
+KTCCD="${KTCCD:-0}"
+# build-time profile per phase and object into LOG.profile.csv, -p
+KPROFILE="${KPROFILE:-0}"
+KPROFILE_TOP="${KPROFILE_TOP:-20}"
+KTIME="${KTIME:-/usr/bin/time}"
+while [ $# -gt 0 ]
+do
+	case $1 in
+	-j) KJOBS="$2" ; shift 2 ;;
+	-j*) KJOBS="${1#-j}" ; shift ;;
+	-i) KINCREMENTAL=1 ; shift ;;
+	-s) KTCCD=1 ; shift ;;
+	-p) KPROFILE=1 ; shift ;;
+	*) echo "usage: $0 [-j N] [-i] [-s] [-p]" ; exit 1 ;;
+	esac
+done
+# incremental keys are built from tcc -MD dependency files, libtcc in ktccd cannot write them
+if [ ${KINCREMENTAL} = 1 ] && [ ${KTCCD} = 1 ] ; then
+	echo "$0: -i and -s cannot be combined, ktccd writes no dependency files"
+	exit 1
+fi
 #mount -o remount,exec ${KTMP} >/dev/null 2>&1 || true
 
 ### keep tcc for prepare_loader
@@ -272,6 +542,11 @@ AS="/usr/bin/i386-tcc -D__GNUC__=2 -D__GNUC_MINOR__=95 ${OPTIMIZE}"
 KCONF=kconfig-i486-2.4.37.11.DEBUG
 . ./kfiles-2.4.DEBUG
 
+## the kfiles lists carry fib_hash.c; CONFIG_IP_FIB_TRIE=y in KCONF builds fib_trie.c in its place
+if grep -q '^CONFIG_IP_FIB_TRIE=y' ${KCONF} ; then
+	FILE_LIST="$(echo "$FILE_LIST" | sed 's|/net/ipv4/fib_hash\.c$|/net/ipv4/fib_trie.c|')"
+fi
+
 
 # ext2, romfs, squashfs v1/v2 rootfs
 INITRD="/media/DATA/TCC/initrd.romfs"
@@ -279,7 +554,7 @@ INITRD_SIZE="$(du -B1024 ${INITRD} | cut -d'/' -f1 || echo 0)"
 
 
 #
-prepare_config
+profile_phase prepare_config
 
 
 ### AS86 suffices for TINY and SMALL configuration variant only; trampoline.AS86 needs re-feactoring
@@ -293,7 +568,7 @@ prepare_config
 #REALAS="i586-tcc-linux-musl-as"
 ## YASM can fully replace GNU binutils-as with a much smaller dependency graph and less lines of code
 REALAS="yasm -p gas -f elf32"
-prepare_loader_gas
+profile_phase prepare_loader_gas
 
 
 ## ensure tcc does not include nor link anything unknown into; tcc patches/tcc/tcc-9999-library_path.patch
@@ -306,7 +581,7 @@ export TCC_CPATH="/dev/null"
 ## noticed with ahci.c which panics kernel in interrupt handler (dd if=/dev/sdX of=/dev/null bs=1M count=1024)!
 #CCLIB="/usr/lib/tcc/i386-libtcc1.a" compilelink_kernel
 ## first compiling objects and linking in a separate stage with tcc does not cause kernel panics with ahci.c/sata
-compile_kernel ; CCLIB="/usr/lib/tcc/i386-libtcc1.a" link_kernel
+profile_phase compile_kernel ; CCLIB="/usr/lib/tcc/i386-libtcc1.a" profile_phase link_kernel
 
 
 ### gcc-4.7.4
@@ -320,5 +595,5 @@ compile_kernel ; CCLIB="/usr/lib/tcc/i386-libtcc1.a" link_kernel
 
 
 ###
-create_iso
+profile_phase create_iso
 
@@ -0,0 +1,200 @@
+/*
+ * aio_bench.c - random O_DIRECT I/O through io_submit(), fio style
+ *
+ *	gcc -O2 -I/usr/src/linux/include -o aio_bench aio_bench.c
+ *	./aio_bench [-w] [-b blocksize] [-q depth] [-t seconds] [-s size] file
+ *
+ * Keeps 'depth' (default 32) requests of 'blocksize' (default 4096) bytes
+ * in flight against random aligned offsets in the first 'size' bytes
+ * of 'file' (default its current size, or 64M), which is opened O_DIRECT.
+ * Reads unless -w is given; a write run overwrites the file in place and
+ * never extends it, so create the file first. At the end it prints
+ * IOPS, bandwidth and the average and maximum completion latency:
+ *
+ *	dd if=/dev/zero of=/mnt/test bs=1M count=1024
+ *	for q in 1 4 16 64; do ./aio_bench -q $q /mnt/test; done
+ *
+ * With truly asynchronous O_DIRECT the IOPS grow with the queue depth
+ * until the device saturates; if io_submit() did the I/O synchronously
+ * the numbers would stay at the depth 1 level.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <linux/types.h>
+#include <linux/aio_abi.h>
+
+#ifndef O_DIRECT
+#define O_DIRECT	040000		/* i386 */
+#endif
+
+static int io_setup(unsigned nr, aio_context_t *ctx)
+{
+	return syscall(__NR_io_setup, nr, ctx);
+}
+
+static int io_submit(aio_context_t ctx, long nr, struct iocb **iocbs)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbs);
+}
+
+static int io_getevents(aio_context_t ctx, long min, long max,
+			struct io_event *events)
+{
+	return syscall(__NR_io_getevents, ctx, min, max, events, NULL);
+}
+
+static int io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-w] [-b blocksize] [-q depth] "
+		"[-t seconds] [-s size] file\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int writing = 0, bs = 4096, depth = 32, seconds = 10;
+	long long size = 0, blocks, done = 0;
+	struct iocb *iocbs, **ptrs;
+	struct io_event *events;
+	double *started, t0, t, lat, lat_sum = 0, lat_max = 0;
+	aio_context_t ctx = 0;
+	struct stat st;
+	char *bufs;
+	int fd, c, i, n;
+
+	while ((c = getopt(argc, argv, "wb:q:t:s:")) != -1) {
+		switch (c) {
+		case 'w':
+			writing = 1;
+			break;
+		case 'b':
+			bs = atoi(optarg);
+			break;
+		case 'q':
+			depth = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 's':
+			size = strtoll(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || bs < 512 || (bs & 511) || depth < 1 ||
+	    seconds < 1)
+		usage(argv[0]);
+
+	fd = open(argv[optind], (writing ? O_RDWR : O_RDONLY) | O_DIRECT);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+	if (!size)
+		size = S_ISREG(st.st_mode) ? st.st_size : 64 << 20;
+	blocks = size / bs;
+	if (blocks < 1) {
+		fprintf(stderr, "%s: smaller than one block\n", argv[optind]);
+		return 1;
+	}
+
+	if (io_setup(depth, &ctx) < 0) {
+		perror("io_setup");
+		return 1;
+	}
+	iocbs = calloc(depth, sizeof(*iocbs));
+	ptrs = calloc(depth, sizeof(*ptrs));
+	events = calloc(depth, sizeof(*events));
+	started = calloc(depth, sizeof(*started));
+	if (posix_memalign((void **) &bufs, 4096, (size_t) depth * bs)) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	memset(bufs, 0x5a, (size_t) depth * bs);
+
+	/* iocb i always uses buffer i, aio_data says which one it is */
+	for (i = 0; i < depth; i++) {
+		iocbs[i].aio_data = i;
+		iocbs[i].aio_lio_opcode = writing ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+		iocbs[i].aio_fildes = fd;
+		iocbs[i].aio_buf = (unsigned long) (bufs + (size_t) i * bs);
+		iocbs[i].aio_nbytes = bs;
+	}
+
+	t0 = now();
+	n = depth;
+	for (i = 0; i < depth; i++)
+		ptrs[i] = iocbs + i;
+	do {
+		/* (re)submit the n iocbs in ptrs with fresh offsets */
+		t = now();
+		for (i = 0; i < n; i++) {
+			ptrs[i]->aio_offset = (random() % blocks) * bs;
+			started[ptrs[i]->aio_data] = t;
+		}
+		if (io_submit(ctx, n, ptrs) != n) {
+			perror("io_submit");
+			return 1;
+		}
+
+		n = io_getevents(ctx, 1, depth, events);
+		if (n < 0) {
+			perror("io_getevents");
+			return 1;
+		}
+		t = now();
+		for (i = 0; i < n; i++) {
+			if (events[i].res != bs) {
+				fprintf(stderr, "I/O error: %lld\n",
+					(long long) events[i].res);
+				return 1;
+			}
+			lat = t - started[events[i].data];
+			lat_sum += lat;
+			if (lat > lat_max)
+				lat_max = lat;
+			ptrs[i] = iocbs + events[i].data;
+		}
+		done += n;
+	} while (t - t0 < seconds);
+
+	/* reap what is still in flight */
+	for (i = depth - n; i > 0; i -= c) {
+		c = io_getevents(ctx, 1, i, events);
+		if (c <= 0)
+			break;
+	}
+	t = now() - t0;
+	io_destroy(ctx);
+	close(fd);
+
+	printf("%s bs=%d depth=%d: %.0f IOPS, %.1f MB/s, "
+	       "lat avg %.0f us max %.0f us\n",
+	       writing ? "write" : "read", bs, depth, done / t,
+	       done * bs / t / (1 << 20), lat_sum / done * 1e6, lat_max * 1e6);
+	return 0;
+}
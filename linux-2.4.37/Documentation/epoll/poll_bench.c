@@ -0,0 +1,186 @@
+/*
+ * poll_bench.c - poll() vs. epoll_wait() with many idle descriptors
+ *
+ *	gcc -O2 -o poll_bench poll_bench.c
+ *	ulimit -n 110000
+ *	./poll_bench [connections [active [seconds]]]
+ *
+ * Opens 'connections' pipes (default 1000) and watches their read ends,
+ * the way a server watches its client sockets. Each round the program
+ * writes one byte into 'active' (default 10) randomly chosen pipes, waits
+ * for readiness with poll() or epoll_wait() and reads the bytes back. It
+ * prints rounds/s for both; poll() pays for every watched descriptor on
+ * every call, epoll_wait() only for the ready ones:
+ *
+ *	for n in 1000 10000 50000; do ./poll_bench $n; done
+ *
+ * Every connection costs two descriptors, so 50000 needs an fd limit
+ * above 100000 (fs.file-max and the hard RLIMIT_NOFILE as well).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/poll.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+/* <sys/epoll.h> may be missing from the C library, use the syscalls */
+#define EPOLL_CTL_ADD	1
+#define EPOLLIN		0x001
+
+struct epoll_event {
+	unsigned int events;
+	unsigned long long data;
+} __attribute__ ((packed));
+
+static int epoll_create(int size)
+{
+	return syscall(__NR_epoll_create, size);
+}
+
+static int epoll_ctl(int epfd, int op, int fd, struct epoll_event *ev)
+{
+	return syscall(__NR_epoll_ctl, epfd, op, fd, ev);
+}
+
+static int epoll_wait(int epfd, struct epoll_event *ev, int max, int timeout)
+{
+	return syscall(__NR_epoll_wait, epfd, ev, max, timeout);
+}
+
+static int nconn, nactive;
+static int (*pipes)[2];
+static struct pollfd *pfds;
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void make_ready(void)
+{
+	int i;
+
+	for (i = 0; i < nactive; i++)
+		if (write(pipes[random() % nconn][1], "x", 1) != 1)
+			die("write");
+}
+
+static int drain(int fd)
+{
+	char buf[64];
+
+	return read(fd, buf, sizeof(buf)) > 0;
+}
+
+/* returns the number of rounds done in 'seconds' */
+static long run_poll(int seconds)
+{
+	double t0 = now();
+	long rounds = 0;
+	int i, n;
+
+	do {
+		make_ready();
+		n = poll(pfds, nconn, -1);
+		if (n < 0)
+			die("poll");
+		for (i = 0; i < nconn && n; i++)
+			if (pfds[i].revents & POLLIN)
+				n -= drain(pfds[i].fd);
+		rounds++;
+	} while (now() - t0 < seconds);
+	return rounds;
+}
+
+static long run_epoll(int seconds)
+{
+	struct epoll_event ev, *evs;
+	double t0 = now();
+	long rounds = 0;
+	int epfd, i, n;
+
+	evs = calloc(nactive, sizeof(*evs));
+	epfd = epoll_create(nconn);
+	if (epfd < 0)
+		die("epoll_create");
+	for (i = 0; i < nconn; i++) {
+		ev.events = EPOLLIN;
+		ev.data = pipes[i][0];
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, pipes[i][0], &ev) < 0)
+			die("epoll_ctl");
+	}
+
+	do {
+		make_ready();
+		n = epoll_wait(epfd, evs, nactive, -1);
+		if (n < 0)
+			die("epoll_wait");
+		for (i = 0; i < n; i++)
+			drain(evs[i].data);
+		rounds++;
+	} while (now() - t0 < seconds);
+
+	/* leave nothing behind for the next run */
+	while ((n = epoll_wait(epfd, evs, nactive, 0)) > 0)
+		for (i = 0; i < n; i++)
+			drain(evs[i].data);
+	close(epfd);
+	free(evs);
+	return rounds;
+}
+
+int main(int argc, char **argv)
+{
+	struct rlimit rl;
+	int seconds, i;
+	long rounds;
+
+	nconn = argc > 1 ? atoi(argv[1]) : 1000;
+	nactive = argc > 2 ? atoi(argv[2]) : 10;
+	seconds = argc > 3 ? atoi(argv[3]) : 5;
+	if (nconn < 1 || nactive < 1 || seconds < 1) {
+		fprintf(stderr, "usage: %s [connections [active [seconds]]]\n",
+			argv[0]);
+		return 1;
+	}
+
+	getrlimit(RLIMIT_NOFILE, &rl);
+	rl.rlim_cur = rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+	if (rl.rlim_cur < (rlim_t) 2 * nconn + 16) {
+		fprintf(stderr, "need %d descriptors, the limit is %lu\n",
+			2 * nconn + 16, (unsigned long) rl.rlim_cur);
+		return 1;
+	}
+
+	pipes = calloc(nconn, sizeof(*pipes));
+	pfds = calloc(nconn, sizeof(*pfds));
+	for (i = 0; i < nconn; i++) {
+		if (pipe(pipes[i]) < 0)
+			die("pipe");
+		pfds[i].fd = pipes[i][0];
+		pfds[i].events = POLLIN;
+	}
+
+	rounds = run_poll(seconds);
+	printf("poll   %6d connections %3d active %9.0f rounds/s\n",
+	       nconn, nactive, (double) rounds / seconds);
+	rounds = run_epoll(seconds);
+	printf("epoll  %6d connections %3d active %9.0f rounds/s\n",
+	       nconn, nactive, (double) rounds / seconds);
+	return 0;
+}
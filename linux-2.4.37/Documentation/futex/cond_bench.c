@@ -0,0 +1,229 @@
+/*
+ * cond_bench.c - condition variable broadcast cost, wake-all vs. requeue
+ *
+ *	gcc -O2 -o cond_bench cond_bench.c -lpthread
+ *
+ * (gcc 4.1 or later, for the __sync atomic builtins)
+ *	./cond_bench [threads [seconds]]
+ *
+ * 'threads' waiters block on one condition variable. The main thread
+ * waits until all of them are asleep, then broadcasts; every waiter
+ * takes the mutex, bumps a counter and goes back to sleep. Each round
+ * is one broadcast, and the program prints rounds/s and the context
+ * switches per round for three implementations:
+ *
+ *	pthread	 pthread_cond_broadcast() of the C library, whatever it
+ *		 uses on this kernel
+ *	wake	 a futex condvar that wakes all waiters (FUTEX_WAKE, INT_MAX)
+ *	requeue	 the same condvar waking one waiter and moving the rest to
+ *		 the mutex (FUTEX_CMP_REQUEUE)
+ *
+ * With 'wake' all waiters run and all but one block again on the mutex;
+ * with 'requeue' they are handed the mutex one after the other, which
+ * shows as fewer context switches per round and a higher round rate.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+static int sys_futex(int *uaddr, int op, int val, unsigned long val2,
+		     int *uaddr2, int val3)
+{
+	return syscall(__NR_futex, uaddr, op, val, val2, uaddr2, val3);
+}
+
+/* 0 unlocked, 1 locked, 2 locked with waiters */
+static void futex_lock(int *m)
+{
+	int c = __sync_val_compare_and_swap(m, 0, 1);
+
+	if (!c)
+		return;
+	if (c != 2)
+		c = __sync_lock_test_and_set(m, 2);
+	while (c) {
+		sys_futex(m, FUTEX_WAIT, 2, 0, NULL, 0);
+		c = __sync_lock_test_and_set(m, 2);
+	}
+}
+
+static void futex_unlock(int *m)
+{
+	if (__sync_fetch_and_sub(m, 1) != 1) {
+		*m = 0;
+		sys_futex(m, FUTEX_WAKE, 1, 0, NULL, 0);
+	}
+}
+
+struct fcond {
+	int seq;
+};
+
+static void fcond_wait(struct fcond *c, int *m)
+{
+	int seq = c->seq;
+
+	futex_unlock(m);
+	sys_futex(&c->seq, FUTEX_WAIT, seq, 0, NULL, 0);
+	/* a requeued waiter must leave the mutex marked contended */
+	while (__sync_lock_test_and_set(m, 2))
+		sys_futex(m, FUTEX_WAIT, 2, 0, NULL, 0);
+}
+
+/* called with the mutex held */
+static void fcond_broadcast_wake(struct fcond *c, int *m)
+{
+	__sync_fetch_and_add(&c->seq, 1);
+	sys_futex(&c->seq, FUTEX_WAKE, INT_MAX, 0, NULL, 0);
+}
+
+static void fcond_broadcast_requeue(struct fcond *c, int *m)
+{
+	int seq = __sync_add_and_fetch(&c->seq, 1);
+
+	*m = 2;
+	sys_futex(&c->seq, FUTEX_CMP_REQUEUE, 1, INT_MAX, m, seq);
+}
+
+static void fcond_signal(struct fcond *c)
+{
+	__sync_fetch_and_add(&c->seq, 1);
+	sys_futex(&c->seq, FUTEX_WAKE, 1, 0, NULL, 0);
+}
+
+enum { MODE_PTHREAD, MODE_WAKE, MODE_REQUEUE };
+static const char *mode_name[] = { "pthread", "wake", "requeue" };
+
+static int mode, nthreads;
+static volatile int stop, waiting, generation;
+
+static pthread_mutex_t pmutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pcond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pall_in = PTHREAD_COND_INITIALIZER;
+static int fmutex;
+static struct fcond fcond, fall_in;
+
+static void lock(void)
+{
+	if (mode == MODE_PTHREAD)
+		pthread_mutex_lock(&pmutex);
+	else
+		futex_lock(&fmutex);
+}
+
+static void unlock(void)
+{
+	if (mode == MODE_PTHREAD)
+		pthread_mutex_unlock(&pmutex);
+	else
+		futex_unlock(&fmutex);
+}
+
+static void *waiter(void *arg)
+{
+	int gen;
+
+	lock();
+	while (!stop) {
+		gen = generation;
+		if (++waiting == nthreads) {
+			if (mode == MODE_PTHREAD)
+				pthread_cond_signal(&pall_in);
+			else
+				fcond_signal(&fall_in);
+		}
+		while (gen == generation && !stop) {
+			if (mode == MODE_PTHREAD)
+				pthread_cond_wait(&pcond, &pmutex);
+			else
+				fcond_wait(&fcond, &fmutex);
+		}
+	}
+	unlock();
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void broadcast(void)
+{
+	if (mode == MODE_PTHREAD)
+		pthread_cond_broadcast(&pcond);
+	else if (mode == MODE_WAKE)
+		fcond_broadcast_wake(&fcond, &fmutex);
+	else
+		fcond_broadcast_requeue(&fcond, &fmutex);
+}
+
+static void run(int m, int seconds)
+{
+	pthread_t *tids = calloc(nthreads, sizeof(*tids));
+	struct rusage r0, r1;
+	long rounds = 0, csw;
+	double t0, t;
+	int i;
+
+	mode = m;
+	stop = waiting = generation = 0;
+	for (i = 0; i < nthreads; i++)
+		pthread_create(tids + i, NULL, waiter, NULL);
+
+	getrusage(RUSAGE_SELF, &r0);
+	t0 = now();
+	lock();
+	do {
+		while (waiting < nthreads) {
+			if (mode == MODE_PTHREAD)
+				pthread_cond_wait(&pall_in, &pmutex);
+			else
+				fcond_wait(&fall_in, &fmutex);
+		}
+		waiting = 0;
+		generation++;
+		broadcast();
+		rounds++;
+		t = now() - t0;
+	} while (t < seconds);
+	stop = 1;
+	broadcast();
+	unlock();
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(tids[i], NULL);
+	getrusage(RUSAGE_SELF, &r1);
+	csw = (r1.ru_nvcsw - r0.ru_nvcsw) + (r1.ru_nivcsw - r0.ru_nivcsw);
+
+	printf("%-8s %4d threads %9.0f rounds/s %7.1f csw/round\n",
+	       mode_name[m], nthreads, rounds / t, (double) csw / rounds);
+	free(tids);
+}
+
+int main(int argc, char **argv)
+{
+	int seconds = 5, m;
+
+	nthreads = argc > 1 ? atoi(argv[1]) : 16;
+	if (argc > 2)
+		seconds = atoi(argv[2]);
+	if (nthreads < 1 || seconds < 1) {
+		fprintf(stderr, "usage: %s [threads [seconds]]\n", argv[0]);
+		return 1;
+	}
+
+	for (m = MODE_PTHREAD; m <= MODE_REQUEUE; m++)
+		run(m, seconds);
+	return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * fib_load.c - fill the main routing table with random prefixes
+ *
+ *	gcc -O2 -o fib_load fib_load.c
+ *	./fib_load <gateway> <count> [seed]	add 'count' prefixes
+ *	./fib_load -d <gateway> <count> [seed]	delete them again
+ *
+ * Adds 'count' random prefixes via 'gateway', which has to be reachable
+ * over a directly connected network. The prefix lengths roughly follow
+ * a backbone table: mostly /24, the rest /16 to /23. The same seed gives
+ * the same prefixes, which is how -d finds them. Prefixes that already
+ * exist are skipped and not counted. See fib_bench.c for the lookup side.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/route.h>
+
+static const int plen[10] = { 24, 24, 24, 24, 24, 24, 23, 22, 20, 16 };
+
+static void set_addr(struct sockaddr *sa, unsigned int addr)
+{
+	struct sockaddr_in *sin = (struct sockaddr_in *) sa;
+
+	memset(sin, 0, sizeof(*sin));
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl(addr);
+}
+
+int main(int argc, char **argv)
+{
+	int del = 0, fd, count, done = 0, tries = 0, len;
+	unsigned int gw, addr, mask;
+	struct rtentry rt;
+	struct in_addr in;
+
+	if (argc > 1 && !strcmp(argv[1], "-d")) {
+		del = 1;
+		argc--;
+		argv++;
+	}
+	if (argc < 3 || !inet_aton(argv[1], &in) ||
+	    (count = atoi(argv[2])) < 1) {
+		fprintf(stderr, "usage: fib_load [-d] <gateway> <count> [seed]\n");
+		return 1;
+	}
+	gw = ntohl(in.s_addr);
+	srandom(argc > 3 ? atoi(argv[3]) : 1);
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return 1;
+	}
+
+	while (done < count && tries < 4 * count) {
+		tries++;
+		len = plen[random() % 10];
+		mask = ~0U << (32 - len);
+		addr = ((unsigned int) random() << 1 ^ random()) & mask;
+		/* unicast space only, and keep clear of the gateway */
+		if ((addr >> 24) == 0 || (addr >> 24) == 127 ||
+		    (addr >> 24) >= 224 || (gw & mask) == addr)
+			continue;
+
+		memset(&rt, 0, sizeof(rt));
+		set_addr(&rt.rt_dst, addr);
+		set_addr(&rt.rt_genmask, mask);
+		set_addr(&rt.rt_gateway, gw);
+		rt.rt_flags = RTF_UP | RTF_GATEWAY;
+		if (ioctl(fd, del ? SIOCDELRT : SIOCADDRT, &rt) < 0) {
+			if (errno == EEXIST || errno == ESRCH)
+				continue;
+			perror(del ? "SIOCDELRT" : "SIOCADDRT");
+			return 1;
+		}
+		done++;
+	}
+	printf("%s %d prefixes\n", del ? "deleted" : "added", done);
+	return 0;
+}
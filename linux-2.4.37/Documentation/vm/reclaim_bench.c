@@ -0,0 +1,229 @@
+/*
+ * reclaim_bench.c - page reclaim cost under a memory hog
+ *
+ *	gcc -O2 -o reclaim_bench reclaim_bench.c
+ *	./reclaim_bench [-p procs] [-s shared MB] [-m hog MB] [-t seconds]
+ *
+ * The parent touches 'shared' MB (default 64) of anonymous memory and
+ * forks 'procs' (default 4) children, so every shared page is mapped
+ * by all of them. Each child then keeps writing to its own 'hog' MB
+ * (default 256) and reading the shared area, until 'seconds' (default
+ * 30) have passed. Pick procs * hog larger than RAM so the box has to
+ * reclaim and swap the whole time.
+ *
+ * Every page write is timed: a write that has to fault in or swap in a
+ * page waits for reclaim when memory is short, so the distribution of
+ * these times is the allocation latency seen by the application. At
+ * the end the program prints that distribution and the CPU time kswapd
+ * used during the run, from /proc/<pid>/stat. The output looks like
+ *
+ *	4 procs, 64 MB shared, 256 MB hog each, 30.0 s
+ *	kswapd cpu <seconds> (<percent of the run>)
+ *	page writes <n>, avg <us> us, max <ms> ms
+ *	  <10us <%>  <100us <%>  <1ms <%>  <10ms <%>  >=10ms <%>
+ *
+ * Walking every mm to find the ptes of a page (swap_out()) makes kswapd
+ * time grow with the number of processes sharing memory; compare runs
+ * with -p 1, 4, 16 at the same total size.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS	MAP_ANON
+#endif
+
+#define NR_BUCKETS	5
+static const char *bucket_name[NR_BUCKETS] = {
+	"<10us", "<100us", "<1ms", "<10ms", ">=10ms"
+};
+
+struct stats {
+	unsigned long writes;
+	double sum, max;
+	unsigned long hist[NR_BUCKETS];
+};
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void *map_anon(size_t len, int flags)
+{
+	void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		       flags | MAP_ANONYMOUS, -1, 0);
+
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	return p;
+}
+
+/* utime + stime of kswapd in clock ticks, -1 if it cannot be found */
+static long kswapd_ticks(void)
+{
+	char path[300], buf[512], *p;
+	unsigned long utime, stime;
+	struct dirent *de;
+	long ticks = -1;
+	DIR *dir;
+	FILE *f;
+
+	dir = opendir("/proc");
+	if (!dir)
+		return -1;
+	while ((de = readdir(dir)) != NULL) {
+		if (de->d_name[0] < '0' || de->d_name[0] > '9')
+			continue;
+		snprintf(path, sizeof(path), "/proc/%s/stat", de->d_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		p = fgets(buf, sizeof(buf), f);
+		fclose(f);
+		if (!p || !strstr(buf, "(kswapd"))
+			continue;
+		/* fields 14 and 15, counted after the ") " of the comm */
+		p = strrchr(buf, ')');
+		if (p && sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u "
+				"%*u %*u %lu %lu", &utime, &stime) == 2) {
+			ticks = utime + stime;
+			break;
+		}
+	}
+	closedir(dir);
+	return ticks;
+}
+
+static void child(struct stats *st, char *shared, size_t shared_len,
+		  size_t hog_len, int seconds)
+{
+	long pagesize = sysconf(_SC_PAGESIZE);
+	char *hog = map_anon(hog_len, MAP_PRIVATE);
+	double end = now() + seconds, t, dt;
+	size_t off = 0, soff = 0;
+	unsigned int n = 0;
+	int b;
+
+	for (;;) {
+		t = now();
+		hog[off]++;
+		dt = now() - t;
+
+		st->writes++;
+		st->sum += dt;
+		if (dt > st->max)
+			st->max = dt;
+		for (b = 0; b < NR_BUCKETS - 1 && dt >= 1e-5; b++)
+			dt /= 10;
+		st->hist[b]++;
+
+		/* keep the shared pages referenced too */
+		n += shared[soff];
+		soff = (soff + pagesize) % shared_len;
+		off = (off + pagesize) % hog_len;
+		if (t > end)
+			break;
+	}
+	exit(n == 1);
+}
+
+int main(int argc, char **argv)
+{
+	int procs = 4, shared_mb = 64, hog_mb = 256, seconds = 30;
+	struct stats *st, total;
+	long ticks0, ticks1, hz = sysconf(_SC_CLK_TCK);
+	size_t shared_len, i;
+	double t0, t;
+	char *shared;
+	int c, b;
+
+	while ((c = getopt(argc, argv, "p:s:m:t:")) != -1) {
+		switch (c) {
+		case 'p':
+			procs = atoi(optarg);
+			break;
+		case 's':
+			shared_mb = atoi(optarg);
+			break;
+		case 'm':
+			hog_mb = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-p procs] [-s shared MB] "
+				"[-m hog MB] [-t seconds]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (procs < 1 || shared_mb < 1 || hog_mb < 1 || seconds < 1) {
+		fprintf(stderr, "%s: arguments must be positive\n", argv[0]);
+		return 1;
+	}
+
+	shared_len = (size_t) shared_mb << 20;
+	shared = map_anon(shared_len, MAP_PRIVATE);
+	for (i = 0; i < shared_len; i += 1024)
+		shared[i] = 1;
+	st = map_anon(procs * sizeof(*st), MAP_SHARED);
+	memset(st, 0, procs * sizeof(*st));
+
+	ticks0 = kswapd_ticks();
+	t0 = now();
+	for (c = 0; c < procs; c++) {
+		switch (fork()) {
+		case -1:
+			perror("fork");
+			kill(0, SIGTERM);
+			return 1;
+		case 0:
+			child(st + c, shared, shared_len,
+			      (size_t) hog_mb << 20, seconds);
+		}
+	}
+	while (wait(NULL) > 0)
+		;
+	t = now() - t0;
+	ticks1 = kswapd_ticks();
+
+	memset(&total, 0, sizeof(total));
+	for (c = 0; c < procs; c++) {
+		total.writes += st[c].writes;
+		total.sum += st[c].sum;
+		if (st[c].max > total.max)
+			total.max = st[c].max;
+		for (b = 0; b < NR_BUCKETS; b++)
+			total.hist[b] += st[c].hist[b];
+	}
+
+	printf("%d procs, %d MB shared, %d MB hog each, %.1f s\n",
+	       procs, shared_mb, hog_mb, t);
+	if (ticks0 >= 0 && ticks1 >= 0)
+		printf("kswapd cpu %.2f s (%.1f%%)\n",
+		       (double) (ticks1 - ticks0) / hz,
+		       100.0 * (ticks1 - ticks0) / hz / t);
+	else
+		printf("kswapd not found in /proc\n");
+	printf("page writes %lu, avg %.1f us, max %.0f ms\n", total.writes,
+	       total.sum / total.writes * 1e6, total.max * 1e3);
+	for (b = 0; b < NR_BUCKETS; b++)
+		printf("  %s %.1f%%", bucket_name[b],
+		       100.0 * total.hist[b] / total.writes);
+	printf("\n");
+	return 0;
+}
@@ -23,6 +23,7 @@
 #include <linux/interrupt.h>
 #include <linux/mc146818rtc.h>
 #include <linux/kernel_stat.h>
+#include <linux/hrtimer.h>
 
 #include <asm/atomic.h>
 #include <asm/smp.h>
@@ -30,6 +31,7 @@
 #include <asm/mpspec.h>
 #include <asm/pgalloc.h>
 #include <asm/smpboot.h>
+#include <asm/div64.h>
 
 /* Using APIC to generate smp_local_timer_interrupt? */
 int using_apic_timer = 0;
@@ -973,6 +975,29 @@ int __init calibrate_APIC_clock(void)
 
 static unsigned int calibration_result;
 
+/*
+ * High resolution timers, see kernel/hrtimer.c. While hrtimers are
+ * pending on a CPU its APIC timer interrupts at whatever comes first,
+ * the next hrtimer or the next periodic tick, and apic_next_tick keeps
+ * track of where the tick is due. Once the queue runs empty on a tick,
+ * the timer goes back to plain periodic mode.
+ */
+int hrtimer_arch_ok;
+static int hrtimer_disable __initdata = 0;
+static unsigned long cyc2ns_scale;	/* ns per TSC cycle, << 10 */
+static unsigned long long apic_next_tick[NR_CPUS];
+static int apic_hr_mode[NR_CPUS];
+
+/* APIC count and TSC do not convert exactly, early interrupts are ok */
+#define APIC_HR_SLACK	2000
+
+static int __init hrtimer_setup(char *str)
+{
+	hrtimer_disable = 1;
+	return 0;
+}
+__setup("nohrtimer", hrtimer_setup);
+
 void __init setup_APIC_clocks (void)
 {
 	printk("Using local APIC timer interrupts.\n");
@@ -990,6 +1015,12 @@ void __init setup_APIC_clocks (void)
 
 	/* and update all other cpus */
 	smp_call_function(setup_APIC_timer, (void *)calibration_result, 1, 1);
+
+	if (cpu_has_tsc && cpu_khz && !hrtimer_disable) {
+		cyc2ns_scale = (1000000 << 10) / cpu_khz;
+		hrtimer_arch_ok = 1;
+		printk("Using local APIC timer for high resolution timers.\n");
+	}
 }
 
 void __init disable_APIC_timer(void)
@@ -1040,6 +1071,81 @@ int setup_profiling_timer(unsigned int multiplier)
 	return 0;
 }
 
+unsigned long long hrtimer_arch_clock(void)
+{
+	unsigned long lo, hi;
+
+	rdtsc(lo, hi);
+	return (((unsigned long long) lo * cyc2ns_scale) >> 10) +
+		(((unsigned long long) hi * cyc2ns_scale) << 22);
+}
+
+static inline unsigned long apic_tick_ns(int cpu)
+{
+	return HRTIMER_TICK_NS / prof_old_multiplier[cpu];
+}
+
+/* cut the current period short, delta is less than a tick */
+static void apic_program_ns(long long delta)
+{
+	unsigned long long clocks;
+
+	if (delta < 1000)
+		delta = 1000;
+	clocks = (unsigned long long) delta * calibration_result;
+	do_div(clocks, HRTIMER_TICK_NS);
+	apic_write_around(APIC_TMICT, (unsigned long) clocks / APIC_DIVISOR + 1);
+}
+
+/* expires is the first pending hrtimer on this CPU, interrupts are off */
+void hrtimer_arch_program(unsigned long long expires)
+{
+	int cpu = smp_processor_id();
+	unsigned long long now = hrtimer_arch_clock();
+	unsigned long long left;
+
+	if (!apic_hr_mode[cpu]) {
+		left = (unsigned long long) apic_read(APIC_TMCCT) *
+			APIC_DIVISOR * HRTIMER_TICK_NS;
+		do_div(left, calibration_result);
+		apic_next_tick[cpu] = now + left;
+		apic_hr_mode[cpu] = 1;
+	}
+	if ((long long)(expires - apic_next_tick[cpu]) > 0)
+		expires = apic_next_tick[cpu];
+	apic_program_ns(expires - now);
+}
+
+/* is this interrupt the periodic tick, or only an hrtimer event? */
+static int apic_hr_tick(int cpu)
+{
+	unsigned long long now = hrtimer_arch_clock();
+
+	if ((long long)(apic_next_tick[cpu] - now) > APIC_HR_SLACK)
+		return 0;
+	apic_next_tick[cpu] += apic_tick_ns(cpu);
+	if ((long long)(apic_next_tick[cpu] - now) <= 0)
+		apic_next_tick[cpu] = now + apic_tick_ns(cpu);
+	return 1;
+}
+
+static void apic_hr_reprogram(int cpu, int tick)
+{
+	unsigned long long next;
+
+	if (!hrtimer_interrupt(&next)) {
+		if (tick) {
+			apic_hr_mode[cpu] = 0;
+			apic_write_around(APIC_TMICT, calibration_result /
+				prof_old_multiplier[cpu] / APIC_DIVISOR);
+			return;
+		}
+		next = apic_next_tick[cpu];
+	} else if ((long long)(next - apic_next_tick[cpu]) > 0)
+		next = apic_next_tick[cpu];
+	apic_program_ns(next - hrtimer_arch_clock());
+}
+
 #undef APIC_DIVISOR
 
 /*
@@ -1128,7 +1234,15 @@ void smp_apic_timer_interrupt(struct pt_regs * regs)
 	 * interrupt lock, which is the WrongThing (tm) to do.
 	 */
 	irq_enter(cpu, 0);
-	smp_local_timer_interrupt(regs);
+	if (!apic_hr_mode[cpu])
+		smp_local_timer_interrupt(regs);
+	else {
+		int tick = apic_hr_tick(cpu);
+
+		if (tick)
+			smp_local_timer_interrupt(regs);
+		apic_hr_reprogram(cpu, tick);
+	}
 	irq_exit(cpu, 0);
 
 	if (softirq_pending(cpu))
@@ -58,7 +58,7 @@ int smp_num_cpus = 1;
 
 /* Number of siblings per CPU package */
 int smp_num_siblings = 1;
-int __initdata phys_proc_id[NR_CPUS]; /* Package ID of each logical CPU */
+int phys_proc_id[NR_CPUS]; /* Package ID of each logical CPU */
 
 /* Bitmask of currently online CPUs */
 unsigned long cpu_online_map;
@@ -963,6 +963,8 @@ static int boot_cpu_logical_apicid;
 void *xquad_portio;
 
 int cpu_sibling_map[NR_CPUS] __cacheline_aligned;
+/* Quad of each logical CPU on multiquad, 0 everywhere else */
+int cpu_node_map[NR_CPUS] __cacheline_aligned;
 
 void __init smp_boot_cpus(void)
 {
@@ -1188,6 +1190,10 @@ void __init smp_boot_cpus(void)
 			}
 		}
 	}
+
+	if (clustered_apic_mode == CLUSTERED_APIC_NUMAQ)
+		for (cpu = 0; cpu < smp_num_cpus; cpu++)
+			cpu_node_map[cpu] = cpu_2_logical_apicid[cpu] >> 4;
 	     
 #ifndef CONFIG_VISWS
 	/*
@@ -329,7 +329,12 @@ int hugetlb_prefault(struct address_space *mapping, struct vm_area_struct *vma)
 				ret = -ENOMEM;
 				goto out;
 			}
-			add_to_page_cache(page, mapping, idx);
+			if (add_to_page_cache(page, mapping, idx)) {
+				huge_page_release(page);
+				hugetlb_put_quota(mapping);
+				ret = -ENOMEM;
+				goto out;
+			}
 			unlock_page(page);
 		}
 		set_huge_pte(mm, vma, page, pte, vma->vm_flags & VM_WRITE);
@@ -339,8 +339,6 @@ static unsigned inline long _kc_msleep_interruptible(unsigned int msecs)
 #define pci_choose_state(pdev,state) state
 #define PMSG_SUSPEND 3
 
-#undef NETIF_F_LLTX
-
 #ifndef ARCH_HAS_PREFETCH
 #define prefetch(X)
 #endif
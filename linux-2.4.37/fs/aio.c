@@ -0,0 +1,684 @@
+/*
+ *  linux/fs/aio.c
+ *
+ *  Asynchronous I/O: io_setup(), io_submit(), io_getevents(), io_cancel()
+ *  and io_destroy().
+ *
+ *  Reads and writes on O_DIRECT files whose direct_IO goes through
+ *  generic_direct_IO() (block devices, ext2, ext3, reiserfs) are truly
+ *  asynchronous: the user pages are mapped into a kiobuf, the blocks are
+ *  looked up and the buffer heads submitted, and io_submit() returns
+ *  without waiting. The kiobuf's end_io hands the request to keventd,
+ *  which unmaps the pages and posts the completion to the context's
+ *  event ring. The block queues are unplugged once per io_submit() so a
+ *  batch of requests reaches the driver together. Everything else, and
+ *  the cases direct I/O falls back from, is done synchronously in
+ *  io_submit() and completes before it returns.
+ */
+
+#include <linux/config.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/iobuf.h>
+#include <linux/tqueue.h>
+#include <linux/blkdev.h>
+#include <linux/aio.h>
+
+#include <asm/uaccess.h>
+
+/* total of max_reqs over all contexts, limited by /proc/sys/fs/aio-max-nr */
+int aio_nr;
+int aio_max_nr = 0x10000;
+
+static spinlock_t aio_nr_lock = SPIN_LOCK_UNLOCKED;
+static aio_context_t aio_next_id;
+
+static kmem_cache_t *kiocb_cachep;
+static kmem_cache_t *kioctx_cachep;
+
+extern asmlinkage ssize_t sys_pread(unsigned int fd, char * buf, size_t count, loff_t pos);
+extern asmlinkage ssize_t sys_pwrite(unsigned int fd, const char * buf, size_t count, loff_t pos);
+extern asmlinkage long sys_fsync(unsigned int fd);
+extern asmlinkage long sys_fdatasync(unsigned int fd);
+
+static inline void get_ioctx(struct kioctx *ctx)
+{
+	atomic_inc(&ctx->users);
+}
+
+static void put_ioctx(struct kioctx *ctx)
+{
+	if (!atomic_dec_and_test(&ctx->users))
+		return;
+
+	while (ctx->nr_iobufs)
+		free_kiovec(1, &ctx->iobufs[--ctx->nr_iobufs]);
+	vfree(ctx->ring);
+
+	spin_lock(&aio_nr_lock);
+	aio_nr -= ctx->max_reqs;
+	spin_unlock(&aio_nr_lock);
+
+	kmem_cache_free(kioctx_cachep, ctx);
+}
+
+static struct kioctx *ioctx_alloc(unsigned nr_events)
+{
+	struct mm_struct *mm = current->mm;
+	struct kioctx *ctx;
+
+	if (!mm)
+		return ERR_PTR(-EINVAL);
+	if (nr_events > (unsigned)aio_max_nr)
+		return ERR_PTR(-EAGAIN);
+
+	ctx = kmem_cache_alloc(kioctx_cachep, GFP_KERNEL);
+	if (!ctx)
+		return ERR_PTR(-ENOMEM);
+	memset(ctx, 0, sizeof(*ctx));
+
+	ctx->ring_nr = nr_events + 1;
+	ctx->ring = vmalloc(ctx->ring_nr * sizeof(struct io_event));
+	if (!ctx->ring) {
+		kmem_cache_free(kioctx_cachep, ctx);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	/* the list reference, dropped by io_destroy() or exit_aio() */
+	atomic_set(&ctx->users, 1);
+	ctx->mm = mm;
+	ctx->max_reqs = nr_events;
+	init_waitqueue_head(&ctx->wait);
+	spin_lock_init(&ctx->ctx_lock);
+	INIT_LIST_HEAD(&ctx->active_reqs);
+
+	spin_lock(&aio_nr_lock);
+	if (aio_nr + nr_events > (unsigned)aio_max_nr) {
+		spin_unlock(&aio_nr_lock);
+		vfree(ctx->ring);
+		kmem_cache_free(kioctx_cachep, ctx);
+		return ERR_PTR(-EAGAIN);
+	}
+	aio_nr += nr_events;
+	if (!++aio_next_id)
+		++aio_next_id;
+	ctx->user_id = aio_next_id;
+	spin_unlock(&aio_nr_lock);
+
+	write_lock(&mm->ioctx_list_lock);
+	ctx->next = mm->ioctx_list;
+	mm->ioctx_list = ctx;
+	write_unlock(&mm->ioctx_list_lock);
+
+	return ctx;
+}
+
+static struct kioctx *lookup_ioctx(aio_context_t ctx_id)
+{
+	struct mm_struct *mm = current->mm;
+	struct kioctx *ctx;
+
+	if (!mm)
+		return NULL;
+
+	read_lock(&mm->ioctx_list_lock);
+	for (ctx = mm->ioctx_list; ctx; ctx = ctx->next)
+		if (ctx->user_id == ctx_id && !ctx->dead) {
+			get_ioctx(ctx);
+			break;
+		}
+	read_unlock(&mm->ioctx_list_lock);
+
+	return ctx;
+}
+
+/* wait for the in-flight requests, their pages are pinned until then */
+static void wait_for_all_aios(struct kioctx *ctx)
+{
+	wait_event(ctx->wait, !ctx->reqs_active);
+}
+
+/* Called with the context already taken off the mm list */
+static void kill_ioctx(struct kioctx *ctx)
+{
+	ctx->dead = 1;
+	wake_up(&ctx->wait);
+	wait_for_all_aios(ctx);
+	put_ioctx(ctx);
+}
+
+/* Called by mmput() when the last user of an mm is gone */
+void exit_aio(struct mm_struct *mm)
+{
+	struct kioctx *ctx;
+
+	while ((ctx = mm->ioctx_list) != NULL) {
+		mm->ioctx_list = ctx->next;
+		ctx->next = NULL;
+		kill_ioctx(ctx);
+	}
+}
+
+static inline unsigned aio_ring_events(struct kioctx *ctx)
+{
+	return (ctx->tail + ctx->ring_nr - ctx->head) % ctx->ring_nr;
+}
+
+/*
+ * Every request reserves its slot in the event ring, so completions can
+ * never overflow it. The slot is given back when io_getevents() reaps
+ * the event.
+ */
+static struct kiocb *aio_get_req(struct kioctx *ctx)
+{
+	struct kiocb *req;
+
+	req = kmem_cache_alloc(kiocb_cachep, GFP_KERNEL);
+	if (!req)
+		return NULL;
+	memset(req, 0, sizeof(*req));
+
+	spin_lock(&ctx->ctx_lock);
+	if (ctx->reqs_active + aio_ring_events(ctx) >= ctx->max_reqs) {
+		spin_unlock(&ctx->ctx_lock);
+		kmem_cache_free(kiocb_cachep, req);
+		return NULL;
+	}
+	ctx->reqs_active++;
+	list_add(&req->ki_list, &ctx->active_reqs);
+	spin_unlock(&ctx->ctx_lock);
+
+	get_ioctx(ctx);
+	req->ki_ctx = ctx;
+	return req;
+}
+
+/* post the completion event and free the request */
+static void aio_complete(struct kiocb *req, long res)
+{
+	struct kioctx *ctx = req->ki_ctx;
+	struct io_event *event;
+
+	spin_lock(&ctx->ctx_lock);
+	list_del(&req->ki_list);
+	ctx->reqs_active--;
+	event = ctx->ring + ctx->tail;
+	event->obj = (unsigned long) req->ki_obj;
+	event->data = req->ki_user_data;
+	event->res = res;
+	event->res2 = 0;
+	ctx->tail = (ctx->tail + 1) % ctx->ring_nr;
+	spin_unlock(&ctx->ctx_lock);
+
+	wake_up(&ctx->wait);
+
+	fput(req->ki_filp);
+	kmem_cache_free(kiocb_cachep, req);
+	put_ioctx(ctx);
+}
+
+static struct kiobuf *aio_get_iobuf(struct kioctx *ctx)
+{
+	struct kiobuf *iobuf = NULL;
+
+	spin_lock(&ctx->ctx_lock);
+	if (ctx->nr_iobufs)
+		iobuf = ctx->iobufs[--ctx->nr_iobufs];
+	spin_unlock(&ctx->ctx_lock);
+
+	if (!iobuf && alloc_kiovec(1, &iobuf))
+		return NULL;
+	return iobuf;
+}
+
+static void aio_put_iobuf(struct kioctx *ctx, struct kiobuf *iobuf)
+{
+	iobuf->end_io = NULL;
+	iobuf->private = NULL;
+
+	spin_lock(&ctx->ctx_lock);
+	if (ctx->nr_iobufs < ARRAY_SIZE(ctx->iobufs)) {
+		ctx->iobufs[ctx->nr_iobufs++] = iobuf;
+		iobuf = NULL;
+	}
+	spin_unlock(&ctx->ctx_lock);
+
+	if (iobuf)
+		free_kiovec(1, &iobuf);
+}
+
+/* keventd: finish a direct I/O request once the block layer is done */
+static void aio_direct_done(void *data)
+{
+	struct kiocb *req = data;
+	struct kiobuf *iobuf = req->ki_iobuf;
+	struct inode *inode = req->ki_filp->f_dentry->d_inode->i_mapping->host;
+	long res;
+
+	res = iobuf->errno ? iobuf->errno : iobuf->length;
+	if (req->ki_rw == READ && res > 0)
+		mark_dirty_kiobuf(iobuf, res);
+	unmap_kiobuf(iobuf);
+	aio_put_iobuf(req->ki_ctx, iobuf);
+
+	if (req->ki_rw == WRITE && res > 0)
+		invalidate_inode_pages2(inode->i_mapping);
+	up_read(&inode->i_alloc_sem);
+
+	aio_complete(req, res);
+}
+
+/* kiobuf end_io, usually from interrupt context */
+static void aio_kiobuf_end_io(struct kiobuf *iobuf)
+{
+	struct kiocb *req = iobuf->private;
+
+	schedule_task(&req->ki_tq);
+}
+
+/*
+ * Start an O_DIRECT read or write. Returns -EIOCBQUEUED once the I/O is
+ * under way, -ENOTBLK if the request has to be done synchronously, or
+ * the result of a request that completed immediately.
+ */
+static int aio_direct_submit(struct kiocb *req)
+{
+	struct file *file = req->ki_filp;
+	struct address_space *mapping = file->f_dentry->d_inode->i_mapping;
+	struct inode *inode = mapping->host;
+	int blocksize = 1 << inode->i_blkbits;
+	size_t count = req->ki_nbytes;
+	loff_t pos = req->ki_pos;
+	struct kiobuf *iobuf;
+	int ret;
+
+	if (!(file->f_flags & O_DIRECT) || !mapping->a_ops->direct_IO)
+		return -ENOTBLK;
+	if (count > (KIO_MAX_ATOMIC_IO << 10))
+		return -ENOTBLK;
+	if ((pos & (blocksize - 1)) || (count & (blocksize - 1)) ||
+	    ((unsigned long) req->ki_buf & (blocksize - 1)))
+		return -EINVAL;
+
+	/*
+	 * Like the synchronous O_DIRECT paths, keep truncate away from
+	 * the blocks until aio_direct_done(); i_size is stable from here.
+	 */
+	down_read(&inode->i_alloc_sem);
+
+	if (req->ki_rw == READ) {
+		ret = 0;
+		if (pos >= inode->i_size)
+			goto out;
+		if (pos + count > inode->i_size)
+			count = inode->i_size - pos;
+	} else {
+		/* appending and extending writes update i_size, do them in line */
+		ret = -ENOTBLK;
+		if ((file->f_flags & O_APPEND) ||
+		    (!S_ISBLK(inode->i_mode) && pos + count > inode->i_size))
+			goto out;
+	}
+
+	/* same as generic_file_direct_IO(), the page cache goes first */
+	ret = filemap_fdatasync(mapping);
+	if (ret == 0)
+		ret = fsync_inode_data_buffers(inode);
+	if (ret == 0)
+		ret = filemap_fdatawait(mapping);
+	if (ret < 0)
+		goto out;
+
+	ret = -ENOMEM;
+	iobuf = aio_get_iobuf(req->ki_ctx);
+	if (!iobuf)
+		goto out;
+	ret = map_user_kiobuf(req->ki_rw, iobuf, (unsigned long) req->ki_buf, count);
+	if (ret)
+		goto out_put;
+
+	if (req->ki_rw == WRITE) {
+		down(&inode->i_sem);
+		remove_suid(inode);
+		inode->i_ctime = inode->i_mtime = CURRENT_TIME;
+		mark_inode_dirty_sync(inode);
+		up(&inode->i_sem);
+	}
+
+	INIT_TQUEUE(&req->ki_tq, aio_direct_done, req);
+	req->ki_iobuf = iobuf;
+	iobuf->private = req;
+	iobuf->end_io = aio_kiobuf_end_io;
+
+	ret = mapping->a_ops->direct_IO(req->ki_rw, inode, iobuf,
+					pos >> inode->i_blkbits, blocksize);
+	if (ret > 0)
+		return -EIOCBQUEUED;
+
+	/* nothing was submitted, the iobuf is still ours */
+	unmap_kiobuf(iobuf);
+	req->ki_iobuf = NULL;
+out_put:
+	aio_put_iobuf(req->ki_ctx, iobuf);
+out:
+	up_read(&inode->i_alloc_sem);
+	return ret;
+}
+
+static int io_submit_one(struct kioctx *ctx, struct iocb *user_iocb,
+			 struct iocb *iocb)
+{
+	struct kiocb *req;
+	struct file *file;
+	long ret;
+
+	if (iocb->aio_reserved1 || iocb->aio_reserved2 || iocb->aio_reserved3)
+		return -EINVAL;
+	if (iocb->aio_buf != (unsigned long) iocb->aio_buf ||
+	    iocb->aio_nbytes != (size_t) iocb->aio_nbytes ||
+	    (ssize_t) iocb->aio_nbytes < 0)
+		return -EINVAL;
+
+	file = fget(iocb->aio_fildes);
+	if (!file)
+		return -EBADF;
+
+	switch (iocb->aio_lio_opcode) {
+	case IOCB_CMD_PREAD:
+		ret = -EBADF;
+		if (!(file->f_mode & FMODE_READ))
+			goto out_fput;
+		ret = -EFAULT;
+		if (!access_ok(VERIFY_WRITE, (char *)(unsigned long) iocb->aio_buf,
+			       iocb->aio_nbytes))
+			goto out_fput;
+		break;
+	case IOCB_CMD_PWRITE:
+		ret = -EBADF;
+		if (!(file->f_mode & FMODE_WRITE))
+			goto out_fput;
+		ret = -EFAULT;
+		if (!access_ok(VERIFY_READ, (char *)(unsigned long) iocb->aio_buf,
+			       iocb->aio_nbytes))
+			goto out_fput;
+		break;
+	case IOCB_CMD_FSYNC:
+	case IOCB_CMD_FDSYNC:
+	case IOCB_CMD_NOOP:
+		break;
+	default:
+		ret = -EINVAL;
+		goto out_fput;
+	}
+
+	ret = -EAGAIN;
+	req = aio_get_req(ctx);
+	if (!req)
+		goto out_fput;
+
+	req->ki_filp = file;
+	req->ki_obj = user_iocb;
+	req->ki_user_data = iocb->aio_data;
+	req->ki_buf = (char *)(unsigned long) iocb->aio_buf;
+	req->ki_nbytes = iocb->aio_nbytes;
+	req->ki_pos = iocb->aio_offset;
+
+	switch (iocb->aio_lio_opcode) {
+	case IOCB_CMD_PREAD:
+	case IOCB_CMD_PWRITE:
+		req->ki_rw = iocb->aio_lio_opcode == IOCB_CMD_PREAD ? READ : WRITE;
+		ret = -EINVAL;
+		if (req->ki_pos < 0)
+			break;
+		ret = aio_direct_submit(req);
+		if (ret == -EIOCBQUEUED)
+			return 0;
+		if (ret != -ENOTBLK)
+			break;
+		if (req->ki_rw == READ)
+			ret = sys_pread(iocb->aio_fildes, req->ki_buf,
+					req->ki_nbytes, req->ki_pos);
+		else
+			ret = sys_pwrite(iocb->aio_fildes, req->ki_buf,
+					 req->ki_nbytes, req->ki_pos);
+		break;
+	case IOCB_CMD_FSYNC:
+		ret = sys_fsync(iocb->aio_fildes);
+		break;
+	case IOCB_CMD_FDSYNC:
+		ret = sys_fdatasync(iocb->aio_fildes);
+		break;
+	default:
+		ret = 0;
+	}
+
+	aio_complete(req, ret);
+	return 0;
+
+out_fput:
+	fput(file);
+	return ret;
+}
+
+/*
+ * Destroy a context. Waits for the requests in flight, their events
+ * are dropped.
+ */
+asmlinkage long sys_io_destroy(aio_context_t ctx_id)
+{
+	struct mm_struct *mm = current->mm;
+	struct kioctx *ctx, **p;
+
+	if (!mm)
+		return -EINVAL;
+
+	write_lock(&mm->ioctx_list_lock);
+	for (p = &mm->ioctx_list; (ctx = *p) != NULL; p = &ctx->next)
+		if (ctx->user_id == ctx_id) {
+			*p = ctx->next;
+			break;
+		}
+	write_unlock(&mm->ioctx_list_lock);
+
+	if (!ctx)
+		return -EINVAL;
+	kill_ioctx(ctx);
+	return 0;
+}
+
+/*
+ * Create a context able to hold nr_events requests in flight and store
+ * its id in *ctxp, which must be zero on entry.
+ */
+asmlinkage long sys_io_setup(unsigned nr_events, aio_context_t *ctxp)
+{
+	struct kioctx *ctx;
+	aio_context_t ctx_id;
+	long ret;
+
+	ret = get_user(ctx_id, ctxp);
+	if (ret)
+		return ret;
+	if (ctx_id || !nr_events || (int)nr_events < 0)
+		return -EINVAL;
+
+	ctx = ioctx_alloc(nr_events);
+	if (IS_ERR(ctx))
+		return PTR_ERR(ctx);
+
+	ret = put_user(ctx->user_id, ctxp);
+	if (ret)
+		sys_io_destroy(ctx->user_id);
+	return ret;
+}
+
+/*
+ * Queue nr requests. Returns the number of requests queued, or an
+ * error if the first one already failed.
+ */
+asmlinkage long sys_io_submit(aio_context_t ctx_id, long nr, struct iocb **iocbpp)
+{
+	struct kioctx *ctx;
+	long ret = 0;
+	int i;
+
+	if (nr < 0)
+		return -EINVAL;
+
+	ctx = lookup_ioctx(ctx_id);
+	if (!ctx)
+		return -EINVAL;
+
+	for (i = 0; i < nr; i++) {
+		struct iocb *user_iocb, tmp;
+
+		if (get_user(user_iocb, iocbpp + i) ||
+		    copy_from_user(&tmp, user_iocb, sizeof(tmp))) {
+			ret = -EFAULT;
+			break;
+		}
+		ret = io_submit_one(ctx, user_iocb, &tmp);
+		if (ret)
+			break;
+	}
+
+	/* start the whole batch */
+	run_task_queue(&tq_disk);
+
+	put_ioctx(ctx);
+	return i ? i : ret;
+}
+
+/*
+ * Nothing is ever cancelled: requests already handed to the block layer
+ * cannot be called back, and all others complete before io_submit()
+ * returns. An in-flight request gets -EAGAIN, anything else -EINVAL, and
+ * the caller has to reap the completion with io_getevents().
+ */
+asmlinkage long sys_io_cancel(aio_context_t ctx_id, struct iocb *iocb,
+			      struct io_event *result)
+{
+	struct kioctx *ctx;
+	struct list_head *pos;
+	long ret = -EINVAL;
+
+	ctx = lookup_ioctx(ctx_id);
+	if (!ctx)
+		return -EINVAL;
+
+	spin_lock(&ctx->ctx_lock);
+	list_for_each(pos, &ctx->active_reqs)
+		if (list_entry(pos, struct kiocb, ki_list)->ki_obj == iocb) {
+			ret = -EAGAIN;
+			break;
+		}
+	spin_unlock(&ctx->ctx_lock);
+
+	put_ioctx(ctx);
+	return ret;
+}
+
+static int aio_read_evt(struct kioctx *ctx, struct io_event *ent)
+{
+	int ret = 0;
+
+	spin_lock(&ctx->ctx_lock);
+	if (ctx->head != ctx->tail) {
+		*ent = ctx->ring[ctx->head];
+		ctx->head = (ctx->head + 1) % ctx->ring_nr;
+		ret = 1;
+	}
+	spin_unlock(&ctx->ctx_lock);
+	return ret;
+}
+
+static long read_events(struct kioctx *ctx, long min_nr, long nr,
+			struct io_event *events, long timeout)
+{
+	DECLARE_WAITQUEUE(wait, current);
+	struct io_event ent;
+	long i = 0, ret = 0;
+
+	while (i < nr) {
+		if (aio_read_evt(ctx, &ent)) {
+			if (copy_to_user(events + i, &ent, sizeof(ent))) {
+				ret = -EFAULT;
+				break;
+			}
+			i++;
+			continue;
+		}
+		if (i >= min_nr || !timeout)
+			break;
+
+		add_wait_queue(&ctx->wait, &wait);
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (ctx->head == ctx->tail && !ctx->dead) {
+			if (signal_pending(current))
+				ret = -EINTR;
+			else
+				timeout = schedule_timeout(timeout);
+		}
+		set_current_state(TASK_RUNNING);
+		remove_wait_queue(&ctx->wait, &wait);
+
+		if (ret || ctx->dead)
+			break;
+	}
+	return i ? i : ret;
+}
+
+/*
+ * Reap at least min_nr and at most nr completion events, waiting up to
+ * *timeout for them. A NULL timeout waits forever.
+ */
+asmlinkage long sys_io_getevents(aio_context_t ctx_id, long min_nr, long nr,
+				 struct io_event *events, struct timespec *timeout)
+{
+	struct kioctx *ctx;
+	long jtimeout = MAX_SCHEDULE_TIMEOUT;
+	long ret;
+
+	if (min_nr < 0 || nr < 0 || min_nr > nr)
+		return -EINVAL;
+
+	if (timeout) {
+		struct timespec ts;
+
+		if (copy_from_user(&ts, timeout, sizeof(ts)))
+			return -EFAULT;
+		if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000L)
+			return -EINVAL;
+		jtimeout = timespec_to_jiffies(&ts);
+		if (ts.tv_sec || ts.tv_nsec)
+			jtimeout++;
+	}
+
+	ctx = lookup_ioctx(ctx_id);
+	if (!ctx)
+		return -EINVAL;
+
+	ret = read_events(ctx, min_nr, nr, events, jtimeout);
+
+	put_ioctx(ctx);
+	return ret;
+}
+
+static int __init aio_setup(void)
+{
+	kiocb_cachep = kmem_cache_create("kiocb", sizeof(struct kiocb),
+					 0, SLAB_HWCACHE_ALIGN, NULL, NULL);
+	kioctx_cachep = kmem_cache_create("kioctx", sizeof(struct kioctx),
+					  0, SLAB_HWCACHE_ALIGN, NULL, NULL);
+	if (!kiocb_cachep || !kioctx_cachep)
+		panic("aio_setup: cannot create slab caches\n");
+	return 0;
+}
+
+__initcall(aio_setup);
@@ -47,6 +47,7 @@
 #include <linux/highmem.h>
 #include <linux/module.h>
 #include <linux/completion.h>
+#include <linux/tqueue.h>
 
 #include <asm/uaccess.h>
 #include <asm/io.h>
@@ -79,6 +80,83 @@ static spinlock_cacheline_t lru_list_lock_cacheline = {SPIN_LOCK_UNLOCKED};
 static int nr_buffers_type[NR_LIST];
 static unsigned long size_buffers_type[NR_LIST];
 
+/*
+ * Dirty buffers are not kept on lru_list[BUF_DIRTY] but on one list per
+ * device, each written back by a flusher thread of its own, so that a
+ * slow device only ever holds up writeback to itself.  The totals in
+ * nr_buffers_type[BUF_DIRTY] and size_buffers_type[BUF_DIRTY] still
+ * cover all of them.
+ *
+ * Entries come from a fixed table and are never freed, so a buffer is
+ * always found on the list it was put on: once the table is full, new
+ * devices share bdflush_default, which bdflush and kupdate look after
+ * themselves.  Everything here is protected by the lru_list_lock.
+ */
+#define BDFLUSH_MAX_DEVS	64
+#define BDFLUSH_HASH_BITS	5
+#define BDFLUSH_HASH_SIZE	(1 << BDFLUSH_HASH_BITS)
+#define bdflush_hashfn(dev) \
+	((HASHDEV(dev) ^ (HASHDEV(dev) >> BDFLUSH_HASH_BITS)) & (BDFLUSH_HASH_SIZE - 1))
+
+#define BDF_KICKED	0x01	/* there may be work for the flusher */
+#define BDF_OLD		0x02	/* kupdate wants old buffers written */
+#define BDF_STARTING	0x04	/* flusher thread is being started */
+
+struct bdflush_dev {
+	struct list_head	list;		/* bdflush_dev_list */
+	struct bdflush_dev	*hash_next;
+	kdev_t			dev;
+	struct buffer_head	*dirty;		/* dirty buffers, oldest first */
+	int			nr_dirty;
+	unsigned long		size_dirty;	/* in sectors */
+	unsigned long		written;	/* sectors, decays every interval */
+	int			flags;
+	struct task_struct	*task;		/* flusher thread */
+	wait_queue_head_t	wait;		/* flusher sleeps here */
+};
+
+static struct bdflush_dev bdflush_devs[BDFLUSH_MAX_DEVS];
+static int nr_bdflush_devs;
+static struct bdflush_dev *bdflush_hash[BDFLUSH_HASH_SIZE];
+static struct bdflush_dev bdflush_default;
+static LIST_HEAD(bdflush_dev_list);
+static unsigned long bdflush_written;	/* sum of all ->written */
+
+static struct bdflush_dev *__bdflush_dev(kdev_t dev, int create)
+{
+	struct bdflush_dev **bdp = &bdflush_hash[bdflush_hashfn(dev)];
+	struct bdflush_dev *bd;
+
+	for (bd = *bdp; bd; bd = bd->hash_next)
+		if (bd->dev == dev)
+			return bd;
+	if (!create || nr_bdflush_devs == BDFLUSH_MAX_DEVS)
+		return &bdflush_default;
+
+	bd = &bdflush_devs[nr_bdflush_devs++];
+	bd->dev = dev;
+	init_waitqueue_head(&bd->wait);
+	bd->hash_next = *bdp;
+	*bdp = bd;
+	list_add_tail(&bd->list, &bdflush_dev_list);
+	return bd;
+}
+
+/* The device with dirty buffers that has been writing fastest lately */
+static struct bdflush_dev *__bdflush_fastest_dev(void)
+{
+	struct bdflush_dev *best = &bdflush_default;
+	struct list_head *p;
+
+	list_for_each(p, &bdflush_dev_list) {
+		struct bdflush_dev *bd = list_entry(p, struct bdflush_dev, list);
+
+		if (bd->dirty && (!best->dirty || bd->written > best->written))
+			best = bd;
+	}
+	return best;
+}
+
 static struct buffer_head * unused_list;
 static int nr_unused_buffer_heads;
 static spinlock_t unused_list_lock = SPIN_LOCK_UNLOCKED;
@@ -239,21 +317,21 @@ static void write_locked_buffers(struct buffer_head **array, unsigned int count)
 }
 
 /*
- * Write some buffers from the head of the dirty queue.
+ * Write some buffers from the head of a device's dirty queue.
  *
  * This must be called with the LRU lock held, and will
  * return without it!
  */
 #define NRSYNC (32)
-static int write_some_buffers(kdev_t dev)
+static int __write_some_buffers(struct bdflush_dev *bd, kdev_t dev)
 {
 	struct buffer_head *next;
 	struct buffer_head *array[NRSYNC];
 	unsigned int count;
 	int nr;
 
-	next = lru_list[BUF_DIRTY];
-	nr = nr_buffers_type[BUF_DIRTY];
+	next = bd->dirty;
+	nr = bd->nr_dirty;
 	count = 0;
 	while (next && --nr >= 0) {
 		struct buffer_head * bh = next;
@@ -273,6 +351,8 @@ static int write_some_buffers(kdev_t dev)
 			__refile_buffer(bh);
 			get_bh(bh);
 			array[count++] = bh;
+			bd->written += bh->b_size >> 9;
+			bdflush_written += bh->b_size >> 9;
 			if (count < NRSYNC)
 				continue;
 
@@ -290,29 +370,54 @@ static int write_some_buffers(kdev_t dev)
 	return 0;
 }
 
+/*
+ * Write some buffers of dev, or for NODEV of the device that
+ * is retiring dirty data fastest.  Same locking as above.
+ */
+static int write_some_buffers(kdev_t dev)
+{
+	struct bdflush_dev *bd;
+
+	if (dev == NODEV)
+		bd = __bdflush_fastest_dev();
+	else
+		bd = __bdflush_dev(dev, 0);
+	return __write_some_buffers(bd, dev);
+}
+
 /*
  * Write out all buffers on the dirty list.
  */
 static void write_unlocked_buffers(kdev_t dev)
 {
-	do
+	struct list_head *p;
+
+	if (dev != NODEV) {
+		do
+			spin_lock(&lru_list_lock);
+		while (write_some_buffers(dev));
+		return;
+	}
+
+	/* Entries are never removed, so p stays valid across the unlocks */
+	spin_lock(&lru_list_lock);
+	list_for_each(p, &bdflush_dev_list) {
+		struct bdflush_dev *bd = list_entry(p, struct bdflush_dev, list);
+
+		while (__write_some_buffers(bd, NODEV))
+			spin_lock(&lru_list_lock);
 		spin_lock(&lru_list_lock);
-	while (write_some_buffers(dev));
+	}
+	spin_unlock(&lru_list_lock);
 }
 
 /*
- * Wait for a buffer on the proper list.
- *
- * This must be called with the LRU lock held, and
- * will return with it released.
+ * Wait for a buffer on one list.  Returns -EAGAIN with the LRU
+ * lock dropped after it slept, 0 with the lock still held.
  */
-static int wait_for_buffers(kdev_t dev, int index, int refile)
+static int __wait_for_buffers(struct buffer_head *next, int nr,
+			      kdev_t dev, int refile)
 {
-	struct buffer_head * next;
-	int nr;
-
-	next = lru_list[index];
-	nr = nr_buffers_type[index];
 	while (next && --nr >= 0) {
 		struct buffer_head *bh = next;
 		next = bh->b_next_free;
@@ -331,6 +436,36 @@ static int wait_for_buffers(kdev_t dev, int index, int refile)
 		put_bh(bh);
 		return -EAGAIN;
 	}
+	return 0;
+}
+
+/*
+ * Wait for a buffer on the proper list.
+ *
+ * This must be called with the LRU lock held, and
+ * will return with it released.
+ */
+static int wait_for_buffers(kdev_t dev, int index, int refile)
+{
+	struct bdflush_dev *bd;
+	struct list_head *p;
+
+	if (index != BUF_DIRTY) {
+		if (__wait_for_buffers(lru_list[index], nr_buffers_type[index],
+				       dev, refile))
+			return -EAGAIN;
+	} else if (dev != NODEV) {
+		bd = __bdflush_dev(dev, 0);
+		if (__wait_for_buffers(bd->dirty, bd->nr_dirty, dev, refile))
+			return -EAGAIN;
+	} else {
+		list_for_each(p, &bdflush_dev_list) {
+			bd = list_entry(p, struct bdflush_dev, list);
+			if (__wait_for_buffers(bd->dirty, bd->nr_dirty,
+					       dev, refile))
+				return -EAGAIN;
+		}
+	}
 	spin_unlock(&lru_list_lock);
 	return 0;
 }
@@ -575,6 +710,14 @@ static void __insert_into_lru_list(struct buffer_head * bh, int blist)
 
 	if (bh->b_prev_free || bh->b_next_free) BUG();
 
+	if (blist == BUF_DIRTY) {
+		struct bdflush_dev *bd = __bdflush_dev(bh->b_dev, 1);
+
+		bhp = &bd->dirty;
+		bd->nr_dirty++;
+		bd->size_dirty += bh->b_size >> 9;
+	}
+
 	if(!*bhp) {
 		*bhp = bh;
 		bh->b_prev_free = bh;
@@ -587,19 +730,32 @@ static void __insert_into_lru_list(struct buffer_head * bh, int blist)
 	size_buffers_type[blist] += bh->b_size >> 9;
 }
 
+/*
+ * A dirty buffer's b_dev does not change while it is on a list, so it
+ * is looked up on the same per-device list it was inserted on.
+ */
 static void __remove_from_lru_list(struct buffer_head * bh)
 {
 	struct buffer_head *next = bh->b_next_free;
 	if (next) {
 		struct buffer_head *prev = bh->b_prev_free;
 		int blist = bh->b_list;
+		struct buffer_head **bhp = &lru_list[blist];
+
+		if (blist == BUF_DIRTY) {
+			struct bdflush_dev *bd = __bdflush_dev(bh->b_dev, 0);
+
+			bhp = &bd->dirty;
+			bd->nr_dirty--;
+			bd->size_dirty -= bh->b_size >> 9;
+		}
 
 		prev->b_next_free = next;
 		next->b_prev_free = prev;
-		if (lru_list[blist] == bh) {
+		if (*bhp == bh) {
 			if (next == bh)
 				next = NULL;
-			lru_list[blist] = next;
+			*bhp = next;
 		}
 		bh->b_next_free = NULL;
 		bh->b_prev_free = NULL;
@@ -730,9 +886,16 @@ void invalidate_bdev(struct block_device *bdev, int destroy_dirty_buffers)
 	spin_lock(&lru_list_lock);
 	for(nlist = 0; nlist < NR_LIST; nlist++) {
 		bh = lru_list[nlist];
+		i = nr_buffers_type[nlist];
+		if (nlist == BUF_DIRTY) {
+			struct bdflush_dev *bd = __bdflush_dev(dev, 0);
+
+			bh = bd->dirty;
+			i = bd->nr_dirty;
+		}
 		if (!bh)
 			continue;
-		for (i = nr_buffers_type[nlist]; i > 0 ; bh = bh_next, i--) {
+		for (; i > 0 ; bh = bh_next, i--) {
 			bh_next = bh->b_next_free;
 
 			/* Another device? */
@@ -1066,11 +1229,116 @@ static int bdflush_stop(void)
 }
 
 /*
- * if a new dirty buffer is created we need to balance bdflush.
- *
- * in the future we might want to make bdflush aware of different
- * pressures on different devices - thus the (currently unused)
- * 'dev' parameter.
+ * A device's share of the dirty limit, in 1/1024ths, follows its share
+ * of the writeback done lately, so a slow device cannot fill the whole
+ * budget with buffers it will take ages to write.  The floor lets a
+ * device that has only just started to see writes get going.
+ */
+static unsigned long bdflush_dev_share(struct bdflush_dev *bd)
+{
+	unsigned long share = 1024;
+
+	if (bdflush_written) {
+		share = bd->written / ((bdflush_written >> 10) + 1);
+		if (share > 1024)
+			share = 1024;
+	}
+	if (share < 64)
+		share = 64;
+	return share;
+}
+
+static int bdflush_dev_over_limit(struct bdflush_dev *bd)
+{
+	unsigned long dirty, limit;
+
+	dirty = (bd->size_dirty >> (PAGE_SHIFT - 9)) * 100;
+	limit = nr_free_buffer_pages() * bdf_prm.b_un.nfract_sync;
+
+	return dirty > (limit >> 10) * bdflush_dev_share(bd);
+}
+
+static int bdflush_dev_thread(void *);
+
+/*
+ * Flusher threads exit when their device has been idle for a while
+ * and are started again from keventd once it has dirty buffers.
+ */
+static void bdflush_spawn(void *unused)
+{
+	struct list_head *p;
+
+	spin_lock(&lru_list_lock);
+	list_for_each(p, &bdflush_dev_list) {
+		struct bdflush_dev *bd = list_entry(p, struct bdflush_dev, list);
+
+		if (bd == &bdflush_default || bd->task || !bd->dirty ||
+		    (bd->flags & BDF_STARTING))
+			continue;
+		bd->flags |= BDF_STARTING;
+		spin_unlock(&lru_list_lock);
+		if (kernel_thread(bdflush_dev_thread, bd, CLONE_KERNEL) < 0) {
+			spin_lock(&lru_list_lock);
+			bd->flags &= ~BDF_STARTING;
+			continue;
+		}
+		spin_lock(&lru_list_lock);
+	}
+	spin_unlock(&lru_list_lock);
+}
+
+static struct tq_struct bdflush_spawn_tq = {
+	routine:	bdflush_spawn,
+};
+
+/* Called with the LRU lock held */
+static void __bdflush_kick(struct bdflush_dev *bd, int why)
+{
+	if (bd == &bdflush_default) {
+		wakeup_bdflush();
+		return;
+	}
+	bd->flags |= BDF_KICKED | why;
+	if (bd->task)
+		wake_up_interruptible(&bd->wait);
+	else if (!(bd->flags & BDF_STARTING))
+		schedule_task(&bdflush_spawn_tq);
+}
+
+/*
+ * if a new dirty buffer is created on dev we need to balance its
+ * flusher.  Writers are made to write back buffers themselves when
+ * their own device holds more than its share of the dirty data, so
+ * heavy writers to one device do not stall writers to the others.
+ * Past the global hard limit everybody is throttled like in
+ * balance_dirty(), whatever the share of its own device.
+ */
+void balance_dirty_dev(kdev_t dev)
+{
+	struct bdflush_dev *bd;
+	int state = balance_dirty_state();
+
+	if (state < 0)
+		return;
+
+	spin_lock(&lru_list_lock);
+	bd = __bdflush_dev(dev, 0);
+	__bdflush_kick(bd, 0);
+	if (!(current->flags & PF_NOIO) && bdflush_dev_over_limit(bd)) {
+		__write_some_buffers(bd, dev);
+		return;
+	}
+	if (state > 0) {
+		write_some_buffers(NODEV);
+		return;
+	}
+	spin_unlock(&lru_list_lock);
+}
+EXPORT_SYMBOL(balance_dirty_dev);
+
+/*
+ * Same for callers that do not know the device: throttle on whichever
+ * device can take the dirty data fastest.
  */
 void balance_dirty(void)
 {
@@ -1113,7 +1381,7 @@ void fastcall mark_buffer_dirty(struct buffer_head *bh)
 		if (block_dump)
 			printk("%s: dirtied buffer\n", current->comm);
 		__mark_dirty(bh);
-		balance_dirty();
+		balance_dirty_dev(bh->b_dev);
 	}
 }
 
@@ -1732,6 +2000,7 @@ static int __block_commit_write(struct inode *inode, struct page *page,
 {
 	unsigned block_start, block_end;
 	int partial = 0, need_balance_dirty = 0;
+	kdev_t dev = NODEV;
 	unsigned blocksize;
 	struct buffer_head *bh, *head;
 
@@ -1750,12 +2019,13 @@ static int __block_commit_write(struct inode *inode, struct page *page,
 				__mark_dirty(bh);
 				buffer_insert_inode_data_queue(bh, inode);
 				need_balance_dirty = 1;
+				dev = bh->b_dev;
 			}
 		}
 	}
 
 	if (need_balance_dirty)
-		balance_dirty();
+		balance_dirty_dev(dev);
 	/*
 	 * is this a partial write that happened to make all buffers
 	 * uptodate then we can optimize away a bogus readpage() for
@@ -2087,7 +2357,7 @@ int block_truncate_page(struct address_space *mapping, loff_t from, get_block_t
 	if (!atomic_set_buffer_dirty(bh)) {
 		__mark_dirty(bh);
 		buffer_insert_inode_data_queue(bh, inode);
-		balance_dirty();
+		balance_dirty_dev(bh->b_dev);
 	}
 
 	err = 0;
@@ -2241,6 +2511,14 @@ int generic_direct_IO(int rw, struct inode * inode, struct kiobuf * iobuf, unsig
 
 	/* patch length to handle short I/O */
 	iobuf->length = i * blocksize;
+	if (iobuf->end_io) {
+		/*
+		 * Asynchronous I/O, the caller does not hold i_sem. The iobuf
+		 * may be gone once submitted, so iobuf->length stays patched.
+		 */
+		retval = brw_kiobuf_async(rw, iobuf, inode->i_dev, iobuf->blocks, blocksize);
+		goto out;
+	}
 	if (!beyond_eof)
 		up(&inode->i_sem);
 	retval = brw_kiovec(rw, 1, &iobuf, inode->i_dev, iobuf->blocks, blocksize);
@@ -2264,9 +2542,10 @@ static void end_buffer_io_kiobuf(struct buffer_head *bh, int uptodate)
 	
 	mark_buffer_uptodate(bh, uptodate);
 
+	/* the buffer_head is gone once an asynchronous kiobuf completes */
 	kiobuf = bh->b_private;
-	end_kio_request(kiobuf, uptodate);
 	unlock_buffer(bh);
+	end_kio_request(kiobuf, uptodate);
 }
 
 /*
@@ -2437,6 +2716,83 @@ int brw_kiovec(int rw, int nr, struct kiobuf *iovec[],
 	return err;
 }
 
+/*
+ * Start I/O on a single locked kiobuf without waiting for it: the
+ * kiobuf's end_io is called, usually from interrupt context, once all
+ * of it has completed and iobuf->errno tells whether it failed. The
+ * whole kiobuf must fit into its KIO_MAX_SECTORS buffer heads.
+ *
+ * Returns the number of bytes submitted, or an error if nothing was.
+ * The kiobuf must not be touched afterwards, end_io may have freed it.
+ */
+int brw_kiobuf_async(int rw, struct kiobuf *iobuf,
+		     kdev_t dev, unsigned long b[], int size)
+{
+	int		length, offset, pageind, transferred;
+	int		bufind = 0, bhind = 0;
+	unsigned long	blocknr;
+	struct page *	map;
+	struct buffer_head *tmp;
+
+	if ((iobuf->offset & (size-1)) || (iobuf->length & (size-1)) ||
+	    iobuf->length / size > KIO_MAX_SECTORS)
+		return -EINVAL;
+	if (!iobuf->nr_pages)
+		panic("brw_kiobuf_async: iobuf not initialised");
+	if (!iobuf->length)
+		return 0;
+	for (pageind = 0; pageind < iobuf->nr_pages; pageind++)
+		if (!iobuf->maplist[pageind])
+			return -EFAULT;
+
+	/* hold off end_io until everything is submitted */
+	iobuf->errno = 0;
+	atomic_set(&iobuf->io_count, 1);
+
+	offset = iobuf->offset;
+	length = transferred = iobuf->length;
+	for (pageind = 0; pageind < iobuf->nr_pages && length > 0; pageind++) {
+		map = iobuf->maplist[pageind];
+
+		while (length > 0) {
+			blocknr = b[bufind++];
+			if (blocknr == -1UL) {
+				if (rw != READ)
+					BUG();
+				/* there was an hole in the filesystem */
+				memset(kmap(map) + offset, 0, size);
+				flush_dcache_page(map);
+				kunmap(map);
+			} else {
+				tmp = iobuf->bh[bhind++];
+
+				tmp->b_size = size;
+				set_bh_page(tmp, map, offset);
+				tmp->b_this_page = tmp;
+
+				init_buffer(tmp, end_buffer_io_kiobuf, iobuf);
+				tmp->b_dev = dev;
+				tmp->b_blocknr = blocknr;
+				tmp->b_state = (1 << BH_Mapped) | (1 << BH_Lock) |
+					       (1 << BH_Req) | (1 << BH_Uptodate);
+
+				atomic_inc(&iobuf->io_count);
+				submit_bh(rw, tmp);
+			}
+
+			length -= size;
+			offset += size;
+			if (offset >= PAGE_SIZE) {
+				offset = 0;
+				break;
+			}
+		}
+	}
+
+	end_kio_request(iobuf, 1);
+	return transferred;
+}
+
 /*
  * Start I/O on a page.
  * This function expects the page to be locked and may return
@@ -2821,22 +3177,46 @@ void show_buffers(void)
 	if (!spin_trylock(&lru_list_lock))
 		return;
 	for(nlist = 0; nlist < NR_LIST; nlist++) {
+		struct list_head *p = bdflush_dev_list.next;
+		struct buffer_head *head = lru_list[nlist];
+
 		delalloc = found = locked = dirty = used = lastused = 0;
-		bh = lru_list[nlist];
-		if(!bh) continue;
+		for (;;) {
+			/* dirty buffers live on the per-device lists */
+			if (nlist == BUF_DIRTY) {
+				struct bdflush_dev *bd;
 
-		do {
-			found++;
-			if (buffer_locked(bh))
-				locked++;
-			if (buffer_dirty(bh))
-				dirty++;
-			if (buffer_delay(bh))
-				delalloc++;
-			if (atomic_read(&bh->b_count))
-				used++, lastused = found;
-			bh = bh->b_next_free;
-		} while (bh != lru_list[nlist]);
+				if (p == &bdflush_dev_list)
+					break;
+				bd = list_entry(p, struct bdflush_dev, list);
+				p = p->next;
+				head = bd->dirty;
+				if (head)
+					printk("%9s: %d buffers, %lu kbyte, "
+					       "share %lu/1024, flusher %d\n",
+					       kdevname(bd->dev), bd->nr_dirty,
+					       bd->size_dirty >> (10-9),
+					       bdflush_dev_share(bd),
+					       bd->task ? bd->task->pid : 0);
+			}
+			bh = head;
+			if (bh) do {
+				found++;
+				if (buffer_locked(bh))
+					locked++;
+				if (buffer_dirty(bh))
+					dirty++;
+				if (buffer_delay(bh))
+					delalloc++;
+				if (atomic_read(&bh->b_count))
+					used++, lastused = found;
+				bh = bh->b_next_free;
+			} while (bh != head);
+			if (nlist != BUF_DIRTY)
+				break;
+		}
+		if (!found)
+			continue;
 		{
 			int tmp = nr_buffers_type[nlist];
 			if (found != tmp)
@@ -2905,6 +3285,10 @@ void __init buffer_init(unsigned long mempages)
 	for(i = 0; i < NR_LIST; i++)
 		lru_list[i] = NULL;
 
+	bdflush_default.dev = NODEV;
+	init_waitqueue_head(&bdflush_default.wait);
+	list_add(&bdflush_default.list, &bdflush_dev_list);
+
 }
 
 
@@ -2936,25 +3320,49 @@ void wakeup_kupdate(void)
  * and superblocks so that we could write back only the old ones as well
  */
 
+
+static int bdflush_dev_expired(struct bdflush_dev *bd)
+{
+	struct buffer_head *bh = bd->dirty;
+
+	return bh && (laptop_mode || !time_before(jiffies, bh->b_flushtime));
+}
+
+/*
+ * Old buffers are written by each device's flusher; kupdate only
+ * writes those of devices that do not have one running.  This is
+ * also where the writeback rates behind bdflush_dev_share() decay.
+ */
 static int sync_old_buffers(void)
 {
+	struct list_head *p;
+
 	lock_kernel();
 	sync_unlocked_inodes();
 	sync_supers(0, 0);
 	unlock_kernel();
 
-	for (;;) {
-		struct buffer_head *bh;
+	spin_lock(&lru_list_lock);
+	list_for_each(p, &bdflush_dev_list) {
+		struct bdflush_dev *bd = list_entry(p, struct bdflush_dev, list);
 
-		spin_lock(&lru_list_lock);
-		bh = lru_list[BUF_DIRTY];
-		if (!bh)
-			break;
-		if (time_before(jiffies, bh->b_flushtime) && !laptop_mode)
-			break;
-		if (write_some_buffers(NODEV))
+		bdflush_written -= bd->written - (bd->written >> 1);
+		bd->written >>= 1;
+
+		if (!bdflush_dev_expired(bd))
 			continue;
-		return 0;
+		if (bd != &bdflush_default) {
+			__bdflush_kick(bd, BDF_OLD);
+			if (bd->task || (bd->flags & BDF_STARTING))
+				continue;
+		}
+		while (bdflush_dev_expired(bd)) {
+			if (!__write_some_buffers(bd, NODEV)) {
+				spin_lock(&lru_list_lock);
+				break;
+			}
+			spin_lock(&lru_list_lock);
+		}
 	}
 	spin_unlock(&lru_list_lock);
 	return 0;
@@ -3058,12 +3466,24 @@ int bdflush(void *startup)
 	 */
 	for (;;) {
 		int ndirty = bdf_prm.b_un.ndirty;
+		struct list_head *p;
 
 		CHECK_EMERGENCY_SYNC
 
+		/* The per-device flushers do the real work */
+		spin_lock(&lru_list_lock);
+		list_for_each(p, &bdflush_dev_list) {
+			struct bdflush_dev *bd;
+
+			bd = list_entry(p, struct bdflush_dev, list);
+			if (bd != &bdflush_default && bd->dirty)
+				__bdflush_kick(bd, 0);
+		}
+		spin_unlock(&lru_list_lock);
+
 		while (ndirty > 0) {
 			spin_lock(&lru_list_lock);
-			if (!write_some_buffers(NODEV))
+			if (!__write_some_buffers(&bdflush_default, NODEV))
 				break;
 			ndirty -= NRSYNC;
 		}
@@ -3072,6 +3492,84 @@ int bdflush(void *startup)
 	}
 }
 
+/*
+ * Is there anything for bd's flusher to write?  Everything above the
+ * bdflush stop level, the device's excess over its share of the
+ * dirty limit, and old buffers when kupdate asked for them.
+ */
+static int bdflush_dev_pending(struct bdflush_dev *bd, int old)
+{
+	if (!bd->dirty)
+		return 0;
+	if (!bdflush_stop() || bdflush_dev_over_limit(bd))
+		return 1;
+	return old && bdflush_dev_expired(bd);
+}
+
+#define BDFLUSH_IDLE	(30*HZ)
+
+/*
+ * Per-device writeback thread.  It blocks on nothing but its own
+ * device's request queue and goes away after BDFLUSH_IDLE without
+ * dirty buffers.
+ */
+static int bdflush_dev_thread(void *data)
+{
+	struct bdflush_dev *bd = data;
+	struct task_struct *tsk = current;
+	DECLARE_WAITQUEUE(wait, tsk);
+
+	daemonize();
+	snprintf(tsk->comm, sizeof(tsk->comm), "bdflush/%s", kdevname(bd->dev));
+
+	spin_lock_irq(&tsk->sighand->siglock);
+	flush_signals(tsk);
+	sigfillset(&tsk->blocked);
+	recalc_sigpending_tsk(tsk);
+	spin_unlock_irq(&tsk->sighand->siglock);
+
+	spin_lock(&lru_list_lock);
+	bd->task = tsk;
+	bd->flags &= ~BDF_STARTING;
+	spin_unlock(&lru_list_lock);
+
+	for (;;) {
+		long timeout;
+		int old;
+
+		spin_lock(&lru_list_lock);
+		old = bd->flags & BDF_OLD;
+		bd->flags &= ~(BDF_KICKED | BDF_OLD);
+		while (bdflush_dev_pending(bd, old)) {
+			if (!__write_some_buffers(bd, bd->dev)) {
+				spin_lock(&lru_list_lock);
+				break;
+			}
+			spin_lock(&lru_list_lock);
+		}
+		spin_unlock(&lru_list_lock);
+		run_task_queue(&tq_disk);
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		add_wait_queue(&bd->wait, &wait);
+		timeout = BDFLUSH_IDLE;
+		if (!(bd->flags & BDF_KICKED))
+			timeout = schedule_timeout(timeout);
+		__set_current_state(TASK_RUNNING);
+		remove_wait_queue(&bd->wait, &wait);
+		if (timeout)
+			continue;
+
+		spin_lock(&lru_list_lock);
+		if (!bd->dirty && !(bd->flags & BDF_KICKED)) {
+			bd->task = NULL;
+			spin_unlock(&lru_list_lock);
+			return 0;
+		}
+		spin_unlock(&lru_list_lock);
+	}
+}
+
 /*
  * This is the kernel update daemon. It was used to live in userspace
  * but since it's need to run safely we want it unkillable by mistake.
@@ -0,0 +1,847 @@
+/*
+ *  linux/fs/eventpoll.c
+ *
+ *  Event notification on a persistent set of file descriptors.
+ *
+ *  select() and poll() hand the whole descriptor set to the kernel on
+ *  every call and go through every file's ->poll() method twice, so a
+ *  daemon with thousands of mostly idle connections pays for all of
+ *  them on every wait. An epoll file keeps the interest set instead:
+ *  every watched file is polled once when it is added, with a poll
+ *  table whose qproc hooks a callback entry into each wait queue the
+ *  ->poll() method registers. Wakeups on those queues put the item on
+ *  the ready list, and epoll_wait() only looks at the ready items.
+ *
+ *  Locking: epsem serializes the release of watched files against the
+ *  release of epoll files. ep->sem protects the item hash, it is taken
+ *  for writing by epoll_ctl() and releases, for reading while events are
+ *  transferred to user space. ep->lock protects the ready list and is
+ *  taken from the wait queue callbacks, i.e. with interrupts disabled.
+ *  Lock order is epsem, ep->sem, wait queue lock, ep->lock.
+ *
+ *  Nesting epoll files inside each other is not supported.
+ */
+
+#include <linux/config.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/slab.h>
+#include <linux/poll.h>
+#include <linux/hash.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/eventpoll.h>
+
+#include <asm/uaccess.h>
+#include <asm/semaphore.h>
+
+#define EVENTPOLLFS_MAGIC	0x03111965
+
+/* item hash size, from the size hint given to epoll_create() */
+#define EP_MIN_HASH_BITS	5
+#define EP_MAX_HASH_BITS	14
+
+/* maximum number of events returned by a single epoll_wait() */
+#define EP_MAX_EVENTS		(INT_MAX / sizeof(struct epoll_event))
+
+#define EP_PRIVATE_BITS		(EPOLLONESHOT | EPOLLET)
+
+struct eventpoll {
+	/* protects rdllist */
+	spinlock_t lock;
+
+	/* protects the item hash */
+	struct rw_semaphore sem;
+
+	/* tasks sleeping in epoll_wait() */
+	wait_queue_head_t wq;
+
+	/* select()/poll() on the epoll file itself */
+	wait_queue_head_t poll_wait;
+
+	/* items with events available */
+	struct list_head rdllist;
+
+	unsigned int hashbits;
+	struct list_head *hash;
+};
+
+/* one per watched (file, fd) pair */
+struct epitem {
+	/* entry in the eventpoll hash */
+	struct list_head llink;
+
+	/* entry in ep->rdllist */
+	struct list_head rdllink;
+
+	/* entry in the transfer list of epoll_wait() */
+	struct list_head txlink;
+
+	/* entry in file->f_ep_links */
+	struct list_head fllink;
+
+	/* the eppoll_entry hooks of this item */
+	struct list_head pwqlist;
+	int nwait;
+
+	struct eventpoll *ep;
+	struct file *file;
+	int fd;
+
+	struct epoll_event event;
+
+	/* events found in the last epoll_wait() */
+	unsigned int revents;
+};
+
+/* wait queue hook, one per wait queue the watched file polls on */
+struct eppoll_entry {
+	struct list_head llink;
+	struct epitem *base;
+	wait_queue_t wait;
+	wait_queue_head_t *whead;
+};
+
+/* poll table used while adding an item */
+struct ep_pqueue {
+	poll_table pt;
+	struct epitem *epi;
+};
+
+static DECLARE_MUTEX(epsem);
+
+static kmem_cache_t *epi_cache;
+static kmem_cache_t *pwq_cache;
+
+static struct vfsmount *eventpoll_mnt;
+
+static int ep_eventpoll_close(struct inode *inode, struct file *file);
+static unsigned int ep_eventpoll_poll(struct file *file, poll_table *wait);
+
+static const struct file_operations eventpoll_fops = {
+	release:	ep_eventpoll_close,
+	poll:		ep_eventpoll_poll,
+};
+
+static inline int is_file_epoll(struct file *file)
+{
+	return file->f_op == &eventpoll_fops;
+}
+
+static inline struct list_head *ep_hash_entry(struct eventpoll *ep,
+					      struct file *file, int fd)
+{
+	return ep->hash + hash_long((unsigned long)file + fd, ep->hashbits);
+}
+
+static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd)
+{
+	struct list_head *head = ep_hash_entry(ep, file, fd), *lnk;
+
+	list_for_each(lnk, head) {
+		struct epitem *epi = list_entry(lnk, struct epitem, llink);
+
+		if (epi->file == file && epi->fd == fd)
+			return epi;
+	}
+	return NULL;
+}
+
+static int ep_alloc(struct eventpoll **pep, int size)
+{
+	struct eventpoll *ep;
+	unsigned int i, hashbits = EP_MIN_HASH_BITS;
+
+	while (hashbits < EP_MAX_HASH_BITS && (1 << hashbits) < size)
+		hashbits++;
+
+	ep = kmalloc(sizeof(*ep), GFP_KERNEL);
+	if (!ep)
+		return -ENOMEM;
+	ep->hash = kmalloc(sizeof(struct list_head) << hashbits, GFP_KERNEL);
+	if (!ep->hash) {
+		kfree(ep);
+		return -ENOMEM;
+	}
+	ep->hashbits = hashbits;
+	for (i = 0; i < (1 << hashbits); i++)
+		INIT_LIST_HEAD(&ep->hash[i]);
+
+	spin_lock_init(&ep->lock);
+	init_rwsem(&ep->sem);
+	init_waitqueue_head(&ep->wq);
+	init_waitqueue_head(&ep->poll_wait);
+	INIT_LIST_HEAD(&ep->rdllist);
+
+	*pep = ep;
+	return 0;
+}
+
+/*
+ * Wait queue callback, called with the lock of the wait queue head held
+ * and often from interrupt context.
+ */
+static int ep_poll_callback(wait_queue_t *wait, unsigned int mode, int sync)
+{
+	struct epitem *epi = list_entry(wait, struct eppoll_entry, wait)->base;
+	struct eventpoll *ep = epi->ep;
+	unsigned long flags;
+	int pwake = 0;
+
+	spin_lock_irqsave(&ep->lock, flags);
+
+	/* disabled by EPOLLONESHOT until the next EPOLL_CTL_MOD */
+	if (!(epi->event.events & ~EP_PRIVATE_BITS))
+		goto out;
+
+	if (list_empty(&epi->rdllink))
+		list_add_tail(&epi->rdllink, &ep->rdllist);
+
+	if (waitqueue_active(&ep->wq))
+		wake_up(&ep->wq);
+	if (waitqueue_active(&ep->poll_wait))
+		pwake = 1;
+out:
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	if (pwake)
+		wake_up(&ep->poll_wait);
+	return 1;
+}
+
+/* qproc of the poll table passed to ->poll() when an item is added */
+static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead,
+				 poll_table *pt)
+{
+	struct epitem *epi = list_entry(pt, struct ep_pqueue, pt)->epi;
+	struct eppoll_entry *pwq;
+
+	if (epi->nwait < 0)
+		return;
+	pwq = kmem_cache_alloc(pwq_cache, SLAB_KERNEL);
+	if (!pwq) {
+		epi->nwait = -1;
+		return;
+	}
+	init_waitqueue_func_entry(&pwq->wait, ep_poll_callback);
+	pwq->whead = whead;
+	pwq->base = epi;
+	add_wait_queue(whead, &pwq->wait);
+	list_add_tail(&pwq->llink, &epi->pwqlist);
+	epi->nwait++;
+}
+
+/* once this returns, ep_poll_callback() cannot run for the item any more */
+static void ep_unregister_pollwait(struct epitem *epi)
+{
+	struct eppoll_entry *pwq;
+
+	while (!list_empty(&epi->pwqlist)) {
+		pwq = list_entry(epi->pwqlist.next, struct eppoll_entry, llink);
+		list_del(&pwq->llink);
+		remove_wait_queue(pwq->whead, &pwq->wait);
+		kmem_cache_free(pwq_cache, pwq);
+	}
+	epi->nwait = 0;
+}
+
+/* queue an item which has events and wake up the waiters */
+static void ep_make_ready(struct eventpoll *ep, struct epitem *epi)
+{
+	unsigned long flags;
+	int pwake = 0;
+
+	spin_lock_irqsave(&ep->lock, flags);
+	if (list_empty(&epi->rdllink)) {
+		list_add_tail(&epi->rdllink, &ep->rdllist);
+		if (waitqueue_active(&ep->wq))
+			wake_up(&ep->wq);
+		if (waitqueue_active(&ep->poll_wait))
+			pwake = 1;
+	}
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	if (pwake)
+		wake_up(&ep->poll_wait);
+}
+
+/* Called with ep->sem held for writing */
+static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
+		     struct file *tfile, int fd)
+{
+	struct ep_pqueue epq;
+	struct epitem *epi;
+	unsigned int revents;
+
+	epi = kmem_cache_alloc(epi_cache, SLAB_KERNEL);
+	if (!epi)
+		return -ENOMEM;
+
+	INIT_LIST_HEAD(&epi->llink);
+	INIT_LIST_HEAD(&epi->rdllink);
+	INIT_LIST_HEAD(&epi->txlink);
+	INIT_LIST_HEAD(&epi->fllink);
+	INIT_LIST_HEAD(&epi->pwqlist);
+	epi->nwait = 0;
+	epi->ep = ep;
+	epi->file = tfile;
+	epi->fd = fd;
+	epi->event = *event;
+	epi->revents = 0;
+
+	/* hooks ep_poll_callback() into the wait queues of the file */
+	epq.epi = epi;
+	init_poll_funcptr(&epq.pt, ep_ptable_queue_proc);
+	revents = tfile->f_op->poll(tfile, &epq.pt);
+
+	if (epi->nwait < 0) {
+		ep_unregister_pollwait(epi);
+		kmem_cache_free(epi_cache, epi);
+		return -ENOMEM;
+	}
+
+	spin_lock(&tfile->f_ep_lock);
+	list_add_tail(&epi->fllink, &tfile->f_ep_links);
+	spin_unlock(&tfile->f_ep_lock);
+
+	list_add(&epi->llink, ep_hash_entry(ep, tfile, fd));
+
+	if (revents & event->events)
+		ep_make_ready(ep, epi);
+	return 0;
+}
+
+/* Called with ep->sem held for writing */
+static int ep_modify(struct eventpoll *ep, struct epitem *epi,
+		     struct epoll_event *event)
+{
+	unsigned long flags;
+	unsigned int revents;
+
+	spin_lock_irqsave(&ep->lock, flags);
+	epi->event = *event;
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	revents = epi->file->f_op->poll(epi->file, NULL);
+	if (revents & event->events)
+		ep_make_ready(ep, epi);
+	return 0;
+}
+
+/* Called with ep->sem held for writing */
+static void ep_remove(struct eventpoll *ep, struct epitem *epi)
+{
+	struct file *file = epi->file;
+	unsigned long flags;
+
+	ep_unregister_pollwait(epi);
+
+	spin_lock(&file->f_ep_lock);
+	if (!list_empty(&epi->fllink))
+		list_del_init(&epi->fllink);
+	spin_unlock(&file->f_ep_lock);
+
+	list_del(&epi->llink);
+
+	spin_lock_irqsave(&ep->lock, flags);
+	if (!list_empty(&epi->rdllink))
+		list_del_init(&epi->rdllink);
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	kmem_cache_free(epi_cache, epi);
+}
+
+/*
+ * The watched file goes away, drop it from all epoll sets. epsem keeps
+ * the eventpoll structures from being freed under us.
+ */
+void eventpoll_release_file(struct file *file)
+{
+	struct list_head *lsthead = &file->f_ep_links;
+	struct eventpoll *ep;
+	struct epitem *epi;
+
+	down(&epsem);
+	while (!list_empty(lsthead)) {
+		epi = list_entry(lsthead->next, struct epitem, fllink);
+		ep = epi->ep;
+		list_del_init(&epi->fllink);
+		down_write(&ep->sem);
+		ep_remove(ep, epi);
+		up_write(&ep->sem);
+	}
+	up(&epsem);
+}
+
+static void ep_free(struct eventpoll *ep)
+{
+	unsigned int i;
+	struct list_head *head;
+
+	/* no more callbacks, then nothing can touch the items */
+	down(&epsem);
+	for (i = 0; i < (1 << ep->hashbits); i++)
+		list_for_each(head, &ep->hash[i])
+			ep_unregister_pollwait(list_entry(head, struct epitem, llink));
+
+	down_write(&ep->sem);
+	for (i = 0; i < (1 << ep->hashbits); i++)
+		while (!list_empty(&ep->hash[i]))
+			ep_remove(ep, list_entry(ep->hash[i].next, struct epitem, llink));
+	up_write(&ep->sem);
+	up(&epsem);
+
+	kfree(ep->hash);
+	kfree(ep);
+}
+
+static int ep_eventpoll_close(struct inode *inode, struct file *file)
+{
+	struct eventpoll *ep = file->private_data;
+
+	if (ep)
+		ep_free(ep);
+	return 0;
+}
+
+static unsigned int ep_eventpoll_poll(struct file *file, poll_table *wait)
+{
+	struct eventpoll *ep = file->private_data;
+	unsigned int pollflags = 0;
+	unsigned long flags;
+
+	poll_wait(file, &ep->poll_wait, wait);
+
+	spin_lock_irqsave(&ep->lock, flags);
+	if (!list_empty(&ep->rdllist))
+		pollflags = POLLIN | POLLRDNORM;
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	return pollflags;
+}
+
+/*
+ * Move up to maxevents ready items over to txlist. The items stay linked
+ * on txlink only, so the callbacks can queue them again meanwhile.
+ */
+static int ep_collect_ready_items(struct eventpoll *ep, struct list_head *txlist,
+				  int maxevents)
+{
+	struct list_head *lnk;
+	struct epitem *epi;
+	unsigned long flags;
+	int nepi = 0;
+
+	spin_lock_irqsave(&ep->lock, flags);
+	for (lnk = ep->rdllist.next; lnk != &ep->rdllist && nepi < maxevents;) {
+		epi = list_entry(lnk, struct epitem, rdllink);
+		lnk = lnk->next;
+
+		if (list_empty(&epi->txlink)) {
+			list_add_tail(&epi->txlink, txlist);
+			nepi++;
+		}
+		list_del_init(&epi->rdllink);
+	}
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	return nepi;
+}
+
+/*
+ * Ask the collected items what is left of their events and copy them to
+ * user space. Sleeps in copy_to_user(), ep->sem keeps the items alive.
+ */
+static int ep_send_events(struct eventpoll *ep, struct list_head *txlist,
+			  struct epoll_event *events)
+{
+	struct list_head *lnk;
+	struct epitem *epi;
+	struct epoll_event ev;
+	int eventcnt = 0;
+
+	list_for_each(lnk, txlist) {
+		epi = list_entry(lnk, struct epitem, txlink);
+
+		epi->revents = epi->file->f_op->poll(epi->file, NULL) &
+				epi->event.events;
+		if (!epi->revents)
+			continue;
+
+		ev.events = epi->revents;
+		ev.data = epi->event.data;
+		if (__copy_to_user(&events[eventcnt], &ev, sizeof(ev)))
+			return eventcnt ? eventcnt : -EFAULT;
+		eventcnt++;
+		if (epi->event.events & EPOLLONESHOT)
+			epi->event.events &= EP_PRIVATE_BITS;
+	}
+	return eventcnt;
+}
+
+/*
+ * Level triggered items which still have events go back on the ready
+ * list, so the next epoll_wait() reports them again.
+ */
+static void ep_reinject_items(struct eventpoll *ep, struct list_head *txlist)
+{
+	struct epitem *epi;
+	unsigned long flags;
+	int ricnt = 0, pwake = 0;
+
+	spin_lock_irqsave(&ep->lock, flags);
+	while (!list_empty(txlist)) {
+		epi = list_entry(txlist->next, struct epitem, txlink);
+		list_del_init(&epi->txlink);
+
+		if (epi->revents && !(epi->event.events & EPOLLET) &&
+		    (epi->event.events & ~EP_PRIVATE_BITS) &&
+		    list_empty(&epi->rdllink)) {
+			list_add_tail(&epi->rdllink, &ep->rdllist);
+			ricnt++;
+		}
+	}
+	if (ricnt) {
+		if (waitqueue_active(&ep->wq))
+			wake_up(&ep->wq);
+		if (waitqueue_active(&ep->poll_wait))
+			pwake = 1;
+	}
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	if (pwake)
+		wake_up(&ep->poll_wait);
+}
+
+static int ep_events_transfer(struct eventpoll *ep, struct epoll_event *events,
+			      int maxevents)
+{
+	struct list_head txlist;
+	int eventcnt = 0;
+
+	INIT_LIST_HEAD(&txlist);
+
+	down_read(&ep->sem);
+	if (ep_collect_ready_items(ep, &txlist, maxevents) > 0) {
+		eventcnt = ep_send_events(ep, &txlist, events);
+		ep_reinject_items(ep, &txlist);
+	}
+	up_read(&ep->sem);
+
+	return eventcnt;
+}
+
+static int ep_poll(struct eventpoll *ep, struct epoll_event *events,
+		   int maxevents, long timeout)
+{
+	wait_queue_t wait;
+	unsigned long flags;
+	long jtimeout;
+	int res, eavail;
+
+	if (timeout < 0 || timeout >= (MAX_SCHEDULE_TIMEOUT - 1000) / HZ)
+		jtimeout = MAX_SCHEDULE_TIMEOUT;
+	else
+		jtimeout = (timeout * HZ + 999) / 1000;
+
+retry:
+	res = 0;
+	spin_lock_irqsave(&ep->lock, flags);
+	if (list_empty(&ep->rdllist)) {
+		init_waitqueue_entry(&wait, current);
+		add_wait_queue(&ep->wq, &wait);
+
+		for (;;) {
+			set_current_state(TASK_INTERRUPTIBLE);
+			if (!list_empty(&ep->rdllist) || !jtimeout)
+				break;
+			if (signal_pending(current)) {
+				res = -EINTR;
+				break;
+			}
+			spin_unlock_irqrestore(&ep->lock, flags);
+			jtimeout = schedule_timeout(jtimeout);
+			spin_lock_irqsave(&ep->lock, flags);
+		}
+		remove_wait_queue(&ep->wq, &wait);
+		set_current_state(TASK_RUNNING);
+	}
+	eavail = !list_empty(&ep->rdllist);
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	/* items may have gone idle again before we got to them */
+	if (!res && eavail &&
+	    !(res = ep_events_transfer(ep, events, maxevents)) && jtimeout)
+		goto retry;
+
+	return res;
+}
+
+static int eventpollfs_delete_dentry(struct dentry *dentry)
+{
+	return 1;
+}
+
+static const struct dentry_operations eventpollfs_dentry_operations = {
+	d_delete:	eventpollfs_delete_dentry,
+};
+
+/* like do_pipe(), the file lives on an internal filesystem */
+static int ep_getfd(int *efd, struct eventpoll *ep)
+{
+	struct qstr this;
+	char name[32];
+	struct dentry *dentry;
+	struct inode *inode;
+	struct file *file;
+	int error, fd;
+
+	error = -ENFILE;
+	file = get_empty_filp();
+	if (!file)
+		goto no_file;
+
+	error = -ENOMEM;
+	inode = new_inode(eventpoll_mnt->mnt_sb);
+	if (!inode)
+		goto close_file;
+	inode->i_fop = &eventpoll_fops;
+	/* never put on the dirty list, see get_pipe_inode() */
+	inode->i_state = I_DIRTY;
+	inode->i_mode = S_IRUSR | S_IWUSR;
+	inode->i_uid = current->fsuid;
+	inode->i_gid = current->fsgid;
+	inode->i_atime = inode->i_mtime = inode->i_ctime = CURRENT_TIME;
+	inode->i_blksize = PAGE_SIZE;
+
+	error = get_unused_fd();
+	if (error < 0)
+		goto close_file_inode;
+	fd = error;
+
+	error = -ENOMEM;
+	sprintf(name, "[%lu]", inode->i_ino);
+	this.name = name;
+	this.len = strlen(name);
+	this.hash = inode->i_ino;
+	dentry = d_alloc(eventpoll_mnt->mnt_sb->s_root, &this);
+	if (!dentry)
+		goto close_file_inode_fd;
+	dentry->d_op = &eventpollfs_dentry_operations;
+	d_add(dentry, inode);
+
+	file->f_vfsmnt = mntget(eventpoll_mnt);
+	file->f_dentry = dentry;
+	file->f_pos = 0;
+	file->f_flags = O_RDONLY;
+	file->f_op = &eventpoll_fops;
+	file->f_mode = FMODE_READ;
+	file->f_version = 0;
+	file->private_data = ep;
+
+	fd_install(fd, file);
+	*efd = fd;
+	return 0;
+
+close_file_inode_fd:
+	put_unused_fd(fd);
+close_file_inode:
+	iput(inode);
+close_file:
+	put_filp(file);
+no_file:
+	return error;
+}
+
+/*
+ * Create an epoll file, size is a hint for the number of descriptors
+ * it is going to watch.
+ */
+asmlinkage long sys_epoll_create(int size)
+{
+	struct eventpoll *ep;
+	int error, fd;
+
+	if (size <= 0)
+		return -EINVAL;
+
+	error = ep_alloc(&ep, size);
+	if (error)
+		return error;
+
+	error = ep_getfd(&fd, ep);
+	if (error) {
+		kfree(ep->hash);
+		kfree(ep);
+		return error;
+	}
+	return fd;
+}
+
+asmlinkage long sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+	struct file *file, *tfile;
+	struct eventpoll *ep;
+	struct epitem *epi;
+	struct epoll_event epds;
+	int error;
+
+	if (op != EPOLL_CTL_DEL &&
+	    copy_from_user(&epds, event, sizeof(struct epoll_event)))
+		return -EFAULT;
+
+	error = -EBADF;
+	file = fget(epfd);
+	if (!file)
+		goto out;
+	tfile = fget(fd);
+	if (!tfile)
+		goto out_fput;
+
+	/* the target file must support poll */
+	error = -EPERM;
+	if (!tfile->f_op || !tfile->f_op->poll)
+		goto out_tfput;
+
+	error = -EINVAL;
+	if (!is_file_epoll(file) || is_file_epoll(tfile))
+		goto out_tfput;
+
+	ep = file->private_data;
+
+	down_write(&ep->sem);
+
+	epi = ep_find(ep, tfile, fd);
+
+	error = -EINVAL;
+	switch (op) {
+	case EPOLL_CTL_ADD:
+		if (!epi) {
+			epds.events |= POLLERR | POLLHUP;
+			error = ep_insert(ep, &epds, tfile, fd);
+		} else
+			error = -EEXIST;
+		break;
+	case EPOLL_CTL_DEL:
+		if (epi) {
+			ep_remove(ep, epi);
+			error = 0;
+		} else
+			error = -ENOENT;
+		break;
+	case EPOLL_CTL_MOD:
+		if (epi) {
+			epds.events |= POLLERR | POLLHUP;
+			error = ep_modify(ep, epi, &epds);
+		} else
+			error = -ENOENT;
+		break;
+	}
+
+	up_write(&ep->sem);
+
+out_tfput:
+	fput(tfile);
+out_fput:
+	fput(file);
+out:
+	return error;
+}
+
+/*
+ * Wait up to timeout milliseconds, -1 meaning forever, for events on the
+ * epoll file and return up to maxevents of them.
+ */
+asmlinkage long sys_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+			       int timeout)
+{
+	struct file *file;
+	int error;
+
+	if (maxevents <= 0 || maxevents > EP_MAX_EVENTS)
+		return -EINVAL;
+
+	if (!access_ok(VERIFY_WRITE, events, maxevents * sizeof(struct epoll_event)))
+		return -EFAULT;
+
+	error = -EBADF;
+	file = fget(epfd);
+	if (!file)
+		goto out;
+
+	error = -EINVAL;
+	if (!is_file_epoll(file))
+		goto out_fput;
+
+	error = ep_poll(file->private_data, events, maxevents, timeout);
+
+out_fput:
+	fput(file);
+out:
+	return error;
+}
+
+static int eventpollfs_statfs(struct super_block *sb, struct statfs *buf)
+{
+	buf->f_type = EVENTPOLLFS_MAGIC;
+	buf->f_bsize = 1024;
+	buf->f_namelen = 255;
+	return 0;
+}
+
+static const struct super_operations eventpollfs_ops = {
+	statfs:		eventpollfs_statfs,
+};
+
+static struct super_block *eventpollfs_read_super(struct super_block *sb, void *data, int silent)
+{
+	struct inode *root = new_inode(sb);
+	if (!root)
+		return NULL;
+	root->i_mode = S_IFDIR | S_IRUSR | S_IWUSR;
+	root->i_uid = root->i_gid = 0;
+	root->i_atime = root->i_mtime = root->i_ctime = CURRENT_TIME;
+	sb->s_blocksize = 1024;
+	sb->s_blocksize_bits = 10;
+	sb->s_magic = EVENTPOLLFS_MAGIC;
+	sb->s_op = &eventpollfs_ops;
+	sb->s_root = d_alloc(NULL, &(const struct qstr) { "eventpoll:", 10, 0 });
+	if (!sb->s_root) {
+		iput(root);
+		return NULL;
+	}
+	sb->s_root->d_sb = sb;
+	sb->s_root->d_parent = sb->s_root;
+	d_instantiate(sb->s_root, root);
+	return sb;
+}
+
+static DECLARE_FSTYPE(eventpoll_fs_type, "eventpollfs", eventpollfs_read_super, FS_NOMOUNT);
+
+static int __init eventpoll_init(void)
+{
+	int err;
+
+	epi_cache = kmem_cache_create("eventpoll_epi", sizeof(struct epitem),
+				      0, SLAB_HWCACHE_ALIGN, NULL, NULL);
+	pwq_cache = kmem_cache_create("eventpoll_pwq", sizeof(struct eppoll_entry),
+				      0, 0, NULL, NULL);
+	if (!epi_cache || !pwq_cache)
+		panic("eventpoll_init: cannot create slab caches\n");
+
+	err = register_filesystem(&eventpoll_fs_type);
+	if (!err) {
+		eventpoll_mnt = kern_mount(&eventpoll_fs_type);
+		err = PTR_ERR(eventpoll_mnt);
+		if (IS_ERR(eventpoll_mnt))
+			unregister_filesystem(&eventpoll_fs_type);
+		else
+			err = 0;
+	}
+	return err;
+}
+
+module_init(eventpoll_init)
@@ -1388,6 +1388,26 @@ static int ext3_releasepage(struct page *page, int wait)
 	return journal_try_to_free_buffers(journal, page, wait);
 }
 
+/*
+ * Direct I/O never allocates blocks, that would need a transaction. Writes
+ * into holes or beyond EOF get -ENOTBLK from generic_direct_IO() and fall
+ * back to buffered I/O, as do all writes with data=journal.
+ */
+static int ext3_get_block_direct_io(struct inode *inode, long iblock,
+			struct buffer_head *bh_result, int create)
+{
+	return ext3_get_block_handle(NULL, inode, iblock, bh_result, 0);
+}
+
+static int ext3_direct_IO(int rw, struct inode *inode, struct kiobuf *iobuf,
+			  unsigned long blocknr, int blocksize)
+{
+	if (rw == WRITE && ext3_should_journal_data(inode))
+		return -ENOTBLK;
+	return generic_direct_IO(rw, inode, iobuf, blocknr, blocksize,
+				 ext3_get_block_direct_io);
+}
+
 
 const struct address_space_operations ext3_aops = {
 	readpage:	ext3_readpage,		/* BKL not held.  Don't need */
@@ -1398,6 +1418,7 @@ const struct address_space_operations ext3_aops = {
 	bmap:		ext3_bmap,		/* BKL held */
 	flushpage:	ext3_flushpage,		/* BKL not held.  Don't need */
 	releasepage:	ext3_releasepage,	/* BKL not held.  Don't need */
+	direct_IO:	ext3_direct_IO,		/* BKL not held.  Don't need */
 };
 
 /*
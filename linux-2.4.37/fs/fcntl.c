@@ -251,6 +251,22 @@ static int setfl(int fd, struct file * filp, unsigned long arg)
 	return 0;
 }
 
+static long fcntl_getrastat(struct file *filp, struct f_rastat *arg)
+{
+	struct file_ra_state *ra = &filp->f_ra;
+	struct f_rastat st;
+	int i;
+
+	st.hits = ra->hits;
+	st.misses = ra->misses;
+	st.readahead = ra->pages;
+	st.streams = 0;
+	for (i = 0; i < RA_STREAMS; i++)
+		if (ra->streams[i].size)
+			st.streams++;
+	return copy_to_user(arg, &st, sizeof(st)) ? -EFAULT : 0;
+}
+
 static long do_fcntl(unsigned int fd, unsigned int cmd,
 		     unsigned long arg, struct file * filp)
 {
@@ -326,6 +342,9 @@ static long do_fcntl(unsigned int fd, unsigned int cmd,
 		case F_NOTIFY:
 			err = fcntl_dirnotify(fd, filp, arg);
 			break;
+		case F_GETRASTAT:
+			err = fcntl_getrastat(filp, (struct f_rastat *) arg);
+			break;
 		default:
 			/* sockets need a few special fcntls. */
 			err = -EINVAL;
@@ -19,9 +19,10 @@ void end_kio_request(struct kiobuf *kiobuf, int uptodate)
 		kiobuf->errno = -EIO;
 
 	if (atomic_dec_and_test(&kiobuf->io_count)) {
+		wake_up(&kiobuf->wait_queue);
+		/* end_io may free the kiobuf */
 		if (kiobuf->end_io)
 			kiobuf->end_io(kiobuf);
-		wake_up(&kiobuf->wait_queue);
 	}
 }
 
@@ -35,6 +36,7 @@ static int kiobuf_init(struct kiobuf *iobuf)
 	iobuf->blocks = NULL;
 	atomic_set(&iobuf->io_count, 0);
 	iobuf->end_io = NULL;
+	iobuf->private = NULL;
 	return expand_kiobuf(iobuf, KIO_STATIC_PAGES);
 }
 
@@ -170,7 +170,7 @@ static int nfs_commit_write(struct file *file, struct page *page, unsigned offse
 }
 
 /*
- * The following is used by wait_on_page(), generic_file_readahead()
+ * The following is used by wait_on_page(), page_cache_readahead()
  * to initiate the completion of any page readahead operations.
  */
 static int nfs_sync_page(struct page *page)
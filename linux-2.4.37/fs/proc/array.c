@@ -656,6 +656,14 @@ int proc_pid_ipaddr(struct task_struct *task, char * buffer)
 }	 
 #endif
 
+int proc_pid_schedstat(struct task_struct *task, char * buffer)
+{
+	return sprintf(buffer, "%llu %llu %lu\n",
+		task->sched_info.cpu_time,
+		task->sched_info.run_delay,
+		task->sched_info.pcnt);
+}
+
 #ifdef CONFIG_SMP
 int proc_pid_cpu(struct task_struct *task, char * buffer)
 {
@@ -42,6 +42,7 @@ int proc_pid_stat(struct task_struct*,char*);
 int proc_pid_status(struct task_struct*,char*);
 int proc_pid_statm(struct task_struct*,char*);
 int proc_pid_cpu(struct task_struct*,char*);
+int proc_pid_schedstat(struct task_struct*,char*);
 #ifdef CONFIG_GRKERNSEC_PROC_IPADDR
 int proc_pid_ipaddr(struct task_struct*,char*);
 #endif
@@ -628,6 +629,7 @@ enum pid_directory_inos {
 	PROC_PID_STATM,
 	PROC_PID_MAPS,
 	PROC_PID_CPU,
+	PROC_PID_SCHEDSTAT,
 #ifdef CONFIG_GRKERNSEC_PROC_IPADDR
 	PROC_PID_IPADDR,
 #endif
@@ -646,6 +648,7 @@ static struct pid_entry base_stuff[] = {
 #ifdef CONFIG_SMP
   E(PROC_PID_CPU,	"cpu",		S_IFREG|S_IRUGO),
 #endif
+  E(PROC_PID_SCHEDSTAT,	"schedstat",	S_IFREG|S_IRUGO),
 #ifdef CONFIG_GRKERNSEC_PROC_IPADDR
   E(PROC_PID_IPADDR,	"ipaddr",	S_IFREG|S_IRUSR),
 #endif
@@ -1012,6 +1015,10 @@ static struct dentry *proc_base_lookup(struct inode *dir, struct dentry *dentry)
 			inode->u.proc_i.op.proc_read = proc_pid_cpu;
 			break;
 #endif
+		case PROC_PID_SCHEDSTAT:
+			inode->i_fop = &proc_info_file_operations;
+			inode->u.proc_i.op.proc_read = proc_pid_schedstat;
+			break;
 #ifdef CONFIG_GRKERNSEC_PROC_IPADDR
 		case PROC_PID_IPADDR:
 			inode->i_fop = &proc_info_file_operations;
@@ -238,6 +238,30 @@ static const struct file_operations proc_cpuinfo_operations = {
 	release:	seq_release,
 };
 
+extern const struct seq_operations schedstat_op;
+static int schedstat_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &schedstat_op);
+}
+static const struct file_operations proc_schedstat_operations = {
+	open:		schedstat_open,
+	read:		seq_read,
+	llseek:		seq_lseek,
+	release:	seq_release,
+};
+
+extern const struct seq_operations pagesets_op;
+static int pagesets_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &pagesets_op);
+}
+static const struct file_operations proc_pagesets_operations = {
+	open:		pagesets_open,
+	read:		seq_read,
+	llseek:		seq_lseek,
+	release:	seq_release,
+};
+
 #ifdef CONFIG_PROC_HARDWARE
 static int hardware_read_proc(char *page, char **start, off_t off,
 				 int count, int *eof, void *data)
@@ -654,6 +678,8 @@ void __init proc_misc_init(void)
 	if (entry)
 		entry->proc_fops = &proc_kmsg_operations;
 	create_seq_entry("cpuinfo", 0, &proc_cpuinfo_operations);
+	create_seq_entry("schedstat", 0, &proc_schedstat_operations);
+	create_seq_entry("pagesets", 0, &proc_pagesets_operations);
 #if defined(CONFIG_X86) && !defined(CONFIG_GRKERNSEC_PROC_ADD)
 	create_seq_entry("interrupts", 0, &proc_interrupts_operations);
 #elif defined(CONFIG_X86)
@@ -0,0 +1,589 @@
+/*
+ *  linux/fs/splice.c
+ *
+ *  splice(), tee() and vmsplice(): move data between a pipe and another
+ *  file, between two pipes, or from user memory into a pipe, by hanging
+ *  page references into the pipe's buffer ring instead of copying.
+ *
+ *  file -> pipe	page cache pages are referenced, not copied
+ *  pipe -> file	->sendpage() if the file has one (sockets), else
+ *			one copy through ->write()
+ *  pipe -> pipe	buffers are moved (splice) or shared (tee)
+ *  memory -> pipe	the user pages are pinned and referenced; they
+ *			must not be modified until the data was consumed
+ */
+
+#include <linux/mm.h>
+#include <linux/file.h>
+#include <linux/pagemap.h>
+#include <linux/uio.h>
+
+#include <asm/uaccess.h>
+
+static int page_cache_pipe_buf_pin(struct pipe_inode_info *info,
+				   struct pipe_buffer *buf)
+{
+	struct page *page = buf->page;
+	int error = 0;
+
+	if (!Page_Uptodate(page)) {
+		lock_page(page);
+		/* truncated or invalidated since it was spliced */
+		if (!page->mapping)
+			error = -ENODATA;
+		else if (!Page_Uptodate(page))
+			error = -EIO;
+		UnlockPage(page);
+	}
+	return error;
+}
+
+static int user_page_pipe_buf_pin(struct pipe_inode_info *info,
+				  struct pipe_buffer *buf)
+{
+	return 0;
+}
+
+static void page_pipe_buf_release(struct pipe_inode_info *info,
+				  struct pipe_buffer *buf)
+{
+	page_cache_release(buf->page);
+}
+
+static const struct pipe_buf_operations page_cache_pipe_buf_ops = {
+	can_merge:	0,
+	pin:		page_cache_pipe_buf_pin,
+	release:	page_pipe_buf_release,
+};
+
+static const struct pipe_buf_operations user_page_pipe_buf_ops = {
+	can_merge:	0,
+	pin:		user_page_pipe_buf_pin,
+	release:	page_pipe_buf_release,
+};
+
+static inline struct inode *get_pipe(struct file *file)
+{
+	struct inode *inode = file->f_dentry->d_inode;
+
+	if (S_ISFIFO(inode->i_mode) && inode->i_pipe)
+		return inode;
+	return NULL;
+}
+
+static inline struct pipe_buffer *pipe_tail(struct pipe_inode_info *info)
+{
+	return info->bufs + ((info->curbuf + info->nrbufs) & (PIPE_BUFFERS - 1));
+}
+
+static void pipe_consume(struct pipe_inode_info *info, struct pipe_buffer *buf)
+{
+	buf->ops->release(info, buf);
+	buf->ops = NULL;
+	info->curbuf = (info->curbuf + 1) & (PIPE_BUFFERS - 1);
+	info->nrbufs--;
+}
+
+/*
+ * Wait until the pipe has a free buffer, with PIPE_SEM held. Like
+ * write(), no readers yields SIGPIPE.
+ */
+static int pipe_wait_writable(struct inode *pipe, int nonblock)
+{
+	for (;;) {
+		if (!PIPE_READERS(*pipe)) {
+			send_sig(SIGPIPE, current, 0);
+			return -EPIPE;
+		}
+		if (!PIPE_FULL(*pipe))
+			return 0;
+		if (nonblock)
+			return -EAGAIN;
+		if (signal_pending(current))
+			return -ERESTARTSYS;
+		PIPE_WAITING_WRITERS(*pipe)++;
+		pipe_wait(pipe);
+		PIPE_WAITING_WRITERS(*pipe)--;
+	}
+}
+
+/*
+ * Wait until the pipe has data, with PIPE_SEM held. Returns 0 with the
+ * pipe still empty if there are no writers left.
+ */
+static int pipe_wait_readable(struct inode *pipe, int nonblock)
+{
+	while (PIPE_EMPTY(*pipe)) {
+		if (!PIPE_WRITERS(*pipe))
+			break;
+		if (nonblock)
+			return -EAGAIN;
+		if (signal_pending(current))
+			return -ERESTARTSYS;
+		PIPE_WAITING_READERS(*pipe)++;
+		pipe_wait(pipe);
+		PIPE_WAITING_READERS(*pipe)--;
+	}
+	return 0;
+}
+
+/*
+ * Read actor for do_generic_file_read(): hang the page cache page into
+ * the pipe, until the pipe is full.
+ */
+static int pipe_splice_actor(read_descriptor_t * desc, struct page *page, unsigned long offset, unsigned long size)
+{
+	struct inode *pipe = (struct inode *) desc->buf;
+	struct pipe_inode_info *info = pipe->i_pipe;
+	struct pipe_buffer *buf;
+
+	if (PIPE_FULL(*pipe))
+		return 0;
+	if (size > desc->count)
+		size = desc->count;
+
+	buf = pipe_tail(info);
+	page_cache_get(page);
+	buf->page = page;
+	buf->offset = offset;
+	buf->len = size;
+	buf->ops = &page_cache_pipe_buf_ops;
+	info->nrbufs++;
+
+	desc->count -= size;
+	desc->written += size;
+	return size;
+}
+
+static long splice_file_to_pipe(struct file *in, loff_t *ppos,
+				struct inode *pipe, size_t len,
+				unsigned int flags)
+{
+	read_descriptor_t desc;
+	long ret;
+
+	if (down_interruptible(PIPE_SEM(*pipe)))
+		return -ERESTARTSYS;
+
+	desc.written = 0;
+	ret = pipe_wait_writable(pipe, flags & SPLICE_F_NONBLOCK);
+	if (!ret) {
+		desc.count = len;
+		desc.buf = (char *) pipe;
+		desc.error = 0;
+		do_generic_file_read(in, ppos, &desc, pipe_splice_actor);
+
+		ret = desc.written;
+		if (!ret)
+			ret = desc.error;
+	}
+	up(PIPE_SEM(*pipe));
+
+	if (desc.written)
+		wake_up_interruptible(PIPE_WAIT(*pipe));
+	return ret;
+}
+
+static ssize_t splice_write_page(struct file *out, struct page *page,
+				 unsigned int offset, size_t size,
+				 loff_t *ppos, int more)
+{
+	mm_segment_t old_fs;
+	ssize_t written;
+	char *kaddr;
+
+	if (out->f_op->sendpage)
+		return out->f_op->sendpage(out, page, offset, size, ppos, more);
+
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	kaddr = kmap(page);
+	written = out->f_op->write(out, kaddr + offset, size, ppos);
+	kunmap(page);
+	set_fs(old_fs);
+	return written;
+}
+
+static long splice_pipe_to_file(struct inode *pipe, struct file *out,
+				loff_t *ppos, size_t len, unsigned int flags)
+{
+	struct pipe_inode_info *info;
+	int do_wakeup = 0;
+	long ret = 0;
+
+	if (down_interruptible(PIPE_SEM(*pipe)))
+		return -ERESTARTSYS;
+
+	info = pipe->i_pipe;
+	while (len) {
+		struct pipe_buffer *buf;
+		ssize_t written;
+		size_t chars;
+		int error, more;
+
+		if (PIPE_EMPTY(*pipe)) {
+			/* as in pipe_read(), stop once we have something */
+			if (ret && !PIPE_WAITING_WRITERS(*pipe))
+				break;
+			if (do_wakeup) {
+				wake_up_interruptible_sync(PIPE_WAIT(*pipe));
+				do_wakeup = 0;
+			}
+			error = pipe_wait_readable(pipe, flags & SPLICE_F_NONBLOCK);
+			if (error) {
+				if (!ret)
+					ret = error;
+				break;
+			}
+			if (PIPE_EMPTY(*pipe))
+				break;
+		}
+
+		buf = info->bufs + info->curbuf;
+		chars = buf->len;
+		if (chars > len)
+			chars = len;
+		more = (flags & SPLICE_F_MORE) || chars < len;
+
+		error = buf->ops->pin(info, buf);
+		if (error) {
+			if (!ret)
+				ret = error;
+			break;
+		}
+		written = splice_write_page(out, buf->page, buf->offset,
+					    chars, ppos, more);
+		if (written <= 0) {
+			if (!ret)
+				ret = written;
+			break;
+		}
+
+		ret += written;
+		len -= written;
+		buf->offset += written;
+		buf->len -= written;
+		if (!buf->len) {
+			pipe_consume(info, buf);
+			do_wakeup = 1;
+		}
+		if (written < chars)
+			break;
+	}
+	up(PIPE_SEM(*pipe));
+
+	if (do_wakeup)
+		wake_up_interruptible(PIPE_WAIT(*pipe));
+	return ret;
+}
+
+/*
+ * Move (splice) or share (tee) buffers from one pipe to another. Both
+ * pipes are waited on separately first, so the double lock never
+ * sleeps.
+ */
+static long splice_pipe_to_pipe(struct inode *ipipe, struct inode *opipe,
+				size_t len, unsigned int flags, int move)
+{
+	int nonblock = flags & SPLICE_F_NONBLOCK;
+	struct pipe_inode_info *iinfo, *oinfo;
+	unsigned int i;
+	long ret;
+
+	if (ipipe == opipe)
+		return -EINVAL;
+
+	if (down_interruptible(PIPE_SEM(*ipipe)))
+		return -ERESTARTSYS;
+	ret = pipe_wait_readable(ipipe, nonblock);
+	up(PIPE_SEM(*ipipe));
+	if (ret)
+		return ret;
+
+	if (down_interruptible(PIPE_SEM(*opipe)))
+		return -ERESTARTSYS;
+	ret = pipe_wait_writable(opipe, nonblock);
+	up(PIPE_SEM(*opipe));
+	if (ret)
+		return ret;
+
+	double_down(PIPE_SEM(*ipipe), PIPE_SEM(*opipe));
+	iinfo = ipipe->i_pipe;
+	oinfo = opipe->i_pipe;
+	i = 0;
+	while (len && i < iinfo->nrbufs && !PIPE_FULL(*opipe)) {
+		struct pipe_buffer *ibuf, *obuf;
+
+		ibuf = iinfo->bufs + ((iinfo->curbuf + i) & (PIPE_BUFFERS - 1));
+		obuf = pipe_tail(oinfo);
+		*obuf = *ibuf;
+		if (obuf->len > len)
+			obuf->len = len;
+
+		if (move && ibuf->len == obuf->len) {
+			/* the whole buffer changes hands */
+			ibuf->ops = NULL;
+			iinfo->curbuf = (iinfo->curbuf + 1) & (PIPE_BUFFERS - 1);
+			iinfo->nrbufs--;
+		} else {
+			page_cache_get(obuf->page);
+			if (move) {
+				ibuf->offset += obuf->len;
+				ibuf->len -= obuf->len;
+			} else
+				i++;
+		}
+		oinfo->nrbufs++;
+		ret += obuf->len;
+		len -= obuf->len;
+	}
+	double_up(PIPE_SEM(*ipipe), PIPE_SEM(*opipe));
+
+	if (ret) {
+		wake_up_interruptible(PIPE_WAIT(*opipe));
+		if (move)
+			wake_up_interruptible(PIPE_WAIT(*ipipe));
+	}
+	return ret;
+}
+
+static long do_splice_to(struct file *in, loff_t *off_in,
+			 struct inode *pipe, size_t len, unsigned int flags)
+{
+	struct inode *inode = in->f_dentry->d_inode;
+	loff_t pos, *ppos = &in->f_pos;
+	long ret;
+
+	if (!inode->i_mapping->a_ops->readpage)
+		return -EINVAL;
+	if (off_in) {
+		if (copy_from_user(&pos, off_in, sizeof(loff_t)))
+			return -EFAULT;
+		ppos = &pos;
+	}
+	ret = rw_verify_area(READ, in, ppos, len);
+	if (ret)
+		return ret;
+
+	ret = splice_file_to_pipe(in, ppos, pipe, len, flags);
+	if (off_in && put_user(pos, off_in))
+		ret = -EFAULT;
+	return ret;
+}
+
+static long do_splice_from(struct inode *pipe, struct file *out,
+			   loff_t *off_out, size_t len, unsigned int flags)
+{
+	loff_t pos, *ppos = &out->f_pos;
+	long ret;
+
+	if (!out->f_op || !out->f_op->write)
+		return -EINVAL;
+	if (off_out) {
+		if (copy_from_user(&pos, off_out, sizeof(loff_t)))
+			return -EFAULT;
+		ppos = &pos;
+	}
+	ret = rw_verify_area(WRITE, out, ppos, len);
+	if (ret)
+		return ret;
+
+	ret = splice_pipe_to_file(pipe, out, ppos, len, flags);
+	if (off_out && put_user(pos, off_out))
+		ret = -EFAULT;
+	return ret;
+}
+
+asmlinkage long sys_splice(int fd_in, loff_t *off_in, int fd_out,
+			   loff_t *off_out, size_t len, unsigned int flags)
+{
+	struct inode *ipipe, *opipe;
+	struct file *in, *out;
+	long ret;
+
+	if (!len)
+		return 0;
+
+	ret = -EBADF;
+	in = fget(fd_in);
+	if (!in)
+		goto out;
+	if (!(in->f_mode & FMODE_READ))
+		goto fput_in;
+	out = fget(fd_out);
+	if (!out)
+		goto fput_in;
+	if (!(out->f_mode & FMODE_WRITE))
+		goto fput_out;
+
+	ipipe = get_pipe(in);
+	opipe = get_pipe(out);
+	ret = -ESPIPE;
+	if ((ipipe && off_in) || (opipe && off_out))
+		goto fput_out;
+
+	if (ipipe && opipe)
+		ret = splice_pipe_to_pipe(ipipe, opipe, len, flags, 1);
+	else if (ipipe)
+		ret = do_splice_from(ipipe, out, off_out, len, flags);
+	else if (opipe)
+		ret = do_splice_to(in, off_in, opipe, len, flags);
+	else
+		ret = -EINVAL;
+
+fput_out:
+	fput(out);
+fput_in:
+	fput(in);
+out:
+	return ret;
+}
+
+/*
+ * Duplicate up to len bytes of one pipe into another without consuming
+ * them, so the same pages can be spliced to two places.
+ */
+asmlinkage long sys_tee(int fd_in, int fd_out, size_t len, unsigned int flags)
+{
+	struct inode *ipipe, *opipe;
+	struct file *in, *out;
+	long ret;
+
+	if (!len)
+		return 0;
+
+	ret = -EBADF;
+	in = fget(fd_in);
+	if (!in)
+		goto out;
+	if (!(in->f_mode & FMODE_READ))
+		goto fput_in;
+	out = fget(fd_out);
+	if (!out)
+		goto fput_in;
+	if (!(out->f_mode & FMODE_WRITE))
+		goto fput_out;
+
+	ipipe = get_pipe(in);
+	opipe = get_pipe(out);
+	ret = -EINVAL;
+	if (ipipe && opipe)
+		ret = splice_pipe_to_pipe(ipipe, opipe, len, flags, 0);
+
+fput_out:
+	fput(out);
+fput_in:
+	fput(in);
+out:
+	return ret;
+}
+
+/*
+ * Pin the user pages of one iovec segment and hang them into the pipe,
+ * with PIPE_SEM held.
+ */
+static long vmsplice_segment(struct inode *pipe, unsigned long base,
+			     size_t len, int nonblock)
+{
+	struct pipe_inode_info *info = pipe->i_pipe;
+	struct page *pages[PIPE_BUFFERS];
+	long ret = 0;
+
+	while (len) {
+		int i, npages, error;
+
+		error = pipe_wait_writable(pipe, nonblock);
+		if (error)
+			return ret ? ret : error;
+
+		npages = ((base & ~PAGE_MASK) + len + PAGE_SIZE - 1) >> PAGE_SHIFT;
+		if (npages > PIPE_BUFFERS - info->nrbufs)
+			npages = PIPE_BUFFERS - info->nrbufs;
+
+		down_read(&current->mm->mmap_sem);
+		npages = get_user_pages(current, current->mm, base & PAGE_MASK,
+					npages, 0, 0, pages, NULL);
+		up_read(&current->mm->mmap_sem);
+		if (npages <= 0)
+			return ret ? ret : -EFAULT;
+
+		for (i = 0; i < npages; i++) {
+			struct pipe_buffer *buf = pipe_tail(info);
+			unsigned int offset = base & ~PAGE_MASK;
+			size_t chars = PAGE_SIZE - offset;
+
+			if (chars > len)
+				chars = len;
+			buf->page = pages[i];
+			buf->offset = offset;
+			buf->len = chars;
+			buf->ops = &user_page_pipe_buf_ops;
+			info->nrbufs++;
+
+			base += chars;
+			len -= chars;
+			ret += chars;
+		}
+		wake_up_interruptible(PIPE_WAIT(*pipe));
+	}
+	return ret;
+}
+
+asmlinkage long sys_vmsplice(int fd, const struct iovec *iov,
+			     unsigned long nr_segs, unsigned int flags)
+{
+	struct inode *pipe;
+	struct file *file;
+	long ret;
+
+	ret = -EBADF;
+	file = fget(fd);
+	if (!file)
+		goto out;
+	if (!(file->f_mode & FMODE_WRITE))
+		goto fput;
+	ret = -EINVAL;
+	pipe = get_pipe(file);
+	if (!pipe || nr_segs > UIO_MAXIOV)
+		goto fput;
+
+	ret = -ERESTARTSYS;
+	if (down_interruptible(PIPE_SEM(*pipe)))
+		goto fput;
+
+	ret = 0;
+	for (; nr_segs; nr_segs--, iov++) {
+		struct iovec v;
+		long done;
+
+		if (copy_from_user(&v, iov, sizeof(v))) {
+			if (!ret)
+				ret = -EFAULT;
+			break;
+		}
+		if (!v.iov_len)
+			continue;
+		if (!access_ok(VERIFY_READ, v.iov_base, v.iov_len)) {
+			if (!ret)
+				ret = -EFAULT;
+			break;
+		}
+
+		done = vmsplice_segment(pipe, (unsigned long) v.iov_base,
+					v.iov_len, flags & SPLICE_F_NONBLOCK);
+		if (done < 0) {
+			if (!ret)
+				ret = done;
+			break;
+		}
+		ret += done;
+		if (done < v.iov_len)
+			break;
+	}
+	up(PIPE_SEM(*pipe));
+
+fput:
+	fput(file);
+out:
+	return ret;
+}
@@ -304,10 +304,7 @@ int unionfs_file_revalidate(struct file *file, int willwrite)
 			 */
 			if (file->f_reada) {
 				hidden_file->f_reada = file->f_reada;
-				hidden_file->f_ramax = file->f_ramax;
-				hidden_file->f_raend = file->f_raend;
-				hidden_file->f_ralen = file->f_ralen;
-				hidden_file->f_rawin = file->f_rawin;
+				hidden_file->f_ra = file->f_ra;
 			}
 #else
 			memcpy(&(hidden_file->f_ra), &(file->f_ra),
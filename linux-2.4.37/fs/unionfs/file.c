@@ -50,10 +50,7 @@ static loff_t unionfs_llseek(struct file *file, loff_t offset, int origin)
 	 */
 	if (file->f_reada) {
 		hidden_file->f_reada = file->f_reada;
-		hidden_file->f_ramax = file->f_ramax;
-		hidden_file->f_raend = file->f_raend;
-		hidden_file->f_ralen = file->f_ralen;
-		hidden_file->f_rawin = file->f_rawin;
+		hidden_file->f_ra = file->f_ra;
 	}
 #else
 	memcpy(&(hidden_file->f_ra), &(file->f_ra),
@@ -121,10 +118,7 @@ static ssize_t unionfs_read(struct file *file, char *buf, size_t count,
 		hidden_file->f_pos = *ppos = pos;
 	if (hidden_file->f_reada) {	/* update readahead information if needed */
 		file->f_reada = hidden_file->f_reada;
-		file->f_ramax = hidden_file->f_ramax;
-		file->f_raend = hidden_file->f_raend;
-		file->f_ralen = hidden_file->f_ralen;
-		file->f_rawin = hidden_file->f_rawin;
+		file->f_ra = hidden_file->f_ra;
 	}
 #else
 	memcpy(&(file->f_ra), &(hidden_file->f_ra),
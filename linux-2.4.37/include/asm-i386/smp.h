@@ -35,6 +35,13 @@ extern volatile unsigned long smp_invalidate_needed;
 extern int pic_mode;
 extern int smp_num_siblings;
 extern int cpu_sibling_map[];
+extern int cpu_node_map[];
+extern int phys_proc_id[];
+
+/* CPU topology for the scheduler domains, see kernel/sched.c */
+#define cpu_sibling(cpu)	(smp_num_siblings > 1 ? cpu_sibling_map[cpu] : NO_PROC_ID)
+#define cpu_to_package(cpu)	(smp_num_siblings > 1 ? phys_proc_id[cpu] : 0)
+#define cpu_to_node(cpu)	(cpu_node_map[cpu])
 
 extern void smp_flush_tlb(void);
 extern void smp_message_irq(int cpl, void *dev_id, struct pt_regs *regs);
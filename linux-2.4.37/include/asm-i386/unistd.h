@@ -258,8 +258,14 @@
 #define __NR_free_hugepages	251
 #define __NR_exit_group		252
 #define __NR_lookup_dcookie	253
+#define __NR_epoll_create	254
+#define __NR_epoll_ctl		255
+#define __NR_epoll_wait		256
 #define __NR_set_tid_address	258
 #define __NR_tgkill		270
+#define __NR_splice		313
+#define __NR_tee		315
+#define __NR_vmsplice		316
 
 /* user-visible error numbers are in the range -1 - -124: see <asm-i386/errno.h> */
 
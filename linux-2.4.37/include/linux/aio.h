@@ -0,0 +1,63 @@
+#ifndef _LINUX_AIO_H
+#define _LINUX_AIO_H
+
+#include <linux/list.h>
+#include <linux/tqueue.h>
+#include <linux/aio_abi.h>
+
+struct kioctx;
+struct kiobuf;
+struct file;
+struct mm_struct;
+
+/*
+ * One asynchronous request. O_DIRECT reads and writes are handed to the
+ * block layer and complete from ki_iobuf->end_io, the request is then
+ * finished from keventd in ki_tq. Everything else runs synchronously in
+ * io_submit().
+ */
+struct kiocb {
+	struct list_head	ki_list;	/* ctx->active_reqs */
+	struct kioctx		*ki_ctx;
+	struct file		*ki_filp;
+	struct iocb		*ki_obj;	/* user iocb, for cancel and events */
+	__u64			ki_user_data;
+	int			ki_rw;
+	char			*ki_buf;
+	size_t			ki_nbytes;
+	loff_t			ki_pos;
+	struct kiobuf		*ki_iobuf;
+	struct tq_struct	ki_tq;
+};
+
+/* an io_setup() context, the event ring is kernel memory */
+struct kioctx {
+	atomic_t		users;
+	int			dead;
+	struct mm_struct	*mm;
+	aio_context_t		user_id;
+	struct kioctx		*next;		/* mm->ioctx_list */
+
+	wait_queue_head_t	wait;
+
+	spinlock_t		ctx_lock;
+	int			reqs_active;
+	struct list_head	active_reqs;
+	unsigned		max_reqs;
+
+	/* completed events, head == tail means empty */
+	struct io_event		*ring;
+	unsigned		ring_nr;
+	unsigned		head;
+	unsigned		tail;
+
+	/* spare kiobufs, allocating their buffer heads is expensive */
+	int			nr_iobufs;
+	struct kiobuf		*iobufs[8];
+};
+
+extern int aio_nr, aio_max_nr;
+
+extern void exit_aio(struct mm_struct *mm);
+
+#endif
@@ -6,6 +6,8 @@
 #include <asm/atomic.h>
 #include <linux/mount.h>
 #include <linux/kernel.h>
+#include <linux/spinlock.h>
+#include <linux/rcupdate.h>
 
 /*
  * linux/include/linux/dcache.h
@@ -66,11 +68,12 @@ static __inline__ unsigned int full_name_hash(const unsigned char * name, unsign
 
 struct dentry {
 	atomic_t d_count;
+	spinlock_t d_lock;		/* lookup vs. d_move and the last dput */
 	unsigned int d_flags;
 	struct inode  * d_inode;	/* Where the name belongs to - NULL is negative */
 	struct dentry * d_parent;	/* parent directory */
 	struct list_head d_hash;	/* lookup hash list */
-	struct list_head d_lru;		/* d_count = 0 LRU list */
+	struct list_head d_lru;		/* LRU list, see prune_dcache() */
 	struct list_head d_child;	/* child of parent list */
 	struct list_head d_subdirs;	/* our children */
 	struct list_head d_alias;	/* inode alias list */
@@ -81,6 +84,7 @@ struct dentry {
 	struct super_block * d_sb;	/* The root of the dentry tree */
 	unsigned long d_vfs_flags;
 	void * d_fsdata;		/* fs-specific data */
+	struct rcu_head d_rcu;		/* deferred freeing, see d_free() */
 	unsigned char d_iname[DNAME_INLINE_LEN]; /* small names */
 };
 
@@ -102,13 +106,16 @@ struct dentry_operations {
 
 /*
 locking rules:
-		big lock	dcache_lock	may block
-d_revalidate:	no		no		yes
-d_hash		no		no		yes
-d_compare:	no		yes		no
-d_delete:	no		yes		no
-d_release:	no		no		yes
-d_iput:		no		no		yes
+		big lock	dcache_lock	d_lock		may block
+d_revalidate:	no		no		no		yes
+d_hash		no		no		no		yes
+d_compare:	no		no		yes		no
+d_delete:	no		yes		yes		no
+d_release:	no		no		no		yes
+d_iput:		no		no		no		yes
+
+d_compare is called with the d_lock of the candidate dentry held, the
+parent may be walked concurrently.
  */
 
 /* d_flags entries */
@@ -127,6 +134,20 @@ d_iput:		no		no		yes
 
 extern spinlock_t dcache_lock;
 
+/*
+ * d_lookup() walks the hash chains without dcache_lock, so an unhashed
+ * dentry keeps its ->d_hash.next pointing into the chain for whoever is
+ * standing on it, and a NULL ->d_hash.prev marks it unhashed instead.
+ * Called with dcache_lock and dentry->d_lock held.
+ */
+static __inline__ void __d_drop(struct dentry * dentry)
+{
+	if (dentry->d_hash.prev) {
+		__list_del(dentry->d_hash.prev, dentry->d_hash.next);
+		dentry->d_hash.prev = NULL;
+	}
+}
+
 /**
  * d_drop - drop a dentry
  * @dentry: dentry to drop
@@ -143,12 +164,12 @@ extern spinlock_t dcache_lock;
  * to invalidate a dentry for some reason (NFS
  * timeouts or autofs deletes).
  */
-
 static __inline__ void d_drop(struct dentry * dentry)
 {
 	spin_lock(&dcache_lock);
-	list_del(&dentry->d_hash);
-	INIT_LIST_HEAD(&dentry->d_hash);
+	spin_lock(&dentry->d_lock);
+	__d_drop(dentry);
+	spin_unlock(&dentry->d_lock);
 	spin_unlock(&dcache_lock);
 }
 
@@ -262,7 +283,7 @@ extern struct dentry * dget_locked(struct dentry *);
  
 static __inline__ int d_unhashed(struct dentry *dentry)
 {
-	return list_empty(&dentry->d_hash);
+	return dentry->d_hash.prev == NULL;
 }
 
 extern void dput(struct dentry *);
@@ -0,0 +1,71 @@
+/*
+ *  include/linux/eventpoll.h
+ *
+ *  Event notification on a persistent set of file descriptors.
+ */
+
+#ifndef _LINUX_EVENTPOLL_H
+#define _LINUX_EVENTPOLL_H
+
+#include <linux/types.h>
+#include <asm/poll.h>
+
+/* Valid opcodes to issue to sys_epoll_ctl() */
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+/* Event masks, the POLL* bits plus the ones below */
+#define EPOLLIN		POLLIN
+#define EPOLLPRI	POLLPRI
+#define EPOLLOUT	POLLOUT
+#define EPOLLERR	POLLERR
+#define EPOLLHUP	POLLHUP
+#define EPOLLRDNORM	POLLRDNORM
+#define EPOLLRDBAND	POLLRDBAND
+#define EPOLLWRNORM	POLLWRNORM
+#define EPOLLWRBAND	POLLWRBAND
+#define EPOLLMSG	POLLMSG
+
+/* report an event only once, until the item is rearmed by EPOLL_CTL_MOD */
+#define EPOLLONESHOT	(1 << 30)
+
+/* report an event only when it happens, not as long as the file is ready */
+#define EPOLLET		(1 << 31)
+
+struct epoll_event {
+	__u32 events;
+	__u64 data;
+} __attribute__ ((packed));
+
+#ifdef __KERNEL__
+
+#include <linux/fs.h>
+
+static inline void eventpoll_init_file(struct file *file)
+{
+	INIT_LIST_HEAD(&file->f_ep_links);
+	spin_lock_init(&file->f_ep_lock);
+}
+
+extern void eventpoll_release_file(struct file *file);
+
+/*
+ * Called by fput() when the last reference is dropped. Nobody can add
+ * the file to an epoll set any more, so the list is checked unlocked.
+ */
+static inline void eventpoll_release(struct file *file)
+{
+	if (likely(list_empty(&file->f_ep_links)))
+		return;
+	eventpoll_release_file(file);
+}
+
+asmlinkage long sys_epoll_create(int size);
+asmlinkage long sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+asmlinkage long sys_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+			       int timeout);
+
+#endif /* __KERNEL__ */
+
+#endif
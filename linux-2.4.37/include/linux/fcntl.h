@@ -12,6 +12,19 @@
  */
 #define F_NOTIFY	(F_LINUX_SPECIFIC_BASE+2)
 
+/*
+ * Read-ahead statistics of an open file, filled in by
+ * fcntl(fd, F_GETRASTAT, struct f_rastat *).
+ */
+#define F_GETRASTAT	(F_LINUX_SPECIFIC_BASE+3)
+
+struct f_rastat {
+	unsigned long	hits;		/* pages found in the page cache */
+	unsigned long	misses;		/* pages read on demand */
+	unsigned long	readahead;	/* pages in read-ahead windows */
+	unsigned long	streams;	/* sequential streams followed */
+};
+
 /*
  * Types of directory notifications that may be requested.
  */
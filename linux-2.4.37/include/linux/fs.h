@@ -21,6 +21,7 @@
 #include <linux/cache.h>
 #include <linux/stddef.h>
 #include <linux/string.h>
+#include <linux/radix-tree.h>
 
 #include <asm/atomic.h>
 #include <asm/bitops.h>
@@ -407,7 +408,18 @@ struct address_space_operations {
 	void (*removepage)(struct page *); /* called when page gets removed from the inode */
 };
 
+/*
+ * Radix tree tags of the page cache. PAGECACHE_TAG_DIRTY is set on the
+ * pages on the dirty_pages list, PAGECACHE_TAG_WRITEBACK on those moved
+ * to the locked_pages list by filemap_fdatasync() until
+ * filemap_fdatawait() has waited on them.
+ */
+#define PAGECACHE_TAG_DIRTY	0
+#define PAGECACHE_TAG_WRITEBACK	1
+
 struct address_space {
+	struct radix_tree_root	page_tree;	/* radix tree of all pages */
+	spinlock_t		page_lock;	/* and spinlock protecting it */
 	struct list_head	clean_pages;	/* list of clean pages */
 	struct list_head	dirty_pages;	/* list of dirty pages */
 	struct list_head	locked_pages;	/* list of locked pages */
@@ -559,6 +571,33 @@ static inline void inode_set_bytes(struct inode *inode, loff_t bytes)
 	inode->i_bytes = bytes & 511;
 }
 
+/*
+ * Read-ahead state of an open file, see the comment above
+ * page_cache_readahead() in mm/filemap.c. Each stream follows one
+ * reader of the file, forwards or backwards.
+ */
+#define RA_STREAMS	4
+
+struct file_ra_stream {
+	unsigned long	prev;		/* first page of the last request */
+	unsigned long	next;		/* page after the last request */
+	unsigned long	start;		/* current window */
+	unsigned long	size;		/* pages in it, 0 until sequential */
+	unsigned long	ahead_start;	/* next window, read asynchronously */
+	unsigned long	ahead_size;
+	unsigned long	stamp;		/* last use, 0 if free */
+	unsigned int	misses;		/* window pages gone before use */
+	int		backward;
+};
+
+struct file_ra_state {
+	struct file_ra_stream streams[RA_STREAMS];
+	unsigned long	stamp;
+	unsigned long	hits;		/* pages found in the page cache */
+	unsigned long	misses;		/* pages that had to be read on demand */
+	unsigned long	pages;		/* pages in read-ahead windows */
+};
+
 struct fown_struct {
 	int pid;		/* pid or -pgrp where SIGIO should be sent */
 	uid_t uid, euid;	/* uid/euid of process setting the owner */
@@ -574,7 +613,8 @@ struct file {
 	unsigned int 		f_flags;
 	mode_t			f_mode;
 	loff_t			f_pos;
-	unsigned long 		f_reada, f_ramax, f_raend, f_ralen, f_rawin;
+	unsigned long 		f_reada;
+	struct file_ra_state	f_ra;
 	struct fown_struct	f_owner;
 	unsigned int		f_uid, f_gid;
 	int			f_error;
@@ -588,6 +628,10 @@ struct file {
 	/* preallocated helper kiobuf to speedup O_DIRECT */
 	struct kiobuf		*f_iobuf;
 	long			f_iobuf_lock;
+
+	/* epoll items watching this file, see fs/eventpoll.c */
+	struct list_head	f_ep_links;
+	spinlock_t		f_ep_lock;
 };
 extern spinlock_t files_lock;
 #define file_list_lock() spin_lock(&files_lock);
@@ -1267,6 +1311,7 @@ static inline void mark_buffer_dirty_inode(struct buffer_head *bh, struct inode
 extern void set_buffer_flushtime(struct buffer_head *);
 extern int get_buffer_flushtime(void);
 extern void balance_dirty(void);
+extern void balance_dirty_dev(kdev_t);
 extern int check_disk_change(kdev_t);
 extern int invalidate_inodes(struct super_block *);
 extern int invalidate_device(kdev_t, int);
@@ -0,0 +1,58 @@
+#ifndef _LINUX_HRTIMER_H
+#define _LINUX_HRTIMER_H
+
+#include <linux/config.h>
+#include <linux/list.h>
+#include <linux/timer.h>
+#include <asm/param.h>
+
+/*
+ * High resolution timers. Expiry is kept in nanoseconds of the local
+ * clock of the CPU the timer was started on and the callback runs from
+ * the local timer interrupt of that CPU, with interrupts disabled: it
+ * must not sleep and should do little more than wake somebody up.
+ *
+ * The part of a delay spanning whole jiffies is waited for on the
+ * ordinary timer wheel via the embedded timer_list, only the remainder
+ * goes into the per-CPU hrtimer queue and reprograms the local APIC
+ * timer. Without a TSC and local APIC timer hrtimers fall back to
+ * jiffy resolution, hrtimer_available() tells which one is in use.
+ */
+struct hrtimer {
+	struct list_head list;
+	unsigned long long expires;
+	unsigned long data;
+	void (*function)(unsigned long);
+	int cpu;
+	int active;
+	struct timer_list timer;
+};
+
+/* shortest delay or interval honoured, to keep callers from flooding irqs */
+#define HRTIMER_MIN_NS		10000ULL
+#define HRTIMER_TICK_NS		(1000000000UL / HZ)
+
+extern void init_hrtimer(struct hrtimer *timer);
+extern unsigned long long hrtimer_start(struct hrtimer *timer, unsigned long long nsec);
+extern unsigned long long hrtimer_forward(struct hrtimer *timer, unsigned long long interval);
+extern int hrtimer_cancel(struct hrtimer *timer);
+extern unsigned long long hrtimer_clock(void);
+extern int hrtimer_available(void);
+extern int hrtimer_interrupt(unsigned long long *next);
+extern unsigned long long hrtimer_nanosleep(unsigned long long nsec);
+
+static inline int hrtimer_active(const struct hrtimer *timer)
+{
+	return timer->active;
+}
+
+/* provided by the architecture, arch/i386/kernel/apic.c */
+#ifdef CONFIG_X86_LOCAL_APIC
+extern int hrtimer_arch_ok;
+extern unsigned long long hrtimer_arch_clock(void);
+extern void hrtimer_arch_program(unsigned long long expires);
+#endif
+
+extern void it_real_hrfn(unsigned long);
+
+#endif
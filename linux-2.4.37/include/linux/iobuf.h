@@ -47,6 +47,7 @@ struct kiobuf
 	atomic_t	io_count;	/* IOs still in progress */
 	int		errno;		/* Status of completed IO */
 	void		(*end_io) (struct kiobuf *); /* Completion callback */
+	void		*private;	/* for use by the end_io owner */
 	wait_queue_head_t wait_queue;
 };
 
@@ -74,5 +75,7 @@ extern void free_kiobuf_bhs(struct kiobuf *);
 
 int	brw_kiovec(int rw, int nr, struct kiobuf *iovec[], 
 		   kdev_t dev, unsigned long b[], int size);
+int	brw_kiobuf_async(int rw, struct kiobuf *iobuf,
+			 kdev_t dev, unsigned long b[], int size);
 
 #endif /* __LINUX_IOBUF_H */
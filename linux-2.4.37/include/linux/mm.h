@@ -102,7 +102,7 @@ struct vm_area_struct {
 
 #define VM_DONTCOPY	0x00020000      /* Do not copy this vma on fork */
 #define VM_DONTEXPAND	0x00040000	/* Cannot expand with mremap() */
-#define VM_RESERVED	0x00080000	/* Don't unmap it from swap_out */
+#define VM_RESERVED	0x00080000	/* Don't unmap it from try_to_unmap */
 
 #ifndef VM_STACK_FLAGS
 #define VM_STACK_FLAGS	0x00000177
@@ -156,15 +156,19 @@ typedef struct page {
 	struct list_head list;		/* ->mapping has some page lists. */
 	struct address_space *mapping;	/* The inode (or ...) we belong to. */
 	unsigned long index;		/* Our offset within mapping. */
-	struct page *next_hash;		/* Next page sharing our hash bucket in
-					   the pagecache hash table. */
+	struct page *next_hash;		/* Next page on the list of pages freed
+					   with interrupts off, page_alloc.c;
+					   some page table caches borrow it. */
 	atomic_t count;			/* Usage count, see below. */
 	unsigned long flags;		/* atomic flags, some possibly
 					   updated asynchronously */
 	struct list_head lru;		/* Pageout list, eg. active_list;
 					   protected by pagemap_lru_lock !! */
-	struct page **pprev_hash;	/* Complement to *next_hash. */
+	struct page **pprev_hash;	/* Unused by the page cache, some
+					   page table caches borrow it. */
 	struct buffer_head * buffers;	/* Buffer maps us to a disk block. */
+	struct pte_chain * pte_chain;	/* Reverse mappings, the ptes mapping
+					   us; protected by PG_chainlock. */
 
 	/*
 	 * On machines where all RAM is mapped into kernel address space,
@@ -248,9 +252,9 @@ static inline struct page *nth_page(struct page *page, int n)
  * using the page->list list_head. These fields are also used for
  * freelist managemet (when page->count==0).
  *
- * There is also a hash table mapping (mapping,index) to the page
- * in memory if present. The lists for this hash table use the fields
- * page->next_hash and page->pprev_hash.
+ * Each mapping also has a radix tree, mapping->page_tree, indexing its
+ * pages in memory by page->index. It is protected by mapping->page_lock,
+ * as are the three lists.
  *
  * All process pages can do I/O:
  * - inode pages may need to be read from disk,
@@ -267,7 +271,7 @@ static inline struct page *nth_page(struct page *page, int n)
  *
  * For choosing which pages to swap out, inode pages carry a
  * PG_referenced bit, which is set any time the system accesses
- * that page through the (mapping,index) hash table. This referenced
+ * that page through the page cache radix tree. This referenced
  * bit, together with the referenced bit in the page tables, is used
  * to manipulate page->age and move the page across the active,
  * inactive_dirty and inactive_clean lists.
@@ -299,6 +303,7 @@ static inline struct page *nth_page(struct page *page, int n)
 #define PG_lru			 6
 #define PG_active		 7
 #define PG_slab			 8
+#define PG_chainlock		 9	/* lock bit for ->pte_chain */
 #define PG_skip			10
 #define PG_highmem		11
 #define PG_checked		12	/* kill me in 2.5.<early>. */
@@ -473,6 +478,7 @@ extern unsigned long FASTCALL(get_zeroed_page(unsigned int gfp_mask));
  */
 extern void FASTCALL(__free_pages(struct page *page, unsigned int order));
 extern void FASTCALL(free_pages(unsigned long addr, unsigned int order));
+extern void FASTCALL(free_cold_page(struct page *page));
 
 #define __free_page(page) __free_pages((page), 0)
 #define free_page(addr) free_pages((addr),0)
@@ -612,6 +618,7 @@ extern struct page *filemap_nopage(struct vm_area_struct *, unsigned long, int);
 #define __GFP_IO	0x40	/* Can start low memory physical IO? */
 #define __GFP_HIGHIO	0x80	/* Can start high mem physical IO? */
 #define __GFP_FS	0x100	/* Can call down to low-level FS? */
+#define __GFP_COLD	0x200	/* Cache-cold page wanted */
 
 #define GFP_NOHIGHIO	(__GFP_HIGH | __GFP_WAIT | __GFP_IO)
 #define GFP_NOIO	(__GFP_HIGH | __GFP_WAIT)
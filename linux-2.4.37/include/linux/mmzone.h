@@ -8,6 +8,7 @@
 #include <linux/spinlock.h>
 #include <linux/list.h>
 #include <linux/wait.h>
+#include <linux/threads.h>
 
 /*
  * Free memory management - zoned buddy allocator.
@@ -44,6 +45,23 @@ typedef struct zone_watermarks_s {
  * ZONE_NORMAL	16-896 MB	direct mapped by the kernel
  * ZONE_HIGHMEM	 > 896 MB	only page cache and user processes
  */
+/*
+ * Per-CPU lists of free order-0 pages, see mm/page_alloc.c.
+ */
+struct per_cpu_pages {
+	int count;		/* pages on the list */
+	int low;		/* refill when count drops to low */
+	int high;		/* drain when count reaches high */
+	int batch;		/* pages moved to/from the buddy lists at once */
+	struct list_head list;
+	unsigned long alloc_hit, alloc_miss;	/* served without zone->lock? */
+	unsigned long free_hit, free_miss;
+};
+
+struct per_cpu_pageset {
+	struct per_cpu_pages pcp[2];	/* 0: hot, 1: cold */
+} ____cacheline_aligned;
+
 typedef struct zone_struct {
 	/*
 	 * Commonly accessed fields:
@@ -59,6 +77,9 @@ typedef struct zone_struct {
 	 */
 	zone_watermarks_t       watermarks[MAX_NR_ZONES];
 
+	/* per-CPU order-0 free lists, only touched with irqs off */
+	struct per_cpu_pageset	pageset[NR_CPUS];
+
 	/*
 	 * The below fields are protected by different locks (or by
 	 * no lock at all like need_balance), so they're longs to
@@ -68,7 +89,7 @@ typedef struct zone_struct {
 	unsigned long           need_balance;
 	/* protected by the pagemap_lru_lock */
 	unsigned long           nr_active_pages, nr_inactive_pages;
-	/* protected by the pagecache_lock */
+	/* protected by the nr_cache_pages_lock in mm/swap.c */
 	unsigned long           nr_cache_pages;
 
 
@@ -220,9 +220,15 @@ enum netdev_state_t
 	__LINK_STATE_PRESENT,
 	__LINK_STATE_SCHED,
 	__LINK_STATE_NOCARRIER,
-	__LINK_STATE_RX_SCHED
+	__LINK_STATE_RX_SCHED,
+	__LINK_STATE_QDISC_RUNNING
 };
 
+/* hard_start_xmit() return codes */
+#define NETDEV_TX_OK		0	/* driver took the packet */
+#define NETDEV_TX_BUSY		1	/* driver tx path was busy */
+#define NETDEV_TX_LOCKED	-1	/* NETIF_F_LLTX driver lost its tx lock */
+
 
 /*
  * This structure holds at boot time configured netdevice settings. They
@@ -382,6 +388,7 @@ struct net_device
 #define NETIF_F_HW_VLAN_RX	256	/* Receive VLAN hw acceleration */
 #define NETIF_F_HW_VLAN_FILTER	512	/* Receive filtering on VLAN */
 #define NETIF_F_VLAN_CHALLENGED	1024	/* Device cannot handle VLAN packets */
+#define NETIF_F_LLTX		4096	/* Driver locks its own tx path */
 
 	/* Called after device is detached from network. */
 	void			(*uninit)(struct net_device *dev);
@@ -880,6 +887,7 @@ extern int		netdev_register_fc(struct net_device *dev, void (*stimul)(struct net
 extern void		netdev_unregister_fc(int bit);
 extern int		netdev_max_backlog;
 extern int		weight_p;
+extern int		netdev_tx_batch;
 extern unsigned long	netdev_fc_xoff;
 extern atomic_t netdev_dropping;
 extern int		netdev_set_master(struct net_device *dev, struct net_device *master);
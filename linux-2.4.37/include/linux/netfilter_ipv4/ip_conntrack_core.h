@@ -1,6 +1,8 @@
 #ifndef _IP_CONNTRACK_CORE_H
 #define _IP_CONNTRACK_CORE_H
 #include <linux/netfilter.h>
+#include <linux/cache.h>
+#include <linux/threads.h>
 #include <linux/netfilter_ipv4/lockhelp.h>
 
 /* This header is used to share core functionality between the
@@ -20,6 +22,8 @@ extern struct ip_conntrack_protocol *ip_ct_find_proto(u_int8_t protocol);
 /* Like above, but you already have conntrack read lock. */
 extern struct ip_conntrack_protocol *__ip_ct_find_proto(u_int8_t protocol);
 extern struct list_head protocol_list;
+/* protocol_list by protocol number, changed under the write lock */
+extern struct ip_conntrack_protocol *ip_ct_protos[256];
 
 /* Returns conntrack if it dealt with ICMP, and filled in skb->nfct */
 extern struct ip_conntrack *icmp_error_track(struct sk_buff *skb,
@@ -48,5 +52,43 @@ static inline int ip_conntrack_confirm(struct sk_buff *skb)
 extern struct list_head *ip_conntrack_hash;
 extern struct list_head ip_conntrack_expect_list;
 DECLARE_RWLOCK_EXTERN(ip_conntrack_lock);
+
+/* The hash buckets are striped over IP_CT_HASH_LOCKS rwlocks, so that
+   lookups, confirmation and timeouts of unrelated connections don't
+   meet on ip_conntrack_lock.  That one still guards expectations,
+   helpers, protocols and the unconfirmed list, and anyone walking the
+   whole table or resizing it takes it too.  Lock order is
+   ip_conntrack_lock, then the stripes in ascending order. */
+#ifdef CONFIG_SMP
+#define IP_CT_HASH_LOCKS	256
+#else
+#define IP_CT_HASH_LOCKS	1
+#endif
+extern rwlock_t ip_conntrack_hash_locks[IP_CT_HASH_LOCKS];
+#define ip_ct_bucket_lock(bucket) \
+	(&ip_conntrack_hash_locks[(bucket) & (IP_CT_HASH_LOCKS - 1)])
+
+/* Rehash into a table of this many buckets, without dropping flows */
+extern int ip_conntrack_set_hashsize(unsigned int size);
+
+/* Per-CPU statistics, see /proc/net/ip_conntrack_stat */
+struct ip_conntrack_stat
+{
+	unsigned int lookup;		/* hash lookups */
+	unsigned int searched;		/* entries compared in lookups */
+	unsigned int found;		/* lookups that hit */
+	unsigned int new;		/* connections created */
+	unsigned int invalid;		/* packets not part of a connection */
+	unsigned int drop;		/* packets dropped for lack of room */
+	unsigned int early_drop;	/* unreplied connections evicted */
+	unsigned int insert_failed;	/* lost the race to confirm */
+	unsigned int delete;		/* connections timed out or killed */
+} ____cacheline_aligned_in_smp;
+
+extern struct ip_conntrack_stat ip_conntrack_stat[NR_CPUS];
+#define CONNTRACK_STAT_INC(count) \
+	(ip_conntrack_stat[smp_processor_id()].count++)
+
+extern atomic_t ip_conntrack_count;
 #endif /* _IP_CONNTRACK_CORE_H */
 
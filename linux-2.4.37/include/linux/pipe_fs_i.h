@@ -2,11 +2,37 @@
 #define _LINUX_PIPE_FS_I_H
 
 #define PIPEFS_MAGIC 0x50495045
+
+/*
+ * A pipe is a ring of PIPE_BUFFERS page references. Data written with
+ * write() goes into private pages that later small writes may append
+ * to, splice() and vmsplice() hang page cache or user pages into the
+ * ring as they are, and tee() lets two pipes share the same pages.
+ */
+#define PIPE_BUFFERS	16
+
+struct page;
+struct pipe_inode_info;
+
+struct pipe_buffer {
+	struct page *page;
+	unsigned int offset, len;
+	const struct pipe_buf_operations *ops;
+};
+
+struct pipe_buf_operations {
+	int can_merge;		/* write() may append to the page */
+	/* make sure the data is there, 0 or -errno */
+	int (*pin)(struct pipe_inode_info *, struct pipe_buffer *);
+	/* drop the pipe's reference to the page */
+	void (*release)(struct pipe_inode_info *, struct pipe_buffer *);
+};
+
 struct pipe_inode_info {
 	wait_queue_head_t wait;
-	char *base;
-	unsigned int len;
-	unsigned int start;
+	unsigned int nrbufs, curbuf;
+	struct pipe_buffer bufs[PIPE_BUFFERS];
+	struct page *tmp_page;		/* spare page for the next write */
 	unsigned int readers;
 	unsigned int writers;
 	unsigned int waiting_readers;
@@ -17,13 +43,12 @@ struct pipe_inode_info {
 
 /* Differs from PIPE_BUF in that PIPE_SIZE is the length of the actual
    memory allocation, whereas PIPE_BUF makes atomicity guarantees.  */
-#define PIPE_SIZE		PAGE_SIZE
+#define PIPE_SIZE		(PIPE_BUFFERS * PAGE_SIZE)
 
 #define PIPE_SEM(inode)		(&(inode).i_sem)
 #define PIPE_WAIT(inode)	(&(inode).i_pipe->wait)
-#define PIPE_BASE(inode)	((inode).i_pipe->base)
-#define PIPE_START(inode)	((inode).i_pipe->start)
-#define PIPE_LEN(inode)		((inode).i_pipe->len)
+#define PIPE_NRBUFS(inode)	((inode).i_pipe->nrbufs)
+#define PIPE_CURBUF(inode)	((inode).i_pipe->curbuf)
 #define PIPE_READERS(inode)	((inode).i_pipe->readers)
 #define PIPE_WRITERS(inode)	((inode).i_pipe->writers)
 #define PIPE_WAITING_READERS(inode)	((inode).i_pipe->waiting_readers)
@@ -31,16 +56,18 @@ struct pipe_inode_info {
 #define PIPE_RCOUNTER(inode)	((inode).i_pipe->r_counter)
 #define PIPE_WCOUNTER(inode)	((inode).i_pipe->w_counter)
 
-#define PIPE_EMPTY(inode)	(PIPE_LEN(inode) == 0)
-#define PIPE_FULL(inode)	(PIPE_LEN(inode) == PIPE_SIZE)
-#define PIPE_FREE(inode)	(PIPE_SIZE - PIPE_LEN(inode))
-#define PIPE_END(inode)	((PIPE_START(inode) + PIPE_LEN(inode)) & (PIPE_SIZE-1))
-#define PIPE_MAX_RCHUNK(inode)	(PIPE_SIZE - PIPE_START(inode))
-#define PIPE_MAX_WCHUNK(inode)	(PIPE_SIZE - PIPE_END(inode))
+#define PIPE_EMPTY(inode)	(PIPE_NRBUFS(inode) == 0)
+#define PIPE_FULL(inode)	(PIPE_NRBUFS(inode) == PIPE_BUFFERS)
+
+/* Flags for splice(), tee() and vmsplice() */
+#define SPLICE_F_MOVE		0x01	/* move pages instead of copying */
+#define SPLICE_F_NONBLOCK	0x02	/* don't block on the pipe */
+#define SPLICE_F_MORE		0x04	/* more data will follow */
 
 /* Drop the inode semaphore and wait for a pipe event, atomically */
 void pipe_wait(struct inode * inode);
 
 struct inode* pipe_new(struct inode* inode);
+void free_pipe_info(struct inode* inode);
 
 #endif
@@ -0,0 +1,58 @@
+#ifndef _LINUX_RADIX_TREE_H
+#define _LINUX_RADIX_TREE_H
+
+/*
+ * A radix tree maps an unsigned long index to a pointer. Interior nodes
+ * hold RADIX_TREE_MAP_SIZE slots each and the tree grows in height only
+ * as far as the largest index stored needs, so small files get a tree
+ * of one node and lookups cost a few pointer dereferences.
+ *
+ * Every slot also carries RADIX_TREE_MAX_TAGS tag bits. A tag set on an
+ * item is propagated to all nodes above it, which lets the tagged gang
+ * lookup skip whole subtrees without any tagged item below them.
+ *
+ * The tree does no locking of its own, the caller serialises all
+ * modifications and lookups.
+ */
+
+#define RADIX_TREE_MAX_TAGS	2
+
+struct radix_tree_node;
+
+struct radix_tree_root {
+	unsigned int		height;
+	int			gfp_mask;
+	struct radix_tree_node	*rnode;
+};
+
+#define RADIX_TREE_INIT(mask)	{ height: 0, gfp_mask: (mask), rnode: NULL }
+
+#define INIT_RADIX_TREE(root, mask)		\
+do {						\
+	(root)->height = 0;			\
+	(root)->gfp_mask = (mask);		\
+	(root)->rnode = NULL;			\
+} while (0)
+
+extern int radix_tree_insert(struct radix_tree_root *, unsigned long, void *);
+extern void *radix_tree_lookup(struct radix_tree_root *, unsigned long);
+extern void *radix_tree_delete(struct radix_tree_root *, unsigned long);
+extern unsigned int radix_tree_gang_lookup(struct radix_tree_root *root,
+			void **results, unsigned long first_index,
+			unsigned int max_items);
+
+extern void *radix_tree_tag_set(struct radix_tree_root *root,
+			unsigned long index, int tag);
+extern void *radix_tree_tag_clear(struct radix_tree_root *root,
+			unsigned long index, int tag);
+extern int radix_tree_tag_get(struct radix_tree_root *root,
+			unsigned long index, int tag);
+extern int radix_tree_tagged(struct radix_tree_root *root, int tag);
+extern unsigned int radix_tree_gang_lookup_tag(struct radix_tree_root *root,
+			void **results, unsigned long first_index,
+			unsigned int max_items, int tag);
+
+extern int radix_tree_preload(int gfp_mask);
+extern void radix_tree_init(void);
+
+#endif /* _LINUX_RADIX_TREE_H */
@@ -0,0 +1,52 @@
+#ifndef _LINUX_RCUPDATE_H
+#define _LINUX_RCUPDATE_H
+
+/*
+ * Read-copy update: deferred freeing of objects that lockless readers
+ * may still be looking at.
+ *
+ * A writer unlinks an object under its usual lock and hands it to
+ * call_rcu(). The callback runs once every CPU has gone through a
+ * quiescent state (a context switch, user mode or the idle loop)
+ * afterwards, by which time no reader can hold a pointer to the object
+ * any more. Readers must not sleep between rcu_read_lock() and
+ * rcu_read_unlock(); without kernel preemption that is all it takes,
+ * so the two only document the read side.
+ */
+
+#include <linux/list.h>
+#include <linux/cache.h>
+#include <linux/threads.h>
+
+struct rcu_head {
+	struct list_head list;
+	void (*func)(void *arg);
+	void *arg;
+};
+
+/* Per-CPU state, see kernel/rcupdate.c */
+struct rcu_data {
+	long		qsctr;		/* quiescent states passed */
+	long		last_qsctr;	/* qsctr when the grace period started */
+	int		qs_pending;	/* grace period waits for this CPU */
+	long		batch;		/* batch curlist is waiting for */
+	struct list_head nxtlist;	/* callbacks not in a batch yet */
+	struct list_head curlist;	/* callbacks waiting for batch */
+} ____cacheline_aligned_in_smp;
+
+extern struct rcu_data rcu_data[NR_CPUS];
+
+/* Called from schedule() on every context switch */
+static inline void rcu_qsctr_inc(int cpu)
+{
+	rcu_data[cpu].qsctr++;
+}
+
+#define rcu_read_lock()		do { } while (0)
+#define rcu_read_unlock()	do { } while (0)
+
+extern void call_rcu(struct rcu_head *head, void (*func)(void *arg), void *arg);
+extern void rcu_check_callbacks(int cpu, int user);
+extern void rcu_init(void);
+
+#endif /* _LINUX_RCUPDATE_H */
@@ -99,6 +99,7 @@ extern unsigned long nr_uninterruptible(void);
 #include <linux/resource.h>
 #ifdef __KERNEL__
 #include <linux/timer.h>
+#include <linux/hrtimer.h>
 #endif
 
 #include <asm/processor.h>
@@ -265,7 +266,6 @@ struct mm_struct {
 	unsigned long rss, total_vm, locked_vm;
 	unsigned long def_flags;
 	unsigned long cpu_vm_mask;
-	unsigned long swap_address;
 
 	unsigned dumpable:1;
 
@@ -281,6 +281,10 @@ struct mm_struct {
 	/* coredumping support */
 	int core_waiters;
 	struct completion *core_startup_done, core_done;
+
+	/* asynchronous I/O contexts, see fs/aio.c */
+	rwlock_t ioctx_list_lock;
+	struct kioctx *ioctx_list;
 };
 
 extern int mmlist_nr;
@@ -294,6 +298,7 @@ extern int mmlist_nr;
 	mmap_sem:	__RWSEM_INITIALIZER(name.mmap_sem), \
 	page_table_lock: SPIN_LOCK_UNLOCKED, 		\
 	mmlist:		LIST_HEAD_INIT(name.mmlist),	\
+	ioctx_list_lock: RW_LOCK_UNLOCKED,		\
 }
 
 extern void show_stack(unsigned long *esp);
@@ -367,6 +372,20 @@ extern struct user_struct root_user;
 
 typedef struct prio_array prio_array_t;
 
+/*
+ * Scheduler statistics, in hrtimer_clock() nanoseconds: time spent on a
+ * CPU and waiting on a runqueue, and the number of timeslices run.
+ * Exported through /proc/<pid>/schedstat.
+ */
+struct sched_info {
+	unsigned long long cpu_time, run_delay;
+	unsigned long pcnt;
+
+	/* timestamps */
+	unsigned long long last_arrival, last_queued;
+	int woken;
+};
+
 struct task_struct {
 	/*
 	 * offsets of these are hardcoded elsewhere - touch with care
@@ -394,6 +413,7 @@ struct task_struct {
 
 	unsigned long sleep_avg;
 	unsigned long last_run;
+	struct sched_info sched_info;
 
 	unsigned long policy;
 	unsigned long cpus_allowed;
@@ -449,6 +469,8 @@ struct task_struct {
 	unsigned long it_real_value, it_prof_value, it_virt_value;
 	unsigned long it_real_incr, it_prof_incr, it_virt_incr;
 	struct timer_list real_timer;
+	struct hrtimer real_hrtimer;		/* ITIMER_REAL with hrtimers */
+	unsigned long long it_real_incr_ns;
 	struct tms times;
 	struct tms group_times;
 	unsigned long start_time;
@@ -0,0 +1,58 @@
+#ifndef __LINUX_SEQLOCK_H
+#define __LINUX_SEQLOCK_H
+
+/*
+ * Sequence locks: writers serialise on a spinlock and bump a counter
+ * before and after each update, readers take no lock at all and retry
+ * if the counter was odd or changed under them.
+ *
+ *	do {
+ *		seq = read_seqbegin(&foo);
+ *		...
+ *	} while (read_seqretry(&foo, seq));
+ *
+ * Readers must cope with seeing a half done update until the retry
+ * check, so the protected data must not be freed under them.
+ */
+
+#include <linux/spinlock.h>
+#include <asm/system.h>
+
+typedef struct {
+	unsigned sequence;
+	spinlock_t lock;
+} seqlock_t;
+
+#define SEQLOCK_UNLOCKED	{ 0, SPIN_LOCK_UNLOCKED }
+#define seqlock_init(x)		do { *(x) = (seqlock_t) SEQLOCK_UNLOCKED; } while (0)
+
+static inline void write_seqlock(seqlock_t *sl)
+{
+	spin_lock(&sl->lock);
+	++sl->sequence;
+	smp_wmb();
+}
+
+static inline void write_sequnlock(seqlock_t *sl)
+{
+	smp_wmb();
+	sl->sequence++;
+	spin_unlock(&sl->lock);
+}
+
+static inline unsigned read_seqbegin(const seqlock_t *sl)
+{
+	unsigned ret = sl->sequence;
+
+	smp_rmb();
+	return ret;
+}
+
+/* Also fails while a writer was active when read_seqbegin() ran */
+static inline int read_seqretry(const seqlock_t *sl, unsigned start)
+{
+	smp_rmb();
+	return (start & 1) | (sl->sequence ^ start);
+}
+
+#endif /* __LINUX_SEQLOCK_H */
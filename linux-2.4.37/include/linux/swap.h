@@ -91,9 +91,6 @@ extern int nr_inactive_pages;
 extern unsigned long page_cache_size;
 extern atomic_t buffermem_pages;
 
-extern spinlock_cacheline_t pagecache_lock_cacheline;
-#define pagecache_lock (pagecache_lock_cacheline.lock)
-
 extern void __remove_inode_page(struct page *);
 
 /* Incomplete types for prototype declarations: */
@@ -118,6 +115,20 @@ extern int FASTCALL(try_to_free_pages_zone(zone_t *, unsigned int));
 extern int FASTCALL(try_to_free_pages(unsigned int));
 extern int vm_vfs_scan_ratio, vm_cache_scan_ratio, vm_lru_balance_ratio, vm_passes, vm_gfp_debug, vm_mapped_ratio, vm_anon_lru;
 
+/* linux/mm/rmap.c */
+#define SWAP_SUCCESS	0
+#define SWAP_AGAIN	1
+#define SWAP_FAIL	2
+
+struct mm_struct;
+extern void pgtable_add_rmap(pte_t *, struct mm_struct *, unsigned long);
+extern void pgtable_remove_rmap(pte_t *);
+extern void page_add_rmap(struct page *, pte_t *);
+extern void page_remove_rmap(struct page *, pte_t *);
+extern int page_referenced(struct page *);
+extern int try_to_unmap(struct page *);
+extern void pte_chain_init(void);
+
 /* linux/mm/page_io.c */
 extern void rw_swap_page(int, struct page *);
 extern void rw_swap_page_nolock(int, swp_entry_t, char *);
@@ -130,6 +141,7 @@ extern void rw_swap_page_nolock(int, swp_entry_t, char *);
 extern void show_swap_cache_info(void);
 #endif
 extern int add_to_swap_cache(struct page *, swp_entry_t);
+extern int add_to_swap(struct page *);
 extern void __delete_from_swap_cache(struct page *page);
 extern void delete_from_swap_cache(struct page *page);
 extern void free_page_and_swap_cache(struct page *page);
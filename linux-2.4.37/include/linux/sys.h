@@ -4,7 +4,7 @@
 /*
  * system call entry points ... but not all are defined
  */
-#define NR_syscalls 271
+#define NR_syscalls 317
 
 /*
  * These are system calls that will be removed at some time
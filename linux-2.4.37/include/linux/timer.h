@@ -13,11 +13,15 @@
  * timeouts. You can use this field to distinguish between the different
  * invocations.
  */
+struct tvec_base_s;
+
 struct timer_list {
 	struct list_head list;
 	unsigned long expires;
 	unsigned long data;
 	void (*function)(unsigned long);
+	/* per-CPU base the timer was queued on last, managed by kernel/timer.c */
+	struct tvec_base_s *base;
 };
 
 extern void add_timer(struct timer_list * timer);
@@ -31,6 +35,8 @@ extern void sync_timers(void);
 #define sync_timers()		do { } while (0)
 #endif
 
+extern void bust_timer_locks(void);
+
 /*
  * mod_timer is a more efficient way to update the expire field of an
  * active timer (if the timer is inactive it will be activated)
@@ -45,6 +51,7 @@ extern void it_real_fn(unsigned long);
 static inline void init_timer(struct timer_list * timer)
 {
 	timer->list.next = timer->list.prev = NULL;
+	timer->base = NULL;
 }
 
 static inline int timer_pending (const struct timer_list * timer)
@@ -33,6 +33,7 @@ struct dst_entry
 	int			obsolete;
 	int			flags;
 #define DST_HOST		1
+#define DST_NOCACHE		2	/* never hashed, freed by last release */
 	unsigned long		lastuse;
 	unsigned long		expires;
 
@@ -101,19 +102,24 @@ struct dst_entry * dst_clone(struct dst_entry * dst)
 	return dst;
 }
 
+extern void * dst_alloc(struct dst_ops * ops);
+extern void __dst_free(struct dst_entry * dst);
+extern void dst_destroy(struct dst_entry * dst);
+
 static inline
 void dst_release(struct dst_entry * dst)
 {
 	if (dst) {
 		smp_mb__before_atomic_dec();
+		if (dst->flags & DST_NOCACHE) {
+			if (atomic_dec_and_test(&dst->__refcnt))
+				dst_destroy(dst);
+			return;
+		}
 		atomic_dec(&dst->__refcnt);
 	}
 }
 
-extern void * dst_alloc(struct dst_ops * ops);
-extern void __dst_free(struct dst_entry * dst);
-extern void dst_destroy(struct dst_entry * dst);
-
 static inline
 void dst_free(struct dst_entry * dst)
 {
@@ -224,7 +224,7 @@ extern int fib_convert_rtentry(int cmd, struct nlmsghdr *nl, struct rtmsg *rtm,
 extern void fib_node_get_info(int type, int dead, struct fib_info *fi, u32 prefix, u32 mask, char *buffer);
 extern u32  __fib_res_prefsrc(struct fib_result *res);
 
-/* Exported by fib_hash.c */
+/* Exported by fib_hash.c, or fib_trie.c with CONFIG_IP_FIB_TRIE */
 extern struct fib_table *fib_hash_init(int id);
 
 #ifdef CONFIG_IP_MULTIPLE_TABLES
@@ -79,6 +79,7 @@ struct Qdisc
 #define TCQ_F_BUILTIN	1
 #define TCQ_F_THROTTLED	2
 #define TCQ_F_INGRESS	4
+#define TCQ_F_CAN_BYPASS 8	/* empty queue may be skipped */
 	struct Qdisc_ops	*ops;
 	u32			handle;
 	u32			parent;
@@ -441,12 +442,25 @@ int tc_filter_init(void);
 int pktsched_init(void);
 
 extern int qdisc_restart(struct net_device *dev);
+extern int qdisc_xmit(struct net_device *dev, struct sk_buff *skb);
 
-static inline void qdisc_run(struct net_device *dev)
+/* Only the CPU owning __LINK_STATE_QDISC_RUNNING dequeues, the others
+   enqueue and leave. Both run under dev->queue_lock, which is what
+   keeps a packet from being left behind when the owner stops.
+ */
+static inline void __qdisc_run(struct net_device *dev)
 {
 	while (!netif_queue_stopped(dev) &&
 	       qdisc_restart(dev)<0)
 		/* NOTHING */;
+	clear_bit(__LINK_STATE_QDISC_RUNNING, &dev->state);
+}
+
+static inline void qdisc_run(struct net_device *dev)
+{
+	if (!netif_queue_stopped(dev) &&
+	    !test_and_set_bit(__LINK_STATE_QDISC_RUNNING, &dev->state))
+		__qdisc_run(dev);
 }
 
 /* Calculate maximal size of packet seen by hard_start_xmit
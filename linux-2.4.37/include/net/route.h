@@ -116,6 +116,13 @@ struct rt_cache_stat
         unsigned int gc_dst_overflow;
 	unsigned int in_hlist_search;
 	unsigned int out_hlist_search;
+	unsigned int gc_sync_buckets;	/* buckets swept in softirq */
+	unsigned int gc_sync_freed;
+	unsigned int gc_sync_cycles;	/* get_cycles() spent doing it */
+	unsigned int gc_bg_runs;	/* keventd passes */
+	unsigned int gc_bg_freed;
+	unsigned int gc_chain_freed;	/* reaped while hashing a new entry */
+	unsigned int in_nocache;	/* forwarded on uncached routes */
 } ____cacheline_aligned_in_smp;
 
 extern struct ip_rt_acct *ip_rt_acct;
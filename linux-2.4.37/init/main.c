@@ -29,6 +29,7 @@
 #include <linux/file.h>
 #include <linux/tty.h>
 #include <linux/grsecurity.h>
+#include <linux/rcupdate.h>
 
 #include <asm/io.h>
 #include <asm/bugs.h>
@@ -380,6 +381,7 @@ asmlinkage void __init start_kernel(void)
 	init_IRQ();
 	sched_init();
 	softirq_init();
+	rcu_init();
 	time_init();
 
 	/*
@@ -431,7 +433,8 @@ asmlinkage void __init start_kernel(void)
 	proc_caches_init();
 	vfs_caches_init(num_physpages);
 	buffer_init(num_physpages);
-	page_cache_init(num_physpages);
+	radix_tree_init();
+	pte_chain_init();
 #if defined(CONFIG_ARCH_S390)
 	ccwcache_init();
 #endif
@@ -676,6 +676,7 @@ asmlinkage NORET_TYPE void do_exit(long code)
 
 	tsk->flags |= PF_EXITING;
 	del_timer_sync(&tsk->real_timer);
+	hrtimer_cancel(&tsk->real_hrtimer);
 
 	if (unlikely(current->ptrace & PT_TRACE_EXIT))
 		ptrace_notify((PTRACE_EVENT_EXIT << 8) | SIGTRAP);
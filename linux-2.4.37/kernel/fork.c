@@ -26,6 +26,7 @@
 #include <linux/binfmts.h>
 #include <linux/fs.h>
 #include <linux/futex.h>
+#include <linux/aio.h>
 #include <linux/ptrace.h>
 
 #include <asm/pgtable.h>
@@ -194,7 +195,6 @@ static inline int dup_mmap(struct mm_struct * mm)
 	mm->free_area_cache = TASK_UNMAPPED_BASE;
 	mm->rss = 0;
 	mm->cpu_vm_mask = 0;
-	mm->swap_address = 0;
 	pprev = &mm->mmap;
 
 	/*
@@ -280,6 +280,8 @@ static struct mm_struct * mm_init(struct mm_struct * mm)
 	mm->free_area_cache = TASK_UNMAPPED_BASE;
 	mm->pgd = pgd_alloc(mm);
 	mm->def_flags = 0;
+	mm->ioctx_list_lock = RW_LOCK_UNLOCKED;
+	mm->ioctx_list = NULL;
 	if (mm->pgd)
 		return mm;
 	free_mm(mm);
@@ -322,12 +324,10 @@ void fastcall __mmdrop(struct mm_struct *mm)
 void mmput(struct mm_struct *mm)
 {
 	if (atomic_dec_and_lock(&mm->mm_users, &mmlist_lock)) {
-		extern struct mm_struct *swap_mm;
-		if (swap_mm == mm)
-			swap_mm = list_entry(mm->mmlist.next, struct mm_struct, mmlist);
 		list_del(&mm->mmlist);
 		mmlist_nr--;
 		spin_unlock(&mmlist_lock);
+		exit_aio(mm);
 		exit_mmap(mm);
 		mmdrop(mm);
 	}
@@ -364,7 +364,7 @@ void mm_release(void)
 		 * not set up a proper pointer then tough luck.
 		 */
 		put_user(0, tidptr);
-		sys_futex((unsigned long)tidptr, FUTEX_WAKE, 1, NULL);
+		sys_futex((unsigned long)tidptr, FUTEX_WAKE, 1, NULL, 0, 0);
 	}
 }
 
@@ -814,6 +814,10 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 	p->it_real_incr = p->it_virt_incr = p->it_prof_incr = 0;
 	init_timer(&p->real_timer);
 	p->real_timer.data = (unsigned long) p;
+	init_hrtimer(&p->real_hrtimer);
+	p->real_hrtimer.function = it_real_hrfn;
+	p->real_hrtimer.data = (unsigned long) p;
+	p->it_real_incr_ns = 0;
 
 	p->leader = 0;		/* session leadership doesn't inherit */
 	p->tty_old_pgrp = 0;
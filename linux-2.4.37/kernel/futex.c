@@ -11,6 +11,8 @@
  *
  *  Generalized futexes for every mapping type, Ingo Molnar, 2002
  *
+ *  Requeue, wake-op and bitset operations, per-bucket hash locking
+ *
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -35,6 +37,7 @@
 #include <linux/mount.h>
 #include <linux/vcache.h>
 #include <linux/module.h>
+#include <linux/highmem.h>
 
 #define FUTEX_HASHBITS 8
 
@@ -50,41 +53,66 @@ struct futex_q {
 	struct page *page;
 	int offset;
 
+	/* FUTEX_WAKE_BITSET wakes only waiters with a common bit */
+	unsigned int bitset;
+
+	/* hash bucket the waiter is queued on */
+	struct futex_hash_bucket *bh;
+
 	/* the virtual => physical COW-safe cache */
 	vcache_t vcache;
 };
 
-/* The key for the hash is the address + index + offset within page */
-static struct list_head futex_queues[1<<FUTEX_HASHBITS];
-static spinlock_t futex_lock = SPIN_LOCK_UNLOCKED;
+struct futex_hash_bucket {
+	spinlock_t lock;
+	struct list_head chain;
+};
 
 /*
- * These are all locks that are necessery to look up a physical
- * mapping safely, and modify/search the futex hash, atomically:
+ * The key for the hash is the address + index + offset within page.
+ *
+ * Locking: mm->page_table_lock keeps the user mapping stable while a
+ * futex is looked up, every hash bucket has its own lock for its chain.
+ * vcache_lock is only needed when a waiter is queued, requeued or
+ * unqueued, or when COW moves it to a new page: q->page, q->offset and
+ * q->bh change only with vcache_lock and the bucket lock(s) held.
+ * Wakers take the waiter off the chain and the waiter detaches its
+ * vcache entry itself. Lock order is page_table_lock, vcache_lock,
+ * bucket locks by ascending address.
  */
-static inline void lock_futex_mm(void)
-{
-	spin_lock(&current->mm->page_table_lock);
-	spin_lock(&vcache_lock);
-	spin_lock(&futex_lock);
-}
-
-static inline void unlock_futex_mm(void)
-{
-	spin_unlock(&futex_lock);
-	spin_unlock(&vcache_lock);
-	spin_unlock(&current->mm->page_table_lock);
-}
+static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
 
 /*
  * The physical page is shared, so we can hash on its address:
  */
-static inline struct list_head *hash_futex(struct page *page, int offset)
+static inline struct futex_hash_bucket *hash_futex(struct page *page, int offset)
 {
 	return &futex_queues[hash_long((unsigned long)page + offset,
 							FUTEX_HASHBITS)];
 }
 
+static inline void double_lock_bucket(struct futex_hash_bucket *bh1,
+				      struct futex_hash_bucket *bh2)
+{
+	if (bh1 == bh2)
+		spin_lock(&bh1->lock);
+	else if (bh1 < bh2) {
+		spin_lock(&bh1->lock);
+		spin_lock(&bh2->lock);
+	} else {
+		spin_lock(&bh2->lock);
+		spin_lock(&bh1->lock);
+	}
+}
+
+static inline void double_unlock_bucket(struct futex_hash_bucket *bh1,
+					struct futex_hash_bucket *bh2)
+{
+	spin_unlock(&bh1->lock);
+	if (bh1 != bh2)
+		spin_unlock(&bh2->lock);
+}
+
 /* Waiter either waiting in FUTEX_WAIT or poll(), or expecting signal */
 static inline void tell_waiter(struct futex_q *q)
 {
@@ -92,11 +120,12 @@ static inline void tell_waiter(struct futex_q *q)
 }
 
 /*
- * Get kernel address of the user page and pin it.
+ * Get kernel address of the user page and pin it. With write set, COW
+ * is broken first so the page can be modified through the kernel map.
  *
- * Must be called with (and returns with) all futex-MM locks held.
+ * Must be called with (and returns with) page_table_lock held.
  */
-static struct page *__pin_page(unsigned long addr)
+static struct page *__pin_page(unsigned long addr, int write)
 {
 	struct mm_struct *mm = current->mm;
 	struct page *page, *tmp;
@@ -105,7 +134,7 @@ static struct page *__pin_page(unsigned long addr)
 	/*
 	 * Do a quick atomic lookup first - this is the fastpath.
 	 */
-	page = follow_page(mm, addr, 0);
+	page = follow_page(mm, addr, write);
 	if (likely(page != NULL)) {	
 		if (!PageReserved(page))
 			get_page(page);
@@ -117,13 +146,13 @@ static struct page *__pin_page(unsigned long addr)
 	 */
 repeat_lookup:
 
-	unlock_futex_mm();
+	spin_unlock(&mm->page_table_lock);
 
 	down_read(&mm->mmap_sem);
-	err = get_user_pages(current, mm, addr, 1, 0, 0, &page, NULL);
+	err = get_user_pages(current, mm, addr, 1, write, 0, &page, NULL);
 	up_read(&mm->mmap_sem);
 
-	lock_futex_mm();
+	spin_lock(&mm->page_table_lock);
 
 	if (err < 0)
 		return NULL;
@@ -131,7 +160,7 @@ repeat_lookup:
 	 * Since the faulting happened with locks released, we have to
 	 * check for races:
 	 */
-	tmp = follow_page(mm, addr, 0);
+	tmp = follow_page(mm, addr, write);
 	if (tmp != page) {
 		put_page(page);
 		goto repeat_lookup;
@@ -146,39 +175,106 @@ static inline void unpin_page(struct page *page)
 }
 
 /*
- * Wake up all waiters hashed on the physical page that is mapped
- * to this virtual address:
+ * A queued waiter holds a reference on q->page, which it drops when it
+ * is unqueued. Whoever moves it to another page hands the reference
+ * over: the new page is pinned for the waiter, the old one released.
  */
-static int futex_wake(unsigned long uaddr, int offset, int num)
+static inline void repin_page(struct page *old, struct page *new)
 {
-	struct list_head *i, *next, *head;
-	struct page *page;
-	int ret = 0;
+	if (!PageReserved(new))
+		get_page(new);
+	put_page(old);
+}
 
-	lock_futex_mm();
+/*
+ * Pin the pages of two futexes. Pinning the second one may drop
+ * page_table_lock, so the first is looked up again afterwards.
+ */
+static int __pin_pages(unsigned long addr1, struct page **page1,
+		       unsigned long addr2, struct page **page2, int write2)
+{
+	struct mm_struct *mm = current->mm;
 
-	page = __pin_page(uaddr - offset);
-	if (!page) {
-		unlock_futex_mm();
-		return -EFAULT;
+	for (;;) {
+		*page1 = __pin_page(addr1, 0);
+		if (!*page1)
+			return -EFAULT;
+		*page2 = __pin_page(addr2, write2);
+		if (!*page2) {
+			unpin_page(*page1);
+			return -EFAULT;
+		}
+		if (follow_page(mm, addr1, 0) == *page1)
+			return 0;
+		unpin_page(*page2);
+		unpin_page(*page1);
 	}
+}
 
-	head = hash_futex(page, offset);
+/* Read the futex word through the pinned page, with spinlocks held */
+static inline int futex_read(struct page *page, int offset)
+{
+	char *kaddr = kmap_atomic(page, KM_USER0);
+	int val = *(volatile int *)(kaddr + offset);
 
-	list_for_each_safe(i, next, head) {
+	kunmap_atomic(kaddr, KM_USER0);
+	return val;
+}
+
+/*
+ * Wake up to num waiters on page + offset sharing a bit with bitset.
+ * The bucket must be locked.
+ */
+static int __futex_wake(struct futex_hash_bucket *bh, struct page *page,
+			int offset, int num, unsigned int bitset)
+{
+	struct list_head *i, *next;
+	int ret = 0;
+
+	list_for_each_safe(i, next, &bh->chain) {
 		struct futex_q *this = list_entry(i, struct futex_q, list);
 
-		if (this->page == page && this->offset == offset) {
+		if (this->page == page && this->offset == offset &&
+		    (this->bitset & bitset)) {
 			list_del_init(i);
-			__detach_vcache(&this->vcache);
 			tell_waiter(this);
 			ret++;
 			if (ret >= num)
 				break;
 		}
 	}
+	return ret;
+}
+
+/*
+ * Wake up all waiters hashed on the physical page that is mapped
+ * to this virtual address:
+ */
+static int futex_wake(unsigned long uaddr, int offset, int num,
+		      unsigned int bitset)
+{
+	struct mm_struct *mm = current->mm;
+	struct futex_hash_bucket *bh;
+	struct page *page;
+	int ret;
 
-	unlock_futex_mm();
+	if (!bitset)
+		return -EINVAL;
+
+	spin_lock(&mm->page_table_lock);
+
+	page = __pin_page(uaddr - offset, 0);
+	if (!page) {
+		spin_unlock(&mm->page_table_lock);
+		return -EFAULT;
+	}
+
+	bh = hash_futex(page, offset);
+	spin_lock(&bh->lock);
+	ret = __futex_wake(bh, page, offset, num, bitset);
+	spin_unlock(&bh->lock);
+
+	spin_unlock(&mm->page_table_lock);
 	unpin_page(page);
 
 	return ret;
@@ -193,28 +289,221 @@ static int futex_wake(unsigned long uaddr, int offset, int num)
 static void futex_vcache_callback(vcache_t *vcache, struct page *new_page)
 {
 	struct futex_q *q = container_of(vcache, struct futex_q, vcache);
-	struct list_head *head = hash_futex(new_page, q->offset);
+	struct futex_hash_bucket *bh = q->bh;
+	struct futex_hash_bucket *new_bh = hash_futex(new_page, q->offset);
 
-	spin_lock(&futex_lock);
+	double_lock_bucket(bh, new_bh);
 
 	if (!list_empty(&q->list)) {
+		repin_page(q->page, new_page);
 		q->page = new_page;
+		q->bh = new_bh;
 		list_del(&q->list);
-		list_add_tail(&q->list, head);
+		list_add_tail(&q->list, &new_bh->chain);
 	}
 
-	spin_unlock(&futex_lock);
+	double_unlock_bucket(bh, new_bh);
 }
 
+/*
+ * Wake nr_wake waiters on uaddr1 and move up to nr_requeue of the
+ * others over to uaddr2, so a condition variable broadcast does not
+ * wake every waiter only to have them all block on the mutex. With
+ * valp set the operation fails with -EAGAIN unless *uaddr1 == *valp.
+ *
+ * Only waiters of the caller's mm are moved: the vcache entry that
+ * follows COW is keyed on the waiter's mm and address, and where uaddr2
+ * is mapped in another mm is unknown here. Waiters of other processes
+ * sharing the futex are woken instead, which futex users have to
+ * expect anyway, and count against nr_requeue like a moved one.
+ */
+static int futex_requeue(unsigned long uaddr1, int offset1,
+			 unsigned long uaddr2, int offset2,
+			 int nr_wake, int nr_requeue, int *valp)
+{
+	struct mm_struct *mm = current->mm;
+	struct futex_hash_bucket *bh1, *bh2;
+	struct list_head *i, *next;
+	struct page *page1, *page2;
+	int ret;
+
+	spin_lock(&mm->page_table_lock);
+
+	ret = __pin_pages(uaddr1 - offset1, &page1, uaddr2 - offset2, &page2, 0);
+	if (ret) {
+		spin_unlock(&mm->page_table_lock);
+		return ret;
+	}
+
+	spin_lock(&vcache_lock);
+	bh1 = hash_futex(page1, offset1);
+	bh2 = hash_futex(page2, offset2);
+	double_lock_bucket(bh1, bh2);
+
+	if (valp && futex_read(page1, offset1) != *valp) {
+		ret = -EAGAIN;
+		goto out;
+	}
+
+	list_for_each_safe(i, next, &bh1->chain) {
+		struct futex_q *this = list_entry(i, struct futex_q, list);
+
+		if (this->page != page1 || this->offset != offset1)
+			continue;
+		if (ret < nr_wake) {
+			ret++;
+			list_del_init(i);
+			tell_waiter(this);
+			continue;
+		}
+		if (ret - nr_wake >= nr_requeue)
+			break;
+		ret++;
+		if (this->vcache.mm != mm) {
+			list_del_init(i);
+			tell_waiter(this);
+			continue;
+		}
+		if (bh1 != bh2) {
+			list_del(i);
+			list_add_tail(i, &bh2->chain);
+			this->bh = bh2;
+		}
+		repin_page(page1, page2);
+		this->page = page2;
+		this->offset = offset2;
+		__detach_vcache(&this->vcache);
+		__attach_vcache(&this->vcache, uaddr2, mm, futex_vcache_callback);
+	}
+
+out:
+	double_unlock_bucket(bh1, bh2);
+	spin_unlock(&vcache_lock);
+	spin_unlock(&mm->page_table_lock);
+	unpin_page(page1);
+	unpin_page(page2);
+
+	return ret;
+}
+
+#ifdef __HAVE_ARCH_CMPXCHG
+/*
+ * Apply the FUTEX_OP encoded in encoded_op to the futex word and
+ * return its old value, or -ENOSYS for an unknown operation with the
+ * result in *oldval. The page is pinned writable.
+ */
+static int futex_atomic_op(struct page *page, int offset, int encoded_op,
+			   int *oldval)
+{
+	int op = (encoded_op >> 28) & 7;
+	int oparg = (encoded_op << 8) >> 20;
+	int old, new;
+	char *kaddr;
+	int *uval;
+
+	if (encoded_op & (FUTEX_OP_OPARG_SHIFT << 28))
+		oparg = 1 << oparg;
+	if (op > FUTEX_OP_XOR)
+		return -ENOSYS;
+
+	kaddr = kmap_atomic(page, KM_USER0);
+	uval = (int *)(kaddr + offset);
+	do {
+		old = *(volatile int *)uval;
+		switch (op) {
+		case FUTEX_OP_SET:	new = oparg; break;
+		case FUTEX_OP_ADD:	new = old + oparg; break;
+		case FUTEX_OP_OR:	new = old | oparg; break;
+		case FUTEX_OP_ANDN:	new = old & ~oparg; break;
+		default:		new = old ^ oparg; break;
+		}
+	} while (cmpxchg(uval, old, new) != old);
+	kunmap_atomic(kaddr, KM_USER0);
+
+	*oldval = old;
+	return 0;
+}
+
+static int futex_op_cmp(int encoded_op, int oldval)
+{
+	int cmp = (encoded_op >> 24) & 15;
+	int cmparg = (encoded_op << 20) >> 20;
+
+	switch (cmp) {
+	case FUTEX_OP_CMP_EQ: return oldval == cmparg;
+	case FUTEX_OP_CMP_NE: return oldval != cmparg;
+	case FUTEX_OP_CMP_LT: return oldval < cmparg;
+	case FUTEX_OP_CMP_LE: return oldval <= cmparg;
+	case FUTEX_OP_CMP_GT: return oldval > cmparg;
+	case FUTEX_OP_CMP_GE: return oldval >= cmparg;
+	}
+	return -ENOSYS;
+}
+
+/*
+ * Atomically modify *uaddr2, wake nr_wake waiters on uaddr1 and, if the
+ * old value of *uaddr2 passes the comparison, nr_wake2 waiters on uaddr2.
+ * Lets a condition variable signal drop the internal lock and wake in
+ * one system call.
+ */
+static int futex_wake_op(unsigned long uaddr1, int offset1,
+			 unsigned long uaddr2, int offset2,
+			 int nr_wake, int nr_wake2, int encoded_op)
+{
+	struct mm_struct *mm = current->mm;
+	struct futex_hash_bucket *bh1, *bh2;
+	struct page *page1, *page2;
+	int ret, oldval, cmp;
+
+	spin_lock(&mm->page_table_lock);
+
+	ret = __pin_pages(uaddr1 - offset1, &page1, uaddr2 - offset2, &page2, 1);
+	if (ret) {
+		spin_unlock(&mm->page_table_lock);
+		return ret;
+	}
+
+	bh1 = hash_futex(page1, offset1);
+	bh2 = hash_futex(page2, offset2);
+	double_lock_bucket(bh1, bh2);
+
+	ret = futex_atomic_op(page2, offset2, encoded_op, &oldval);
+	if (ret)
+		goto out;
+	ret = __futex_wake(bh1, page1, offset1, nr_wake, FUTEX_BITSET_MATCH_ANY);
+	cmp = futex_op_cmp(encoded_op, oldval);
+	if (cmp < 0)
+		ret = cmp;
+	else if (cmp)
+		ret += __futex_wake(bh2, page2, offset2, nr_wake2,
+				    FUTEX_BITSET_MATCH_ANY);
+
+out:
+	double_unlock_bucket(bh1, bh2);
+	spin_unlock(&mm->page_table_lock);
+	set_page_dirty(page2);
+	unpin_page(page1);
+	unpin_page(page2);
+
+	return ret;
+}
+#else
+#define futex_wake_op(uaddr1, offset1, uaddr2, offset2, nr, nr2, op)	(-ENOSYS)
+#endif
+
+/* Called with vcache_lock held */
 static inline void __queue_me(struct futex_q *q, struct page *page,
 				unsigned long uaddr, int offset)
 {
-	struct list_head *head = hash_futex(page, offset);
+	struct futex_hash_bucket *bh = hash_futex(page, offset);
 
 	q->offset = offset;
 	q->page = page;
+	q->bh = bh;
 
-	list_add_tail(&q->list, head);
+	spin_lock(&bh->lock);
+	list_add_tail(&q->list, &bh->chain);
+	spin_unlock(&bh->lock);
 	/*
 	 * We register a futex callback to this virtual address,
 	 * to make sure a COW properly rehashes the futex-queue.
@@ -225,16 +514,18 @@ static inline void __queue_me(struct futex_q *q, struct page *page,
 /* Return 1 if we were still queued (ie. 0 means we were woken) */
 static inline int unqueue_me(struct futex_q *q)
 {
+	struct futex_hash_bucket *bh;
 	int ret = 0;
 
 	spin_lock(&vcache_lock);
-	spin_lock(&futex_lock);
+	bh = q->bh;
+	spin_lock(&bh->lock);
 	if (!list_empty(&q->list)) {
 		list_del(&q->list);
-		__detach_vcache(&q->vcache);
 		ret = 1;
 	}
-	spin_unlock(&futex_lock);
+	spin_unlock(&bh->lock);
+	__detach_vcache(&q->vcache);
 	spin_unlock(&vcache_lock);
 	return ret;
 }
@@ -242,25 +533,33 @@ static inline int unqueue_me(struct futex_q *q)
 static int futex_wait(unsigned long uaddr,
 		      int offset,
 		      int val,
-		      unsigned long time)
+		      unsigned long time,
+		      unsigned int bitset)
 {
 	DECLARE_WAITQUEUE(wait, current);
+	struct mm_struct *mm = current->mm;
 	int ret = 0, curval;
 	struct page *page;
 	struct futex_q q;
 
+	if (!bitset)
+		return -EINVAL;
+
 	init_waitqueue_head(&q.waiters);
+	q.bitset = bitset;
 
-	lock_futex_mm();
+	spin_lock(&mm->page_table_lock);
 
-	page = __pin_page(uaddr - offset);
+	page = __pin_page(uaddr - offset, 0);
 	if (!page) {
-		unlock_futex_mm();
+		spin_unlock(&mm->page_table_lock);
 		return -EFAULT;
 	}
+	spin_lock(&vcache_lock);
 	__queue_me(&q, page, uaddr, offset);
+	spin_unlock(&vcache_lock);
 
-	unlock_futex_mm();
+	spin_unlock(&mm->page_table_lock);
 
 	/* Page is pinned, but may no longer be in this address space. */
 	if (get_user(curval, (int *)uaddr) != 0) {
@@ -297,15 +596,23 @@ out:
 	/* Were we woken up anyway? */
 	if (!unqueue_me(&q))
 		ret = 0;
-	unpin_page(page);
+	/* requeue or COW may have moved us, and our reference, to q.page */
+	unpin_page(q.page);
 
 	return ret;
 }
 
+/*
+ * FUTEX_WAIT takes a relative timeout, FUTEX_WAIT_BITSET an absolute
+ * one. There is no monotonic clock in 2.4, both clocks are taken as
+ * CLOCK_REALTIME.
+ */
 static inline int futex_wait_utime(unsigned long uaddr,
 		      int offset,
 		      int val,
-		      struct timespec* utime)
+		      struct timespec* utime,
+		      unsigned int bitset,
+		      int abs)
 {
 	unsigned long time = MAX_SCHEDULE_TIMEOUT;
 
@@ -313,15 +620,31 @@ static inline int futex_wait_utime(unsigned long uaddr,
 		struct timespec t;
 		if (copy_from_user(&t, utime, sizeof(t)) != 0)
 			return -EFAULT;
+		if (abs) {
+			struct timeval now;
+
+			do_gettimeofday(&now);
+			t.tv_sec -= now.tv_sec;
+			t.tv_nsec -= now.tv_usec * 1000;
+			if (t.tv_nsec < 0) {
+				t.tv_nsec += 1000000000;
+				t.tv_sec--;
+			}
+			if (t.tv_sec < 0)
+				t.tv_sec = t.tv_nsec = 0;
+		}
 		time = timespec_to_jiffies(&t) + 1;
 	}
 
-	return futex_wait(uaddr, offset, val, time);
+	return futex_wait(uaddr, offset, val, time, bitset);
 }
 
-asmlinkage int sys_futex(unsigned long uaddr, int op, int val, struct timespec *utime)
+asmlinkage int sys_futex(unsigned long uaddr, int op, int val,
+			 struct timespec *utime, unsigned long uaddr2, int val3)
 {
-	unsigned long pos_in_page;
+	unsigned long pos_in_page, pos_in_page2;
+	int cmd = op & FUTEX_CMD_MASK;
+	int val2 = (int)(unsigned long) utime;
 	int ret;
 
 	pos_in_page = uaddr % PAGE_SIZE;
@@ -330,12 +653,36 @@ asmlinkage int sys_futex(unsigned long uaddr, int op, int val, struct timespec *
 	if (pos_in_page % sizeof(int))
 		return -EINVAL;
 
-	switch (op) {
+	pos_in_page2 = uaddr2 % PAGE_SIZE;
+	if ((cmd == FUTEX_REQUEUE || cmd == FUTEX_CMP_REQUEUE ||
+	     cmd == FUTEX_WAKE_OP) && (pos_in_page2 % sizeof(int)))
+		return -EINVAL;
+
+	switch (cmd) {
 	case FUTEX_WAIT:
-		ret = futex_wait_utime(uaddr, pos_in_page, val, utime);
+		ret = futex_wait_utime(uaddr, pos_in_page, val, utime,
+				       FUTEX_BITSET_MATCH_ANY, 0);
+		break;
+	case FUTEX_WAIT_BITSET:
+		ret = futex_wait_utime(uaddr, pos_in_page, val, utime, val3, 1);
 		break;
 	case FUTEX_WAKE:
-		ret = futex_wake(uaddr, pos_in_page, val);
+		ret = futex_wake(uaddr, pos_in_page, val, FUTEX_BITSET_MATCH_ANY);
+		break;
+	case FUTEX_WAKE_BITSET:
+		ret = futex_wake(uaddr, pos_in_page, val, val3);
+		break;
+	case FUTEX_REQUEUE:
+		ret = futex_requeue(uaddr, pos_in_page, uaddr2, pos_in_page2,
+				    val, val2, NULL);
+		break;
+	case FUTEX_CMP_REQUEUE:
+		ret = futex_requeue(uaddr, pos_in_page, uaddr2, pos_in_page2,
+				    val, val2, &val3);
+		break;
+	case FUTEX_WAKE_OP:
+		ret = futex_wake_op(uaddr, pos_in_page, uaddr2, pos_in_page2,
+				    val, val2, val3);
 		break;
 	/*
 	 * We disable FUTEX_FD support due to risks: it is the least tested
@@ -348,6 +695,12 @@ asmlinkage int sys_futex(unsigned long uaddr, int op, int val, struct timespec *
 		ret = futex_fd(uaddr, pos_in_page, val);
 		break;
 #endif
+	/* no priority inheritance, user space falls back to plain futexes */
+	case FUTEX_LOCK_PI:
+	case FUTEX_UNLOCK_PI:
+	case FUTEX_TRYLOCK_PI:
+		ret = -ENOSYS;
+		break;
 	default:
 		ret = -EINVAL;
 	}
@@ -358,8 +711,10 @@ static int __init init(void)
 {
 	unsigned int i;
 
-	for (i = 0; i < ARRAY_SIZE(futex_queues); i++)
-		INIT_LIST_HEAD(&futex_queues[i]);
+	for (i = 0; i < ARRAY_SIZE(futex_queues); i++) {
+		spin_lock_init(&futex_queues[i].lock);
+		INIT_LIST_HEAD(&futex_queues[i].chain);
+	}
 	return 0;
 }
 __initcall(init);
@@ -0,0 +1,287 @@
+/*
+ *  linux/kernel/hrtimer.c
+ *
+ *  High resolution timers on top of the jiffy timer wheel.
+ *
+ *  The timer wheel only fires on tick boundaries, so nanosleep() and
+ *  setitimer() used to round every request up to the next jiffy plus
+ *  one, i.e. 10-20 ms with HZ=100. An hrtimer waits for the whole jiffies
+ *  of its delay on the wheel as before and queues the rest on a sorted
+ *  per-CPU list. The architecture then cuts the current tick period of
+ *  the local APIC timer short to interrupt at the first expiry and calls
+ *  hrtimer_interrupt(), the periodic tick itself is kept unchanged.
+ *
+ *  The per-CPU queues only ever take timers started on the local CPU,
+ *  other CPUs merely remove timers from them in hrtimer_cancel().
+ */
+
+#include <linux/config.h>
+#include <linux/init.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/hrtimer.h>
+
+#include <asm/div64.h>
+
+#ifndef CONFIG_X86_LOCAL_APIC
+#define hrtimer_arch_ok		0
+#define hrtimer_arch_clock()	0ULL
+#define hrtimer_arch_program(e)	do { } while (0)
+#endif
+
+struct hrtimer_base {
+	spinlock_t lock;
+	struct list_head pending;	/* sorted by expiry */
+	struct hrtimer *running;
+	int in_interrupt;
+} ____cacheline_aligned;
+
+static struct hrtimer_base hrtimer_bases[NR_CPUS] __cacheline_aligned;
+
+void __init init_hrtimers(void)
+{
+	int cpu;
+
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		spin_lock_init(&hrtimer_bases[cpu].lock);
+		INIT_LIST_HEAD(&hrtimer_bases[cpu].pending);
+	}
+}
+
+int hrtimer_available(void)
+{
+	return hrtimer_arch_ok;
+}
+
+/*
+ * Nanoseconds of the local clock. The TSCs of all CPUs are assumed to be
+ * close enough for a timer to expire on a CPU other than the one it was
+ * started on. Without hrtimer support this is jiffies in nanoseconds.
+ */
+unsigned long long hrtimer_clock(void)
+{
+	if (hrtimer_arch_ok)
+		return hrtimer_arch_clock();
+	return (unsigned long long) jiffies * HRTIMER_TICK_NS;
+}
+
+static void hrtimer_timer_fn(unsigned long data);
+
+void init_hrtimer(struct hrtimer *timer)
+{
+	timer->list.next = timer->list.prev = NULL;
+	timer->cpu = -1;
+	timer->active = 0;
+	init_timer(&timer->timer);
+	timer->timer.function = hrtimer_timer_fn;
+	timer->timer.data = (unsigned long) timer;
+}
+
+/*
+ * Queue on the local CPU, interrupts must be disabled. The interrupt
+ * handler reprograms the hardware itself once it is done with the queue.
+ */
+static void hrtimer_enqueue(struct hrtimer *timer)
+{
+	int cpu = smp_processor_id();
+	struct hrtimer_base *base = hrtimer_bases + cpu;
+	struct list_head *head;
+
+	spin_lock(&base->lock);
+	timer->cpu = cpu;
+	list_for_each(head, &base->pending) {
+		struct hrtimer *t = list_entry(head, struct hrtimer, list);
+
+		if ((long long)(t->expires - timer->expires) > 0)
+			break;
+	}
+	list_add_tail(&timer->list, head);
+	if (base->pending.next == &timer->list && !base->in_interrupt)
+		hrtimer_arch_program(timer->expires);
+	spin_unlock(&base->lock);
+}
+
+/* the jiffy part of the delay is over, wait for the rest with precision */
+static void hrtimer_timer_fn(unsigned long data)
+{
+	struct hrtimer *timer = (struct hrtimer *) data;
+	unsigned long flags;
+
+	if (!hrtimer_arch_ok) {
+		timer->active = 0;
+		timer->function(timer->data);
+		return;
+	}
+	local_irq_save(flags);
+	hrtimer_enqueue(timer);
+	local_irq_restore(flags);
+}
+
+static void hrtimer_arm(struct hrtimer *timer, unsigned long long nsec)
+{
+	unsigned long long ticks = nsec;
+	unsigned long rem;
+
+	rem = do_div(ticks, HRTIMER_TICK_NS);
+	timer->active = 1;
+
+	/* like nanosleep, round up and add one for the tick under way */
+	if (!hrtimer_arch_ok)
+		ticks += (rem != 0) + 1;
+	else if (ticks <= 1) {
+		hrtimer_enqueue(timer);
+		return;
+	} else
+		ticks--;
+
+	if (ticks > MAX_JIFFY_OFFSET)
+		ticks = MAX_JIFFY_OFFSET;
+	timer->timer.expires = jiffies + (unsigned long) ticks;
+	add_timer(&timer->timer);
+}
+
+/*
+ * Start an inactive timer nsec nanoseconds from now on the local CPU.
+ * Returns the expiry time in hrtimer_clock() units.
+ */
+unsigned long long hrtimer_start(struct hrtimer *timer, unsigned long long nsec)
+{
+	unsigned long flags;
+
+	if (nsec < HRTIMER_MIN_NS)
+		nsec = HRTIMER_MIN_NS;
+	local_irq_save(flags);
+	timer->expires = hrtimer_clock() + nsec;
+	hrtimer_arm(timer, nsec);
+	local_irq_restore(flags);
+	return timer->expires;
+}
+
+/*
+ * Restart a timer interval nanoseconds after its last expiry, for periodic
+ * timers from within their callback. Missed periods are skipped.
+ */
+unsigned long long hrtimer_forward(struct hrtimer *timer, unsigned long long interval)
+{
+	unsigned long long now;
+	unsigned long flags;
+
+	if (interval < HRTIMER_MIN_NS)
+		interval = HRTIMER_MIN_NS;
+	local_irq_save(flags);
+	now = hrtimer_clock();
+	timer->expires += interval;
+	if ((long long)(timer->expires - now) <= 0)
+		timer->expires = now + interval;
+	hrtimer_arm(timer, timer->expires - now);
+	local_irq_restore(flags);
+	return timer->expires;
+}
+
+/*
+ * Deactivate a timer and wait for its callback to finish. Returns 1 if
+ * the timer was still pending. Must not be called from the callback.
+ */
+int hrtimer_cancel(struct hrtimer *timer)
+{
+	struct hrtimer_base *base;
+	unsigned long flags;
+	int cpu, ret = 0;
+
+	do {
+		ret |= del_timer_sync(&timer->timer);
+		while ((cpu = timer->cpu) >= 0) {
+			base = hrtimer_bases + cpu;
+			spin_lock_irqsave(&base->lock, flags);
+			if (timer->cpu == cpu) {
+				if (timer->list.next) {
+					list_del(&timer->list);
+					timer->list.next = NULL;
+					ret = 1;
+				}
+				if (base->running != timer) {
+					timer->cpu = -1;
+					spin_unlock_irqrestore(&base->lock, flags);
+					break;
+				}
+			}
+			spin_unlock_irqrestore(&base->lock, flags);
+			cpu_relax();
+		}
+	} while (timer_pending(&timer->timer));
+	timer->active = 0;
+	return ret;
+}
+
+/*
+ * Called by the architecture from the local timer interrupt. Runs the
+ * expired timers of this CPU and returns 1 with the next expiry in *next
+ * if any timers are left.
+ */
+int hrtimer_interrupt(unsigned long long *next)
+{
+	struct hrtimer_base *base = hrtimer_bases + smp_processor_id();
+	struct hrtimer *timer;
+	int pending = 0;
+
+	spin_lock(&base->lock);
+	base->in_interrupt = 1;
+	while (!list_empty(&base->pending)) {
+		timer = list_entry(base->pending.next, struct hrtimer, list);
+		if ((long long)(timer->expires - hrtimer_arch_clock()) > 0) {
+			*next = timer->expires;
+			pending = 1;
+			break;
+		}
+		list_del(&timer->list);
+		timer->list.next = NULL;
+		timer->active = 0;
+		base->running = timer;
+		spin_unlock(&base->lock);
+
+		timer->function(timer->data);
+
+		spin_lock(&base->lock);
+		if (!timer->list.next)
+			timer->cpu = -1;
+		base->running = NULL;
+	}
+	base->in_interrupt = 0;
+	spin_unlock(&base->lock);
+	return pending;
+}
+
+static void hrtimer_wakeup(unsigned long data)
+{
+	wake_up_process((struct task_struct *) data);
+}
+
+/*
+ * Sleep interruptibly for nsec nanoseconds. Returns 0 when the time has
+ * passed, otherwise the nanoseconds left when a signal arrived.
+ */
+unsigned long long hrtimer_nanosleep(unsigned long long nsec)
+{
+	struct hrtimer timer;
+	unsigned long long expires, now;
+
+	init_hrtimer(&timer);
+	timer.function = hrtimer_wakeup;
+	timer.data = (unsigned long) current;
+	expires = hrtimer_start(&timer, nsec);
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!hrtimer_active(&timer) || signal_pending(current))
+			break;
+		schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+
+	if (!hrtimer_cancel(&timer))
+		return 0;
+	now = hrtimer_clock();
+	if ((long long)(expires - now) <= 0)
+		return 0;
+	return expires - now;
+}
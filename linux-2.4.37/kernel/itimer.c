@@ -9,8 +9,10 @@
 #include <linux/mm.h>
 #include <linux/smp_lock.h>
 #include <linux/interrupt.h>
+#include <linux/hrtimer.h>
 
 #include <asm/uaccess.h>
+#include <asm/div64.h>
 
 /*
  * change timeval to jiffies, trying to avoid the 
@@ -40,12 +42,42 @@ static void jiffiestotv(unsigned long jiffies, struct timeval *value)
 	value->tv_sec = jiffies / HZ;
 }
 
+/*
+ * ITIMER_REAL runs on an hrtimer when available and keeps its
+ * values in nanoseconds then, with microsecond precision.
+ */
+static unsigned long long tvtons(struct timeval *value)
+{
+	unsigned long long sec = (unsigned) value->tv_sec;
+	unsigned long usec = (unsigned) value->tv_usec;
+
+	return sec * 1000000000 + usec * 1000ULL;
+}
+
+static void nstotv(unsigned long long ns, struct timeval *value)
+{
+	value->tv_usec = do_div(ns, 1000000000) / 1000;
+	value->tv_sec = (unsigned long) ns;
+}
+
 int do_getitimer(int which, struct itimerval *value)
 {
 	register unsigned long val, interval;
 
 	switch (which) {
 	case ITIMER_REAL:
+		if (hrtimer_available()) {
+			unsigned long long left = 0;
+
+			if (hrtimer_active(&current->real_hrtimer)) {
+				left = current->real_hrtimer.expires - hrtimer_clock();
+				if ((long long) left < 1000)
+					left = 1000;
+			}
+			nstotv(left, &value->it_value);
+			nstotv(current->it_real_incr_ns, &value->it_interval);
+			return 0;
+		}
 		interval = current->it_real_incr;
 		val = 0;
 		/* 
@@ -105,6 +137,15 @@ void it_real_fn(unsigned long __data)
 	}
 }
 
+void it_real_hrfn(unsigned long __data)
+{
+	struct task_struct * p = (struct task_struct *) __data;
+
+	send_sig(SIGALRM, p, 1);
+	if (p->it_real_incr_ns)
+		hrtimer_forward(&p->real_hrtimer, p->it_real_incr_ns);
+}
+
 int do_setitimer(int which, struct itimerval *value, struct itimerval *ovalue)
 {
 	register unsigned long i, j;
@@ -119,6 +160,15 @@ int do_setitimer(int which, struct itimerval *value, struct itimerval *ovalue)
 			del_timer_sync(&current->real_timer);
 			current->it_real_value = j;
 			current->it_real_incr = i;
+			if (hrtimer_available()) {
+				unsigned long long ns = tvtons(&value->it_value);
+
+				hrtimer_cancel(&current->real_hrtimer);
+				current->it_real_incr_ns = tvtons(&value->it_interval);
+				if (ns)
+					hrtimer_start(&current->real_hrtimer, ns);
+				break;
+			}
 			if (!j)
 				break;
 			if (j > (unsigned long) LONG_MAX)
@@ -51,6 +51,7 @@
 #include <linux/crc32.h>
 #include <linux/firmware.h>
 #include <linux/grsecurity.h>
+#include <linux/rcupdate.h>
 #include <asm/checksum.h>
 
 #if defined(CONFIG_PROC_FS)
@@ -238,8 +239,6 @@ EXPORT_SYMBOL(generic_file_write);
 EXPORT_SYMBOL(generic_file_mmap);
 EXPORT_SYMBOL(generic_ro_fops);
 EXPORT_SYMBOL(generic_buffer_fdatasync);
-EXPORT_SYMBOL(page_hash_bits);
-EXPORT_SYMBOL(page_hash_table);
 EXPORT_SYMBOL(file_lock_list);
 EXPORT_SYMBOL(locks_init_lock);
 EXPORT_SYMBOL(locks_copy_lock);
@@ -275,8 +274,9 @@ EXPORT_SYMBOL(no_llseek);
 EXPORT_SYMBOL(__pollwait);
 EXPORT_SYMBOL(poll_freewait);
 EXPORT_SYMBOL(ROOT_DEV);
-EXPORT_SYMBOL(__find_get_page);
-EXPORT_SYMBOL(__find_lock_page);
+EXPORT_SYMBOL(find_get_page);
+EXPORT_SYMBOL(find_lock_page);
+EXPORT_SYMBOL(find_get_pages);
 EXPORT_SYMBOL(find_trylock_page);
 EXPORT_SYMBOL(find_or_create_page);
 EXPORT_SYMBOL(grab_cache_page_nowait);
@@ -412,6 +412,12 @@ EXPORT_SYMBOL(probe_irq_off);
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 EXPORT_SYMBOL(mod_timer);
+EXPORT_SYMBOL(init_hrtimer);
+EXPORT_SYMBOL(hrtimer_start);
+EXPORT_SYMBOL(hrtimer_forward);
+EXPORT_SYMBOL(hrtimer_cancel);
+EXPORT_SYMBOL(hrtimer_clock);
+EXPORT_SYMBOL(hrtimer_available);
 EXPORT_SYMBOL(tq_timer);
 EXPORT_SYMBOL(tq_immediate);
 
@@ -438,6 +444,7 @@ EXPORT_SYMBOL(unmap_kiobuf);
 EXPORT_SYMBOL(lock_kiovec);
 EXPORT_SYMBOL(unlock_kiovec);
 EXPORT_SYMBOL(brw_kiovec);
+EXPORT_SYMBOL(brw_kiobuf_async);
 EXPORT_SYMBOL(kiobuf_wait_for_io);
 
 /* dma handling */
@@ -613,6 +620,9 @@ EXPORT_SYMBOL(cpu_raise_softirq);
 EXPORT_SYMBOL(__tasklet_schedule);
 EXPORT_SYMBOL(__tasklet_hi_schedule);
 
+/* read-copy update */
+EXPORT_SYMBOL(call_rcu);
+
 /* init task, for moving kthread roots - ought to export a function ?? */
 
 EXPORT_SYMBOL(init_task_union);
@@ -0,0 +1,179 @@
+/*
+ *  linux/kernel/rcupdate.c
+ *
+ *  Read-copy update, deferred freeing for lockless readers.
+ *
+ *  Callbacks handed to call_rcu() are collected per CPU and moved into
+ *  numbered batches. A batch completes once every CPU has passed a
+ *  quiescent state after it was started: schedule() counts context
+ *  switches and the timer tick counts ticks taken in user mode or in
+ *  the idle loop. Callbacks run from a per-CPU tasklet on the CPU that
+ *  queued them.
+ */
+
+#include <linux/config.h>
+#include <linux/sched.h>
+#include <linux/init.h>
+#include <linux/interrupt.h>
+#include <linux/smp.h>
+#include <linux/rcupdate.h>
+
+#include <asm/hardirq.h>
+
+struct rcu_ctrlblk {
+	spinlock_t	lock;
+	long		curbatch;	/* batch in its grace period */
+	long		maxbatch;	/* highest batch asked for */
+	int		cpus_pending;	/* CPUs yet to pass a quiescent state */
+};
+
+static struct rcu_ctrlblk rcu_ctrlblk = {
+	lock:		SPIN_LOCK_UNLOCKED,
+	curbatch:	1,
+	maxbatch:	1,
+	cpus_pending:	0,
+};
+
+struct rcu_data rcu_data[NR_CPUS] __cacheline_aligned;
+static struct tasklet_struct rcu_tasklets[NR_CPUS];
+
+#define RCU_QSCTR_INVALID	(-1L)
+
+#define rcu_batch_before(a, b)	((long) ((a) - (b)) < 0)
+#define rcu_batch_after(a, b)	((long) ((a) - (b)) > 0)
+
+/**
+ * call_rcu - queue a callback for after a grace period
+ * @head: structure used to queue the callback, usually in the object
+ * @func: function to call
+ * @arg: argument to @func
+ *
+ * @func(@arg) is called from softirq context once no lockless reader
+ * can still see the object unlinked before the call. May be called from
+ * any context.
+ */
+void call_rcu(struct rcu_head *head, void (*func)(void *arg), void *arg)
+{
+	unsigned long flags;
+
+	head->func = func;
+	head->arg = arg;
+	local_irq_save(flags);
+	list_add_tail(&head->list, &rcu_data[smp_processor_id()].nxtlist);
+	local_irq_restore(flags);
+}
+
+/*
+ * Make sure a grace period for batch newbatch gets started, with
+ * rcu_ctrlblk.lock held. If one is running already the next one is
+ * started when it completes.
+ */
+static void rcu_start_batch(long newbatch)
+{
+	int i;
+
+	if (rcu_batch_before(rcu_ctrlblk.maxbatch, newbatch))
+		rcu_ctrlblk.maxbatch = newbatch;
+	if (rcu_batch_before(rcu_ctrlblk.maxbatch, rcu_ctrlblk.curbatch) ||
+	    rcu_ctrlblk.cpus_pending)
+		return;
+
+	for (i = 0; i < smp_num_cpus; i++)
+		rcu_data[cpu_logical_map(i)].qs_pending = 1;
+	rcu_ctrlblk.cpus_pending = smp_num_cpus;
+}
+
+/*
+ * The first call after a grace period started takes a snapshot of the
+ * quiescent state counter, any later call that sees it changed reports
+ * this CPU done. The last CPU to report completes the batch.
+ */
+static void rcu_check_quiescent_state(struct rcu_data *rdp)
+{
+	if (!rdp->qs_pending)
+		return;
+	if (rdp->last_qsctr == RCU_QSCTR_INVALID) {
+		rdp->last_qsctr = rdp->qsctr;
+		return;
+	}
+	if (rdp->qsctr == rdp->last_qsctr)
+		return;
+
+	spin_lock(&rcu_ctrlblk.lock);
+	if (rdp->qs_pending) {
+		rdp->qs_pending = 0;
+		rdp->last_qsctr = RCU_QSCTR_INVALID;
+		if (!--rcu_ctrlblk.cpus_pending) {
+			rcu_ctrlblk.curbatch++;
+			rcu_start_batch(rcu_ctrlblk.maxbatch);
+		}
+	}
+	spin_unlock(&rcu_ctrlblk.lock);
+}
+
+static void rcu_process_callbacks(unsigned long data)
+{
+	struct rcu_data *rdp = &rcu_data[smp_processor_id()];
+	struct list_head list;
+
+	INIT_LIST_HEAD(&list);
+	if (!list_empty(&rdp->curlist) &&
+	    rcu_batch_after(rcu_ctrlblk.curbatch, rdp->batch)) {
+		list_splice(&rdp->curlist, &list);
+		INIT_LIST_HEAD(&rdp->curlist);
+	}
+
+	local_irq_disable();
+	if (!list_empty(&rdp->nxtlist) && list_empty(&rdp->curlist)) {
+		list_splice(&rdp->nxtlist, &rdp->curlist);
+		INIT_LIST_HEAD(&rdp->nxtlist);
+		local_irq_enable();
+
+		spin_lock(&rcu_ctrlblk.lock);
+		rdp->batch = rcu_ctrlblk.curbatch + 1;
+		rcu_start_batch(rdp->batch);
+		spin_unlock(&rcu_ctrlblk.lock);
+	} else
+		local_irq_enable();
+
+	rcu_check_quiescent_state(rdp);
+
+	while (!list_empty(&list)) {
+		struct rcu_head *head;
+
+		head = list_entry(list.next, struct rcu_head, list);
+		list_del(&head->list);
+		head->func(head->arg);
+	}
+}
+
+/*
+ * Called from the timer interrupt. A tick that interrupted user mode
+ * or the idle loop itself is a quiescent state.
+ */
+void rcu_check_callbacks(int cpu, int user)
+{
+	struct rcu_data *rdp = &rcu_data[cpu];
+
+	if (user || (current->pid == 0 && !local_bh_count(cpu) &&
+		     local_irq_count(cpu) <= 1))
+		rdp->qsctr++;
+
+	if (!list_empty(&rdp->curlist) || !list_empty(&rdp->nxtlist) ||
+	    rdp->qs_pending)
+		tasklet_schedule(&rcu_tasklets[cpu]);
+}
+
+void __init rcu_init(void)
+{
+	int i;
+
+	for (i = 0; i < NR_CPUS; i++) {
+		struct rcu_data *rdp = &rcu_data[i];
+
+		rdp->last_qsctr = RCU_QSCTR_INVALID;
+		INIT_LIST_HEAD(&rdp->nxtlist);
+		INIT_LIST_HEAD(&rdp->curlist);
+		tasklet_init(&rcu_tasklets[i], rcu_process_callbacks, 0);
+	}
+}
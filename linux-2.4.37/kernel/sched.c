@@ -31,6 +31,8 @@
 #include <linux/blkdev.h>
 #include <linux/delay.h>
 #include <linux/timer.h>
+#include <linux/seq_file.h>
+#include <linux/rcupdate.h>
 
 /*
  * Convert user-nice values [ -20 ... 0 ... 19 ]
@@ -133,6 +135,43 @@ static inline unsigned int task_timeslice(task_t *p)
 
 typedef struct runqueue runqueue_t;
 
+/*
+ * Wakeup latency histogram: bucket 0 counts wakeup-to-run delays below
+ * 1024 ns, bucket n delays of [2^(n-1), 2^n) * 1024 ns, the last one
+ * everything longer.
+ */
+#define SCHED_LAT_BUCKETS	24
+
+/*
+ * Scheduler domains: every CPU balances against its hyperthreaded
+ * sibling first, then against the other packages of its node, then
+ * across nodes. Lower levels share caches, are balanced often and may
+ * take cache-hot tasks; upper levels are balanced rarely and leave
+ * tasks alone that ran within cache_hot_time. A level spanning the same
+ * CPUs as the one below is not set up.
+ */
+#define SD_SIBLING	0
+#define SD_PACKAGE	1
+#define SD_NODE		2
+#define SD_LEVELS	3
+
+/* consecutive failures before cache-hot tasks are moved anyway */
+#define SD_CACHE_NICE_TRIES	2
+
+struct sched_domain {
+	int level;
+	unsigned long span;
+	unsigned long last_balance;
+	unsigned long busy_interval, idle_interval;
+	unsigned long cache_hot_time;
+	unsigned int imbalance_pct;
+	unsigned int nr_failed;
+
+	/* /proc/schedstat, indexed by idle */
+	unsigned long lb_cnt[2], lb_balanced[2], lb_failed[2];
+	unsigned long lb_gained[2], lb_hot[2];
+};
+
 struct prio_array {
 	int nr_active;
 	unsigned long bitmap[BITMAP_SIZE];
@@ -154,11 +193,20 @@ struct runqueue {
 	struct mm_struct *prev_mm;
 	prio_array_t *active, *expired, arrays[2];
 	int prev_nr_running[NR_CPUS];
+#if CONFIG_SMP
+	int nr_domains;
+	struct sched_domain sd[SD_LEVELS];
+#endif
 
 	task_t *migration_thread;
 	struct list_head migration_queue;
 
 	atomic_t nr_iowait;
+
+	/* schedstats, see sched_info_switch() */
+	unsigned long ttwu_cnt, pcnt;
+	unsigned long long cpu_time, run_delay;
+	unsigned long lat_hist[SCHED_LAT_BUCKETS];
 } ____cacheline_aligned;
 
 static struct runqueue runqueues[NR_CPUS] __cacheline_aligned;
@@ -267,6 +315,68 @@ static inline int effective_prio(task_t *p)
 	return prio;
 }
 
+/*
+ * Scheduler statistics. A task is stamped when it is queued and when it
+ * gets the CPU, the differences are summed up per task and per runqueue
+ * at context switch time, under the runqueue lock. This costs two clock
+ * reads per context switch.
+ */
+static inline void sched_info_queued(task_t *p)
+{
+	if (!p->sched_info.last_queued)
+		p->sched_info.last_queued = hrtimer_clock();
+}
+
+/*
+ * Bucket n counts delays of [2^(n-1), 2^n) microseconds (roughly), the
+ * last bucket everything above. No fls() here, i386 has none.
+ */
+static inline int sched_lat_bucket(unsigned long long delay)
+{
+	unsigned long us;
+	int bucket = 0;
+
+	delay >>= 10;
+	if (delay >= 1UL << (SCHED_LAT_BUCKETS - 2))
+		return SCHED_LAT_BUCKETS - 1;
+	for (us = (unsigned long) delay; us; us >>= 1)
+		bucket++;
+	return bucket;
+}
+
+static inline void sched_info_switch(runqueue_t *rq, task_t *prev, task_t *next)
+{
+	unsigned long long now = hrtimer_clock();
+	long long delta;
+
+	if (prev != rq->idle) {
+		delta = now - prev->sched_info.last_arrival;
+		if (delta > 0) {
+			prev->sched_info.cpu_time += delta;
+			rq->cpu_time += delta;
+		}
+		/* preempted, still on the runqueue */
+		if (prev->array)
+			prev->sched_info.last_queued = now;
+	}
+	if (next != rq->idle) {
+		if (next->sched_info.last_queued) {
+			delta = now - next->sched_info.last_queued;
+			if (delta < 0)
+				delta = 0;
+			next->sched_info.run_delay += delta;
+			rq->run_delay += delta;
+			if (next->sched_info.woken)
+				rq->lat_hist[sched_lat_bucket(delta)]++;
+		}
+		next->sched_info.last_queued = 0;
+		next->sched_info.woken = 0;
+		next->sched_info.last_arrival = now;
+		next->sched_info.pcnt++;
+		rq->pcnt++;
+	}
+}
+
 /*
  * activate_task - move a task to the runqueue.
 
@@ -275,6 +385,7 @@ static inline int effective_prio(task_t *p)
  */
 static inline void __activate_task(task_t *p, runqueue_t *rq)
 {
+	sched_info_queued(p);
 	enqueue_task(p, rq->active);
 	rq->nr_running++;
 }
@@ -421,6 +532,8 @@ repeat_lock_task:
 			}
 			if (old_state == TASK_UNINTERRUPTIBLE)
 				rq->nr_uninterruptible--;
+			rq->ttwu_cnt++;
+			p->sched_info.woken = 1;
 			if (sync)
 				__activate_task(p, rq);
 			else {
@@ -460,6 +573,7 @@ void fastcall wake_up_forked_process(task_t * p)
 	runqueue_t *rq = this_rq_lock();
 
 	p->state = TASK_RUNNING;
+	memset(&p->sched_info, 0, sizeof(p->sched_info));
 	if (!rt_task(p)) {
 		/*
 		 * We decrease the sleep average of forking parents
@@ -477,6 +591,7 @@ void fastcall wake_up_forked_process(task_t * p)
 			__activate_task(p, rq);
 		else {
 			p->prio = current->prio;
+			sched_info_queued(p);
 			list_add_tail(&p->run_list, &current->run_list);
 			p->array = current->array;
 			p->array->nr_active++;
@@ -671,13 +786,13 @@ static inline unsigned int double_lock_balance(runqueue_t *this_rq,
 /*
  * find_busiest_queue - find the busiest runqueue.
  */
-static inline runqueue_t *find_busiest_queue(runqueue_t *this_rq, int this_cpu, int idle, int *imbalance)
+static inline runqueue_t *find_busiest_queue(runqueue_t *this_rq, int this_cpu, int idle, int *imbalance, struct sched_domain *sd)
 {
 	int nr_running, load, max_load, i;
 	runqueue_t *busiest, *rq_src;
 
 	/*
-	 * We search all runqueues to find the most busy one.
+	 * We search all runqueues of the domain to find the most busy one.
 	 * We do this lockless to reduce cache-bouncing overhead,
 	 * we re-check the 'best' source CPU later on again, with
 	 * the lock held.
@@ -706,7 +821,7 @@ static inline runqueue_t *find_busiest_queue(runqueue_t *this_rq, int this_cpu,
 	busiest = NULL;
 	max_load = 1;
 	for (i = 0; i < NR_CPUS; i++) {
-		if (!cpu_online(i))
+		if (!cpu_online(i) || !(sd->span & (1UL << i)))
 			continue;
 
 		rq_src = cpu_rq(i);
@@ -728,9 +843,8 @@ static inline runqueue_t *find_busiest_queue(runqueue_t *this_rq, int this_cpu,
 	//*imbalance = (max_load - nr_running) / 2;
 	*imbalance = max_load - nr_running;
 
-	/* It needs an at least ~25% imbalance to trigger balancing. */
-	//if (!idle && (*imbalance < (max_load + 3)/4)) {
-	if (!idle && ((*imbalance)*4 < max_load)) {
+	/* It needs an imbalance of imbalance_pct to trigger balancing. */
+	if (!idle && max_load * 100 < nr_running * sd->imbalance_pct) {
 		busiest = NULL;
 		goto out;
  	}
@@ -749,7 +863,7 @@ static inline runqueue_t *find_busiest_queue(runqueue_t *this_rq, int this_cpu,
 	 * We only want to steal a number of tasks equal to 1/2 the imbalance,
 	 * otherwise we'll just shift the imbalance to the new queue:
 	 */
-	*imbalance /= 2;
+	*imbalance = (*imbalance + 1) / 2;
 out:
 	return busiest;
 }
@@ -781,22 +895,26 @@ static inline void pull_task(runqueue_t *src_rq, prio_array_t *src_array, task_t
 /*
  * Current runqueue is empty, or rebalance tick: if there is an
  * inbalance (current runqueue is too short) then pull from
- * busiest runqueue(s).
+ * busiest runqueue(s) within the domain. Returns the number of
+ * tasks pulled.
  *
  * We call this with the current runqueue locked,
  * irqs disabled.
  */
-static void load_balance(runqueue_t *this_rq, int idle)
+static int load_balance(runqueue_t *this_rq, int idle, struct sched_domain *sd)
 {
-	int imbalance, idx, this_cpu = smp_processor_id();
+	int imbalance, idx, pulled = 0, this_cpu = smp_processor_id();
 	runqueue_t *busiest;
 	prio_array_t *array;
 	struct list_head *head, *curr;
 	task_t *tmp;
 
-	busiest = find_busiest_queue(this_rq, this_cpu, idle, &imbalance);
-	if (!busiest)
+	sd->lb_cnt[idle]++;
+	busiest = find_busiest_queue(this_rq, this_cpu, idle, &imbalance, sd);
+	if (!busiest) {
+		sd->lb_balanced[idle]++;
 		goto out;
+	}
 
 	/*
 	 * We first consider expired tasks. Those will likely not be
@@ -834,56 +952,180 @@ skip_queue:
 	 * We do not migrate tasks that are:
 	 * 1) running (obviously), or
 	 * 2) cannot be migrated to this CPU due to cpus_allowed, or
-	 * 3) are cache-hot on their current CPU.
+	 * 3) are cache-hot on their current CPU, unless balancing this
+	 *    domain failed repeatedly.
 	 */
 
 #define CAN_MIGRATE_TASK(p,rq,this_cpu)					\
-	((jiffies - (p)->last_run > cache_decay_ticks) &&	\
-		!task_running(rq, p) &&					\
-			((p)->cpus_allowed & (1UL << (this_cpu))))
+	(!task_running(rq, p) &&					\
+		((p)->cpus_allowed & (1UL << (this_cpu))))
+
+#define TASK_CACHE_HOT(p,sd)						\
+	((sd)->cache_hot_time &&					\
+		jiffies - (p)->last_run <= (sd)->cache_hot_time)
 
 	curr = curr->prev;
 
-	if (!CAN_MIGRATE_TASK(tmp, busiest, this_cpu)) {
-		if (curr != head)
-			goto skip_queue;
-		idx++;
-		goto skip_bitmap;
+	if (!CAN_MIGRATE_TASK(tmp, busiest, this_cpu))
+		goto next_task;
+	if (TASK_CACHE_HOT(tmp, sd) && sd->nr_failed <= SD_CACHE_NICE_TRIES) {
+		sd->lb_hot[idle]++;
+		goto next_task;
 	}
 	pull_task(busiest, array, tmp, this_rq, this_cpu);
-	if (!idle && --imbalance) {
-		if (curr != head)
-			goto skip_queue;
-		idx++;
-		goto skip_bitmap;
-	}
+	pulled++;
+	if (idle || !--imbalance)
+		goto out_unlock;
+next_task:
+	if (curr != head)
+		goto skip_queue;
+	idx++;
+	goto skip_bitmap;
 out_unlock:
 	spin_unlock(&busiest->lock);
+	if (pulled) {
+		sd->lb_gained[idle] += pulled;
+		sd->nr_failed = 0;
+	} else {
+		sd->lb_failed[idle]++;
+		sd->nr_failed++;
+	}
 out:
-	;
+	return pulled;
 }
- 
+
 /*
- * One of the idle_cpu_tick() and busy_cpu_tick() functions will
- * get called every timer tick, on every CPU. Our balancing action
- * frequency and balancing agressivity depends on whether the CPU is
- * idle or not.
- *
- * busy-rebalance every 250 msecs. idle-rebalance every 1 msec. (or on
- * systems with HZ=100, every 10 msecs.)
+ * This CPU is about to go idle: pull from the closest domain which
+ * has work to spare.
+ */
+static inline int idle_balance(runqueue_t *rq)
+{
+	int i;
+
+	for (i = 0; i < rq->nr_domains; i++)
+		if (load_balance(rq, 1, rq->sd + i))
+			return 1;
+	return 0;
+}
+
+/*
+ * Called every timer tick, on every CPU, with the runqueue locked.
+ * Each domain is balanced at its own interval, which depends on
+ * whether the CPU is idle or not.
+ */
+static void rebalance_tick(runqueue_t *rq, int idle)
+{
+	struct sched_domain *sd;
+	unsigned long interval;
+	int i;
+
+	for (i = 0; i < rq->nr_domains; i++) {
+		sd = rq->sd + i;
+		interval = idle ? sd->idle_interval : sd->busy_interval;
+		if (jiffies - sd->last_balance < interval)
+			continue;
+		sd->last_balance = jiffies;
+		if (load_balance(rq, idle, sd))
+			idle = 0;
+	}
+}
+
+/*
+ * busy-rebalance across packages every 250 msecs. idle-rebalance every
+ * 1 msec. (or on systems with HZ=100, every 10 msecs.)
  */
 #define BUSY_REBALANCE_TICK (HZ/4 ?: 1)
 #define IDLE_REBALANCE_TICK (HZ/1000 ?: 1)
 
 static inline void idle_tick(runqueue_t *rq)
 {
-	if (jiffies % IDLE_REBALANCE_TICK)
-		return;
 	spin_lock(&rq->lock);
-	load_balance(rq, 1);
+	rebalance_tick(rq, 1);
 	spin_unlock(&rq->lock);
 }
 
+#ifndef cpu_sibling
+#define cpu_sibling(cpu)	NO_PROC_ID
+#endif
+#ifndef cpu_to_package
+#define cpu_to_package(cpu)	0
+#endif
+#ifndef cpu_to_node
+#define cpu_to_node(cpu)	0
+#endif
+
+static void sched_init_domain(struct sched_domain *sd, int level, unsigned long span)
+{
+	memset(sd, 0, sizeof(*sd));
+	sd->level = level;
+	sd->span = span;
+	sd->last_balance = jiffies;
+	sd->imbalance_pct = 125;
+	switch (level) {
+	case SD_SIBLING:
+		sd->busy_interval = HZ/50 ?: 1;
+		sd->idle_interval = 1;
+		sd->imbalance_pct = 110;
+		break;
+	case SD_PACKAGE:
+		sd->busy_interval = BUSY_REBALANCE_TICK;
+		sd->idle_interval = IDLE_REBALANCE_TICK;
+		sd->cache_hot_time = cache_decay_ticks;
+		break;
+	case SD_NODE:
+		sd->busy_interval = 2 * BUSY_REBALANCE_TICK;
+		sd->idle_interval = HZ/100 ?: 1;
+		sd->cache_hot_time = 2 * cache_decay_ticks + 1;
+		break;
+	}
+}
+
+/*
+ * Build the domains of every CPU from the topology found by the
+ * architecture at SMP boot, until then every CPU balances flat.
+ * A package is the set of CPUs of one node with the same physical
+ * package id; an architecture that cannot tell packages apart reports
+ * 0 for all of them and the node is balanced as one package.
+ */
+static void __init sched_init_domains(void)
+{
+	unsigned long span[SD_LEVELS], flags;
+	struct sched_domain sd[SD_LEVELS];
+	int cpu, i, level, nr, sibling;
+	runqueue_t *rq;
+
+	for (cpu = 0; cpu < smp_num_cpus; cpu++) {
+		span[SD_SIBLING] = 1UL << cpu;
+		sibling = cpu_sibling(cpu);
+		if (sibling >= 0 && sibling < smp_num_cpus)
+			span[SD_SIBLING] |= 1UL << sibling;
+		span[SD_PACKAGE] = span[SD_NODE] = 0;
+		for (i = 0; i < smp_num_cpus; i++) {
+			span[SD_NODE] |= 1UL << i;
+			if (cpu_to_node(i) == cpu_to_node(cpu) &&
+			    cpu_to_package(i) == cpu_to_package(cpu))
+				span[SD_PACKAGE] |= 1UL << i;
+		}
+
+		nr = 0;
+		for (level = 0; level < SD_LEVELS; level++) {
+			if (span[level] == (nr ? sd[nr - 1].span : 1UL << cpu))
+				continue;
+			sched_init_domain(sd + nr++, level, span[level]);
+		}
+
+		rq = cpu_rq(cpu);
+		spin_lock_irqsave(&rq->lock, flags);
+		memcpy(rq->sd, sd, sizeof(sd));
+		rq->nr_domains = nr;
+		spin_unlock_irqrestore(&rq->lock, flags);
+
+		for (i = 0; i < nr; i++)
+			printk("CPU%d: sched domain %d span %08lx\n",
+				cpu, sd[i].level, sd[i].span);
+	}
+}
+
 #endif
 
 /*
@@ -976,8 +1218,7 @@ void scheduler_tick(int user_ticks, int sys_ticks)
 	}
 out:
 #if CONFIG_SMP
-	if (!(jiffies % BUSY_REBALANCE_TICK))
-		load_balance(rq, 0);
+	rebalance_tick(rq, 0);
 #endif
 	spin_unlock(&rq->lock);
 }
@@ -1025,7 +1266,7 @@ pick_next_task:
 #endif
 	if (unlikely(!rq->nr_running)) {
 #if CONFIG_SMP
-		load_balance(rq, 1);
+		idle_balance(rq);
 		if (rq->nr_running)
 			goto pick_next_task;
 #endif
@@ -1052,10 +1293,12 @@ pick_next_task:
 switch_tasks:
 	prefetch(next);
 	clear_tsk_need_resched(prev);
+	rcu_qsctr_inc(task_cpu(prev));
 
 	if (likely(prev != next)) {
 		struct mm_struct *prev_mm;
 		rq->nr_switches++;
+		sched_info_switch(rq, prev, next);
 		rq->curr = next;
 	
 		prepare_arch_switch(rq, next);
@@ -1094,6 +1337,12 @@ static inline void __wake_up_common(wait_queue_head_t *q, unsigned int mode, int
 
 	list_for_each(tmp, &q->task_list) {
 		curr = list_entry(tmp, wait_queue_t, task_list);
+		if (curr->func) {
+			if (curr->func(curr, mode, sync) &&
+			    (curr->flags & WQ_FLAG_EXCLUSIVE) && !--nr_exclusive)
+				break;
+			continue;
+		}
 		p = curr->task;
 		state = p->state;
 		if ((state & mode) && try_to_wake_up(p, mode, sync) &&
@@ -1907,6 +2156,73 @@ void show_state(void)
 	read_unlock(&tasklist_lock);
 }
 
+/*
+ * /proc/schedstat: two lines per CPU, followed on SMP by one line per
+ * scheduler domain of that CPU. Times are in nanoseconds.
+ *
+ *	cpu<N> <context switches> <wakeups> <timeslices> <running time>
+ *		<runnable time waited for the CPU>
+ *	lat<N> <SCHED_LAT_BUCKETS wakeup latency histogram buckets>
+ *	domain<N> <level> <span> then, for busy and idle balancing each,
+ *		<attempts> <balanced> <failed> <tasks pulled> <cache-hot skips>
+ */
+#define SCHEDSTAT_VERSION	2
+
+static void *schedstat_start(struct seq_file *m, loff_t *pos)
+{
+	return *pos < smp_num_cpus ? cpu_rq(*pos) : NULL;
+}
+
+static void *schedstat_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	++*pos;
+	return schedstat_start(m, pos);
+}
+
+static void schedstat_stop(struct seq_file *m, void *v)
+{
+}
+
+static int schedstat_show(struct seq_file *m, void *v)
+{
+	runqueue_t *rq = v;
+	int cpu = rq - runqueues, i;
+#if CONFIG_SMP
+	struct sched_domain *sd;
+	int idle;
+#endif
+
+	if (!cpu)
+		seq_printf(m, "version %d\ntimestamp %lu\n",
+			SCHEDSTAT_VERSION, jiffies);
+	seq_printf(m, "cpu%d %lu %lu %lu %llu %llu\n", cpu, rq->nr_switches,
+		rq->ttwu_cnt, rq->pcnt, rq->cpu_time, rq->run_delay);
+	seq_printf(m, "lat%d", cpu);
+	for (i = 0; i < SCHED_LAT_BUCKETS; i++)
+		seq_printf(m, " %lu", rq->lat_hist[i]);
+	seq_putc(m, '\n');
+#if CONFIG_SMP
+	for (i = 0; i < rq->nr_domains; i++) {
+		sd = rq->sd + i;
+		seq_printf(m, "domain%d %d %08lx", i, sd->level, sd->span);
+		for (idle = 0; idle < 2; idle++)
+			seq_printf(m, " %lu %lu %lu %lu %lu",
+				sd->lb_cnt[idle], sd->lb_balanced[idle],
+				sd->lb_failed[idle], sd->lb_gained[idle],
+				sd->lb_hot[idle]);
+		seq_putc(m, '\n');
+	}
+#endif
+	return 0;
+}
+
+const struct seq_operations schedstat_op = {
+	start:	schedstat_start,
+	next:	schedstat_next,
+	stop:	schedstat_stop,
+	show:	schedstat_show,
+};
+
 void __init init_idle(task_t *idle, int cpu)
 {
 	runqueue_t *idle_rq = cpu_rq(cpu), *rq = cpu_rq(task_cpu(idle));
@@ -2093,6 +2409,8 @@ __init int migration_init(void)
 {
 	int cpu;
 
+	sched_init_domains();
+
 	/* Start one for boot CPU. */
 	migration_call((void *)(long)smp_processor_id());
 
@@ -2107,6 +2425,7 @@ __init int migration_init(void)
 
 
 extern void init_timervecs(void);
+extern void init_hrtimers(void);
 extern void timer_bh(void);
 extern void tqueue_bh(void);
 extern void immediate_bh(void);
@@ -2135,6 +2454,10 @@ void __init sched_init(void)
 			// delimiter for bitsearch
 			__set_bit(MAX_PRIO, array->bitmap);
 		}
+#if CONFIG_SMP
+		sched_init_domain(rq->sd, SD_PACKAGE, ~0UL);
+		rq->nr_domains = 1;
+#endif
 	}
 	/*
 	 * We have to do a little magic to get the first
@@ -2147,6 +2470,7 @@ void __init sched_init(void)
 	wake_up_forked_process(current);
 
 	init_timervecs();
+	init_hrtimers();
 	init_bh(TIMER_BH, timer_bh);
 	init_bh(TQUEUE_BH, tqueue_bh);
 	init_bh(IMMEDIATE_BH, immediate_bh);
@@ -22,8 +22,11 @@
 #include <linux/smp_lock.h>
 #include <linux/interrupt.h>
 #include <linux/kernel_stat.h>
+#include <linux/hrtimer.h>
+#include <linux/rcupdate.h>
 
 #include <asm/uaccess.h>
+#include <asm/div64.h>
 
 struct kernel_stat kstat;
 
@@ -75,6 +78,16 @@ unsigned long prof_shift;
 
 /*
  * Event timer code
+ *
+ * Every CPU owns a timer base with its own lock and wheel. A timer is
+ * queued on the base of the CPU which armed it and expires from the
+ * TIMER_SOFTIRQ of that CPU, so arming and deleting timers on different
+ * CPUs never share a lock or cache line. timer->base remembers the base a
+ * timer was last queued on, it has to be rechecked after taking the base
+ * lock as mod_timer() can move the timer to another base meanwhile.
+ *
+ * Handlers still run with the guarantees they had under TIMER_BH, see
+ * run_timer_softirq().
  */
 #define TVN_BITS 6
 #define TVR_BITS 8
@@ -93,67 +106,88 @@ struct timer_vec_root {
 	struct list_head vec[TVR_SIZE];
 };
 
-static struct timer_vec tv5;
-static struct timer_vec tv4;
-static struct timer_vec tv3;
-static struct timer_vec tv2;
-static struct timer_vec_root tv1;
+struct tvec_base_s {
+	spinlock_t lock;
+	unsigned long timer_jiffies;
+	struct timer_list *running_timer;
+	struct list_head *run_timer_list_running;
+	struct timer_vec_root tv1;
+	struct timer_vec tv2;
+	struct timer_vec tv3;
+	struct timer_vec tv4;
+	struct timer_vec tv5;
+} ____cacheline_aligned;
 
-static struct timer_vec * const tvecs[] = {
-	(struct timer_vec *)&tv1, &tv2, &tv3, &tv4, &tv5
-};
+typedef struct tvec_base_s tvec_base_t;
 
-static struct list_head * run_timer_list_running;
+static tvec_base_t tvec_bases[NR_CPUS] __cacheline_aligned;
+
+#define NOOF_TVECS 5
+
+static inline struct timer_vec *tvec(tvec_base_t *base, int n)
+{
+	switch (n) {
+	case 0: return (struct timer_vec *)&base->tv1;
+	case 1: return &base->tv2;
+	case 2: return &base->tv3;
+	case 3: return &base->tv4;
+	}
+	return &base->tv5;
+}
 
-#define NOOF_TVECS (sizeof(tvecs) / sizeof(tvecs[0]))
+static void run_timer_softirq(struct softirq_action *h);
 
 void init_timervecs (void)
 {
-	int i;
+	int i, cpu;
 
-	for (i = 0; i < TVN_SIZE; i++) {
-		INIT_LIST_HEAD(tv5.vec + i);
-		INIT_LIST_HEAD(tv4.vec + i);
-		INIT_LIST_HEAD(tv3.vec + i);
-		INIT_LIST_HEAD(tv2.vec + i);
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		tvec_base_t *base = tvec_bases + cpu;
+
+		spin_lock_init(&base->lock);
+		for (i = 0; i < TVN_SIZE; i++) {
+			INIT_LIST_HEAD(base->tv5.vec + i);
+			INIT_LIST_HEAD(base->tv4.vec + i);
+			INIT_LIST_HEAD(base->tv3.vec + i);
+			INIT_LIST_HEAD(base->tv2.vec + i);
+		}
+		for (i = 0; i < TVR_SIZE; i++)
+			INIT_LIST_HEAD(base->tv1.vec + i);
 	}
-	for (i = 0; i < TVR_SIZE; i++)
-		INIT_LIST_HEAD(tv1.vec + i);
+	open_softirq(TIMER_SOFTIRQ, run_timer_softirq, NULL);
 }
 
-static unsigned long timer_jiffies;
-
-static inline void internal_add_timer(struct timer_list *timer)
+static inline void internal_add_timer(tvec_base_t *base, struct timer_list *timer)
 {
 	/*
-	 * must be cli-ed when calling this
+	 * must be cli-ed and hold base->lock when calling this
 	 */
 	unsigned long expires = timer->expires;
-	unsigned long idx = expires - timer_jiffies;
+	unsigned long idx = expires - base->timer_jiffies;
 	struct list_head * vec;
 
-	if (run_timer_list_running)
-		vec = run_timer_list_running;
+	if (base->run_timer_list_running)
+		vec = base->run_timer_list_running;
 	else if (idx < TVR_SIZE) {
 		int i = expires & TVR_MASK;
-		vec = tv1.vec + i;
+		vec = base->tv1.vec + i;
 	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
 		int i = (expires >> TVR_BITS) & TVN_MASK;
-		vec = tv2.vec + i;
+		vec = base->tv2.vec + i;
 	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
 		int i = (expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK;
-		vec =  tv3.vec + i;
+		vec = base->tv3.vec + i;
 	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
 		int i = (expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK;
-		vec = tv4.vec + i;
+		vec = base->tv4.vec + i;
 	} else if ((signed long) idx < 0) {
 		/* can happen if you add a timer with expires == jiffies,
 		 * or you set a timer to go off in the past
 		 */
-		vec = tv1.vec + tv1.index;
+		vec = base->tv1.vec + base->tv1.index;
 	} else if (idx <= 0xffffffffUL) {
 		int i = (expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK;
-		vec = tv5.vec + i;
+		vec = base->tv5.vec + i;
 	} else {
 		/* Can only get here on architectures with 64-bit jiffies */
 		INIT_LIST_HEAD(&timer->list);
@@ -162,37 +196,49 @@ static inline void internal_add_timer(struct timer_list *timer)
 	/*
 	 * Timers are FIFO!
 	 */
+	timer->base = base;
 	list_add(&timer->list, vec->prev);
 }
 
-/* Initialize both explicitly - let's try to have them in the same cache line */
-spinlock_t timerlist_lock = SPIN_LOCK_UNLOCKED;
-
 #ifdef CONFIG_SMP
-volatile struct timer_list * volatile running_timer;
-#define timer_enter(t) do { running_timer = t; mb(); } while (0)
-#define timer_exit() do { running_timer = NULL; } while (0)
-#define timer_is_running(t) (running_timer == t)
-#define timer_synchronize(t) while (timer_is_running(t)) barrier()
+#define timer_enter(b, t) do { (b)->running_timer = t; mb(); } while (0)
+#define timer_exit(b) do { (b)->running_timer = NULL; } while (0)
 #else
-#define timer_enter(t)		do { } while (0)
-#define timer_exit()		do { } while (0)
+#define timer_enter(b, t)	do { } while (0)
+#define timer_exit(b)		do { } while (0)
 #endif
 
-void add_timer(struct timer_list *timer)
+/*
+ * Base a timer was queued on last. Timers set up without init_timer()
+ * may carry a stale pointer which must not be taken for a base.
+ */
+static inline tvec_base_t *timer_base(struct timer_list *timer)
 {
-	unsigned long flags;
+	tvec_base_t *base = timer->base;
 
-	spin_lock_irqsave(&timerlist_lock, flags);
-	if (timer_pending(timer))
-		goto bug;
-	internal_add_timer(timer);
-	spin_unlock_irqrestore(&timerlist_lock, flags);
-	return;
-bug:
-	spin_unlock_irqrestore(&timerlist_lock, flags);
-	printk("bug: kernel timer added twice at %p.\n",
-			__builtin_return_address(0));
+	if (base < tvec_bases || base >= tvec_bases + NR_CPUS)
+		return NULL;
+	return base;
+}
+
+/*
+ * Lock the base a timer is queued on, NULL if it never was queued.
+ * Returns with interrupts disabled and the base locked otherwise.
+ */
+static tvec_base_t *lock_timer_base(struct timer_list *timer, unsigned long *flags)
+{
+	tvec_base_t *base;
+
+	for (;;) {
+		local_irq_save(*flags);
+		base = timer_base(timer);
+		if (!base)
+			return NULL;
+		spin_lock(&base->lock);
+		if (base == timer_base(timer))
+			return base;
+		spin_unlock_irqrestore(&base->lock, *flags);
+	}
 }
 
 static inline int detach_timer (struct timer_list *timer)
@@ -203,35 +249,105 @@ static inline int detach_timer (struct timer_list *timer)
 	return 1;
 }
 
-int mod_timer(struct timer_list *timer, unsigned long expires)
+/*
+ * Queue a timer on the local base, detaching it from the base it is
+ * currently queued on. A timer whose handler is running stays on its
+ * old base, otherwise del_timer_sync() could miss the running handler
+ * and the handler could run concurrently with itself on two CPUs.
+ */
+static int __mod_timer(struct timer_list *timer, unsigned long expires, int added)
 {
-	int ret;
+	tvec_base_t *old_base, *new_base;
 	unsigned long flags;
+	int ret;
 
-	spin_lock_irqsave(&timerlist_lock, flags);
-	timer->expires = expires;
+repeat:
+	local_irq_save(flags);
+	new_base = tvec_bases + smp_processor_id();
+	old_base = timer_base(timer);
+
+	if (old_base && old_base != new_base) {
+		/* lock order is by address so two CPUs swapping bases cannot deadlock */
+		if (old_base < new_base) {
+			spin_lock(&old_base->lock);
+			spin_lock(&new_base->lock);
+		} else {
+			spin_lock(&new_base->lock);
+			spin_lock(&old_base->lock);
+		}
+		if (timer_base(timer) != old_base) {
+			spin_unlock(&new_base->lock);
+			spin_unlock(&old_base->lock);
+			local_irq_restore(flags);
+			goto repeat;
+		}
+	} else {
+		spin_lock(&new_base->lock);
+		if (timer_base(timer) != old_base) {
+			spin_unlock(&new_base->lock);
+			local_irq_restore(flags);
+			goto repeat;
+		}
+	}
+
+	if (added && timer_pending(timer)) {
+		ret = -1;
+		goto out;
+	}
 	ret = detach_timer(timer);
-	internal_add_timer(timer);
-	spin_unlock_irqrestore(&timerlist_lock, flags);
+	timer->expires = expires;
+	if (old_base && old_base->running_timer == timer)
+		internal_add_timer(old_base, timer);
+	else
+		internal_add_timer(new_base, timer);
+out:
+	if (old_base && old_base != new_base)
+		spin_unlock(&old_base->lock);
+	spin_unlock(&new_base->lock);
+	local_irq_restore(flags);
 	return ret;
 }
 
+void add_timer(struct timer_list *timer)
+{
+	if (__mod_timer(timer, timer->expires, 1) < 0)
+		printk("bug: kernel timer added twice at %p.\n",
+				__builtin_return_address(0));
+}
+
+int mod_timer(struct timer_list *timer, unsigned long expires)
+{
+	return __mod_timer(timer, expires, 0);
+}
+
 int del_timer(struct timer_list * timer)
 {
-	int ret;
+	tvec_base_t *base;
 	unsigned long flags;
+	int ret;
 
-	spin_lock_irqsave(&timerlist_lock, flags);
+	base = lock_timer_base(timer, &flags);
+	if (!base) {
+		local_irq_restore(flags);
+		return 0;
+	}
 	ret = detach_timer(timer);
 	timer->list.next = timer->list.prev = NULL;
-	spin_unlock_irqrestore(&timerlist_lock, flags);
+	spin_unlock_irqrestore(&base->lock, flags);
 	return ret;
 }
 
 #ifdef CONFIG_SMP
+/*
+ * Wait until no timer handler is running on any CPU.
+ */
 void sync_timers(void)
 {
-	spin_unlock_wait(&global_bh_lock);
+	int i;
+
+	for (i = 0; i < smp_num_cpus; i++)
+		while (tvec_bases[i].running_timer)
+			cpu_relax();
 }
 
 /*
@@ -244,30 +360,31 @@ void sync_timers(void)
 
 int del_timer_sync(struct timer_list * timer)
 {
-	int ret = 0;
+	tvec_base_t *base;
+	int i, ret = 0;
 
-	for (;;) {
-		unsigned long flags;
-		int running;
-
-		spin_lock_irqsave(&timerlist_lock, flags);
-		ret += detach_timer(timer);
-		timer->list.next = timer->list.prev = 0;
-		running = timer_is_running(timer);
-		spin_unlock_irqrestore(&timerlist_lock, flags);
+del_again:
+	ret += del_timer(timer);
 
-		if (!running)
+	for (i = 0; i < smp_num_cpus; i++) {
+		base = tvec_bases + i;
+		if (base->running_timer == timer) {
+			while (base->running_timer == timer)
+				cpu_relax();
 			break;
-
-		timer_synchronize(timer);
+		}
 	}
+	smp_rmb();
+	/* the handler may have re-armed the timer */
+	if (timer_pending(timer))
+		goto del_again;
 
 	return ret;
 }
 #endif
 
 
-static inline void cascade_timers(struct timer_vec *tv)
+static inline void cascade_timers(tvec_base_t *base, struct timer_vec *tv)
 {
 	/* cascade all the timers from tv up one level */
 	struct list_head *head, *curr, *next;
@@ -284,28 +401,28 @@ static inline void cascade_timers(struct timer_vec *tv)
 		tmp = list_entry(curr, struct timer_list, list);
 		next = curr->next;
 		list_del(curr); // not needed
-		internal_add_timer(tmp);
+		internal_add_timer(base, tmp);
 		curr = next;
 	}
 	INIT_LIST_HEAD(head);
 	tv->index = (tv->index + 1) & TVN_MASK;
 }
 
-static inline void run_timer_list(void)
+static inline void run_timer_list(tvec_base_t *base)
 {
-	spin_lock_irq(&timerlist_lock);
-	while ((long)(jiffies - timer_jiffies) >= 0) {
+	spin_lock_irq(&base->lock);
+	while ((long)(jiffies - base->timer_jiffies) >= 0) {
 		LIST_HEAD(queued);
 		struct list_head *head, *curr;
-		if (!tv1.index) {
+		if (!base->tv1.index) {
 			int n = 1;
 			do {
-				cascade_timers(tvecs[n]);
-			} while (tvecs[n]->index == 1 && ++n < NOOF_TVECS);
+				cascade_timers(base, tvec(base, n));
+			} while (tvec(base, n)->index == 1 && ++n < NOOF_TVECS);
 		}
-		run_timer_list_running = &queued;
+		base->run_timer_list_running = &queued;
 repeat:
-		head = tv1.vec + tv1.index;
+		head = base->tv1.vec + base->tv1.index;
 		curr = head->next;
 		if (curr != head) {
 			struct timer_list *timer;
@@ -318,16 +435,16 @@ repeat:
 
 			detach_timer(timer);
 			timer->list.next = timer->list.prev = NULL;
-			timer_enter(timer);
-			spin_unlock_irq(&timerlist_lock);
+			timer_enter(base, timer);
+			spin_unlock_irq(&base->lock);
 			fn(data);
-			spin_lock_irq(&timerlist_lock);
-			timer_exit();
+			spin_lock_irq(&base->lock);
+			timer_exit(base);
 			goto repeat;
 		}
-		run_timer_list_running = NULL;
-		++timer_jiffies; 
-		tv1.index = (tv1.index + 1) & TVR_MASK;
+		base->run_timer_list_running = NULL;
+		++base->timer_jiffies; 
+		base->tv1.index = (base->tv1.index + 1) & TVR_MASK;
 
 		curr = queued.next;
 		while (curr != &queued) {
@@ -335,10 +452,62 @@ repeat:
 
 			timer = list_entry(curr, struct timer_list, list);
 			curr = curr->next;
-			internal_add_timer(timer);
+			internal_add_timer(base, timer);
 		}			
 	}
-	spin_unlock_irq(&timerlist_lock);
+	spin_unlock_irq(&base->lock);
+}
+
+/*
+ * Timer handlers are written for TIMER_BH: they never run in parallel
+ * with each other, cli() keeps them out and tasklet_disable() of the
+ * TIMER_BH tasklet waits for them (deliver_to_old_ones() does). Expiry
+ * is run the way bh_action() runs a BH: owning the TIMER_BH tasklet and
+ * global_bh_lock, and tried again later if either is busy.
+ */
+static void run_timer_softirq(struct softirq_action *h)
+{
+	int cpu = smp_processor_id();
+	tvec_base_t *base = tvec_bases + cpu;
+	struct tasklet_struct *t = bh_task_vec + TIMER_BH;
+
+	if ((long)(jiffies - base->timer_jiffies) < 0)
+		return;
+
+	if (!tasklet_trylock(t))
+		goto resched;
+	if (atomic_read(&t->count))
+		goto resched_unlock_bh;
+	if (!spin_trylock(&global_bh_lock))
+		goto resched_unlock_bh;
+	if (!hardirq_trylock(cpu))
+		goto resched_unlock;
+
+	run_timer_list(base);
+
+	hardirq_endlock(cpu);
+	spin_unlock(&global_bh_lock);
+	tasklet_unlock(t);
+	return;
+
+resched_unlock:
+	spin_unlock(&global_bh_lock);
+resched_unlock_bh:
+	tasklet_unlock(t);
+resched:
+	__cpu_raise_softirq(cpu, TIMER_SOFTIRQ);
+}
+
+/*
+ * Unlock the timer bases which would prevent an oops message from
+ * getting out, the console unblank code takes them.
+ */
+void bust_timer_locks(void)
+{
+	int i;
+
+	for (i = 0; i < NR_CPUS; i++)
+		spin_lock_init(&tvec_bases[i].lock);
 }
 
 spinlock_t tqueue_lock = SPIN_LOCK_UNLOCKED;
@@ -603,6 +772,9 @@ void update_process_times(int user_tick)
 
 	update_one_process(p, user_tick, system, cpu);
 	scheduler_tick(user_tick, system);
+	rcu_check_callbacks(cpu, user_tick);
+	/* expire the timers queued on this CPU */
+	__cpu_raise_softirq(cpu, TIMER_SOFTIRQ);
 }
 
 /*
@@ -669,7 +841,6 @@ static inline void update_times(void)
 void timer_bh(void)
 {
 	update_times();
-	run_timer_list();
 }
 
 void do_timer(struct pt_regs *regs)
@@ -901,6 +1072,21 @@ asmlinkage long sys_nanosleep(struct timespec *rqtp, struct timespec *rmtp)
 	if (t.tv_nsec >= 1000000000L || t.tv_nsec < 0 || t.tv_sec < 0)
 		return -EINVAL;
 
+	if (hrtimer_available()) {
+		unsigned long long left;
+
+		left = hrtimer_nanosleep((unsigned long long) t.tv_sec *
+					 1000000000 + t.tv_nsec);
+		if (!left)
+			return 0;
+		if (rmtp) {
+			t.tv_nsec = do_div(left, 1000000000);
+			t.tv_sec = (time_t) left;
+			if (copy_to_user(rmtp, &t, sizeof(struct timespec)))
+				return -EFAULT;
+		}
+		return -EINTR;
+	}
 
 	if (t.tv_sec == 0 && t.tv_nsec <= 2000000L &&
 	    current->policy != SCHED_NORMAL)
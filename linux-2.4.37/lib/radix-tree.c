@@ -0,0 +1,637 @@
+/*
+ *  linux/lib/radix-tree.c
+ *
+ *  Radix tree mapping unsigned long indices to pointers, with per-slot
+ *  tags and gang lookups. Used to index the page cache of each
+ *  address_space, see include/linux/radix-tree.h.
+ *
+ *  Node allocation: trees whose gfp_mask cannot sleep (the page cache
+ *  trees are modified under a spinlock) fall back to a small per-CPU
+ *  pool of nodes when the slab allocation fails. radix_tree_preload()
+ *  fills that pool beforehand, from a context which may still sleep,
+ *  so that a following insertion cannot run out of nodes. The pool is
+ *  only safe because nobody inserts from interrupt context and the
+ *  caller does not sleep between the preload and the insertion.
+ */
+
+#include <linux/errno.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/smp.h>
+#include <linux/cache.h>
+#include <linux/string.h>
+#include <linux/radix-tree.h>
+
+#include <asm/bitops.h>
+
+#define RADIX_TREE_MAP_SHIFT	6
+#define RADIX_TREE_MAP_SIZE	(1UL << RADIX_TREE_MAP_SHIFT)
+#define RADIX_TREE_MAP_MASK	(RADIX_TREE_MAP_SIZE - 1)
+#define RADIX_TREE_TAG_LONGS	\
+	((RADIX_TREE_MAP_SIZE + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
+struct radix_tree_node {
+	unsigned int	count;
+	void		*slots[RADIX_TREE_MAP_SIZE];
+	unsigned long	tags[RADIX_TREE_MAX_TAGS][RADIX_TREE_TAG_LONGS];
+};
+
+struct radix_tree_path {
+	struct radix_tree_node *node;
+	void **slot;
+	int offset;
+};
+
+#define RADIX_TREE_INDEX_BITS	(8 * sizeof(unsigned long))
+#define RADIX_TREE_MAX_PATH	(RADIX_TREE_INDEX_BITS / RADIX_TREE_MAP_SHIFT + 2)
+
+static unsigned long height_to_maxindex[RADIX_TREE_MAX_PATH];
+
+static kmem_cache_t *radix_tree_node_cachep;
+
+struct radix_tree_preload {
+	int nr;
+	struct radix_tree_node *nodes[RADIX_TREE_MAX_PATH];
+} ____cacheline_aligned;
+
+static struct radix_tree_preload radix_tree_preloads[NR_CPUS];
+
+static struct radix_tree_node *radix_tree_node_alloc(struct radix_tree_root *root)
+{
+	struct radix_tree_node *node;
+
+	node = kmem_cache_alloc(radix_tree_node_cachep, root->gfp_mask);
+	if (node == NULL && !(root->gfp_mask & __GFP_WAIT)) {
+		struct radix_tree_preload *rtp;
+
+		rtp = &radix_tree_preloads[smp_processor_id()];
+		if (rtp->nr) {
+			node = rtp->nodes[--rtp->nr];
+			rtp->nodes[rtp->nr] = NULL;
+		}
+	}
+	if (node)
+		memset(node, 0, sizeof(*node));
+	return node;
+}
+
+static inline void radix_tree_node_free(struct radix_tree_node *node)
+{
+	kmem_cache_free(radix_tree_node_cachep, node);
+}
+
+/*
+ * Make sure the pool of this CPU holds enough nodes for one insertion
+ * into any tree. Returns -ENOMEM if it could not be filled completely.
+ */
+int radix_tree_preload(int gfp_mask)
+{
+	struct radix_tree_preload *rtp;
+	struct radix_tree_node *node;
+
+	/* callers pass the gfp_mask of a mapping, which may ask for highmem */
+	gfp_mask &= SLAB_LEVEL_MASK;
+
+	rtp = &radix_tree_preloads[smp_processor_id()];
+	while (rtp->nr < RADIX_TREE_MAX_PATH) {
+		node = kmem_cache_alloc(radix_tree_node_cachep, gfp_mask);
+		if (node == NULL)
+			return -ENOMEM;
+		/* we may have slept and come back on another CPU */
+		rtp = &radix_tree_preloads[smp_processor_id()];
+		if (rtp->nr < RADIX_TREE_MAX_PATH)
+			rtp->nodes[rtp->nr++] = node;
+		else
+			radix_tree_node_free(node);
+	}
+	return 0;
+}
+
+static inline void tag_set(struct radix_tree_node *node, int tag, int offset)
+{
+	__set_bit(offset, node->tags[tag]);
+}
+
+static inline void tag_clear(struct radix_tree_node *node, int tag, int offset)
+{
+	__clear_bit(offset, node->tags[tag]);
+}
+
+static inline int tag_get(struct radix_tree_node *node, int tag, int offset)
+{
+	return test_bit(offset, node->tags[tag]);
+}
+
+static inline int any_tag_set(struct radix_tree_node *node, int tag)
+{
+	int idx;
+
+	for (idx = 0; idx < RADIX_TREE_TAG_LONGS; idx++)
+		if (node->tags[tag][idx])
+			return 1;
+	return 0;
+}
+
+/*
+ * Largest index a tree of the given height can hold.
+ */
+static inline unsigned long radix_tree_maxindex(unsigned int height)
+{
+	return height_to_maxindex[height];
+}
+
+/*
+ * Add new root nodes until the tree is high enough to hold index. The
+ * old root becomes slot 0 of the new one and passes its tags upwards.
+ */
+static int radix_tree_extend(struct radix_tree_root *root, unsigned long index)
+{
+	struct radix_tree_node *node;
+	unsigned int height;
+	char tags[RADIX_TREE_MAX_TAGS];
+	int tag;
+
+	height = root->height + 1;
+	while (index > radix_tree_maxindex(height))
+		height++;
+
+	if (root->rnode == NULL) {
+		root->height = height;
+		return 0;
+	}
+
+	for (tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++)
+		tags[tag] = any_tag_set(root->rnode, tag);
+
+	do {
+		node = radix_tree_node_alloc(root);
+		if (node == NULL)
+			return -ENOMEM;
+
+		node->slots[0] = root->rnode;
+		for (tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++)
+			if (tags[tag])
+				tag_set(node, tag, 0);
+		node->count = 1;
+		root->rnode = node;
+		root->height++;
+	} while (height > root->height);
+
+	return 0;
+}
+
+/**
+ * radix_tree_insert - insert into a radix tree
+ * @root: radix tree root
+ * @index: index key
+ * @item: item to insert
+ *
+ * Returns -EEXIST if @index is already in use and -ENOMEM if a node
+ * could not be allocated.
+ */
+int radix_tree_insert(struct radix_tree_root *root, unsigned long index, void *item)
+{
+	struct radix_tree_node *node = NULL, *tmp;
+	unsigned int height, shift;
+	void **slot;
+	int offset = 0;
+	int error;
+
+	if ((!index && !root->rnode) || index > radix_tree_maxindex(root->height)) {
+		error = radix_tree_extend(root, index);
+		if (error)
+			return error;
+	}
+
+	slot = (void **) &root->rnode;
+	height = root->height;
+	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+
+	while (height > 0) {
+		if (*slot == NULL) {
+			tmp = radix_tree_node_alloc(root);
+			if (tmp == NULL)
+				return -ENOMEM;
+			*slot = tmp;
+			if (node)
+				node->count++;
+		}
+
+		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		node = *slot;
+		slot = node->slots + offset;
+		shift -= RADIX_TREE_MAP_SHIFT;
+		height--;
+	}
+
+	if (*slot != NULL)
+		return -EEXIST;
+	if (node) {
+		node->count++;
+		BUG_ON(tag_get(node, 0, offset));
+		BUG_ON(tag_get(node, 1, offset));
+	}
+	*slot = item;
+	return 0;
+}
+
+/**
+ * radix_tree_lookup - look up an item in a radix tree
+ * @root: radix tree root
+ * @index: index key
+ *
+ * Returns the item at @index, or NULL if there is none.
+ */
+void *radix_tree_lookup(struct radix_tree_root *root, unsigned long index)
+{
+	unsigned int height, shift;
+	struct radix_tree_node *node;
+	void **slot;
+
+	height = root->height;
+	if (index > radix_tree_maxindex(height))
+		return NULL;
+
+	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+	slot = (void **) &root->rnode;
+
+	while (height > 0) {
+		if (*slot == NULL)
+			return NULL;
+
+		node = *slot;
+		slot = node->slots + ((index >> shift) & RADIX_TREE_MAP_MASK);
+		shift -= RADIX_TREE_MAP_SHIFT;
+		height--;
+	}
+
+	return *slot;
+}
+
+/**
+ * radix_tree_tag_set - set a tag on a radix tree item
+ * @root: radix tree root
+ * @index: index key
+ * @tag: tag index
+ *
+ * Sets @tag on the item at @index and on all nodes above it. The item
+ * must be present. Returns the item.
+ */
+void *radix_tree_tag_set(struct radix_tree_root *root, unsigned long index, int tag)
+{
+	unsigned int height, shift;
+	struct radix_tree_node *node;
+	void *item;
+
+	height = root->height;
+	if (index > radix_tree_maxindex(height))
+		return NULL;
+
+	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+	item = root->rnode;
+
+	while (height > 0) {
+		int offset;
+
+		node = item;
+		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		tag_set(node, tag, offset);
+		item = node->slots[offset];
+		BUG_ON(item == NULL);
+		shift -= RADIX_TREE_MAP_SHIFT;
+		height--;
+	}
+
+	return item;
+}
+
+/**
+ * radix_tree_tag_clear - clear a tag on a radix tree item
+ * @root: radix tree root
+ * @index: index key
+ * @tag: tag index
+ *
+ * Clears @tag on the item at @index, and on the nodes above it as long
+ * as they have no other tagged slot. Returns the item, or NULL if
+ * there is none at @index.
+ */
+void *radix_tree_tag_clear(struct radix_tree_root *root, unsigned long index, int tag)
+{
+	struct radix_tree_path path[RADIX_TREE_MAX_PATH], *pathp = path;
+	struct radix_tree_node *node;
+	unsigned int height, shift;
+	void *item;
+
+	height = root->height;
+	if (index > radix_tree_maxindex(height))
+		return NULL;
+
+	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+	pathp->node = NULL;
+	item = root->rnode;
+
+	while (height > 0) {
+		int offset;
+
+		if (item == NULL)
+			return NULL;
+
+		node = item;
+		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		pathp[1].offset = offset;
+		pathp[1].node = node;
+		item = node->slots[offset];
+		pathp++;
+		shift -= RADIX_TREE_MAP_SHIFT;
+		height--;
+	}
+
+	if (item == NULL)
+		return NULL;
+
+	do {
+		if (!tag_get(pathp->node, tag, pathp->offset))
+			break;
+		tag_clear(pathp->node, tag, pathp->offset);
+		if (any_tag_set(pathp->node, tag))
+			break;
+		pathp--;
+	} while (pathp->node);
+
+	return item;
+}
+
+/**
+ * radix_tree_tag_get - get a tag on a radix tree item
+ * @root: radix tree root
+ * @index: index key
+ * @tag: tag index
+ *
+ * Returns 1 if the item at @index is present and has @tag set.
+ */
+int radix_tree_tag_get(struct radix_tree_root *root, unsigned long index, int tag)
+{
+	unsigned int height, shift;
+	struct radix_tree_node *node;
+
+	height = root->height;
+	if (index > radix_tree_maxindex(height))
+		return 0;
+
+	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+	node = root->rnode;
+
+	while (node != NULL) {
+		int offset;
+
+		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		if (!tag_get(node, tag, offset))
+			return 0;
+		if (height == 1)
+			return 1;
+		node = node->slots[offset];
+		shift -= RADIX_TREE_MAP_SHIFT;
+		height--;
+	}
+
+	return 0;
+}
+
+/**
+ * radix_tree_tagged - test whether any item in the tree has a tag set
+ * @root: radix tree root
+ * @tag: tag index
+ */
+int radix_tree_tagged(struct radix_tree_root *root, int tag)
+{
+	if (root->rnode == NULL)
+		return 0;
+	return any_tag_set(root->rnode, tag);
+}
+
+/*
+ * Collect up to max_items items, all tagged with tag if tag is not
+ * negative, from the first leaf node at or after index holding any.
+ * *next_index is set to where the next call should continue, or to 0
+ * once the end of the index space was reached.
+ */
+static unsigned int __lookup(struct radix_tree_root *root, void **results,
+	unsigned long index, unsigned int max_items, unsigned long *next_index,
+	int tag)
+{
+	unsigned int nr_found = 0;
+	unsigned int height, shift;
+	struct radix_tree_node *node;
+
+	height = root->height;
+	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+	node = root->rnode;
+
+	while (height > 0) {
+		unsigned long i = (index >> shift) & RADIX_TREE_MAP_MASK;
+
+		for ( ; i < RADIX_TREE_MAP_SIZE; i++) {
+			if (tag < 0 ? node->slots[i] != NULL : tag_get(node, tag, i))
+				break;
+			index &= ~((1UL << shift) - 1);
+			index += 1UL << shift;
+			if (index == 0)
+				goto out;	/* wrapped around */
+		}
+		if (i == RADIX_TREE_MAP_SIZE)
+			goto out;
+
+		height--;
+		if (height == 0) {
+			unsigned long j = index & RADIX_TREE_MAP_MASK;
+
+			for ( ; j < RADIX_TREE_MAP_SIZE; j++) {
+				index++;
+				if (node->slots[j] == NULL)
+					continue;
+				if (tag >= 0 && !tag_get(node, tag, j))
+					continue;
+				results[nr_found++] = node->slots[j];
+				if (nr_found == max_items)
+					goto out;
+			}
+		}
+		shift -= RADIX_TREE_MAP_SHIFT;
+		node = node->slots[i];
+	}
+out:
+	*next_index = index;
+	return nr_found;
+}
+
+static unsigned int radix_tree_gang(struct radix_tree_root *root, void **results,
+	unsigned long first_index, unsigned int max_items, int tag)
+{
+	const unsigned long max_index = radix_tree_maxindex(root->height);
+	unsigned long cur_index = first_index;
+	unsigned int ret = 0;
+
+	if (root->rnode == NULL)
+		return 0;
+
+	while (ret < max_items) {
+		unsigned long next_index;
+
+		if (cur_index > max_index)
+			break;
+		ret += __lookup(root, results + ret, cur_index,
+				max_items - ret, &next_index, tag);
+		if (next_index == 0)
+			break;
+		cur_index = next_index;
+	}
+
+	return ret;
+}
+
+/**
+ * radix_tree_gang_lookup - look up several items at once
+ * @root: radix tree root
+ * @results: where the results of the lookup are placed
+ * @first_index: start the lookup from this key
+ * @max_items: place up to this many items at *results
+ *
+ * Returns the number of items found, in ascending index order, all of
+ * them at or after @first_index.
+ */
+unsigned int radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
+	unsigned long first_index, unsigned int max_items)
+{
+	return radix_tree_gang(root, results, first_index, max_items, -1);
+}
+
+/**
+ * radix_tree_gang_lookup_tag - look up several tagged items at once
+ * @root: radix tree root
+ * @results: where the results of the lookup are placed
+ * @first_index: start the lookup from this key
+ * @max_items: place up to this many items at *results
+ * @tag: only return items with this tag set
+ *
+ * Like radix_tree_gang_lookup(), but subtrees without any item tagged
+ * with @tag are skipped without being looked at.
+ */
+unsigned int radix_tree_gang_lookup_tag(struct radix_tree_root *root, void **results,
+	unsigned long first_index, unsigned int max_items, int tag)
+{
+	return radix_tree_gang(root, results, first_index, max_items, tag);
+}
+
+/**
+ * radix_tree_delete - delete an item from a radix tree
+ * @root: radix tree root
+ * @index: index key
+ *
+ * Removes the item at @index together with its tags, and frees the
+ * nodes that became empty. Returns the item, or NULL if there was none.
+ */
+void *radix_tree_delete(struct radix_tree_root *root, unsigned long index)
+{
+	struct radix_tree_path path[RADIX_TREE_MAX_PATH], *pathp = path;
+	struct radix_tree_path *orig_pathp;
+	unsigned int height, shift;
+	char tags[RADIX_TREE_MAX_TAGS];
+	int nr_cleared_tags;
+	void *item;
+	int tag;
+
+	height = root->height;
+	if (index > radix_tree_maxindex(height))
+		return NULL;
+
+	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+	pathp->node = NULL;
+	pathp->slot = (void **) &root->rnode;
+
+	while (height > 0) {
+		int offset;
+
+		if (*pathp->slot == NULL)
+			return NULL;
+
+		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		pathp[1].offset = offset;
+		pathp[1].node = *pathp->slot;
+		pathp[1].slot = pathp[1].node->slots + offset;
+		pathp++;
+		shift -= RADIX_TREE_MAP_SHIFT;
+		height--;
+	}
+
+	item = *pathp->slot;
+	if (item == NULL)
+		return NULL;
+
+	orig_pathp = pathp;
+
+	/* Clear the tags of the item, and above it where nothing else is tagged */
+	memset(tags, 0, sizeof(tags));
+	do {
+		nr_cleared_tags = RADIX_TREE_MAX_TAGS;
+		for (tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++) {
+			if (tags[tag])
+				continue;
+			tag_clear(pathp->node, tag, pathp->offset);
+			if (any_tag_set(pathp->node, tag)) {
+				tags[tag] = 1;
+				nr_cleared_tags--;
+			}
+		}
+		pathp--;
+	} while (pathp->node && nr_cleared_tags);
+
+	/* Now free the nodes which do not hold anything any more */
+	pathp = orig_pathp;
+	*pathp->slot = NULL;
+	while (pathp->node && --pathp->node->count == 0) {
+		pathp--;
+		BUG_ON(*pathp->slot == NULL);
+		*pathp->slot = NULL;
+		radix_tree_node_free(pathp[1].node);
+	}
+	if (root->rnode == NULL)
+		root->height = 0;
+
+	return item;
+}
+
+EXPORT_SYMBOL(radix_tree_insert);
+EXPORT_SYMBOL(radix_tree_lookup);
+EXPORT_SYMBOL(radix_tree_delete);
+EXPORT_SYMBOL(radix_tree_gang_lookup);
+EXPORT_SYMBOL(radix_tree_tag_set);
+EXPORT_SYMBOL(radix_tree_tag_clear);
+EXPORT_SYMBOL(radix_tree_tag_get);
+EXPORT_SYMBOL(radix_tree_tagged);
+EXPORT_SYMBOL(radix_tree_gang_lookup_tag);
+EXPORT_SYMBOL(radix_tree_preload);
+
+static unsigned long __init __maxindex(unsigned int height)
+{
+	unsigned int shift = height * RADIX_TREE_MAP_SHIFT;
+
+	if (shift >= RADIX_TREE_INDEX_BITS)
+		return ~0UL;
+	return (1UL << shift) - 1;
+}
+
+void __init radix_tree_init(void)
+{
+	unsigned int i;
+
+	radix_tree_node_cachep = kmem_cache_create("radix_tree_node",
+				sizeof(struct radix_tree_node), 0,
+				SLAB_HWCACHE_ALIGN, NULL, NULL);
+	if (!radix_tree_node_cachep)
+		panic("radix_tree_init: cannot create radix_tree_node cache");
+
+	for (i = 0; i < RADIX_TREE_MAX_PATH; i++)
+		height_to_maxindex[i] = __maxindex(i);
+}
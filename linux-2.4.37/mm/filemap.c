@@ -43,8 +43,6 @@
  */
 
 unsigned long page_cache_size;
-unsigned int page_hash_bits;
-struct page **page_hash_table;
 
 int vm_max_readahead = 31;
 int vm_min_readahead = 3;
@@ -52,43 +50,41 @@ EXPORT_SYMBOL(vm_max_readahead);
 EXPORT_SYMBOL(vm_min_readahead);
 
 
-spinlock_cacheline_t pagecache_lock_cacheline  = {SPIN_LOCK_UNLOCKED};
 /*
  * NOTE: to avoid deadlocking you must never acquire the pagemap_lru_lock 
- *	with the pagecache_lock held.
+ *	with a mapping->page_lock held.
  *
  * Ordering:
  *	swap_lock ->
  *		pagemap_lru_lock ->
- *			pagecache_lock
+ *			mapping->page_lock
  */
 spinlock_cacheline_t pagemap_lru_lock_cacheline = {SPIN_LOCK_UNLOCKED};
 
 #define CLUSTER_PAGES		(1 << page_cluster)
 #define CLUSTER_OFFSET(x)	(((x) >> page_cluster) << page_cluster)
 
-static void FASTCALL(add_page_to_hash_queue(struct page * page, struct page **p));
-static void fastcall add_page_to_hash_queue(struct page * page, struct page **p)
+/*
+ * Insert the page into the radix tree of the mapping and onto its list
+ * of clean pages, called with mapping->page_lock held. Can only fail
+ * with -ENOMEM when no tree node could be allocated, see
+ * radix_tree_preload().
+ */
+static inline int add_page_to_inode_queue(struct address_space *mapping, struct page * page)
 {
-	struct page *next = *p;
+	int error;
 
-	*p = page;
-	page->next_hash = next;
-	page->pprev_hash = p;
-	if (next)
-		next->pprev_hash = &page->next_hash;
 	if (page->buffers)
 		PAGE_BUG(page);
-	inc_nr_cache_pages(page);
-}
-
-static inline void add_page_to_inode_queue(struct address_space *mapping, struct page * page)
-{
-	struct list_head *head = &mapping->clean_pages;
+	error = radix_tree_insert(&mapping->page_tree, page->index, page);
+	if (error)
+		return error;
 
 	mapping->nrpages++;
-	list_add(&page->list, head);
+	list_add(&page->list, &mapping->clean_pages);
 	page->mapping = mapping;
+	inc_nr_cache_pages(page);
+	return 0;
 }
 
 static inline void remove_page_from_inode_queue(struct page * page)
@@ -98,45 +94,36 @@ static inline void remove_page_from_inode_queue(struct page * page)
 	if (mapping->a_ops->removepage)
 		mapping->a_ops->removepage(page);
 	
+	radix_tree_delete(&mapping->page_tree, page->index);
 	list_del(&page->list);
 	page->mapping = NULL;
 	wmb();
 	mapping->nrpages--;
+	dec_nr_cache_pages(page);
 	if (!mapping->nrpages)
 		refile_inode(mapping->host);
 }
 
-static inline void remove_page_from_hash_queue(struct page * page)
-{
-	struct page *next = page->next_hash;
-	struct page **pprev = page->pprev_hash;
-
-	if (next)
-		next->pprev_hash = pprev;
-	*pprev = next;
-	page->pprev_hash = NULL;
-	dec_nr_cache_pages(page);
-}
-
 /*
  * Remove a page from the page cache and free it. Caller has to make
  * sure the page is locked and that nobody else uses it - or that usage
- * is safe.
+ * is safe, and must hold the page_lock of its mapping.
  */
 void __remove_inode_page(struct page *page)
 {
 	remove_page_from_inode_queue(page);
-	remove_page_from_hash_queue(page);
 }
 
 void remove_inode_page(struct page *page)
 {
+	struct address_space *mapping = page->mapping;
+
 	if (!PageLocked(page))
 		PAGE_BUG(page);
 
-	spin_lock(&pagecache_lock);
+	spin_lock(&mapping->page_lock);
 	__remove_inode_page(page);
-	spin_unlock(&pagecache_lock);
+	spin_unlock(&mapping->page_lock);
 }
 
 static inline int sync_page(struct page *page)
@@ -157,13 +144,19 @@ void fastcall set_page_dirty(struct page *page)
 		struct address_space *mapping = page->mapping;
 
 		if (mapping) {
-			spin_lock(&pagecache_lock);
-			mapping = page->mapping;
-			if (mapping) {	/* may have been truncated */
+			spin_lock(&mapping->page_lock);
+			if (page->mapping == mapping) {	/* may have been truncated */
 				list_del(&page->list);
 				list_add(&page->list, &mapping->dirty_pages);
+				radix_tree_tag_clear(&mapping->page_tree,
+					page->index, PAGECACHE_TAG_WRITEBACK);
+				radix_tree_tag_set(&mapping->page_tree,
+					page->index, PAGECACHE_TAG_DIRTY);
+				spin_unlock(&mapping->page_lock);
+			} else {
+				spin_unlock(&mapping->page_lock);
+				mapping = NULL;
 			}
-			spin_unlock(&pagecache_lock);
 
 			if (mapping && mapping->host)
 				mark_inode_dirty_pages(mapping->host);
@@ -183,13 +176,14 @@ void fastcall set_page_dirty(struct page *page)
 
 void invalidate_inode_pages(struct inode * inode)
 {
+	struct address_space *mapping = inode->i_mapping;
 	struct list_head *head, *curr;
 	struct page * page;
 
-	head = &inode->i_mapping->clean_pages;
+	head = &mapping->clean_pages;
 
 	spin_lock(&pagemap_lru_lock);
-	spin_lock(&pagecache_lock);
+	spin_lock(&mapping->page_lock);
 	curr = head->next;
 
 	while (curr != head) {
@@ -220,7 +214,7 @@ unlock:
 		continue;
 	}
 
-	spin_unlock(&pagecache_lock);
+	spin_unlock(&mapping->page_lock);
 	spin_unlock(&pagemap_lru_lock);
 }
 
@@ -259,66 +253,6 @@ static void truncate_complete_page(struct page *page)
 	page_cache_release(page);
 }
 
-static int FASTCALL(truncate_list_pages(struct list_head *, unsigned long, unsigned *));
-static int fastcall truncate_list_pages(struct list_head *head, unsigned long start, unsigned *partial)
-{
-	struct list_head *curr;
-	struct page * page;
-	int unlocked = 0;
-
- restart:
-	curr = head->prev;
-	while (curr != head) {
-		unsigned long offset;
-
-		page = list_entry(curr, struct page, list);
-		offset = page->index;
-
-		/* Is one of the pages to truncate? */
-		if ((offset >= start) || (*partial && (offset + 1) == start)) {
-			int failed;
-
-			page_cache_get(page);
-			failed = TryLockPage(page);
-
-			list_del(head);
-			if (!failed)
-				/* Restart after this page */
-				list_add_tail(head, curr);
-			else
-				/* Restart on this page */
-				list_add(head, curr);
-
-			spin_unlock(&pagecache_lock);
-			unlocked = 1;
-
- 			if (!failed) {
-				if (*partial && (offset + 1) == start) {
-					truncate_partial_page(page, *partial);
-					*partial = 0;
-				} else 
-					truncate_complete_page(page);
-
-				UnlockPage(page);
-			} else
- 				wait_on_page(page);
-
-			page_cache_release(page);
-
-			if (current->need_resched) {
-				__set_current_state(TASK_RUNNING);
-				schedule();
-			}
-
-			spin_lock(&pagecache_lock);
-			goto restart;
-		}
-		curr = curr->prev;
-	}
-	return unlocked;
-}
-
-
 /**
  * truncate_inode_pages - truncate *all* the pages from an offset
  * @mapping: mapping to truncate
@@ -327,31 +261,63 @@ static int fastcall truncate_list_pages(struct list_head *head, unsigned long st
  * Truncate the page cache at a set offset, removing the pages
  * that are beyond that offset (and zeroing out partial pages).
  * If any page is locked we wait for it to become unlocked.
+ *
+ * The pages are found with gang lookups in the radix tree, in index
+ * order and TRUNCATE_BATCH at a time, instead of walking all the
+ * pages of the mapping on its three lists.
  */
+#define TRUNCATE_BATCH		16
+
 void truncate_inode_pages(struct address_space * mapping, loff_t lstart) 
 {
 	unsigned long start = (lstart + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
 	unsigned partial = lstart & (PAGE_CACHE_SIZE - 1);
-	int unlocked;
+	struct page *pages[TRUNCATE_BATCH];
+	unsigned long next;
+	unsigned int i, nr;
 
-	spin_lock(&pagecache_lock);
-	do {
-		unlocked = truncate_list_pages(&mapping->clean_pages, start, &partial);
-		unlocked |= truncate_list_pages(&mapping->dirty_pages, start, &partial);
-		unlocked |= truncate_list_pages(&mapping->locked_pages, start, &partial);
-	} while (unlocked);
-	/* Traversed all three lists without dropping the lock */
-	spin_unlock(&pagecache_lock);
+	if (partial) {
+		struct page *page = find_lock_page(mapping, start - 1);
+
+		if (page) {
+			truncate_partial_page(page, partial);
+			UnlockPage(page);
+			page_cache_release(page);
+		}
+	}
+
+	next = start;
+	while ((nr = find_get_pages(mapping, next, TRUNCATE_BATCH, pages)) != 0) {
+		for (i = 0; i < nr; i++) {
+			struct page *page = pages[i];
+
+			lock_page(page);
+			/* Still ours, or truncated or moved while we slept? */
+			if (page->mapping == mapping) {
+				if (page->index >= next)
+					next = page->index + 1;
+				truncate_complete_page(page);
+			}
+			UnlockPage(page);
+			page_cache_release(page);
+		}
+
+		if (current->need_resched) {
+			__set_current_state(TASK_RUNNING);
+			schedule();
+		}
+	}
 }
 
-static inline int invalidate_this_page2(struct page * page,
+static inline int invalidate_this_page2(struct address_space * mapping,
+					struct page * page,
 					struct list_head * curr,
 					struct list_head * head)
 {
 	int unlocked = 1;
 
 	/*
-	 * The page is locked and we hold the pagecache_lock as well
+	 * The page is locked and we hold the page_lock as well
 	 * so both page_count(page) and page->buffers stays constant here.
 	 */
 	if (page_count(page) == 1 + !!page->buffers) {
@@ -360,7 +326,7 @@ static inline int invalidate_this_page2(struct page * page,
 		list_add_tail(head, curr);
 
 		page_cache_get(page);
-		spin_unlock(&pagecache_lock);
+		spin_unlock(&mapping->page_lock);
 		truncate_complete_page(page);
 	} else {
 		if (page->buffers) {
@@ -369,7 +335,7 @@ static inline int invalidate_this_page2(struct page * page,
 			list_add_tail(head, curr);
 
 			page_cache_get(page);
-			spin_unlock(&pagecache_lock);
+			spin_unlock(&mapping->page_lock);
 			block_invalidate_page(page);
 		} else
 			unlocked = 0;
@@ -381,8 +347,8 @@ static inline int invalidate_this_page2(struct page * page,
 	return unlocked;
 }
 
-static int FASTCALL(invalidate_list_pages2(struct list_head *));
-static int fastcall invalidate_list_pages2(struct list_head *head)
+static int FASTCALL(invalidate_list_pages2(struct address_space *, struct list_head *));
+static int fastcall invalidate_list_pages2(struct address_space * mapping, struct list_head *head)
 {
 	struct list_head *curr;
 	struct page * page;
@@ -396,7 +362,7 @@ static int fastcall invalidate_list_pages2(struct list_head *head)
 		if (!TryLockPage(page)) {
 			int __unlocked;
 
-			__unlocked = invalidate_this_page2(page, curr, head);
+			__unlocked = invalidate_this_page2(mapping, page, curr, head);
 			UnlockPage(page);
 			unlocked |= __unlocked;
 			if (!__unlocked) {
@@ -409,7 +375,7 @@ static int fastcall invalidate_list_pages2(struct list_head *head)
 			list_add(head, curr);
 
 			page_cache_get(page);
-			spin_unlock(&pagecache_lock);
+			spin_unlock(&mapping->page_lock);
 			unlocked = 1;
 			wait_on_page(page);
 		}
@@ -420,7 +386,7 @@ static int fastcall invalidate_list_pages2(struct list_head *head)
 			schedule();
 		}
 
-		spin_lock(&pagecache_lock);
+		spin_lock(&mapping->page_lock);
 		goto restart;
 	}
 	return unlocked;
@@ -435,66 +401,55 @@ void invalidate_inode_pages2(struct address_space * mapping)
 {
 	int unlocked;
 
-	spin_lock(&pagecache_lock);
+	spin_lock(&mapping->page_lock);
 	do {
-		unlocked = invalidate_list_pages2(&mapping->clean_pages);
-		unlocked |= invalidate_list_pages2(&mapping->dirty_pages);
-		unlocked |= invalidate_list_pages2(&mapping->locked_pages);
+		unlocked = invalidate_list_pages2(mapping, &mapping->clean_pages);
+		unlocked |= invalidate_list_pages2(mapping, &mapping->dirty_pages);
+		unlocked |= invalidate_list_pages2(mapping, &mapping->locked_pages);
 	} while (unlocked);
-	spin_unlock(&pagecache_lock);
+	spin_unlock(&mapping->page_lock);
 }
 
-static inline struct page * __find_page_nolock(struct address_space *mapping, unsigned long offset, struct page *page)
-{
-	goto inside;
-
-	for (;;) {
-		page = page->next_hash;
-inside:
-		if (!page)
-			goto not_found;
-		if (page->mapping != mapping)
-			continue;
-		if (page->index == offset)
-			break;
-	}
-
-not_found:
-	return page;
-}
+/*
+ * Walk the pages of the mapping from start to end in index order,
+ * FDATASYNC_BATCH at a time, and call fn on the ones with buffers.
+ */
+#define FDATASYNC_BATCH		16
 
-static int do_buffer_fdatasync(struct list_head *head, unsigned long start, unsigned long end, int (*fn)(struct page *))
+static int do_buffer_fdatasync(struct address_space *mapping, unsigned long start, unsigned long end, int (*fn)(struct page *))
 {
-	struct list_head *curr;
-	struct page *page;
+	struct page *pages[FDATASYNC_BATCH];
+	unsigned long index = start;
+	unsigned int i, nr;
 	int retval = 0;
 
-	spin_lock(&pagecache_lock);
-	curr = head->next;
-	while (curr != head) {
-		page = list_entry(curr, struct page, list);
-		curr = curr->next;
-		if (!page->buffers)
-			continue;
-		if (page->index >= end)
-			continue;
-		if (page->index < start)
-			continue;
+	while (index < end) {
+		spin_lock(&mapping->page_lock);
+		nr = radix_tree_gang_lookup(&mapping->page_tree, (void **) pages,
+					    index, FDATASYNC_BATCH);
+		for (i = 0; i < nr; i++)
+			page_cache_get(pages[i]);
+		if (nr)
+			index = pages[nr - 1]->index + 1;
+		spin_unlock(&mapping->page_lock);
+		if (!nr)
+			break;
 
-		page_cache_get(page);
-		spin_unlock(&pagecache_lock);
-		lock_page(page);
+		for (i = 0; i < nr; i++) {
+			struct page *page = pages[i];
 
-		/* The buffers could have been free'd while we waited for the page lock */
-		if (page->buffers)
-			retval |= fn(page);
+			if (page->buffers && page->index < end) {
+				lock_page(page);
 
-		UnlockPage(page);
-		spin_lock(&pagecache_lock);
-		curr = page->list.next;
-		page_cache_release(page);
+				/* The buffers could have been free'd while we waited for the page lock */
+				if (page->mapping == mapping && page->buffers)
+					retval |= fn(page);
+
+				UnlockPage(page);
+			}
+			page_cache_release(page);
+		}
 	}
-	spin_unlock(&pagecache_lock);
 
 	return retval;
 }
@@ -507,15 +462,11 @@ int generic_buffer_fdatasync(struct inode *inode, unsigned long start_idx, unsig
 {
 	int retval;
 
-	/* writeout dirty buffers on pages from both clean and dirty lists */
-	retval = do_buffer_fdatasync(&inode->i_mapping->dirty_pages, start_idx, end_idx, writeout_one_page);
-	retval |= do_buffer_fdatasync(&inode->i_mapping->clean_pages, start_idx, end_idx, writeout_one_page);
-	retval |= do_buffer_fdatasync(&inode->i_mapping->locked_pages, start_idx, end_idx, writeout_one_page);
+	/* writeout dirty buffers on the pages of the range, whatever list they are on */
+	retval = do_buffer_fdatasync(inode->i_mapping, start_idx, end_idx, writeout_one_page);
 
-	/* now wait for locked buffers on pages from both clean and dirty lists */
-	retval |= do_buffer_fdatasync(&inode->i_mapping->dirty_pages, start_idx, end_idx, waitfor_one_page);
-	retval |= do_buffer_fdatasync(&inode->i_mapping->clean_pages, start_idx, end_idx, waitfor_one_page);
-	retval |= do_buffer_fdatasync(&inode->i_mapping->locked_pages, start_idx, end_idx, waitfor_one_page);
+	/* now wait for locked buffers on the same pages */
+	retval |= do_buffer_fdatasync(inode->i_mapping, start_idx, end_idx, waitfor_one_page);
 
 	return retval;
 }
@@ -549,32 +500,56 @@ int fail_writepage(struct page *page)
 
 EXPORT_SYMBOL(fail_writepage);
 
-/**
- *      filemap_fdatawrite - walk the list of dirty pages of the given address space
- *     	and writepage() each unlocked page (does not wait on locked pages).
- * 
- *      @mapping: address space structure to write
- *
+/*
+ * Move the next page tagged dirty at or after *index to the list of
+ * locked pages and tag it for filemap_fdatawait(). Returns the page
+ * with a reference held if it still needs to be written, or NULL once
+ * no tagged page is left. Pages redirtied behind *index are left for
+ * the next call of filemap_fdatasync(), so that a process dirtying a
+ * file all the time cannot livelock us.
  */
-int filemap_fdatawrite(struct address_space * mapping)
+static struct page * next_dirty_page(struct address_space * mapping, unsigned long *index)
 {
-	int ret = 0;
-	int (*writepage)(struct page *) = mapping->a_ops->writepage;
-
-	spin_lock(&pagecache_lock);
+	struct page *page;
 
-	while (!list_empty(&mapping->dirty_pages)) {
-		struct page *page = list_entry(mapping->dirty_pages.prev, struct page, list);
+	spin_lock(&mapping->page_lock);
+	while (radix_tree_gang_lookup_tag(&mapping->page_tree, (void **) &page,
+					  *index, 1, PAGECACHE_TAG_DIRTY)) {
+		*index = page->index + 1;
 
 		list_del(&page->list);
 		list_add(&page->list, &mapping->locked_pages);
+		radix_tree_tag_clear(&mapping->page_tree, page->index,
+				     PAGECACHE_TAG_DIRTY);
+		radix_tree_tag_set(&mapping->page_tree, page->index,
+				   PAGECACHE_TAG_WRITEBACK);
 
 		if (!PageDirty(page))
 			continue;
 
 		page_cache_get(page);
-		spin_unlock(&pagecache_lock);
+		spin_unlock(&mapping->page_lock);
+		return page;
+	}
+	spin_unlock(&mapping->page_lock);
+	return NULL;
+}
+
+/**
+ *      filemap_fdatawrite - walk the dirty pages of the given address space
+ *     	and writepage() each unlocked page (does not wait on locked pages).
+ * 
+ *      @mapping: address space structure to write
+ *
+ */
+int filemap_fdatawrite(struct address_space * mapping)
+{
+	int ret = 0;
+	int (*writepage)(struct page *) = mapping->a_ops->writepage;
+	unsigned long index = 0;
+	struct page *page;
 
+	while ((page = next_dirty_page(mapping, &index)) != NULL) {
 		if (!TryLockPage(page)) {
 			if (PageDirty(page)) {
 				int err;
@@ -586,14 +561,12 @@ int filemap_fdatawrite(struct address_space * mapping)
 				UnlockPage(page);
 		}
 		page_cache_release(page);
-		spin_lock(&pagecache_lock);
 	}
-	spin_unlock(&pagecache_lock);
 	return ret;
 }
 
 /**
- *      filemap_fdatasync - walk the list of dirty pages of the given address space
+ *      filemap_fdatasync - walk the dirty pages of the given address space
  *     	and writepage() all of them.
  * 
  *      @mapping: address space structure to write
@@ -603,21 +576,10 @@ int filemap_fdatasync(struct address_space * mapping)
 {
 	int ret = 0;
 	int (*writepage)(struct page *) = mapping->a_ops->writepage;
+	unsigned long index = 0;
+	struct page *page;
 
-	spin_lock(&pagecache_lock);
-
-        while (!list_empty(&mapping->dirty_pages)) {
-		struct page *page = list_entry(mapping->dirty_pages.prev, struct page, list);
-
-		list_del(&page->list);
-		list_add(&page->list, &mapping->locked_pages);
-
-		if (!PageDirty(page))
-			continue;
-
-		page_cache_get(page);
-		spin_unlock(&pagecache_lock);
-
+	while ((page = next_dirty_page(mapping, &index)) != NULL) {
 		lock_page(page);
 
 		if (PageDirty(page)) {
@@ -630,15 +592,13 @@ int filemap_fdatasync(struct address_space * mapping)
 			UnlockPage(page);
 
 		page_cache_release(page);
-		spin_lock(&pagecache_lock);
 	}
-	spin_unlock(&pagecache_lock);
 	return ret;
 }
 
 /**
- *      filemap_fdatawait - walk the list of locked pages of the given address space
- *     	and wait for all of them.
+ *      filemap_fdatawait - walk the pages of the given address space under
+ *     	writeback and wait for all of them.
  * 
  *      @mapping: address space structure to wait for
  *
@@ -646,29 +606,34 @@ int filemap_fdatasync(struct address_space * mapping)
 int filemap_fdatawait(struct address_space * mapping)
 {
 	int ret = 0;
+	unsigned long index = 0;
+	struct page *page;
 
-	spin_lock(&pagecache_lock);
+	spin_lock(&mapping->page_lock);
 
-        while (!list_empty(&mapping->locked_pages)) {
-		struct page *page = list_entry(mapping->locked_pages.next, struct page, list);
+	while (radix_tree_gang_lookup_tag(&mapping->page_tree, (void **) &page,
+					  index, 1, PAGECACHE_TAG_WRITEBACK)) {
+		index = page->index + 1;
 
 		list_del(&page->list);
 		list_add(&page->list, &mapping->clean_pages);
+		radix_tree_tag_clear(&mapping->page_tree, page->index,
+				     PAGECACHE_TAG_WRITEBACK);
 
 		if (!PageLocked(page))
 			continue;
 
 		page_cache_get(page);
-		spin_unlock(&pagecache_lock);
+		spin_unlock(&mapping->page_lock);
 
 		___wait_on_page(page);
 		if (PageError(page))
 			ret = -EIO;
 
 		page_cache_release(page);
-		spin_lock(&pagecache_lock);
+		spin_lock(&mapping->page_lock);
 	}
-	spin_unlock(&pagecache_lock);
+	spin_unlock(&mapping->page_lock);
 	return ret;
 }
 
@@ -677,30 +642,43 @@ int filemap_fdatawait(struct address_space * mapping)
  *
  * The caller must have locked the page and 
  * set all the page flags correctly..
+ * Fails with -ENOMEM if no radix tree node can be allocated, callers
+ * which cannot sleep should have done a radix_tree_preload() first.
  */
-void add_to_page_cache_locked(struct page * page, struct address_space *mapping, unsigned long index)
+int add_to_page_cache_locked(struct page * page, struct address_space *mapping, unsigned long index)
 {
+	int error;
+
 	if (!PageLocked(page))
 		BUG();
 
 	page->index = index;
-	page_cache_get(page);
-	spin_lock(&pagecache_lock);
-	add_page_to_inode_queue(mapping, page);
-	add_page_to_hash_queue(page, page_hash(mapping, index));
-	spin_unlock(&pagecache_lock);
+	spin_lock(&mapping->page_lock);
+	error = add_page_to_inode_queue(mapping, page);
+	spin_unlock(&mapping->page_lock);
+	if (error)
+		return error;
 
+	page_cache_get(page);
 	lru_cache_add(page);
+	return 0;
 }
 
 /*
  * This adds a page to the page cache, starting out as locked,
  * owned by us, but unreferenced, not uptodate and with no errors.
+ * Called with mapping->page_lock held.
  */
-static inline void __add_to_page_cache(struct page * page,
-	struct address_space *mapping, unsigned long offset,
-	struct page **hash)
+static inline int __add_to_page_cache(struct page * page,
+	struct address_space *mapping, unsigned long offset)
 {
+	int error;
+
+	page->index = offset;
+	error = add_page_to_inode_queue(mapping, page);
+	if (error)
+		return error;
+
 	/*
 	 * Yes this is inefficient, however it is needed.  The problem
 	 * is that we could be adding a page to the swap cache while
@@ -715,64 +693,64 @@ static inline void __add_to_page_cache(struct page * page,
 	ClearPageChecked(page);
 	LockPage(page);
 	page_cache_get(page);
-	page->index = offset;
-	add_page_to_inode_queue(mapping, page);
-	add_page_to_hash_queue(page, hash);
+	return 0;
 }
 
-void add_to_page_cache(struct page * page, struct address_space * mapping, unsigned long offset)
+int add_to_page_cache(struct page * page, struct address_space * mapping, unsigned long offset)
 {
-	spin_lock(&pagecache_lock);
-	__add_to_page_cache(page, mapping, offset, page_hash(mapping, offset));
-	spin_unlock(&pagecache_lock);
-	lru_cache_add(page);
+	int error;
+
+	spin_lock(&mapping->page_lock);
+	error = __add_to_page_cache(page, mapping, offset);
+	spin_unlock(&mapping->page_lock);
+	if (!error)
+		lru_cache_add(page);
+	return error;
 }
 
+/*
+ * Add the page unless there already is one at offset, in which case 1
+ * is returned. The radix tree nodes are preallocated with gfp_mask, a
+ * failure then leaves the insertion to atomic allocations, which may
+ * fail with -ENOMEM.
+ */
 int add_to_page_cache_unique(struct page * page,
 	struct address_space *mapping, unsigned long offset,
-	struct page **hash)
+	int gfp_mask)
 {
 	int err;
-	struct page *alias;
 
-	spin_lock(&pagecache_lock);
-	alias = __find_page_nolock(mapping, offset, *hash);
+	radix_tree_preload(gfp_mask);
 
+	spin_lock(&mapping->page_lock);
 	err = 1;
-	if (!alias) {
-		__add_to_page_cache(page,mapping,offset,hash);
-		err = 0;
-	}
+	if (!radix_tree_lookup(&mapping->page_tree, offset))
+		err = __add_to_page_cache(page, mapping, offset);
+	spin_unlock(&mapping->page_lock);
 
-	spin_unlock(&pagecache_lock);
 	if (!err)
 		lru_cache_add(page);
 	return err;
 }
 
 /*
- * This adds the requested page to the page cache if it isn't already there,
- * and schedules an I/O to read in its contents from disk.
+ * Add a new page at offset to the page cache and start reading it,
+ * the caller found none there.
  */
-static int FASTCALL(page_cache_read(struct file * file, unsigned long offset));
-static int fastcall page_cache_read(struct file * file, unsigned long offset)
+static int FASTCALL(__page_cache_read(struct file * file, unsigned long offset));
+static int fastcall __page_cache_read(struct file * file, unsigned long offset)
 {
 	struct address_space *mapping = file->f_dentry->d_inode->i_mapping;
-	struct page **hash = page_hash(mapping, offset);
 	struct page *page; 
+	int error;
 
-	spin_lock(&pagecache_lock);
-	page = __find_page_nolock(mapping, offset, *hash);
-	spin_unlock(&pagecache_lock);
-	if (page)
-		return 0;
-
-	page = page_cache_alloc(mapping);
+	page = page_cache_alloc_cold(mapping);
 	if (!page)
 		return -ENOMEM;
 
-	if (!add_to_page_cache_unique(page, mapping, offset, hash)) {
-		int error = mapping->a_ops->readpage(file, page);
+	error = add_to_page_cache_unique(page, mapping, offset, mapping->gfp_mask);
+	if (!error) {
+		error = mapping->a_ops->readpage(file, page);
 		page_cache_release(page);
 		return error;
 	}
@@ -781,7 +759,73 @@ static int fastcall page_cache_read(struct file * file, unsigned long offset)
 	 * raced with us and added our page to the cache first.
 	 */
 	page_cache_release(page);
-	return 0;
+	return error < 0 ? error : 0;
+}
+
+/*
+ * This adds the requested page to the page cache if it isn't already there,
+ * and schedules an I/O to read in its contents from disk.
+ */
+static int FASTCALL(page_cache_read(struct file * file, unsigned long offset));
+static int fastcall page_cache_read(struct file * file, unsigned long offset)
+{
+	struct address_space *mapping = file->f_dentry->d_inode->i_mapping;
+	struct page *page; 
+
+	spin_lock(&mapping->page_lock);
+	page = radix_tree_lookup(&mapping->page_tree, offset);
+	spin_unlock(&mapping->page_lock);
+	if (page)
+		return 0;
+
+	return __page_cache_read(file, offset);
+}
+
+/*
+ * Read the *nr pages from offset on into the page cache, like
+ * page_cache_read() on each of them. The pages already cached are found
+ * with gang lookups of READ_RANGE_BATCH pages at a time instead of one
+ * lookup per page. On return *nr holds the number of pages dealt with
+ * before an error stopped us.
+ */
+#define READ_RANGE_BATCH	16
+
+static int page_cache_read_range(struct file * file, unsigned long offset, unsigned long *nr)
+{
+	struct address_space *mapping = file->f_dentry->d_inode->i_mapping;
+	struct page *pages[READ_RANGE_BATCH];
+	unsigned long cached[READ_RANGE_BATCH];
+	unsigned long left = *nr;
+	unsigned int i, found;
+	int error = 0;
+
+	while (left) {
+		spin_lock(&mapping->page_lock);
+		found = radix_tree_gang_lookup(&mapping->page_tree, (void **) pages,
+					       offset, READ_RANGE_BATCH);
+		for (i = 0; i < found; i++)
+			cached[i] = pages[i]->index;
+		spin_unlock(&mapping->page_lock);
+
+		i = 0;
+		while (left) {
+			if (i < found && cached[i] == offset) {
+				i++;
+			} else if (i == READ_RANGE_BATCH) {
+				/* look up the next batch from here */
+				break;
+			} else {
+				error = __page_cache_read(file, offset);
+				if (error < 0)
+					goto out;
+			}
+			offset++;
+			left--;
+		}
+	}
+out:
+	*nr -= left;
+	return error;
 }
 
 /*
@@ -796,14 +840,12 @@ static int fastcall read_cluster_nonblocking(struct file * file, unsigned long o
 	unsigned long pages = CLUSTER_PAGES;
 
 	offset = CLUSTER_OFFSET(offset);
-	while ((pages-- > 0) && (offset < filesize)) {
-		int error = page_cache_read(file, offset);
-		if (error < 0)
-			return error;
-		offset ++;
-	}
+	if (offset >= filesize)
+		return 0;
+	if (pages > filesize - offset)
+		pages = filesize - offset;
 
-	return 0;
+	return page_cache_read_range(file, offset, &pages);
 }
 
 /*
@@ -982,22 +1024,17 @@ void fastcall lock_page(struct page *page)
 
 /*
  * a rather lightweight function, finding and getting a reference to a
- * hashed page atomically.
+ * page of the page cache atomically.
  */
-struct page * __find_get_page(struct address_space *mapping,
-			      unsigned long offset, struct page **hash)
+struct page * find_get_page(struct address_space *mapping, unsigned long offset)
 {
 	struct page *page;
 
-	/*
-	 * We scan the hash list read-only. Addition to and removal from
-	 * the hash-list needs a held write-lock.
-	 */
-	spin_lock(&pagecache_lock);
-	page = __find_page_nolock(mapping, offset, *hash);
+	spin_lock(&mapping->page_lock);
+	page = radix_tree_lookup(&mapping->page_tree, offset);
 	if (page)
 		page_cache_get(page);
-	spin_unlock(&pagecache_lock);
+	spin_unlock(&mapping->page_lock);
 	return page;
 }
 
@@ -1007,41 +1044,56 @@ struct page * __find_get_page(struct address_space *mapping,
 struct page *find_trylock_page(struct address_space *mapping, unsigned long offset)
 {
 	struct page *page;
-	struct page **hash = page_hash(mapping, offset);
 
-	spin_lock(&pagecache_lock);
-	page = __find_page_nolock(mapping, offset, *hash);
+	spin_lock(&mapping->page_lock);
+	page = radix_tree_lookup(&mapping->page_tree, offset);
 	if (page) {
 		if (TryLockPage(page))
 			page = NULL;
 	}
-	spin_unlock(&pagecache_lock);
+	spin_unlock(&mapping->page_lock);
 	return page;
 }
 
 /*
- * Must be called with the pagecache lock held,
+ * Like find_get_page(), for up to nr_pages pages at or after start.
+ * The pages are returned in index order, the number found is returned.
+ * Their ->index is only stable once the caller has locked them and
+ * checked that they still belong to the mapping.
+ */
+unsigned int find_get_pages(struct address_space *mapping, unsigned long start,
+			    unsigned int nr_pages, struct page **pages)
+{
+	unsigned int i, ret;
+
+	spin_lock(&mapping->page_lock);
+	ret = radix_tree_gang_lookup(&mapping->page_tree, (void **) pages,
+				     start, nr_pages);
+	for (i = 0; i < ret; i++)
+		page_cache_get(pages[i]);
+	spin_unlock(&mapping->page_lock);
+	return ret;
+}
+
+/*
+ * Must be called with the page_lock of the mapping held,
  * will return with it held (but it may be dropped
  * during blocking operations..
  */
-static struct page * FASTCALL(__find_lock_page_helper(struct address_space *, unsigned long, struct page *));
+static struct page * FASTCALL(__find_lock_page_helper(struct address_space *, unsigned long));
 static struct page * fastcall __find_lock_page_helper(struct address_space *mapping,
-					unsigned long offset, struct page *hash)
+					unsigned long offset)
 {
 	struct page *page;
 
-	/*
-	 * We scan the hash list read-only. Addition to and removal from
-	 * the hash-list needs a held write-lock.
-	 */
 repeat:
-	page = __find_page_nolock(mapping, offset, hash);
+	page = radix_tree_lookup(&mapping->page_tree, offset);
 	if (page) {
 		page_cache_get(page);
 		if (TryLockPage(page)) {
-			spin_unlock(&pagecache_lock);
+			spin_unlock(&mapping->page_lock);
 			lock_page(page);
-			spin_lock(&pagecache_lock);
+			spin_lock(&mapping->page_lock);
 
 			/* Has the page been re-allocated while we slept? */
 			if (page->mapping != mapping || page->index != offset) {
@@ -1058,14 +1110,13 @@ repeat:
  * Same as the above, but lock the page too, verifying that
  * it's still valid once we own it.
  */
-struct page * __find_lock_page (struct address_space *mapping,
-				unsigned long offset, struct page **hash)
+struct page * find_lock_page(struct address_space *mapping, unsigned long offset)
 {
 	struct page *page;
 
-	spin_lock(&pagecache_lock);
-	page = __find_lock_page_helper(mapping, offset, *hash);
-	spin_unlock(&pagecache_lock);
+	spin_lock(&mapping->page_lock);
+	page = __find_lock_page_helper(mapping, offset);
+	spin_unlock(&mapping->page_lock);
 	return page;
 }
 
@@ -1075,22 +1126,23 @@ struct page * __find_lock_page (struct address_space *mapping,
 struct page * find_or_create_page(struct address_space *mapping, unsigned long index, unsigned int gfp_mask)
 {
 	struct page *page;
-	struct page **hash = page_hash(mapping, index);
 
-	spin_lock(&pagecache_lock);
-	page = __find_lock_page_helper(mapping, index, *hash);
-	spin_unlock(&pagecache_lock);
+	spin_lock(&mapping->page_lock);
+	page = __find_lock_page_helper(mapping, index);
+	spin_unlock(&mapping->page_lock);
 	if (!page) {
 		struct page *newpage = alloc_page(gfp_mask);
 		if (newpage) {
-			spin_lock(&pagecache_lock);
-			page = __find_lock_page_helper(mapping, index, *hash);
+			radix_tree_preload(gfp_mask);
+			spin_lock(&mapping->page_lock);
+			page = __find_lock_page_helper(mapping, index);
 			if (likely(!page)) {
-				page = newpage;
-				__add_to_page_cache(page, mapping, index, hash);
-				newpage = NULL;
+				if (!__add_to_page_cache(newpage, mapping, index)) {
+					page = newpage;
+					newpage = NULL;
+				}
 			}
-			spin_unlock(&pagecache_lock);
+			spin_unlock(&mapping->page_lock);
 			if (newpage == NULL)
 				lru_cache_add(page);
 			else 
@@ -1108,10 +1160,9 @@ struct page * find_or_create_page(struct address_space *mapping, unsigned long i
  */
 struct page *grab_cache_page_nowait(struct address_space *mapping, unsigned long index)
 {
-	struct page *page, **hash;
+	struct page *page;
 
-	hash = page_hash(mapping, index);
-	page = __find_get_page(mapping, index, hash);
+	page = find_get_page(mapping, index);
 
 	if ( page ) {
 		if ( !TryLockPage(page) ) {
@@ -1136,8 +1187,8 @@ struct page *grab_cache_page_nowait(struct address_space *mapping, unsigned long
 	if ( unlikely(!page) )
 		return NULL;	/* Failed to allocate a page */
 
-	if ( unlikely(add_to_page_cache_unique(page, mapping, index, hash)) ) {
-		/* Someone else grabbed the page already. */
+	if ( unlikely(add_to_page_cache_unique(page, mapping, index, mapping->gfp_mask)) ) {
+		/* Someone else grabbed the page already, or out of memory. */
 		page_cache_release(page);
 		return NULL;
 	}
@@ -1145,241 +1196,246 @@ struct page *grab_cache_page_nowait(struct address_space *mapping, unsigned long
 	return page;
 }
 
-#if 0
-#define PROFILE_READAHEAD
-#define DEBUG_READAHEAD
-#endif
+static inline int get_max_readahead(struct inode * inode)
+{
+	if (!inode->i_dev || !max_readahead[MAJOR(inode->i_dev)])
+		return vm_max_readahead;
+	return max_readahead[MAJOR(inode->i_dev)][MINOR(inode->i_dev)];
+}
 
 /*
- * Read-ahead profiling information
- * --------------------------------
- * Every PROFILE_MAXREADCOUNT, the following information is written 
- * to the syslog:
- *   Percentage of asynchronous read-ahead.
- *   Average of read-ahead fields context value.
- * If DEBUG_READAHEAD is defined, a snapshot of these fields is written 
- * to the syslog.
+ * Read-ahead:
+ * -----------
+ * Every open file follows up to RA_STREAMS readers in file->f_ra, so
+ * that interleaved sequential reads through one descriptor (a server
+ * feeding several clients from one file, a program merging two parts
+ * of a file, nfsd) each get a window of their own. A stream is found
+ * again by the pages its last request covered.
+ *
+ * A request no stream knows about takes over the least recently used
+ * one and only its own pages are read: random access does not drag in
+ * pages nobody asked for. When the next request carries on where the
+ * stream left off, or the file is read from its start, the stream is
+ * sequential and gets a window of pages read ahead of the reader. A
+ * request ending where the last one began makes it a backward stream,
+ * which reads its windows below the reader instead.
+ *
+ * Once the reader is half way through a window the next window is read
+ * asynchronously, so the I/O overlaps the reader using the pages that
+ * are already there. Each new window doubles up to the device maximum
+ * as long as the reader found the pages of the current one in memory.
+ * Pages of a window that are gone again by the time the reader gets to
+ * them mean we read further ahead than memory allows, more than a
+ * quarter of them halves the next window instead.
+ *
+ * The per-file hit, miss and read-ahead page counts are reported to
+ * user space by fcntl(F_GETRASTAT).
  */
 
-#ifdef PROFILE_READAHEAD
-
-#define PROFILE_MAXREADCOUNT 1000
-
-static unsigned long total_reada;
-static unsigned long total_async;
-static unsigned long total_ramax;
-static unsigned long total_ralen;
-static unsigned long total_rawin;
-
-static void profile_readahead(int async, struct file *filp)
+/*
+ * Read [start, start + size) clipped to the end of the file, pages
+ * already cached are skipped.
+ */
+static void ra_read(struct file * filp, unsigned long start, unsigned long size)
 {
-	unsigned long flags;
-
-	++total_reada;
-	if (async)
-		++total_async;
-
-	total_ramax	+= filp->f_ramax;
-	total_ralen	+= filp->f_ralen;
-	total_rawin	+= filp->f_rawin;
+	struct inode *inode = filp->f_dentry->d_inode;
+	unsigned long end_index;
 
-	if (total_reada > PROFILE_MAXREADCOUNT) {
-		save_flags(flags);
-		cli();
-		if (!(total_reada > PROFILE_MAXREADCOUNT)) {
-			restore_flags(flags);
-			return;
-		}
+	end_index = (inode->i_size + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+	if (start >= end_index)
+		return;
+	if (size > end_index - start)
+		size = end_index - start;
+	page_cache_read_range(filp, start, &size);
+}
 
-		printk("Readahead average:  max=%ld, len=%ld, win=%ld, async=%ld%%\n",
-			total_ramax/total_reada,
-			total_ralen/total_reada,
-			total_rawin/total_reada,
-			(total_async*100)/total_reada);
-#ifdef DEBUG_READAHEAD
-		printk("Readahead snapshot: max=%ld, len=%ld, win=%ld, raend=%Ld\n",
-			filp->f_ramax, filp->f_ralen, filp->f_rawin, filp->f_raend);
-#endif
+static unsigned long ra_clamp(unsigned long size, unsigned long max)
+{
+	if (size < vm_min_readahead)
+		size = vm_min_readahead;
+	if (size > max)
+		size = max;
+	return size;
+}
 
-		total_reada	= 0;
-		total_async	= 0;
-		total_ramax	= 0;
-		total_ralen	= 0;
-		total_rawin	= 0;
+static unsigned long ra_next_size(struct file_ra_stream * s, unsigned long max)
+{
+	if (!s->misses)
+		return ra_clamp(s->size << 1, max);
+	if (s->misses > s->size >> 2)
+		return ra_clamp(s->size >> 1, max);
+	return ra_clamp(s->size, max);
+}
 
-		restore_flags(flags);
-	}
+static inline int ra_in_windows(struct file_ra_stream * s, unsigned long index)
+{
+	if (!s->size)
+		return 0;
+	if (index >= s->start && index - s->start < s->size)
+		return 1;
+	return s->ahead_size && index >= s->ahead_start &&
+		index - s->ahead_start < s->ahead_size;
 }
-#endif  /* defined PROFILE_READAHEAD */
 
 /*
- * Read-ahead context:
- * -------------------
- * The read ahead context fields of the "struct file" are the following:
- * - f_raend : position of the first byte after the last page we tried to
- *	       read ahead.
- * - f_ramax : current read-ahead maximum size.
- * - f_ralen : length of the current IO read block we tried to read-ahead.
- * - f_rawin : length of the current read-ahead window.
- *		if last read-ahead was synchronous then
- *			f_rawin = f_ralen
- *		otherwise (was asynchronous)
- *			f_rawin = previous value of f_ralen + f_ralen
- *
- * Read-ahead limits:
- * ------------------
- * MIN_READAHEAD   : minimum read-ahead size when read-ahead.
- * MAX_READAHEAD   : maximum read-ahead size when read-ahead.
- *
- * Synchronous read-ahead benefits:
- * --------------------------------
- * Using reasonable IO xfer length from peripheral devices increase system 
- * performances.
- * Reasonable means, in this context, not too large but not too small.
- * The actual maximum value is:
- *	MAX_READAHEAD + PAGE_CACHE_SIZE = 76k is CONFIG_READA_SMALL is undefined
- *      and 32K if defined (4K page size assumed).
- *
- * Asynchronous read-ahead benefits:
- * ---------------------------------
- * Overlapping next read request and user process execution increase system 
- * performance.
- *
- * Read-ahead risks:
- * -----------------
- * We have to guess which further data are needed by the user process.
- * If these data are often not really needed, it's bad for system 
- * performances.
- * However, we know that files are often accessed sequentially by 
- * application programs and it seems that it is possible to have some good 
- * strategy in that guessing.
- * We only try to read-ahead files that seems to be read sequentially.
- *
- * Asynchronous read-ahead risks:
- * ------------------------------
- * In order to maximize overlapping, we must start some asynchronous read 
- * request from the device, as soon as possible.
- * We must be very careful about:
- * - The number of effective pending IO read requests.
- *   ONE seems to be the only reasonable value.
- * - The total memory pool usage for the file access stream.
- *   This maximum memory usage is implicitly 2 IO read chunks:
- *   2*(MAX_READAHEAD + PAGE_CACHE_SIZE) = 156K if CONFIG_READA_SMALL is undefined,
- *   64k if defined (4K page size assumed).
+ * The stream a request for nr pages from index belongs to, or NULL.
  */
-
-static inline int get_max_readahead(struct inode * inode)
+static struct file_ra_stream * ra_find_stream(struct file_ra_state * ra,
+	unsigned long index, unsigned long nr)
 {
-	if (!inode->i_dev || !max_readahead[MAJOR(inode->i_dev)])
-		return vm_max_readahead;
-	return max_readahead[MAJOR(inode->i_dev)][MINOR(inode->i_dev)];
+	struct file_ra_stream *s;
+
+	for (s = ra->streams; s < ra->streams + RA_STREAMS; s++) {
+		if (!s->stamp)
+			continue;
+		if (index >= s->prev && index <= s->next)
+			return s;
+		if (index < s->prev && index + nr >= s->prev)
+			return s;
+		if (ra_in_windows(s, index))
+			return s;
+	}
+	return NULL;
 }
 
-static void generic_file_readahead(int reada_ok,
-	struct file * filp, struct inode * inode,
-	struct page * page)
+static struct file_ra_stream * ra_new_stream(struct file_ra_state * ra)
 {
-	unsigned long end_index;
-	unsigned long index = page->index;
-	unsigned long max_ahead, ahead;
-	unsigned long raend;
-	int max_readahead = get_max_readahead(inode);
-
-	end_index = inode->i_size >> PAGE_CACHE_SHIFT;
+	struct file_ra_stream *s, *lru = ra->streams;
 
-	raend = filp->f_raend;
-	max_ahead = 0;
-
-/*
- * The current page is locked.
- * If the current position is inside the previous read IO request, do not
- * try to reread previously read ahead pages.
- * Otherwise decide or not to read ahead some pages synchronously.
- * If we are not going to read ahead, set the read ahead context for this 
- * page only.
- */
-	if (PageLocked(page)) {
-		if (!filp->f_ralen || index >= raend || index + filp->f_rawin < raend) {
-			raend = index;
-			if (raend < end_index)
-				max_ahead = filp->f_ramax;
-			filp->f_rawin = 0;
-			filp->f_ralen = 1;
-			if (!max_ahead) {
-				filp->f_raend  = index + filp->f_ralen;
-				filp->f_rawin += filp->f_ralen;
-			}
+	for (s = ra->streams; s < ra->streams + RA_STREAMS; s++) {
+		if (!s->stamp) {
+			lru = s;
+			break;
 		}
+		if (s->stamp < lru->stamp)
+			lru = s;
 	}
+	memset(lru, 0, sizeof(*lru));
+	return lru;
+}
+
 /*
- * The current page is not locked.
- * If we were reading ahead and,
- * if the current max read ahead size is not zero and,
- * if the current position is inside the last read-ahead IO request,
- *   it is the moment to try to read ahead asynchronously.
- * We will later force unplug device in order to force asynchronous read IO.
- */
-	else if (reada_ok && filp->f_ramax && raend >= 1 &&
-		 index <= raend && index + filp->f_ralen >= raend) {
-/*
- * Add ONE page to max_ahead in order to try to have about the same IO max size
- * as synchronous read-ahead (MAX_READAHEAD + 1)*PAGE_CACHE_SIZE.
- * Compute the position of the last page we have tried to read in order to 
- * begin to read ahead just at the next page.
- */
-		raend -= 1;
-		if (raend < end_index)
-			max_ahead = filp->f_ramax + 1;
-
-		if (max_ahead) {
-			filp->f_rawin = filp->f_ralen;
-			filp->f_ralen = 0;
-			reada_ok      = 2;
-		}
+ * Start reading ahead for a stream that just turned out to be
+ * sequential, the reader is at index and wants nr pages.
+ */
+static void ra_start(struct file * filp, struct file_ra_stream * s,
+	unsigned long index, unsigned long nr, unsigned long max)
+{
+	unsigned long size = ra_clamp(nr << 1, max);
+
+	if (s->backward) {
+		unsigned long end = index + nr;
+
+		s->start = end > size ? end - size : 0;
+		s->size = end - s->start;
+	} else {
+		s->start = index;
+		s->size = size;
 	}
+	s->ahead_size = 0;
+	s->misses = 0;
+	filp->f_ra.pages += s->size;
+	ra_read(filp, s->start, s->size);
+}
+
 /*
- * Try to read ahead pages.
- * We hope that ll_rw_blk() plug/unplug, coalescence, requests sort and the
- * scheduler, will work enough for us to avoid too bad actuals IO requests.
+ * Move on to the asynchronous window once the reader is in it, and
+ * start the next one once the reader is half way through the current
+ * window.
  */
-	ahead = 0;
-	while (ahead < max_ahead) {
-		unsigned long ra_index = raend + ahead + 1;
+static void ra_advance(struct file * filp, struct file_ra_stream * s,
+	unsigned long index, unsigned long max)
+{
+	unsigned long size;
 
-		if (ra_index >= end_index)
-			break;
-		if (page_cache_read(filp, ra_index) < 0)
-			break;
+	if (s->ahead_size && index >= s->ahead_start &&
+	    index - s->ahead_start < s->ahead_size) {
+		s->start = s->ahead_start;
+		s->size = s->ahead_size;
+		s->ahead_size = 0;
+		s->misses = 0;
+	}
+	if (s->ahead_size)
+		return;
 
-		ahead++;
+	if (s->backward) {
+		if (index >= s->start + (s->size >> 1) || !s->start)
+			return;
+		size = ra_next_size(s, max);
+		if (size > s->start)
+			size = s->start;
+		s->ahead_start = s->start - size;
+	} else {
+		if (index < s->start + (s->size >> 1))
+			return;
+		size = ra_next_size(s, max);
+		s->ahead_start = s->start + s->size;
 	}
+	s->ahead_size = size;
+	filp->f_ra.pages += size;
+	ra_read(filp, s->ahead_start, size);
+}
+
 /*
- * If we tried to read ahead some pages,
- * If we tried to read ahead asynchronously,
- *   Try to force unplug of the device in order to start an asynchronous
- *   read IO request.
- * Update the read-ahead context.
- * Store the length of the current read-ahead window.
- * Double the current max read ahead size.
- *   That heuristic avoid to do some large IO for files that are not really
- *   accessed sequentially.
- */
-	if (ahead) {
-		filp->f_ralen += ahead;
-		filp->f_rawin += filp->f_ralen;
-		filp->f_raend = raend + ahead + 1;
-
-		filp->f_ramax += filp->f_ramax;
-
-		if (filp->f_ramax > max_readahead)
-			filp->f_ramax = max_readahead;
-
-#ifdef PROFILE_READAHEAD
-		profile_readahead((reada_ok == 2), filp);
-#endif
+ * Called by the read path once for every page it wants, with the
+ * number of pages left in the request and whether the page was found
+ * in the page cache. May start reading that page and the rest of the
+ * request as well as the read-ahead windows.
+ */
+static void page_cache_readahead(struct file * filp, unsigned long index,
+	unsigned long nr, int cached)
+{
+	struct file_ra_state *ra = &filp->f_ra;
+	unsigned long max = get_max_readahead(filp->f_dentry->d_inode);
+	struct file_ra_stream *s;
+
+	if (cached)
+		ra->hits++;
+	else
+		ra->misses++;
+
+	s = ra_find_stream(ra, index, nr);
+	if (!s) {
+		s = ra_new_stream(ra);
+		s->prev = index;
+		s->next = index + nr;
+		s->stamp = ++ra->stamp;
+		if (!max)
+			return;
+		if (index) {
+			/* Only what was asked for, until it looks sequential */
+			ra_read(filp, index, ra_clamp(nr, max));
+			return;
+		}
+		ra_start(filp, s, index, nr, max);
+		return;
+	}
+	s->stamp = ++ra->stamp;
+	if (!cached && ra_in_windows(s, index))
+		s->misses++;
+
+	if (index == s->next && !s->backward) {
+		/* The next request of a forward stream */
+		s->prev = index;
+		s->next = index + nr;
+		if (max && !s->size)
+			ra_start(filp, s, index, nr, max);
+	} else if (index < s->prev) {
+		/* The next request of a backward stream */
+		s->next = s->prev;
+		s->prev = index;
+		if (max && (!s->size || !s->backward)) {
+			s->backward = 1;
+			ra_start(filp, s, index, nr, max);
+		}
+	} else if (index > s->next) {
+		/* Skipped ahead within its windows */
+		s->prev = index;
+		s->next = index + nr;
 	}
 
-	return;
+	if (max && s->size)
+		ra_advance(filp, s, index, max);
 }
 
 /*
@@ -1409,58 +1465,20 @@ void do_generic_file_read(struct file * filp, loff_t *ppos, read_descriptor_t *
 {
 	struct address_space *mapping = filp->f_dentry->d_inode->i_mapping;
 	struct inode *inode = mapping->host;
-	unsigned long index, offset;
+	unsigned long index, offset, last_index, ra_index;
 	struct page *cached_page;
-	int reada_ok;
 	int error;
-	int max_readahead = get_max_readahead(inode);
 
 	cached_page = NULL;
 	index = *ppos >> PAGE_CACHE_SHIFT;
 	offset = *ppos & ~PAGE_CACHE_MASK;
-
-/*
- * If the current position is outside the previous read-ahead window, 
- * we reset the current read-ahead context and set read ahead max to zero
- * (will be set to just needed value later),
- * otherwise, we assume that the file accesses are sequential enough to
- * continue read-ahead.
- */
-	if (index > filp->f_raend || index + filp->f_rawin < filp->f_raend) {
-		reada_ok = 0;
-		filp->f_raend = 0;
-		filp->f_ralen = 0;
-		filp->f_ramax = 0;
-		filp->f_rawin = 0;
-	} else {
-		reada_ok = 1;
-	}
-/*
- * Adjust the current value of read-ahead max.
- * If the read operation stay in the first half page, force no readahead.
- * Otherwise try to increase read ahead max just enough to do the read request.
- * Then, at least MIN_READAHEAD if read ahead is ok,
- * and at most MAX_READAHEAD in all cases.
- */
-	if (!index && offset + desc->count <= (PAGE_CACHE_SIZE >> 1)) {
-		filp->f_ramax = 0;
-	} else {
-		unsigned long needed;
-
-		needed = ((offset + desc->count) >> PAGE_CACHE_SHIFT) + 1;
-
-		if (filp->f_ramax < needed)
-			filp->f_ramax = needed;
-
-		if (reada_ok && filp->f_ramax < vm_min_readahead)
-				filp->f_ramax = vm_min_readahead;
-		if (filp->f_ramax > max_readahead)
-			filp->f_ramax = max_readahead;
-	}
+	last_index = (*ppos + desc->count + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+	ra_index = ~0UL;
 
 	for (;;) {
-		struct page *page, **hash;
+		struct page *page;
 		unsigned long end_index, nr, ret;
+		int err;
 
 		end_index = inode->i_size >> PAGE_CACHE_SHIFT;
 			
@@ -1478,19 +1496,29 @@ void do_generic_file_read(struct file * filp, loff_t *ppos, read_descriptor_t *
 		/*
 		 * Try to find the data in the page cache..
 		 */
-		hash = page_hash(mapping, index);
+		spin_lock(&mapping->page_lock);
+		page = radix_tree_lookup(&mapping->page_tree, index);
+		if (page)
+			page_cache_get(page);
+		spin_unlock(&mapping->page_lock);
 
-		spin_lock(&pagecache_lock);
-		page = __find_page_nolock(mapping, index, *hash);
+		/*
+		 * Let read-ahead know about each page once. If the page
+		 * was missing it has usually started reading it, so look
+		 * again before reading it ourselves.
+		 */
+		if (index != ra_index) {
+			ra_index = index;
+			page_cache_readahead(filp, index, last_index > index ?
+					     last_index - index : 1, page != NULL);
+			if (!page)
+				continue;
+		}
 		if (!page)
 			goto no_cached_page;
-found_page:
-		page_cache_get(page);
-		spin_unlock(&pagecache_lock);
 
 		if (!Page_Uptodate(page))
 			goto page_not_up_to_date;
-		generic_file_readahead(reada_ok, filp, inode, page);
 page_ok:
 		/* If users can be writing to this page using arbitrary
 		 * virtual addresses, take care about potential aliasing
@@ -1530,8 +1558,6 @@ page_ok:
  * Ok, the page was not immediately readable, so let's try to read ahead while we're at it..
  */
 page_not_up_to_date:
-		generic_file_readahead(reada_ok, filp, inode, page);
-
 		if (Page_Uptodate(page))
 			goto page_ok;
 
@@ -1558,9 +1584,6 @@ readpage:
 		if (!error) {
 			if (Page_Uptodate(page))
 				goto page_ok;
-
-			/* Again, try some read-ahead while waiting for the page to finish.. */
-			generic_file_readahead(reada_ok, filp, inode, page);
 			wait_on_page(page);
 			if (Page_Uptodate(page))
 				goto page_ok;
@@ -1576,34 +1599,29 @@ no_cached_page:
 		/*
 		 * Ok, it wasn't cached, so we need to create a new
 		 * page..
-		 *
-		 * We get here with the page cache lock held.
 		 */
 		if (!cached_page) {
-			spin_unlock(&pagecache_lock);
 			cached_page = page_cache_alloc(mapping);
 			if (!cached_page) {
 				desc->error = -ENOMEM;
 				break;
 			}
-
-			/*
-			 * Somebody may have added the page while we
-			 * dropped the page cache lock. Check for that.
-			 */
-			spin_lock(&pagecache_lock);
-			page = __find_page_nolock(mapping, index, *hash);
-			if (page)
-				goto found_page;
 		}
 
 		/*
-		 * Ok, add the new page to the hash-queues...
+		 * Ok, add the new page to the page cache, unless
+		 * somebody added one while we dropped the lock:
+		 * then just look it up again.
 		 */
+		err = add_to_page_cache_unique(cached_page, mapping, index,
+					       mapping->gfp_mask);
+		if (err < 0) {
+			desc->error = err;
+			break;
+		}
+		if (err)
+			continue;
 		page = cached_page;
-		__add_to_page_cache(page, mapping, index, hash);
-		spin_unlock(&pagecache_lock);
-		lru_cache_add(page);		
 		cached_page = NULL;
 
 		goto readpage;
@@ -1970,11 +1988,7 @@ static ssize_t do_readahead(struct file *file, unsigned long index, unsigned lon
 	if (nr > max)
 		nr = max;
 
-	while (nr) {
-		page_cache_read(file, index);
-		index++;
-		nr--;
-	}
+	page_cache_read_range(file, index, &nr);
 	return 0;
 }
 
@@ -2065,7 +2079,7 @@ struct page * filemap_nopage(struct vm_area_struct * area, unsigned long address
 	struct file *file = area->vm_file;
 	struct address_space *mapping = file->f_dentry->d_inode->i_mapping;
 	struct inode *inode = mapping->host;
-	struct page *page, **hash;
+	struct page *page;
 	unsigned long size, pgoff, endoff;
 
 	pgoff = ((address - area->vm_start) >> PAGE_CACHE_SHIFT) + area->vm_pgoff;
@@ -2087,9 +2101,8 @@ retry_all:
 	/*
 	 * Do we have something in the page cache already?
 	 */
-	hash = page_hash(mapping, pgoff);
 retry_find:
-	page = __find_get_page(mapping, pgoff, hash);
+	page = find_get_page(mapping, pgoff);
 	if (!page)
 		goto no_cached_page;
 
@@ -2620,13 +2633,10 @@ static long madvise_willneed(struct vm_area_struct * vma,
 			if (error < 0)
 				break;
 		}
-	} else {
-		while ((start < end) && (start < size)) {
-			error = page_cache_read(file, start);
-			start++;
-			if (error < 0)
-				break;
-		}
+	} else if ((start < end) && (start < size)) {
+		unsigned long nr = (end < size ? end : size) - start;
+
+		error = page_cache_read_range(file, start, &nr);
 	}
 
 	/* Don't wait for someone else to push these requests. */
@@ -2799,13 +2809,13 @@ static unsigned char mincore_page(struct vm_area_struct * vma,
 {
 	unsigned char present = 0;
 	struct address_space * as = vma->vm_file->f_dentry->d_inode->i_mapping;
-	struct page * page, ** hash = page_hash(as, pgoff);
+	struct page * page;
 
-	spin_lock(&pagecache_lock);
-	page = __find_page_nolock(as, pgoff, *hash);
+	spin_lock(&as->page_lock);
+	page = radix_tree_lookup(&as->page_tree, pgoff);
 	if ((page) && (Page_Uptodate(page)))
 		present = 1;
-	spin_unlock(&pagecache_lock);
+	spin_unlock(&as->page_lock);
 
 	return present;
 }
@@ -2937,11 +2947,10 @@ struct page *__read_cache_page(struct address_space *mapping,
 				int (*filler)(void *,struct page*),
 				void *data)
 {
-	struct page **hash = page_hash(mapping, index);
 	struct page *page, *cached_page = NULL;
 	int err;
 repeat:
-	page = __find_get_page(mapping, index, hash);
+	page = find_get_page(mapping, index);
 	if (!page) {
 		if (!cached_page) {
 			cached_page = page_cache_alloc(mapping);
@@ -2949,7 +2958,12 @@ repeat:
 				return ERR_PTR(-ENOMEM);
 		}
 		page = cached_page;
-		if (add_to_page_cache_unique(page, mapping, index, hash))
+		err = add_to_page_cache_unique(page, mapping, index, mapping->gfp_mask);
+		if (err < 0) {
+			page_cache_release(cached_page);
+			return ERR_PTR(err);
+		}
+		if (err)
 			goto repeat;
 		cached_page = NULL;
 		err = filler(data, page);
@@ -3005,9 +3019,10 @@ retry:
 static inline struct page * __grab_cache_page(struct address_space *mapping,
 				unsigned long index, struct page **cached_page)
 {
-	struct page *page, **hash = page_hash(mapping, index);
+	struct page *page;
+	int err;
 repeat:
-	page = __find_lock_page(mapping, index, hash);
+	page = find_lock_page(mapping, index);
 	if (!page) {
 		if (!*cached_page) {
 			*cached_page = page_cache_alloc(mapping);
@@ -3015,7 +3030,10 @@ repeat:
 				return NULL;
 		}
 		page = *cached_page;
-		if (add_to_page_cache_unique(page, mapping, index, hash))
+		err = add_to_page_cache_unique(page, mapping, index, mapping->gfp_mask);
+		if (err < 0)
+			return NULL;
+		if (err)
 			goto repeat;
 		*cached_page = NULL;
 	}
@@ -3368,30 +3386,3 @@ generic_file_write(struct file *file,const char *buf,size_t count, loff_t *ppos)
 
 	return err;
 }
-
-void __init page_cache_init(unsigned long mempages)
-{
-	unsigned long htable_size, order;
-
-	htable_size = mempages;
-	htable_size *= sizeof(struct page *);
-	for(order = 0; (PAGE_SIZE << order) < htable_size; order++)
-		;
-
-	do {
-		unsigned long tmp = (PAGE_SIZE << order) / sizeof(struct page *);
-
-		page_hash_bits = 0;
-		while((tmp >>= 1UL) != 0UL)
-			page_hash_bits++;
-
-		page_hash_table = (struct page **)
-			__get_free_pages(GFP_ATOMIC, order);
-	} while(page_hash_table == NULL && --order > 0);
-
-	printk("Page-cache hash table entries: %d (order: %ld, %ld bytes)\n",
-	       (1 << page_hash_bits), order, (PAGE_SIZE << order));
-	if (!page_hash_table)
-		panic("Failed to allocate page hash table\n");
-	memset((void *)page_hash_table, 0, PAGE_HASH_SIZE * sizeof(struct page *));
-}
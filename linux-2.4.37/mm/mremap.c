@@ -70,6 +70,12 @@ static inline int copy_one_pte(struct mm_struct *mm, pte_t * src, pte_t * dst)
 			error++;
 		}
 		set_pte(dst, pte);
+		if (dst != src && pte_present(pte)) {
+			struct page *page = pte_page(pte);
+
+			page_remove_rmap(page, src);
+			page_add_rmap(page, dst);
+		}
 	}
 	return error;
 }
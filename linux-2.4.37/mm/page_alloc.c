@@ -21,6 +21,7 @@
 #include <linux/bootmem.h>
 #include <linux/slab.h>
 #include <linux/module.h>
+#include <linux/seq_file.h>
 
 int nr_swap_pages;
 int nr_active_pages;
@@ -46,7 +47,7 @@ static int lower_zone_reserve_ratio[MAX_NR_ZONES-1] = { 256, 32 };
 
 int vm_gfp_debug = 0;
 
-static void FASTCALL(__free_pages_ok (struct page *page, unsigned int order));
+static void FASTCALL(__free_pages_ok (struct page *page, unsigned int order, int cold));
 
 static spinlock_t free_pages_ok_no_irq_lock = SPIN_LOCK_UNLOCKED;
 struct page * free_pages_ok_no_irq_head;
@@ -65,7 +66,7 @@ static void do_free_pages_ok_no_irq(void * arg)
        while (page) {
                __page = page;
                page = page->next_hash;
-               __free_pages_ok(__page, __page->index);
+               __free_pages_ok(__page, __page->index, 0);
        }
 }
 
@@ -109,11 +110,126 @@ static struct tq_struct free_pages_ok_no_irq_task = {
  * -- wli
  */
 
-static void fastcall __free_pages_ok (struct page *page, unsigned int order)
+/*
+ * Per-CPU hot and cold lists. Order-0 pages dominate, so instead of
+ * taking zone->lock for each of them every CPU keeps a short list of
+ * free pages per zone, refilled from and drained to the buddy lists
+ * batch pages at a time. Freed pages go to the hot list, where the
+ * next allocation finds them still in the cache. __GFP_COLD allocations
+ * like readahead, which does not touch the data with the CPU, take from
+ * the cold list instead, which is fed by pages the VM reclaims through
+ * free_cold_page(). Pages on these lists are not in zone->free_pages.
+ */
+static inline void __free_one_page(zone_t *zone, struct page *page, unsigned int order)
 {
-	unsigned long index, page_idx, mask, flags;
+	unsigned long index, page_idx, mask;
 	free_area_t *area;
 	struct page *base;
+
+	mask = (~0UL) << order;
+	base = zone->zone_mem_map;
+	page_idx = page - base;
+	if (page_idx & ~mask)
+		BUG();
+
+	index = page_idx >> (1 + order);
+
+	area = zone->free_area + order;
+
+	zone->free_pages -= mask;
+
+	while (mask + (1 << (MAX_ORDER-1))) {
+		struct page *buddy1, *buddy2;
+
+		if (area >= zone->free_area + MAX_ORDER)
+			BUG();
+		if (!__test_and_change_bit(index, area->map))
+			/*
+			 * the buddy page is still allocated.
+			 */
+			break;
+		/*
+		 * Move the buddy up one level.
+		 * This code is taking advantage of the identity:
+		 * 	-mask = 1+~mask
+		 */
+		buddy1 = base + (page_idx ^ -mask);
+		buddy2 = base + page_idx;
+		if (BAD_RANGE(zone,buddy1))
+			BUG();
+		if (BAD_RANGE(zone,buddy2))
+			BUG();
+
+		list_del(&buddy1->list);
+		mask <<= 1;
+		area++;
+		index >>= 1;
+		page_idx &= mask;
+	}
+	list_add(&(base + page_idx)->list, &area->free_list);
+}
+
+/*
+ * Give back up to count pages from the tail of a per-CPU list, the
+ * coldest ones. Interrupts must be disabled.
+ */
+static int free_pages_bulk(zone_t *zone, int count, struct list_head *list)
+{
+	struct page *page;
+	int freed = 0;
+
+	spin_lock(&zone->lock);
+	while (freed < count && !list_empty(list)) {
+		page = list_entry(list->prev, struct page, list);
+		list_del(&page->list);
+		__free_one_page(zone, page, 0);
+		freed++;
+	}
+	spin_unlock(&zone->lock);
+	return freed;
+}
+
+static void free_hot_cold_page(zone_t *zone, struct page *page, int cold)
+{
+	struct per_cpu_pages *pcp;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	pcp = &zone->pageset[smp_processor_id()].pcp[cold];
+	if (pcp->count >= pcp->high) {
+		pcp->free_miss++;
+		pcp->count -= free_pages_bulk(zone, pcp->batch, &pcp->list);
+	} else
+		pcp->free_hit++;
+	list_add(&page->list, &pcp->list);
+	pcp->count++;
+	local_irq_restore(flags);
+}
+
+/*
+ * Return the pages of this CPU's lists to the buddy allocator, when an
+ * allocation is about to fail.
+ */
+static void drain_local_pages(void)
+{
+	struct per_cpu_pages *pcp;
+	unsigned long flags;
+	zone_t *zone;
+	int i;
+
+	local_irq_save(flags);
+	for_each_zone(zone) {
+		for (i = 0; i < 2; i++) {
+			pcp = &zone->pageset[smp_processor_id()].pcp[i];
+			pcp->count -= free_pages_bulk(zone, pcp->count, &pcp->list);
+		}
+	}
+	local_irq_restore(flags);
+}
+
+static void fastcall __free_pages_ok (struct page *page, unsigned int order, int cold)
+{
+	unsigned long flags;
 	zone_t *zone;
 
 	/*
@@ -142,6 +258,8 @@ static void fastcall __free_pages_ok (struct page *page, unsigned int order)
 		BUG();
 	if (page->mapping)
 		BUG();
+	if (page->pte_chain)
+		BUG();
 	if (!VALID_PAGE(page))
 		BUG();
 	if (PageLocked(page))
@@ -157,50 +275,13 @@ static void fastcall __free_pages_ok (struct page *page, unsigned int order)
 
 	zone = page_zone(page);
 
-	mask = (~0UL) << order;
-	base = zone->zone_mem_map;
-	page_idx = page - base;
-	if (page_idx & ~mask)
-		BUG();
-
-	spin_lock_irqsave(&zone->lock, flags);
-
-	index = page_idx >> (1 + order);
-
-	area = zone->free_area + order;
-
-	zone->free_pages -= mask;
-
-	while (mask + (1 << (MAX_ORDER-1))) {
-		struct page *buddy1, *buddy2;
-
-		if (area >= zone->free_area + MAX_ORDER)
-			BUG();
-		if (!__test_and_change_bit(index, area->map))
-			/*
-			 * the buddy page is still allocated.
-			 */
-			break;
-		/*
-		 * Move the buddy up one level.
-		 * This code is taking advantage of the identity:
-		 * 	-mask = 1+~mask
-		 */
-		buddy1 = base + (page_idx ^ -mask);
-		buddy2 = base + page_idx;
-		if (BAD_RANGE(zone,buddy1))
-			BUG();
-		if (BAD_RANGE(zone,buddy2))
-			BUG();
-
-		list_del(&buddy1->list);
-		mask <<= 1;
-		area++;
-		index >>= 1;
-		page_idx &= mask;
+	if (!order) {
+		free_hot_cold_page(zone, page, cold);
+		return;
 	}
-	list_add(&(base + page_idx)->list, &area->free_list);
 
+	spin_lock_irqsave(&zone->lock, flags);
+	__free_one_page(zone, page, order);
 	spin_unlock_irqrestore(&zone->lock, flags);
 	return;
 
@@ -239,16 +320,14 @@ static inline struct page * expand (zone_t *zone, struct page *page,
 	return page;
 }
 
-static FASTCALL(struct page * rmqueue(zone_t *zone, unsigned int order));
-static struct page * fastcall rmqueue(zone_t *zone, unsigned int order)
+/* zone->lock is held */
+static struct page * __rmqueue(zone_t *zone, unsigned int order)
 {
 	free_area_t * area = zone->free_area + order;
 	unsigned int curr_order = order;
 	struct list_head *head, *curr;
-	unsigned long flags;
 	struct page *page;
 
-	spin_lock_irqsave(&zone->lock, flags);
 	do {
 		head = &area->free_list;
 		curr = head->next;
@@ -266,25 +345,76 @@ static struct page * fastcall rmqueue(zone_t *zone, unsigned int order)
 			zone->free_pages -= 1UL << order;
 
 			page = expand(zone, page, index, order, curr_order, area);
-			spin_unlock_irqrestore(&zone->lock, flags);
-
-			set_page_count(page, 1);
 			if (BAD_RANGE(zone,page))
 				BUG();
-			if (PageLRU(page))
-				BUG();
-			if (PageActive(page))
-				BUG();
-			return page;	
+			return page;
 		}
 		curr_order++;
 		area++;
 	} while (curr_order < MAX_ORDER);
-	spin_unlock_irqrestore(&zone->lock, flags);
 
 	return NULL;
 }
 
+/*
+ * Move up to count order-0 pages to a per-CPU list, interrupts must be
+ * disabled. Returns the number of pages moved.
+ */
+static int rmqueue_bulk(zone_t *zone, int count, struct list_head *list)
+{
+	struct page *page;
+	int allocated = 0;
+
+	spin_lock(&zone->lock);
+	while (allocated < count) {
+		page = __rmqueue(zone, 0);
+		if (!page)
+			break;
+		list_add_tail(&page->list, list);
+		allocated++;
+	}
+	spin_unlock(&zone->lock);
+	return allocated;
+}
+
+static FASTCALL(struct page * rmqueue(zone_t *zone, unsigned int order, int cold));
+static struct page * fastcall rmqueue(zone_t *zone, unsigned int order, int cold)
+{
+	unsigned long flags;
+	struct page *page = NULL;
+
+	if (!order) {
+		struct per_cpu_pages *pcp;
+
+		local_irq_save(flags);
+		pcp = &zone->pageset[smp_processor_id()].pcp[cold];
+		if (pcp->count <= pcp->low) {
+			pcp->alloc_miss++;
+			pcp->count += rmqueue_bulk(zone, pcp->batch, &pcp->list);
+		} else
+			pcp->alloc_hit++;
+		if (pcp->count) {
+			page = list_entry(pcp->list.next, struct page, list);
+			list_del(&page->list);
+			pcp->count--;
+		}
+		local_irq_restore(flags);
+	} else {
+		spin_lock_irqsave(&zone->lock, flags);
+		page = __rmqueue(zone, order);
+		spin_unlock_irqrestore(&zone->lock, flags);
+	}
+
+	if (page) {
+		set_page_count(page, 1);
+		if (PageLRU(page))
+			BUG();
+		if (PageActive(page))
+			BUG();
+	}
+	return page;
+}
+
 #ifndef CONFIG_DISCONTIGMEM
 struct page * fastcall _alloc_pages(unsigned int gfp_mask, unsigned int order)
 {
@@ -352,7 +482,7 @@ static struct page * fastcall balance_classzone(zone_t * classzone, unsigned int
 		while ((entry = local_pages->prev) != local_pages) {
 			list_del(entry);
 			tmp = list_entry(entry, struct page, list);
-			__free_pages_ok(tmp, tmp->index);
+			__free_pages_ok(tmp, tmp->index, 0);
 			if (!nr_pages--)
 				BUG();
 		}
@@ -377,6 +507,7 @@ struct page * fastcall __alloc_pages(unsigned int gfp_mask, unsigned int order,
 	zone_t **zone, * classzone;
 	struct page * page;
 	int freed, class_idx;
+	int cold = !!(gfp_mask & __GFP_COLD);
 
 	zone = zonelist->zones;
 	classzone = *zone;
@@ -388,7 +519,7 @@ struct page * fastcall __alloc_pages(unsigned int gfp_mask, unsigned int order,
 			break;
 
 		if (zone_free_pages(z, order) > z->watermarks[class_idx].low) {
-			page = rmqueue(z, order);
+			page = rmqueue(z, order, cold);
 			if (page)
 				return page;
 		}
@@ -410,7 +541,7 @@ struct page * fastcall __alloc_pages(unsigned int gfp_mask, unsigned int order,
 		if (!(gfp_mask & __GFP_WAIT))
 			min >>= 2;
 		if (zone_free_pages(z, order) > min) {
-			page = rmqueue(z, order);
+			page = rmqueue(z, order, cold);
 			if (page)
 				return page;
 		}
@@ -426,7 +557,7 @@ struct page * fastcall __alloc_pages(unsigned int gfp_mask, unsigned int order,
 			if (!z)
 				break;
 
-			page = rmqueue(z, order);
+			page = rmqueue(z, order, cold);
 			if (page)
 				return page;
 		}
@@ -438,6 +569,7 @@ struct page * fastcall __alloc_pages(unsigned int gfp_mask, unsigned int order,
 		goto out;
 
  rebalance:
+	drain_local_pages();
 	page = balance_classzone(classzone, gfp_mask, order, &freed);
 	if (page)
 		return page;
@@ -450,7 +582,7 @@ struct page * fastcall __alloc_pages(unsigned int gfp_mask, unsigned int order,
 				break;
 
 			if (zone_free_pages(z, order) > z->watermarks[class_idx].min) {
-				page = rmqueue(z, order);
+				page = rmqueue(z, order, cold);
 				if (page)
 					return page;
 			}
@@ -467,7 +599,7 @@ struct page * fastcall __alloc_pages(unsigned int gfp_mask, unsigned int order,
 				break;
 
 			if (zone_free_pages(z, order) > z->watermarks[class_idx].high) {
-				page = rmqueue(z, order);
+				page = rmqueue(z, order, cold);
 				if (page)
 					return page;
 			}
@@ -511,7 +643,17 @@ fastcall unsigned long get_zeroed_page(unsigned int gfp_mask)
 fastcall void __free_pages(struct page *page, unsigned int order)
 {
 	if (!PageReserved(page) && put_page_testzero(page))
-		__free_pages_ok(page, order);
+		__free_pages_ok(page, order, 0);
+}
+
+/*
+ * Drop a reference to an order-0 page whose contents are not going to be
+ * used any more, e.g. one evicted by the VM.
+ */
+fastcall void free_cold_page(struct page *page)
+{
+	if (!PageReserved(page) && put_page_testzero(page))
+		__free_pages_ok(page, 0, 1);
 }
 
 fastcall void free_pages(unsigned long addr, unsigned int order)
@@ -661,6 +803,56 @@ void show_free_areas(void)
 	show_free_areas_core(pgdat_list);
 }
 
+/*
+ * /proc/pagesets: the per-CPU page lists of every zone, with the number
+ * of allocations and frees that were served without taking zone->lock.
+ */
+static void *pagesets_start(struct seq_file *m, loff_t *pos)
+{
+	return *pos < smp_num_cpus ? (void *) (unsigned long) (*pos + 1) : NULL;
+}
+
+static void *pagesets_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	++*pos;
+	return pagesets_start(m, pos);
+}
+
+static void pagesets_stop(struct seq_file *m, void *v)
+{
+}
+
+static int pagesets_show(struct seq_file *m, void *v)
+{
+	int cpu = (unsigned long) v - 1, i;
+	static const char *names[2] = { "hot", "cold" };
+	zone_t *zone;
+
+	if (!cpu)
+		seq_puts(m, "# cpu zone list count low high batch "
+			 "alloc_hit alloc_miss free_hit free_miss\n");
+	for_each_zone(zone) {
+		if (!zone->size)
+			continue;
+		for (i = 0; i < 2; i++) {
+			struct per_cpu_pages *pcp = &zone->pageset[cpu].pcp[i];
+
+			seq_printf(m, "cpu%d %s %s %d %d %d %d %lu %lu %lu %lu\n",
+				cpu, zone->name, names[i], pcp->count, pcp->low,
+				pcp->high, pcp->batch, pcp->alloc_hit,
+				pcp->alloc_miss, pcp->free_hit, pcp->free_miss);
+		}
+	}
+	return 0;
+}
+
+const struct seq_operations pagesets_op = {
+	start:	pagesets_start,
+	next:	pagesets_next,
+	stop:	pagesets_stop,
+	show:	pagesets_show,
+};
+
 /*
  * Builds allocation fallback zone lists.
  */
@@ -807,7 +999,7 @@ void __init free_area_init_core(int nid, pg_data_t *pgdat, struct page **gmap,
 		zone_t *zone = pgdat->node_zones + j;
 		unsigned long mask;
 		unsigned long size, realsize;
-		int idx;
+		int idx, cpu, batch;
 
 		zone_table[nid * MAX_NR_ZONES + j] = zone;
 		realsize = size = zones_size[j];
@@ -824,6 +1016,33 @@ void __init free_area_init_core(int nid, pg_data_t *pgdat, struct page **gmap,
 		zone->need_balance = 0;
 		 zone->nr_active_pages = zone->nr_inactive_pages = 0;
 
+		/*
+		 * Per-CPU lists: batches of about a 1/1000th of the zone,
+		 * at most 64kB worth of pages.
+		 */
+		batch = realsize / 1024;
+		if (batch * PAGE_SIZE > 256 * 1024)
+			batch = (256 * 1024) / PAGE_SIZE;
+		batch /= 4;
+		if (batch < 1)
+			batch = 1;
+		for (cpu = 0; cpu < NR_CPUS; cpu++) {
+			struct per_cpu_pages *pcp;
+
+			pcp = &zone->pageset[cpu].pcp[0];	/* hot */
+			pcp->count = 0;
+			pcp->low = 2 * batch;
+			pcp->high = 6 * batch;
+			pcp->batch = batch;
+			INIT_LIST_HEAD(&pcp->list);
+
+			pcp = &zone->pageset[cpu].pcp[1];	/* cold */
+			pcp->count = 0;
+			pcp->low = 0;
+			pcp->high = 2 * batch;
+			pcp->batch = batch;
+			INIT_LIST_HEAD(&pcp->list);
+		}
 
 		if (!size)
 			continue;
@@ -0,0 +1,251 @@
+/*
+ *  linux/mm/rmap.c
+ *
+ *  Reverse mappings from physical pages to the ptes mapping them.
+ *
+ *  The pageout code used to find pages to evict by walking the page
+ *  tables of every process in swap_out(), which gets very slow with a
+ *  few big processes sharing lots of memory. Instead every mapped user
+ *  page now keeps a chain of the ptes pointing at it, so shrink_cache()
+ *  can check the referenced bits of and unmap exactly the page it wants
+ *  to free.
+ *
+ *  The mm and the virtual address of a pte are found through the
+ *  struct page of the page table page: pte_alloc() stores the mm in
+ *  ->mapping and the address the page table starts at in ->index.
+ *
+ *  Locking: the chain of a page is protected by the PG_chainlock bit,
+ *  which nests inside mm->page_table_lock. try_to_unmap() goes the
+ *  other way around and therefore only trylocks the page_table_lock.
+ */
+
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/swap.h>
+#include <linux/init.h>
+#include <linux/pagemap.h>
+
+#include <asm/pgalloc.h>
+
+struct pte_chain {
+	struct pte_chain *next;
+	pte_t *ptep;
+};
+
+static kmem_cache_t *pte_chain_cache;
+
+static inline void pte_chain_lock(struct page *page)
+{
+	while (test_and_set_bit(PG_chainlock, &page->flags)) {
+		while (test_bit(PG_chainlock, &page->flags))
+			cpu_relax();
+	}
+}
+
+static inline void pte_chain_unlock(struct page *page)
+{
+	smp_mb__before_clear_bit();
+	clear_bit(PG_chainlock, &page->flags);
+}
+
+static inline struct mm_struct *ptep_to_mm(pte_t *ptep)
+{
+	return (struct mm_struct *) virt_to_page(ptep)->mapping;
+}
+
+static inline unsigned long ptep_to_address(pte_t *ptep)
+{
+	unsigned long offset = (unsigned long) ptep & ~PAGE_MASK;
+
+	return virt_to_page(ptep)->index + offset / sizeof(pte_t) * PAGE_SIZE;
+}
+
+/*
+ * A new page table of mm covering address, or one that is being freed.
+ */
+void pgtable_add_rmap(pte_t *pte, struct mm_struct *mm, unsigned long address)
+{
+	struct page *page = virt_to_page(pte);
+
+	page->mapping = (struct address_space *) mm;
+	page->index = address & ~((PTRS_PER_PTE * PAGE_SIZE) - 1);
+}
+
+void pgtable_remove_rmap(pte_t *pte)
+{
+	struct page *page = virt_to_page(pte);
+
+	page->mapping = NULL;
+	page->index = 0;
+}
+
+/*
+ * Record that ptep maps page, with the page_table_lock of the mm held.
+ * If no chain entry can be allocated the mapping stays unknown to the
+ * pageout code: the page is then never freed while it is mapped, but
+ * it may be unmapped from its other ptes.
+ */
+void page_add_rmap(struct page *page, pte_t *ptep)
+{
+	struct pte_chain *pc;
+
+	if (!VALID_PAGE(page) || PageReserved(page))
+		return;
+
+	pc = kmem_cache_alloc(pte_chain_cache, SLAB_ATOMIC);
+	if (!pc)
+		return;
+	pc->ptep = ptep;
+
+	pte_chain_lock(page);
+	pc->next = page->pte_chain;
+	page->pte_chain = pc;
+	pte_chain_unlock(page);
+}
+
+/*
+ * ptep no longer maps page, with the page_table_lock of the mm held.
+ */
+void page_remove_rmap(struct page *page, pte_t *ptep)
+{
+	struct pte_chain *pc, **pprev;
+
+	if (!VALID_PAGE(page) || PageReserved(page))
+		return;
+
+	pte_chain_lock(page);
+	for (pprev = &page->pte_chain; (pc = *pprev) != NULL; pprev = &pc->next) {
+		if (pc->ptep == ptep) {
+			*pprev = pc->next;
+			pte_chain_unlock(page);
+			kmem_cache_free(pte_chain_cache, pc);
+			return;
+		}
+	}
+	pte_chain_unlock(page);
+}
+
+/*
+ * Test and clear the referenced bits of the page and of all ptes
+ * mapping it, returns the number of references found. The chain lock
+ * keeps the page tables in the chain from being freed under us, the
+ * young bits themselves are updated atomically.
+ */
+int page_referenced(struct page *page)
+{
+	struct pte_chain *pc;
+	int referenced = 0;
+
+	if (PageTestandClearReferenced(page))
+		referenced++;
+
+	pte_chain_lock(page);
+	for (pc = page->pte_chain; pc; pc = pc->next)
+		if (ptep_test_and_clear_young(pc->ptep))
+			referenced++;
+	pte_chain_unlock(page);
+
+	return referenced;
+}
+
+/*
+ * Unmap page from one pte, called with the chain lock held. Anonymous
+ * pages must be in the swap cache already so that the pte can be
+ * replaced by a swap entry.
+ */
+static int try_to_unmap_one(struct page *page, pte_t *ptep)
+{
+	struct mm_struct *mm = ptep_to_mm(ptep);
+	unsigned long address = ptep_to_address(ptep);
+	struct vm_area_struct *vma;
+	pte_t pte;
+	int ret;
+
+	if (!spin_trylock(&mm->page_table_lock))
+		return SWAP_AGAIN;
+
+	vma = find_vma(mm, address);
+	if (!vma || address < vma->vm_start) {
+		ret = SWAP_FAIL;
+		goto out_unlock;
+	}
+
+	/* Locked areas and recently used mappings stay */
+	if ((vma->vm_flags & (VM_LOCKED | VM_RESERVED)) ||
+	    ptep_test_and_clear_young(ptep)) {
+		ret = SWAP_FAIL;
+		goto out_unlock;
+	}
+
+	if (!PageSwapCache(page) && !page->mapping) {
+		ret = SWAP_FAIL;
+		goto out_unlock;
+	}
+
+	flush_cache_page(vma, address);
+	pte = ptep_get_and_clear(ptep);
+	flush_tlb_page(vma, address);
+
+	if (PageSwapCache(page)) {
+		swp_entry_t entry;
+
+		entry.val = page->index;
+		swap_duplicate(entry);
+		set_pte(ptep, swp_entry_to_pte(entry));
+	}
+
+	if (pte_dirty(pte))
+		set_page_dirty(page);
+
+	mm->rss--;
+	page_cache_release(page);
+	ret = SWAP_SUCCESS;
+
+out_unlock:
+	spin_unlock(&mm->page_table_lock);
+	return ret;
+}
+
+/*
+ * Remove all the ptes mapping page. The page must be locked and the
+ * caller must hold a reference to it. Returns SWAP_SUCCESS when the
+ * page is no longer mapped, SWAP_AGAIN if some mm was busy and SWAP_FAIL
+ * if the page cannot be unmapped now, e.g. because it is mlocked.
+ */
+int try_to_unmap(struct page *page)
+{
+	struct pte_chain *pc, **pprev;
+	int ret = SWAP_SUCCESS;
+
+	if (!PageLocked(page))
+		BUG();
+
+	pte_chain_lock(page);
+	pprev = &page->pte_chain;
+	while ((pc = *pprev) != NULL) {
+		switch (try_to_unmap_one(page, pc->ptep)) {
+		case SWAP_SUCCESS:
+			*pprev = pc->next;
+			kmem_cache_free(pte_chain_cache, pc);
+			continue;
+		case SWAP_AGAIN:
+			ret = SWAP_AGAIN;
+			break;
+		case SWAP_FAIL:
+			ret = SWAP_FAIL;
+			goto out;
+		}
+		pprev = &pc->next;
+	}
+out:
+	pte_chain_unlock(page);
+	return ret;
+}
+
+void __init pte_chain_init(void)
+{
+	pte_chain_cache = kmem_cache_create("pte_chain", sizeof(struct pte_chain),
+					    0, 0, NULL, NULL);
+	if (!pte_chain_cache)
+		panic("pte_chain_init: cannot create pte_chain cache");
+}
@@ -502,8 +502,7 @@ found:
 	inode = info->inode;
 	mapping = inode->i_mapping;
 	delete_from_swap_cache(page);
-	if (add_to_page_cache_unique(page,
-			mapping, idx, page_hash(mapping, idx)) == 0) {
+	if (add_to_page_cache_unique(page, mapping, idx, GFP_ATOMIC) == 0) {
 		info->flags |= SHMEM_PAGEIN;
 		ptr[offset].val = 0;
 		info->swapped--;
@@ -528,6 +527,13 @@ int shmem_unuse(swp_entry_t entry, struct page *page)
 	struct shmem_inode_info *info;
 	int found = 0;
 
+	/*
+	 * shmem_unuse_inode() moves the page into the page cache, or back
+	 * into the swap cache, under spinlocks: get the radix tree nodes
+	 * for that now. If we cannot, atomic allocations have to do.
+	 */
+	radix_tree_preload(GFP_KERNEL);
+
 	spin_lock(&shmem_ilock);
 	list_for_each(p, &shmem_inodes) {
 		info = list_entry(p, struct shmem_inode_info, list);
@@ -565,6 +571,9 @@ static int shmem_writepage(struct page *page)
 	if (info->flags & VM_LOCKED)
 		goto fail;
 getswap:
+	/* Adding the page back to the page cache below must not fail */
+	if (radix_tree_preload(GFP_NOIO))
+		goto fail;
 	swap = get_swap_page();
 	if (!swap.val)
 		goto fail;
@@ -590,7 +599,8 @@ getswap:
 		 * Raced with "speculative" read_swap_cache_async.
 		 * Add page back to page cache, unref swap, try again.
 		 */
-		add_to_page_cache_locked(page, mapping, index);
+		if (add_to_page_cache_locked(page, mapping, index))
+			BUG();
 		info->flags |= SHMEM_PAGEIN;
 		spin_unlock(&info->lock);
 		swap_free(swap);
@@ -645,6 +655,12 @@ repeat:
 	if (filepage && Page_Uptodate(filepage))
 		goto done;
 
+	/* Radix tree nodes for moving a page between swap and page cache */
+	if (radix_tree_preload(mapping->gfp_mask)) {
+		error = -ENOMEM;
+		goto failed;
+	}
+
 	spin_lock(&info->lock);
 	entry = shmem_swp_alloc(info, idx, sgp);
 	if (IS_ERR(entry)) {
@@ -707,7 +723,7 @@ repeat:
 			SetPageDirty(filepage);
 			swap_free(swap);
 		} else if (add_to_page_cache_unique(swappage,
-			mapping, idx, page_hash(mapping, idx)) == 0) {
+			mapping, idx, GFP_ATOMIC) == 0) {
 			info->flags |= SHMEM_PAGEIN;
 			entry->val = 0;
 			info->swapped--;
@@ -759,13 +775,14 @@ repeat:
 				goto failed;
 			}
 
+			radix_tree_preload(mapping->gfp_mask);
 			spin_lock(&info->lock);
 			entry = shmem_swp_alloc(info, idx, sgp);
 			if (IS_ERR(entry))
 				error = PTR_ERR(entry);
 			if (error || entry->val ||
 			    add_to_page_cache_unique(filepage,
-			    mapping, idx, page_hash(mapping, idx)) != 0) {
+			    mapping, idx, GFP_ATOMIC) != 0) {
 				spin_unlock(&info->lock);
 				page_cache_release(filepage);
 				shmem_free_block(inode);
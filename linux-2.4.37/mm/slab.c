@@ -43,6 +43,13 @@
  * of the entries in the array are given back into the global cache.
  * This reduces the number of spinlock operations.
  *
+ * Entries given back from a per-cpu array go to a per-cache depot first
+ * if it has room, and a cpu whose array ran dry refills from there
+ * before it takes the cache spinlock. Objects freed on one cpu and
+ * allocated on another thus move without touching the slab lists.
+ * A periodic task resizes the per-cpu arrays from their hit and miss
+ * counts, see kmem_autotune_cpucache().
+ *
  * The c_cpuarray may not be read with enabled local interrupts.
  *
  * SMP synchronization:
@@ -51,6 +58,7 @@
  *	are accessed without any locking.
  *  The per-cpu arrays are never accessed from the wrong cpu, no locking.
  *  The non-constant members are protected with a per-cache irq spinlock.
+ *  The depot has a lock of its own, nested inside the cache spinlock.
  *
  * Further notes from the original documentation:
  *
@@ -75,6 +83,7 @@
 #include	<linux/compiler.h>
 #include	<linux/seq_file.h>
 #include	<linux/bootmem.h>
+#include	<linux/tqueue.h>
 #include	<asm/uaccess.h>
 
 /*
@@ -163,13 +172,22 @@ typedef struct slab_s {
  *
  * Per cpu structures
  * The limit is stored in the per-cpu structure to reduce the data cache
- * footprint.
+ * footprint. The hit and miss counts feed the auto-tuning and
+ * /proc/slabinfo, a resized array inherits them from its predecessor.
+ * The depot uses the same structure.
  */
 typedef struct cpucache_s {
 	unsigned int avail;
 	unsigned int limit;
+	unsigned long allochit;
+	unsigned long allocmiss;
+	unsigned long freehit;
+	unsigned long freemiss;
 } cpucache_t;
 
+/* Largest array kmalloc can hold */
+#define CC_LIMIT_MAX	((128000-sizeof(cpucache_t))/sizeof(void *))
+
 #define cc_entry(cpucache) \
 	((void **)(((cpucache_t*)(cpucache))+1))
 #define cc_data(cachep) \
@@ -224,6 +242,13 @@ struct kmem_cache_s {
 #ifdef CONFIG_SMP
 /* 4) per-cpu data */
 	cpucache_t		*cpudata[NR_CPUS];
+	spinlock_t		shared_lock;
+	cpucache_t		*shared;	/* depot between the cpus */
+	unsigned long		contended;	/* spinlock found taken */
+	unsigned int		cc_min;		/* auto-tuning range */
+	unsigned int		cc_max;
+	unsigned long		tune_ops;	/* counts at the last tuning */
+	unsigned long		tune_misses;
 #endif
 #if STATS
 	unsigned long		num_active;
@@ -232,12 +257,6 @@ struct kmem_cache_s {
 	unsigned long		grown;
 	unsigned long		reaped;
 	unsigned long 		errors;
-#ifdef CONFIG_SMP
-	atomic_t		allochit;
-	atomic_t		allocmiss;
-	atomic_t		freehit;
-	atomic_t		freemiss;
-#endif
 #endif
 };
 
@@ -247,6 +266,7 @@ struct kmem_cache_s {
 
 /* c_dflags (dynamic flags). Need to hold the spinlock to access this member */
 #define	DFLGS_GROWN	0x000001UL	/* don't reap a recently grown */
+#define	DFLGS_TUNED	0x000002UL	/* limits set by hand, don't autotune */
 
 #define	OFF_SLAB(x)	((x)->flags & CFLGS_OFF_SLAB)
 #define	OPTIMIZE(x)	((x)->flags & CFLGS_OPTIMIZE)
@@ -272,18 +292,6 @@ struct kmem_cache_s {
 #define	STATS_INC_ERR(x)	do { } while (0)
 #endif
 
-#if STATS && defined(CONFIG_SMP)
-#define STATS_INC_ALLOCHIT(x)	atomic_inc(&(x)->allochit)
-#define STATS_INC_ALLOCMISS(x)	atomic_inc(&(x)->allocmiss)
-#define STATS_INC_FREEHIT(x)	atomic_inc(&(x)->freehit)
-#define STATS_INC_FREEMISS(x)	atomic_inc(&(x)->freemiss)
-#else
-#define STATS_INC_ALLOCHIT(x)	do { } while (0)
-#define STATS_INC_ALLOCMISS(x)	do { } while (0)
-#define STATS_INC_FREEHIT(x)	do { } while (0)
-#define STATS_INC_FREEMISS(x)	do { } while (0)
-#endif
-
 #if DEBUG
 /* Magic nums for obj red zoning.
  * Placed in the first word before and the first word after an obj.
@@ -358,6 +366,9 @@ static kmem_cache_t cache_cache = {
 	spinlock:	SPIN_LOCK_UNLOCKED,
 	colour_off:	L1_CACHE_BYTES,
 	name:		"kmem_cache",
+#ifdef CONFIG_SMP
+	shared_lock:	SPIN_LOCK_UNLOCKED,
+#endif
 };
 
 /* Guard access to the cache-chain. */
@@ -377,6 +388,23 @@ static int g_cpucache_up;
 
 static void enable_cpucache (kmem_cache_t *cachep);
 static void enable_all_cpucaches (void);
+
+/*
+ * Auto-tuning of the per-cpu arrays runs from keventd every
+ * SLAB_TUNE_INTERVAL.
+ */
+#define SLAB_TUNE_INTERVAL	(5*HZ)
+
+static void kmem_autotune(void *data);
+static struct tq_struct kmem_tune_task = {
+	routine:	kmem_autotune,
+};
+static struct timer_list kmem_tune_timer;
+
+static void kmem_tune_timer_fn(unsigned long data)
+{
+	schedule_task(&kmem_tune_task);
+}
 #endif
 
 /* Cal the num objs, wastage, and bytes left over for a given slab size. */
@@ -470,6 +498,10 @@ int __init kmem_cpucache_init(void)
 #ifdef CONFIG_SMP
 	g_cpucache_up = 1;
 	enable_all_cpucaches();
+
+	init_timer(&kmem_tune_timer);
+	kmem_tune_timer.function = kmem_tune_timer_fn;
+	mod_timer(&kmem_tune_timer, jiffies + SLAB_TUNE_INTERVAL);
 #endif
 	return 0;
 }
@@ -797,6 +829,7 @@ next:
 	strcpy(cachep->name, name);
 
 #ifdef CONFIG_SMP
+	spin_lock_init(&cachep->shared_lock);
 	if (g_cpucache_up)
 		enable_cpucache(cachep);
 #endif
@@ -869,16 +902,28 @@ typedef struct ccupdate_struct_s
 	cpucache_t *new[NR_CPUS];
 } ccupdate_struct_t;
 
+static inline void cc_inherit_stats(cpucache_t *cc, cpucache_t *old)
+{
+	cc->allochit = old->allochit;
+	cc->allocmiss = old->allocmiss;
+	cc->freehit = old->freehit;
+	cc->freemiss = old->freemiss;
+}
+
 static void do_ccupdate_local(void *info)
 {
 	ccupdate_struct_t *new = (ccupdate_struct_t *)info;
 	cpucache_t *old = cc_data(new->cachep);
-	
-	cc_data(new->cachep) = new->new[smp_processor_id()];
+	cpucache_t *cc = new->new[smp_processor_id()];
+
+	if (old && cc)
+		cc_inherit_stats(cc, old);
+	cc_data(new->cachep) = cc;
 	new->new[smp_processor_id()] = old;
 }
 
 static void free_block (kmem_cache_t* cachep, void** objpp, int len);
+static void kmem_depot_drain(kmem_cache_t *cachep);
 
 static void drain_cpu_caches(kmem_cache_t *cachep)
 {
@@ -901,6 +946,7 @@ static void drain_cpu_caches(kmem_cache_t *cachep)
 		local_irq_enable();
 		ccold->avail = 0;
 	}
+	kmem_depot_drain(cachep);
 	smp_call_function_all_cpus(do_ccupdate_local, (void *)&new);
 	up(&cache_chain_sem);
 }
@@ -1019,6 +1065,7 @@ int kmem_cache_destroy (kmem_cache_t * cachep)
 		int i;
 		for (i = 0; i < NR_CPUS; i++)
 			kfree(cachep->cpudata[i]);
+		kfree(cachep->shared);
 	}
 #endif
 	kmem_cache_free(&cache_cache, cachep);
@@ -1300,11 +1347,78 @@ static inline void * kmem_cache_alloc_one_tail (kmem_cache_t *cachep,
 })
 
 #ifdef CONFIG_SMP
+/*
+ * Take the cache spinlock from the per-cpu refill and flush paths,
+ * counting how often another cpu held it.
+ */
+static inline void kmem_cache_lock(kmem_cache_t *cachep)
+{
+	if (!spin_trylock(&cachep->spinlock)) {
+		spin_lock(&cachep->spinlock);
+		cachep->contended++;
+	}
+}
+
+/*
+ * Refill an empty per-cpu array with up to nr objects from the depot.
+ * Called with local interrupts disabled.
+ */
+static inline int kmem_depot_get(kmem_cache_t *cachep, cpucache_t *cc, int nr)
+{
+	cpucache_t *shared;
+
+	spin_lock(&cachep->shared_lock);
+	shared = cachep->shared;
+	if (shared) {
+		if (nr > shared->avail)
+			nr = shared->avail;
+		shared->avail -= nr;
+		memcpy(&cc_entry(cc)[cc->avail], &cc_entry(shared)[shared->avail],
+				sizeof(void *)*nr);
+		cc->avail += nr;
+		if (nr)
+			shared->allochit++;
+		else
+			shared->allocmiss++;
+	} else
+		nr = 0;
+	spin_unlock(&cachep->shared_lock);
+	return nr;
+}
+
+/*
+ * Move the nr coldest objects of a full per-cpu array into the depot,
+ * if it has room for all of them. Called with local interrupts disabled.
+ */
+static inline int kmem_depot_put(kmem_cache_t *cachep, cpucache_t *cc, int nr)
+{
+	cpucache_t *shared;
+	int ret = 0;
+
+	spin_lock(&cachep->shared_lock);
+	shared = cachep->shared;
+	if (shared) {
+		if (shared->limit - shared->avail >= nr) {
+			memcpy(&cc_entry(shared)[shared->avail], &cc_entry(cc)[0],
+					sizeof(void *)*nr);
+			shared->avail += nr;
+			shared->freehit++;
+			ret = 1;
+		} else
+			shared->freemiss++;
+	}
+	spin_unlock(&cachep->shared_lock);
+	return ret;
+}
+
 void* kmem_cache_alloc_batch(kmem_cache_t* cachep, cpucache_t* cc, int flags)
 {
 	int batchcount = cachep->batchcount;
 
-	spin_lock(&cachep->spinlock);
+	if (cachep->shared && kmem_depot_get(cachep, cc, batchcount))
+		return cc_entry(cc)[--cc->avail];
+
+	kmem_cache_lock(cachep);
 	while (batchcount--) {
 		struct list_head * slabs_partial, * entry;
 		slab_t *slabp;
@@ -1347,10 +1461,10 @@ try_again:
 
 		if (cc) {
 			if (cc->avail) {
-				STATS_INC_ALLOCHIT(cachep);
+				cc->allochit++;
 				objp = cc_entry(cc)[--cc->avail];
 			} else {
-				STATS_INC_ALLOCMISS(cachep);
+				cc->allocmiss++;
 				objp = kmem_cache_alloc_batch(cachep,cc,flags);
 				if (!objp)
 					goto alloc_new_slab_nolock;
@@ -1478,10 +1592,34 @@ static inline void __free_block (kmem_cache_t* cachep,
 
 static void free_block (kmem_cache_t* cachep, void** objpp, int len)
 {
-	spin_lock(&cachep->spinlock);
+	kmem_cache_lock(cachep);
 	__free_block(cachep, objpp, len);
 	spin_unlock(&cachep->spinlock);
 }
+
+/*
+ * Give everything in the depot back to the slabs. Called with local
+ * interrupts disabled and the cache spinlock held.
+ */
+static void kmem_depot_drain_locked(kmem_cache_t *cachep)
+{
+	cpucache_t *shared;
+
+	spin_lock(&cachep->shared_lock);
+	shared = cachep->shared;
+	if (shared && shared->avail) {
+		__free_block(cachep, cc_entry(shared), shared->avail);
+		shared->avail = 0;
+	}
+	spin_unlock(&cachep->shared_lock);
+}
+
+static void kmem_depot_drain(kmem_cache_t *cachep)
+{
+	spin_lock_irq(&cachep->spinlock);
+	kmem_depot_drain_locked(cachep);
+	spin_unlock_irq(&cachep->spinlock);
+}
 #endif
 
 /*
@@ -1497,17 +1635,19 @@ static inline void __kmem_cache_free (kmem_cache_t *cachep, void* objp)
 	if (cc) {
 		int tofree;
 		if (cc->avail < cc->limit) {
-			STATS_INC_FREEHIT(cachep);
+			cc->freehit++;
 			cc_entry(cc)[cc->avail++] = objp;
 			return;
 		}
-		STATS_INC_FREEMISS(cachep);
+		cc->freemiss++;
 		tofree = cachep->batchcount;
 		cc->avail -= tofree;
 		/*
-		 * True LIFO - zap the cache-cold entries:
+		 * True LIFO - zap the cache-cold entries, into the
+		 * depot if it has room:
 		 */
-		free_block(cachep, &cc_entry(cc)[0],tofree);
+		if (!cachep->shared || !kmem_depot_put(cachep, cc, tofree))
+			free_block(cachep, &cc_entry(cc)[0],tofree);
 		memmove(&cc_entry(cc)[0],
 				&cc_entry(cc)[tofree],sizeof(void*)*cc->avail);
 		cc_entry(cc)[cc->avail++] = objp;
@@ -1641,6 +1781,7 @@ kmem_cache_t * kmem_find_general_cachep (size_t size, int gfpflags)
 static int kmem_tune_cpucache (kmem_cache_t* cachep, int limit, int batchcount)
 {
 	ccupdate_struct_t new;
+	cpucache_t *shared = NULL, *ccold;
 	int i;
 
 	/*
@@ -1654,6 +1795,8 @@ static int kmem_tune_cpucache (kmem_cache_t* cachep, int limit, int batchcount)
 		return -EINVAL;
 	if (limit != 0 && !batchcount)
 		return -EINVAL;
+	if (limit > CC_LIMIT_MAX)
+		return -EINVAL;
 
 	memset(&new.new,0,sizeof(new.new));
 	if (limit) {
@@ -1664,20 +1807,43 @@ static int kmem_tune_cpucache (kmem_cache_t* cachep, int limit, int batchcount)
 					sizeof(cpucache_t), GFP_KERNEL);
 			if (!ccnew)
 				goto oom;
+			memset(ccnew, 0, sizeof(cpucache_t));
 			ccnew->limit = limit;
-			ccnew->avail = 0;
 			new.new[cpu_logical_map(i)] = ccnew;
 		}
 	}
+	/* The depot holds eight batches. */
+	if (limit && smp_num_cpus > 1) {
+		int shared_limit = batchcount*8;
+
+		if (shared_limit > CC_LIMIT_MAX)
+			shared_limit = CC_LIMIT_MAX;
+		shared = kmalloc(sizeof(void*)*shared_limit+
+				sizeof(cpucache_t), GFP_KERNEL);
+		if (!shared)
+			goto oom;
+		memset(shared, 0, sizeof(cpucache_t));
+		shared->limit = shared_limit;
+	}
 	new.cachep = cachep;
+
+	/*
+	 * Old and new arrays are live side by side until every cpu has
+	 * switched, so use a batch that fits both of them meanwhile.
+	 */
 	spin_lock_irq(&cachep->spinlock);
-	cachep->batchcount = batchcount;
+	if (batchcount < cachep->batchcount)
+		cachep->batchcount = batchcount;
 	spin_unlock_irq(&cachep->spinlock);
 
 	smp_call_function_all_cpus(do_ccupdate_local, (void *)&new);
 
+	spin_lock_irq(&cachep->spinlock);
+	cachep->batchcount = batchcount;
+	spin_unlock_irq(&cachep->spinlock);
+
 	for (i = 0; i < smp_num_cpus; i++) {
-		cpucache_t* ccold = new.new[cpu_logical_map(i)];
+		ccold = new.new[cpu_logical_map(i)];
 		if (!ccold)
 			continue;
 		local_irq_disable();
@@ -1685,6 +1851,18 @@ static int kmem_tune_cpucache (kmem_cache_t* cachep, int limit, int batchcount)
 		local_irq_enable();
 		kfree(ccold);
 	}
+
+	spin_lock_irq(&cachep->spinlock);
+	spin_lock(&cachep->shared_lock);
+	ccold = cachep->shared;
+	if (shared && ccold)
+		cc_inherit_stats(shared, ccold);
+	cachep->shared = shared;
+	spin_unlock(&cachep->shared_lock);
+	if (ccold)
+		__free_block(cachep, cc_entry(ccold), ccold->avail);
+	spin_unlock_irq(&cachep->spinlock);
+	kfree(ccold);
 	return 0;
 oom:
 	for (i--; i >= 0; i--)
@@ -1720,8 +1898,12 @@ static void enable_cpucache (kmem_cache_t *cachep)
 	 * kmalloc.
 	 */
 
-	if (limit > (128000/sizeof(void *)))
-		limit = 128000/sizeof(void *);
+	if (limit > CC_LIMIT_MAX)
+		limit = CC_LIMIT_MAX;
+
+	/* auto-tuning may go a factor of four either way */
+	cachep->cc_min = limit/4;
+	cachep->cc_max = min_t(unsigned int, limit*4, CC_LIMIT_MAX);
 
 	err = kmem_tune_cpucache(cachep, limit, limit/4);
 	if (err)
@@ -1745,6 +1927,64 @@ static void enable_all_cpucaches (void)
 
 	up(&cache_chain_sem);
 }
+
+/*
+ * Resize the per-cpu arrays of a cache from the counts of the last
+ * interval: double them while more than one operation in 16 misses,
+ * halve them when the cache has gone quiet, within cc_min..cc_max.
+ * Called with cache_chain_sem held.
+ */
+static void kmem_autotune_cpucache(kmem_cache_t *cachep)
+{
+	unsigned long ops = 0, misses = 0, dops, dmisses;
+	unsigned int limit = 0;
+	int i;
+
+	for (i = 0; i < smp_num_cpus; i++) {
+		cpucache_t *cc = cachep->cpudata[cpu_logical_map(i)];
+
+		if (!cc)
+			return;
+		limit = cc->limit;
+		ops += cc->allochit + cc->freehit;
+		misses += cc->allocmiss + cc->freemiss;
+	}
+	ops += misses;
+	dops = ops - cachep->tune_ops;
+	dmisses = misses - cachep->tune_misses;
+	cachep->tune_ops = ops;
+	cachep->tune_misses = misses;
+
+	if (cachep->dflags & DFLGS_TUNED)
+		return;
+
+	if (dmisses*16 > dops && dops > limit && limit < cachep->cc_max)
+		limit = min(limit*2, cachep->cc_max);
+	else if (dops < limit/2 && limit > cachep->cc_min)
+		limit = max(limit/2, cachep->cc_min);
+	else
+		return;
+	kmem_tune_cpucache(cachep, limit, limit/4);
+}
+
+static void kmem_autotune(void *data)
+{
+	struct list_head* p;
+
+	down(&cache_chain_sem);
+
+	p = &cache_cache.next;
+	do {
+		kmem_cache_t* cachep = list_entry(p, kmem_cache_t, next);
+
+		kmem_autotune_cpucache(cachep);
+		p = cachep->next.next;
+	} while (p != &cache_cache.next);
+
+	up(&cache_chain_sem);
+
+	mod_timer(&kmem_tune_timer, jiffies + SLAB_TUNE_INTERVAL);
+}
 #endif
 
 /**
@@ -1795,6 +2035,7 @@ int fastcall kmem_cache_reap (int gfp_mask)
 				__free_block(searchp, cc_entry(cc), cc->avail);
 				cc->avail = 0;
 			}
+			kmem_depot_drain_locked(searchp);
 		}
 #endif
 
@@ -1914,6 +2155,7 @@ static int s_show(struct seq_file *m, void *p)
 	unsigned long	num_objs;
 	unsigned long	active_slabs = 0;
 	unsigned long	num_slabs;
+	unsigned long	cached = 0;
 	const char *name; 
 
 	if (p == (void*)1) {
@@ -1921,7 +2163,7 @@ static int s_show(struct seq_file *m, void *p)
 		 * Output format version, so at least we can change it
 		 * without _too_ many complaints.
 		 */
-		seq_puts(m, "slabinfo - version: 1.1"
+		seq_puts(m, "slabinfo - version: 1.2"
 #if STATS
 				" (statistics)"
 #endif
@@ -1998,15 +2240,58 @@ static int s_show(struct seq_file *m, void *p)
 		seq_printf(m, " : %4u %4u",
 				limit, batchcount);
 	}
-#endif
-#if STATS && defined(CONFIG_SMP)
 	{
-		unsigned long allochit = atomic_read(&cachep->allochit);
-		unsigned long allocmiss = atomic_read(&cachep->allocmiss);
-		unsigned long freehit = atomic_read(&cachep->freehit);
-		unsigned long freemiss = atomic_read(&cachep->freemiss);
+		unsigned long allochit = 0, allocmiss = 0;
+		unsigned long freehit = 0, freemiss = 0;
+		cpucache_t *shared;
+		int i;
+
+		for (i = 0; i < smp_num_cpus; i++) {
+			cpucache_t *cc = cachep->cpudata[cpu_logical_map(i)];
+
+			if (!cc)
+				continue;
+			allochit += cc->allochit;
+			allocmiss += cc->allocmiss;
+			freehit += cc->freehit;
+			freemiss += cc->freemiss;
+			cached += cc->avail;
+		}
 		seq_printf(m, " : %6lu %6lu %6lu %6lu",
 				allochit, allocmiss, freehit, freemiss);
+
+		spin_lock(&cachep->shared_lock);
+		shared = cachep->shared;
+		if (shared) {
+			cached += shared->avail;
+			seq_printf(m, " : %4u %4u %6lu %6lu",
+					shared->limit, shared->avail,
+					shared->allochit, shared->freehit);
+		} else
+			seq_printf(m, " : %4u %4u %6lu %6lu", 0, 0, 0UL, 0UL);
+		spin_unlock(&cachep->shared_lock);
+		seq_printf(m, " %6lu", cachep->contended);
+	}
+#endif
+	/* slab memory not holding a live object, per-cpu arrays included */
+	seq_printf(m, " : %8lu", ((num_slabs << cachep->gfporder) << PAGE_SHIFT) -
+			(active_objs - cached) * cachep->objsize);
+#ifdef CONFIG_SMP
+	{
+		int i;
+
+		/* per-cpu array hit rate in percent */
+		seq_puts(m, " :");
+		for (i = 0; i < smp_num_cpus; i++) {
+			cpucache_t *cc = cachep->cpudata[cpu_logical_map(i)];
+			unsigned long hits = 0, ops = 0;
+
+			if (cc) {
+				hits = cc->allochit + cc->freehit;
+				ops = hits + cc->allocmiss + cc->freemiss;
+			}
+			seq_printf(m, " %3lu", ops ? hits * 100 / ops : 0);
+		}
 	}
 #endif
 	spin_unlock_irq(&cachep->spinlock);
@@ -2025,7 +2310,14 @@ static int s_show(struct seq_file *m, void *p)
  * num-active-slabs
  * total-slabs
  * num-pages-per-slab
- * + further values on SMP and with statistics enabled
+ * + further values with statistics enabled
+ * on SMP:
+ *   : per-cpu limit, batchcount
+ *   : per-cpu allochit, allocmiss, freehit, freemiss
+ *   : depot limit, objects, refills, flushes, cache lock contention
+ * bytes wasted, i.e. not holding an object in use
+ * on SMP:
+ *   : hit rate in percent for each cpu
  */
 
 const struct seq_operations slabinfo_op = {
@@ -2075,6 +2367,11 @@ ssize_t slabinfo_write(struct file *file, const char *buffer,
 
 		if (!strcmp(cachep->name, kbuf)) {
 			res = kmem_tune_cpucache(cachep, limit, batchcount);
+			if (!res) {
+				spin_lock_irq(&cachep->spinlock);
+				cachep->dflags |= DFLGS_TUNED;
+				spin_unlock_irq(&cachep->spinlock);
+			}
 			break;
 		}
 	}
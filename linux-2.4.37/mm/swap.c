@@ -100,7 +100,7 @@ void fastcall lru_cache_del(struct page * page)
  * @page: the page which is being activated/deactivated
  * @delta: +1 for activation, -1 for deactivation
  *
- * Called under pagecache_lock
+ * Called under pagemap_lru_lock
  */
 void delta_nr_active_pages(struct page *page, long delta)
 {
@@ -124,7 +124,7 @@ void delta_nr_active_pages(struct page *page, long delta)
  * @page: the page which is being deactivated/activated
  * @delta: +1 for deactivation, -1 for activation
  *
- * Called under pagecache_lock
+ * Called under pagemap_lru_lock
  */
 void delta_nr_inactive_pages(struct page *page, long delta)
 {
@@ -142,13 +142,16 @@ void delta_nr_inactive_pages(struct page *page, long delta)
 	nr_inactive_pages += delta;
 }
 
+static spinlock_t nr_cache_pages_lock = SPIN_LOCK_UNLOCKED;
+
 /**
  * delta_nr_cache_pages: alter the number of pages in the pagecache
  *
  * @page: the page which is being added/removed
  * @delta: +1 for addition, -1 for removal
  *
- * Called under pagecache_lock
+ * Called under the page_lock of the mapping of the page. The counters
+ * are shared by all mappings, so they have a lock of their own.
  */
 void delta_nr_cache_pages(struct page *page, long delta)
 {
@@ -159,11 +162,13 @@ void delta_nr_cache_pages(struct page *page, long delta)
 	pgdat = classzone->zone_pgdat;
 	overflow = pgdat->node_zones + pgdat->nr_zones;
 
+	spin_lock(&nr_cache_pages_lock);
 	while (classzone < overflow) {
 		classzone->nr_cache_pages += delta;
 		classzone++;
 	}
 	page_cache_size += delta;
+	spin_unlock(&nr_cache_pages_lock);
 }
 
 /*
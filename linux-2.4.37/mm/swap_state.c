@@ -37,11 +37,12 @@ static const struct address_space_operations swap_aops = {
 };
 
 struct address_space swapper_space = {
-	LIST_HEAD_INIT(swapper_space.clean_pages),
-	LIST_HEAD_INIT(swapper_space.dirty_pages),
-	LIST_HEAD_INIT(swapper_space.locked_pages),
-	0,				/* nrpages	*/
-	&swap_aops,
+	page_tree:	RADIX_TREE_INIT(GFP_ATOMIC),
+	page_lock:	SPIN_LOCK_UNLOCKED,
+	clean_pages:	LIST_HEAD_INIT(swapper_space.clean_pages),
+	dirty_pages:	LIST_HEAD_INIT(swapper_space.dirty_pages),
+	locked_pages:	LIST_HEAD_INIT(swapper_space.locked_pages),
+	a_ops:		&swap_aops,
 };
 
 #ifdef SWAP_CACHE_INFO
@@ -67,17 +68,26 @@ void show_swap_cache_info(void)
 #define INC_CACHE_INFO(x)	do { } while (0)
 #endif
 
+/*
+ * Callers may hold spinlocks, so the radix tree nodes are allocated
+ * atomically: those who can sleep should radix_tree_preload() first.
+ */
 int add_to_swap_cache(struct page *page, swp_entry_t entry)
 {
+	int err;
+
 	if (page->mapping)
 		BUG();
 	if (!swap_duplicate(entry)) {
 		INC_CACHE_INFO(noent_race);
 		return -ENOENT;
 	}
-	if (add_to_page_cache_unique(page, &swapper_space, entry.val,
-			page_hash(&swapper_space, entry.val)) != 0) {
+	err = add_to_page_cache_unique(page, &swapper_space, entry.val,
+				       GFP_ATOMIC);
+	if (err != 0) {
 		swap_free(entry);
+		if (err < 0)
+			return err;
 		INC_CACHE_INFO(exist_race);
 		return -EEXIST;
 	}
@@ -89,6 +99,38 @@ int add_to_swap_cache(struct page *page, swp_entry_t entry)
 	return 0;
 }
 
+/*
+ * Give a locked anonymous page a swap slot, so that the ptes mapping it
+ * can be replaced by swap entries. Returns 0 when swap is full.
+ */
+int add_to_swap(struct page *page)
+{
+	swp_entry_t entry;
+	int err;
+
+	for (;;) {
+		entry = get_swap_page();
+		if (!entry.val)
+			return 0;
+		/* Add it to the swap cache and mark it dirty
+		 * (adding to the page cache will clear the dirty
+		 * and uptodate bits, so we need to do it again)
+		 */
+		err = add_to_swap_cache(page, entry);
+		if (err == 0) {
+			SetPageUptodate(page);
+			set_page_dirty(page);
+			/* the swap cache holds its own reference now */
+			swap_free(entry);
+			return 1;
+		}
+		swap_free(entry);
+		/* Raced with "speculative" read_swap_cache_async? */
+		if (err != -EEXIST)
+			return 0;
+	}
+}
+
 /*
  * This must be called only on pages that have
  * been verified to be in the swap cache.
@@ -122,9 +164,9 @@ void delete_from_swap_cache(struct page *page)
 
 	entry.val = page->index;
 
-	spin_lock(&pagecache_lock);
+	spin_lock(&swapper_space.page_lock);
 	__delete_from_swap_cache(page);
-	spin_unlock(&pagecache_lock);
+	spin_unlock(&swapper_space.page_lock);
 
 	swap_free(entry);
 	page_cache_release(page);
@@ -205,6 +247,8 @@ struct page * read_swap_cache_async(swp_entry_t entry)
 			if (!new_page)
 				break;		/* Out of memory */
 		}
+		if (radix_tree_preload(GFP_KERNEL))
+			break;			/* Out of memory */
 
 		/*
 		 * Associate the page with swap entry in the swap cache.
@@ -212,7 +256,7 @@ struct page * read_swap_cache_async(swp_entry_t entry)
 		 * our caller observed it.  May fail (-EEXIST) if there
 		 * is already a page associated with this entry in the
 		 * swap cache: added by a racing read_swap_cache_async,
-		 * or by try_to_swap_out (or shmem_writepage) re-using
+		 * or by add_to_swap (or shmem_writepage) re-using
 		 * the just freed swap entry for an existing page.
 		 */
 		err = add_to_swap_cache(new_page, entry);
@@ -223,7 +267,7 @@ struct page * read_swap_cache_async(swp_entry_t entry)
 			rw_swap_page(READ, new_page);
 			return new_page;
 		}
-	} while (err != -ENOENT);
+	} while (err == -EEXIST);
 
 	if (new_page)
 		page_cache_release(new_page);
@@ -237,11 +237,11 @@ static int exclusive_swap_page(struct page *page)
 	if (p) {
 		/* Is the only swap cache user the cache itself? */
 		if (p->swap_map[SWP_OFFSET(entry)] == 1) {
-			/* Recheck the page count with the pagecache lock held.. */
-			spin_lock(&pagecache_lock);
+			/* Recheck the page count with the page_lock held.. */
+			spin_lock(&swapper_space.page_lock);
 			if (page_count(page) - !!page->buffers == 2)
 				retval = 1;
-			spin_unlock(&pagecache_lock);
+			spin_unlock(&swapper_space.page_lock);
 		}
 		swap_info_put(p);
 	}
@@ -305,14 +305,14 @@ int fastcall remove_exclusive_swap_page(struct page *page)
 	/* Is the only swap cache user the cache itself? */
 	retval = 0;
 	if (p->swap_map[SWP_OFFSET(entry)] == 1) {
-		/* Recheck the page count with the pagecache lock held.. */
-		spin_lock(&pagecache_lock);
+		/* Recheck the page count with the page_lock held.. */
+		spin_lock(&swapper_space.page_lock);
 		if (page_count(page) - !!page->buffers == 2) {
 			__delete_from_swap_cache(page);
 			SetPageDirty(page);
 			retval = 1;
 		}
-		spin_unlock(&pagecache_lock);
+		spin_unlock(&swapper_space.page_lock);
 	}
 	swap_info_put(p);
 
@@ -373,6 +373,7 @@ static inline void unuse_pte(struct vm_area_struct * vma, unsigned long address,
 		return;
 	get_page(page);
 	set_pte(dir, pte_mkold(mk_pte(page, vma->vm_page_prot)));
+	page_add_rmap(page, dir);
 	swap_free(entry);
 	++vma->vm_mm->rss;
 }
@@ -531,7 +532,7 @@ static int try_to_unuse(unsigned int type)
 	 *
 	 * A simpler strategy would be to start at the last mm we
 	 * freed the previous entry from; but that would take less
-	 * advantage of mmlist ordering (now preserved by swap_out()),
+	 * advantage of mmlist ordering (which nothing reorders now),
 	 * which clusters forked address spaces together, most recent
 	 * child immediately after parent.  If we race with dup_mmap(),
 	 * we very much want to resolve parent before child, otherwise
@@ -663,7 +664,7 @@ static int try_to_unuse(unsigned int type)
 
 		/*
 		 * If a reference remains (rare), we would like to leave
-		 * the page in the swap cache; but try_to_swap_out could
+		 * the page in the swap cache; but try_to_unmap could
 		 * then re-duplicate the entry once we drop page lock,
 		 * so we might loop indefinitely; also, that page could
 		 * not be swapped out to other storage meanwhile.  So:
@@ -694,7 +695,7 @@ static int try_to_unuse(unsigned int type)
 		/*
 		 * So we could skip searching mms once swap count went
 		 * to 1, we did not mark any present ptes as dirty: must
-		 * mark page dirty so try_to_swap_out will preserve it.
+		 * mark page dirty so the pageout code will preserve it.
 		 */
 		SetPageDirty(page);
 		UnlockPage(page);
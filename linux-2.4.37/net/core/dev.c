@@ -1019,6 +1019,8 @@ illegal_highdma(struct net_device *dev, struct sk_buff *skb)
 #define illegal_highdma(dev, skb)	(0)
 #endif
 
+int netdev_tx_batch = 8;	/* packets per trip through the tx locks */
+
 /**
  *	dev_queue_xmit - transmit a buffer
  *	@skb: buffer to transmit
@@ -1070,8 +1072,34 @@ int dev_queue_xmit(struct sk_buff *skb)
 	spin_lock_bh(&dev->queue_lock);
 	q = dev->qdisc;
 	if (q->enqueue) {
-		int ret = q->enqueue(skb, q);
+		int ret;
+
+		/* hard_start_xmit() queueing back to its own device would
+		   keep the queue owner busy forever. */
+		if (dev->xmit_lock_owner == smp_processor_id()) {
+			spin_unlock_bh(&dev->queue_lock);
+			if (net_ratelimit())
+				printk(KERN_DEBUG "Dead loop on netdevice %s, fix it urgently!\n", dev->name);
+			kfree_skb(skb);
+			return -ENETDOWN;
+		}
+
+		/* An idle pfifo_fast would hand the packet straight back,
+		   so skip it and go to the driver. */
+		if ((q->flags & TCQ_F_CAN_BYPASS) && !q->q.qlen &&
+		    !netif_queue_stopped(dev) &&
+		    !test_and_set_bit(__LINK_STATE_QDISC_RUNNING, &dev->state)) {
+			q->stats.bytes += skb->len;
+			q->stats.packets++;
+			if (qdisc_xmit(dev, skb) < 0)
+				__qdisc_run(dev);
+			else
+				clear_bit(__LINK_STATE_QDISC_RUNNING, &dev->state);
+			spin_unlock_bh(&dev->queue_lock);
+			return NET_XMIT_SUCCESS;
+		}
 
+		ret = q->enqueue(skb, q);
 		qdisc_run(dev);
 
 		spin_unlock_bh(&dev->queue_lock);
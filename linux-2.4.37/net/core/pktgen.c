@@ -115,6 +115,7 @@ struct pktgen_info {
 				 (default is to use Interface's MAC Addr) */
 #define F_SET_SRCIP   (1<<7)  /*  Specify-Src-IP
 				  (default is to use Interface's IP Addr) */ 
+#define F_QUEUE_XMIT  (1<<8)  /* Go through dev_queue_xmit() and the qdisc */
 
         
         int pkt_size;    /* = ETH_ZLEN; */
@@ -626,6 +627,28 @@ static void inject(struct pktgen_info* info)
                 }
 
                 nr_frags = skb_shinfo(skb)->nr_frags;
+
+		if (info->flags & F_QUEUE_XMIT) {
+			/* A queued skb is linked through skb->next, so each
+			 * send needs a head of its own.
+			 */
+			struct sk_buff *nskb = skb_clone(skb, GFP_ATOMIC);
+			int ret;
+
+			if (nskb == NULL)
+				ret = -ENOMEM;
+			else
+				ret = dev_queue_xmit(nskb);
+			if (ret) {
+				info->errors++;
+				last_ok = 0;
+			} else {
+				last_ok = 1;
+				info->sofar++;
+				info->seq_num++;
+			}
+			goto sent;
+		}
                    
 		spin_lock_bh(&odev->xmit_lock);
 		if (!netif_queue_stopped(odev)) {
@@ -655,6 +678,7 @@ static void inject(struct pktgen_info* info)
 
 		spin_unlock_bh(&odev->xmit_lock);
 
+sent:
 		if (info->ipg) {
                         /* Try not to busy-spin if we have larger sleep times.
                          * TODO:  Investigate better ways to do this.
@@ -830,6 +854,9 @@ static int proc_read(char *buf , char **start, off_t offset,
         if (info->flags & F_MACDST_RND) {
                 p += sprintf(p, "MACDST_RND  ");
         }
+        if (info->flags & F_QUEUE_XMIT) {
+                p += sprintf(p, "QUEUE_XMIT  ");
+        }
         p += sprintf(p, "\n");
         
         sa = tv_to_ms(&(info->started_at));
@@ -1145,10 +1172,16 @@ static int proc_write(struct file *file, const char *user_buffer,
                 else if (strcmp(f, "!MACDST_RND") == 0) {
                         info->flags &= ~F_MACDST_RND;
                 }
+                else if (strcmp(f, "QUEUE_XMIT") == 0) {
+                        info->flags |= F_QUEUE_XMIT;
+                }
+                else if (strcmp(f, "!QUEUE_XMIT") == 0) {
+                        info->flags &= ~F_QUEUE_XMIT;
+                }
                 else {
                         sprintf(result, "Flag -:%s:- unknown\nAvailable flags, (prepend ! to un-set flag):\n%s",
                                 f,
-                                "IPSRC_RND, IPDST_RND, UDPSRC_RND, UDPDST_RND, MACSRC_RND, MACDST_RND\n");
+                                "IPSRC_RND, IPDST_RND, UDPSRC_RND, UDPDST_RND, MACSRC_RND, MACDST_RND, QUEUE_XMIT\n");
                         return count;
                 }
 		sprintf(result, "OK: flags=0x%x", info->flags);
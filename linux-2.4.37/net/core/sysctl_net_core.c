@@ -13,6 +13,7 @@
 
 extern int netdev_max_backlog;
 extern int weight_p;
+extern int netdev_tx_batch;
 extern int no_cong_thresh;
 extern int no_cong;
 extern int lo_cong;
@@ -55,6 +56,9 @@ ctl_table core_table[] = {
 	{NET_CORE_MAX_BACKLOG, "netdev_max_backlog",
 	 &netdev_max_backlog, sizeof(int), 0644, NULL,
 	 &proc_dointvec},
+	{NET_CORE_TX_BATCH, "netdev_tx_batch",
+	 &netdev_tx_batch, sizeof(int), 0644, NULL,
+	 &proc_dointvec},
 	{NET_CORE_NO_CONG_THRESH, "no_cong_thresh",
 	 &no_cong_thresh, sizeof(int), 0644, NULL,
 	 &proc_dointvec},
@@ -0,0 +1,813 @@
+/*
+ * INET		An implementation of the TCP/IP protocol suite for the LINUX
+ *		operating system.  INET is implemented using the  BSD Socket
+ *		interface as the means of communication with the user level.
+ *
+ *		IPv4 FIB: lookup engine on a path-compressed binary trie.
+ *
+ *		A drop-in replacement for fib_hash.c.  fib_hash probes one
+ *		hash zone per prefix length in use, and its zones have to be
+ *		rehashed as they grow, which hurts with full routing tables.
+ *		Here every prefix in use is a node of a binary trie with
+ *		single-child chains squeezed out, so a lookup visits at most
+ *		33 nodes whatever the size of the table, and inserting or
+ *		deleting a route touches one path and never rehashes.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/config.h>
+#include <asm/uaccess.h>
+#include <asm/system.h>
+#include <asm/bitops.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/string.h>
+#include <linux/socket.h>
+#include <linux/sockios.h>
+#include <linux/errno.h>
+#include <linux/in.h>
+#include <linux/inet.h>
+#include <linux/netdevice.h>
+#include <linux/if_arp.h>
+#include <linux/proc_fs.h>
+#include <linux/skbuff.h>
+#include <linux/netlink.h>
+#include <linux/init.h>
+
+#include <net/ip.h>
+#include <net/protocol.h>
+#include <net/route.h>
+#include <net/tcp.h>
+#include <net/sock.h>
+#include <net/ip_fib.h>
+
+static kmem_cache_t * fn_node_kmem;
+static kmem_cache_t * fn_trie_kmem;
+
+/* One route, as in fib_hash.c.  Routes to the same prefix hang off its
+   trie node, ordered by descending tos, then ascending priority. */
+struct fib_node
+{
+	struct fib_node		*fn_next;
+	struct fib_info		*fn_info;
+#define FIB_INFO(f)	((f)->fn_info)
+	u32			fn_key;		/* prefix, network order */
+	u8			fn_tos;
+	u8			fn_type;
+	u8			fn_scope;
+	u8			fn_state;
+};
+
+#define FN_S_ACCESSED	2
+
+/* A prefix in the trie.  tn_key holds the first tn_plen bits of it in
+   host order, bit tn_plen of a destination picks the child.  Nodes
+   without routes are only kept where two subtrees branch. */
+struct tnode
+{
+	struct tnode		*tn_child[2];
+	struct fib_node		*tn_routes;
+	u32			tn_key;
+	int			tn_plen;
+};
+
+struct fn_trie
+{
+	struct tnode		*ft_root;
+};
+
+/* Readers look up under the read lock; changes are serialised by the
+   RTNL semaphore and published under the write lock. */
+static rwlock_t fib_trie_lock = RW_LOCK_UNLOCKED;
+
+static __inline__ u32 tn_mask(int plen)
+{
+	return plen ? ~0U << (32 - plen) : 0;
+}
+
+static __inline__ int tn_match(const struct tnode *n, u32 key)
+{
+	return ((key ^ n->tn_key) & tn_mask(n->tn_plen)) == 0;
+}
+
+static __inline__ int tn_bit(u32 key, int pos)
+{
+	return (key >> (31 - pos)) & 1;
+}
+
+/* Number of leading bits a and b have in common */
+static int tn_common_bits(u32 a, u32 b)
+{
+	u32 x = a ^ b;
+	int n = 0;
+
+	if (!x)
+		return 32;
+	while (!(x & 0x80000000)) {
+		x <<= 1;
+		n++;
+	}
+	return n;
+}
+
+static struct tnode *tn_alloc(u32 key, int plen)
+{
+	struct tnode *n = kmem_cache_alloc(fn_trie_kmem, SLAB_KERNEL);
+
+	if (n) {
+		memset(n, 0, sizeof(struct tnode));
+		n->tn_key = key & tn_mask(plen);
+		n->tn_plen = plen;
+	}
+	return n;
+}
+
+/*
+ * Find the node of prefix key/plen, adding it (and a branch node above
+ * it if needed) when create is set.
+ */
+static struct tnode *
+trie_get(struct fn_trie *t, u32 key, int plen, int create)
+{
+	struct tnode **np = &t->ft_root, *n, *new, *split;
+	int d;
+
+	while ((n = *np) != NULL) {
+		if (n->tn_plen > plen || !tn_match(n, key))
+			break;
+		if (n->tn_plen == plen)
+			return n;
+		np = &n->tn_child[tn_bit(key, n->tn_plen)];
+	}
+	if (!create)
+		return NULL;
+
+	if ((new = tn_alloc(key, plen)) == NULL)
+		return NULL;
+
+	if (n == NULL) {
+		write_lock_bh(&fib_trie_lock);
+		*np = new;
+		write_unlock_bh(&fib_trie_lock);
+		return new;
+	}
+
+	d = tn_common_bits(key, n->tn_key);
+	if (d > n->tn_plen)
+		d = n->tn_plen;
+	if (d >= plen) {
+		/* n lies under the new prefix */
+		new->tn_child[tn_bit(n->tn_key, plen)] = n;
+		write_lock_bh(&fib_trie_lock);
+		*np = new;
+		write_unlock_bh(&fib_trie_lock);
+		return new;
+	}
+
+	/* They part at bit d: hang both under a new branch node */
+	if ((split = tn_alloc(key, d)) == NULL) {
+		kmem_cache_free(fn_trie_kmem, new);
+		return NULL;
+	}
+	split->tn_child[tn_bit(key, d)] = new;
+	split->tn_child[tn_bit(n->tn_key, d)] = n;
+	write_lock_bh(&fib_trie_lock);
+	*np = split;
+	write_unlock_bh(&fib_trie_lock);
+	return new;
+}
+
+/* Unlink *np if it carries no routes and does not branch. */
+static int trie_collapse(struct tnode **np)
+{
+	struct tnode *n = *np;
+
+	if (n->tn_routes || (n->tn_child[0] && n->tn_child[1]))
+		return 0;
+
+	write_lock_bh(&fib_trie_lock);
+	*np = n->tn_child[0] ? : n->tn_child[1];
+	write_unlock_bh(&fib_trie_lock);
+	kmem_cache_free(fn_trie_kmem, n);
+	return 1;
+}
+
+/* Drop the node of key/plen, and then its parent, once they are useless */
+static void trie_prune(struct fn_trie *t, u32 key, int plen)
+{
+	struct tnode **path[34], **np = &t->ft_root, *n;
+	int depth = 0;
+
+	while ((n = *np) != NULL && n->tn_plen <= plen && tn_match(n, key)) {
+		path[depth++] = np;
+		if (n->tn_plen == plen)
+			break;
+		np = &n->tn_child[tn_bit(key, n->tn_plen)];
+	}
+	if (n == NULL || n->tn_plen != plen)
+		return;
+
+	while (depth > 0 && trie_collapse(path[--depth]))
+		;
+}
+
+static void fn_free_node(struct fib_node * f)
+{
+	fib_release_info(FIB_INFO(f));
+	kmem_cache_free(fn_node_kmem, f);
+}
+
+static int
+fn_trie_lookup(struct fib_table *tb, const struct rt_key *key, struct fib_result *res)
+{
+	int err;
+	struct fn_trie *t = (struct fn_trie*)tb->tb_data;
+	struct tnode *n, *stack[33];
+	u32 dst = ntohl(key->dst);
+	int sp = 0;
+
+	read_lock(&fib_trie_lock);
+	for (n = t->ft_root; n && tn_match(n, dst); ) {
+		if (n->tn_routes)
+			stack[sp++] = n;
+		if (n->tn_plen == 32)
+			break;
+		n = n->tn_child[tn_bit(dst, n->tn_plen)];
+	}
+
+	/* Longest prefix first */
+	while (sp > 0) {
+		struct fib_node *f;
+
+		n = stack[--sp];
+		for (f = n->tn_routes; f; f = f->fn_next) {
+#ifdef CONFIG_IP_ROUTE_TOS
+			if (f->fn_tos && f->fn_tos != key->tos)
+				continue;
+#endif
+			f->fn_state |= FN_S_ACCESSED;
+
+			if (f->fn_scope < key->scope)
+				continue;
+
+			err = fib_semantic_match(f->fn_type, FIB_INFO(f), key, res);
+			if (err == 0) {
+				res->type = f->fn_type;
+				res->scope = f->fn_scope;
+				res->prefixlen = n->tn_plen;
+				goto out;
+			}
+			if (err < 0)
+				goto out;
+		}
+	}
+	err = 1;
+out:
+	read_unlock(&fib_trie_lock);
+	return err;
+}
+
+static int fn_trie_last_dflt=-1;
+
+static int fib_detect_death(struct fib_info *fi, int order,
+			    struct fib_info **last_resort, int *last_idx)
+{
+	struct neighbour *n;
+	int state = NUD_NONE;
+
+	n = neigh_lookup(&arp_tbl, &fi->fib_nh[0].nh_gw, fi->fib_dev);
+	if (n) {
+		state = n->nud_state;
+		neigh_release(n);
+	}
+	if (state==NUD_REACHABLE)
+		return 0;
+	if ((state&NUD_VALID) && order != fn_trie_last_dflt)
+		return 0;
+	if ((state&NUD_VALID) ||
+	    (*last_idx<0 && order > fn_trie_last_dflt)) {
+		*last_resort = fi;
+		*last_idx = order;
+	}
+	return 1;
+}
+
+static void
+fn_trie_select_default(struct fib_table *tb, const struct rt_key *key, struct fib_result *res)
+{
+	int order, last_idx;
+	struct fib_node *f;
+	struct fib_info *fi = NULL;
+	struct fib_info *last_resort;
+	struct fn_trie *t = (struct fn_trie*)tb->tb_data;
+	struct tnode *n;
+
+	last_idx = -1;
+	last_resort = NULL;
+	order = -1;
+
+	read_lock(&fib_trie_lock);
+	n = t->ft_root;
+	if (n == NULL || n->tn_plen != 0)
+		goto out;
+
+	for (f = n->tn_routes; f; f = f->fn_next) {
+		struct fib_info *next_fi = FIB_INFO(f);
+
+		if (f->fn_scope != res->scope ||
+		    f->fn_type != RTN_UNICAST)
+			continue;
+
+		if (next_fi->fib_priority > res->fi->fib_priority)
+			break;
+		if (!next_fi->fib_nh[0].nh_gw || next_fi->fib_nh[0].nh_scope != RT_SCOPE_LINK)
+			continue;
+		f->fn_state |= FN_S_ACCESSED;
+
+		if (fi == NULL) {
+			if (next_fi != res->fi)
+				break;
+		} else if (!fib_detect_death(fi, order, &last_resort, &last_idx)) {
+			if (res->fi)
+				fib_info_put(res->fi);
+			res->fi = fi;
+			atomic_inc(&fi->fib_clntref);
+			fn_trie_last_dflt = order;
+			goto out;
+		}
+		fi = next_fi;
+		order++;
+	}
+
+	if (order<=0 || fi==NULL) {
+		fn_trie_last_dflt = -1;
+		goto out;
+	}
+
+	if (!fib_detect_death(fi, order, &last_resort, &last_idx)) {
+		if (res->fi)
+			fib_info_put(res->fi);
+		res->fi = fi;
+		atomic_inc(&fi->fib_clntref);
+		fn_trie_last_dflt = order;
+		goto out;
+	}
+
+	if (last_idx >= 0) {
+		if (res->fi)
+			fib_info_put(res->fi);
+		res->fi = last_resort;
+		if (last_resort)
+			atomic_inc(&last_resort->fib_clntref);
+	}
+	fn_trie_last_dflt = last_idx;
+out:
+	read_unlock(&fib_trie_lock);
+}
+
+#define FIB_SCAN(f, fp) \
+for ( ; ((f) = *(fp)) != NULL; (fp) = &(f)->fn_next)
+
+#ifndef CONFIG_IP_ROUTE_TOS
+#define FIB_SCAN_TOS(f, fp, tos) FIB_SCAN(f, fp)
+#else
+#define FIB_SCAN_TOS(f, fp, tos) \
+for ( ; ((f) = *(fp)) != NULL && (f)->fn_tos == (tos) ; (fp) = &(f)->fn_next)
+#endif
+
+
+static void rtmsg_fib(int, struct fib_node*, int, int,
+		      struct nlmsghdr *n,
+		      struct netlink_skb_parms *);
+
+static int
+fn_trie_insert(struct fib_table *tb, struct rtmsg *r, struct kern_rta *rta,
+	       struct nlmsghdr *n, struct netlink_skb_parms *req)
+{
+	struct fn_trie *t = (struct fn_trie*)tb->tb_data;
+	struct fib_node *new_f, *f, **fp, **del_fp;
+	struct tnode *tn;
+	struct fib_info *fi;
+
+	int z = r->rtm_dst_len;
+	int type = r->rtm_type;
+#ifdef CONFIG_IP_ROUTE_TOS
+	u8 tos = r->rtm_tos;
+#endif
+	u32 key;
+	int err;
+
+	if (z > 32)
+		return -EINVAL;
+
+	key = 0;
+	if (rta->rta_dst) {
+		memcpy(&key, rta->rta_dst, 4);
+		if (key & ~inet_make_mask(z))
+			return -EINVAL;
+	}
+
+	if  ((fi = fib_create_info(r, rta, n, &err)) == NULL)
+		return err;
+
+	tn = trie_get(t, ntohl(key), z, 1);
+	if (tn == NULL) {
+		fib_release_info(fi);
+		return -ENOBUFS;
+	}
+	fp = &tn->tn_routes;
+
+#ifdef CONFIG_IP_ROUTE_TOS
+	/*
+	 * Find route with the same tos.
+	 */
+	FIB_SCAN(f, fp) {
+		if (f->fn_tos <= tos)
+			break;
+	}
+#endif
+
+	del_fp = NULL;
+
+	FIB_SCAN_TOS(f, fp, tos) {
+		if (fi->fib_priority <= FIB_INFO(f)->fib_priority)
+			break;
+	}
+
+	/* Now f==*fp points to the first node with the same
+	   keys [tos,priority], if such key already exists or to
+	   the node, before which we will insert new one.
+	 */
+
+	if (f &&
+#ifdef CONFIG_IP_ROUTE_TOS
+	    f->fn_tos == tos &&
+#endif
+	    fi->fib_priority == FIB_INFO(f)->fib_priority) {
+		struct fib_node **ins_fp;
+
+		err = -EEXIST;
+		if (n->nlmsg_flags&NLM_F_EXCL)
+			goto out;
+
+		if (n->nlmsg_flags&NLM_F_REPLACE) {
+			del_fp = fp;
+			fp = &f->fn_next;
+			f = *fp;
+			goto replace;
+		}
+
+		ins_fp = fp;
+		err = -EEXIST;
+
+		FIB_SCAN_TOS(f, fp, tos) {
+			if (fi->fib_priority != FIB_INFO(f)->fib_priority)
+				break;
+			if (f->fn_type == type && f->fn_scope == r->rtm_scope
+			    && FIB_INFO(f) == fi)
+				goto out;
+		}
+
+		if (!(n->nlmsg_flags&NLM_F_APPEND)) {
+			fp = ins_fp;
+			f = *fp;
+		}
+	}
+
+	err = -ENOENT;
+	if (!(n->nlmsg_flags&NLM_F_CREATE))
+		goto out;
+
+replace:
+	err = -ENOBUFS;
+	new_f = kmem_cache_alloc(fn_node_kmem, SLAB_KERNEL);
+	if (new_f == NULL)
+		goto out;
+
+	memset(new_f, 0, sizeof(struct fib_node));
+
+	new_f->fn_key = key;
+#ifdef CONFIG_IP_ROUTE_TOS
+	new_f->fn_tos = tos;
+#endif
+	new_f->fn_type = type;
+	new_f->fn_scope = r->rtm_scope;
+	FIB_INFO(new_f) = fi;
+
+	/*
+	 * Insert new entry to the list.
+	 */
+
+	new_f->fn_next = f;
+	write_lock_bh(&fib_trie_lock);
+	*fp = new_f;
+	write_unlock_bh(&fib_trie_lock);
+
+	if (del_fp) {
+		f = *del_fp;
+		/* Unlink replaced node */
+		write_lock_bh(&fib_trie_lock);
+		*del_fp = f->fn_next;
+		write_unlock_bh(&fib_trie_lock);
+
+		rtmsg_fib(RTM_DELROUTE, f, z, tb->tb_id, n, req);
+		if (f->fn_state&FN_S_ACCESSED)
+			rt_cache_flush(-1);
+		fn_free_node(f);
+	} else {
+		rt_cache_flush(-1);
+	}
+	rtmsg_fib(RTM_NEWROUTE, new_f, z, tb->tb_id, n, req);
+	return 0;
+
+out:
+	fib_release_info(fi);
+	if (tn->tn_routes == NULL)
+		trie_prune(t, ntohl(key), z);
+	return err;
+}
+
+
+static int
+fn_trie_delete(struct fib_table *tb, struct rtmsg *r, struct kern_rta *rta,
+	       struct nlmsghdr *n, struct netlink_skb_parms *req)
+{
+	struct fn_trie *t = (struct fn_trie*)tb->tb_data;
+	struct fib_node **fp, **del_fp, *f;
+	struct tnode *tn;
+	int z = r->rtm_dst_len;
+	u32 key;
+#ifdef CONFIG_IP_ROUTE_TOS
+	u8 tos = r->rtm_tos;
+#endif
+
+	if (z > 32)
+		return -EINVAL;
+
+	key = 0;
+	if (rta->rta_dst) {
+		memcpy(&key, rta->rta_dst, 4);
+		if (key & ~inet_make_mask(z))
+			return -EINVAL;
+	}
+
+	if ((tn = trie_get(t, ntohl(key), z, 0)) == NULL)
+		return -ESRCH;
+	fp = &tn->tn_routes;
+
+#ifdef CONFIG_IP_ROUTE_TOS
+	FIB_SCAN(f, fp) {
+		if (f->fn_tos == tos)
+			break;
+	}
+#endif
+
+	del_fp = NULL;
+	FIB_SCAN_TOS(f, fp, tos) {
+		struct fib_info * fi = FIB_INFO(f);
+
+		if ((!r->rtm_type || f->fn_type == r->rtm_type) &&
+		    (r->rtm_scope == RT_SCOPE_NOWHERE || f->fn_scope == r->rtm_scope) &&
+		    (!r->rtm_protocol || fi->fib_protocol == r->rtm_protocol) &&
+		    fib_nh_match(r, n, rta, fi) == 0) {
+			del_fp = fp;
+			break;
+		}
+	}
+
+	if (del_fp) {
+		f = *del_fp;
+		rtmsg_fib(RTM_DELROUTE, f, z, tb->tb_id, n, req);
+
+		write_lock_bh(&fib_trie_lock);
+		*del_fp = f->fn_next;
+		write_unlock_bh(&fib_trie_lock);
+
+		if (f->fn_state&FN_S_ACCESSED)
+			rt_cache_flush(-1);
+		fn_free_node(f);
+
+		if (tn->tn_routes == NULL)
+			trie_prune(t, ntohl(key), z);
+		return 0;
+	}
+	return -ESRCH;
+}
+
+static int fn_flush_list(struct fib_node ** fp)
+{
+	int found = 0;
+	struct fib_node *f;
+
+	while ((f = *fp) != NULL) {
+		struct fib_info *fi = FIB_INFO(f);
+
+		if (fi && (fi->fib_flags&RTNH_F_DEAD)) {
+			write_lock_bh(&fib_trie_lock);
+			*fp = f->fn_next;
+			write_unlock_bh(&fib_trie_lock);
+
+			fn_free_node(f);
+			found++;
+			continue;
+		}
+		fp = &f->fn_next;
+	}
+	return found;
+}
+
+/* Recursion is bounded by the 33 levels of the trie */
+static int fn_flush_subtrie(struct tnode **np)
+{
+	struct tnode *n = *np;
+	int found;
+
+	if (n == NULL)
+		return 0;
+
+	found = fn_flush_subtrie(&n->tn_child[0]);
+	found += fn_flush_subtrie(&n->tn_child[1]);
+	found += fn_flush_list(&n->tn_routes);
+	trie_collapse(np);
+	return found;
+}
+
+static int fn_trie_flush(struct fib_table *tb)
+{
+	struct fn_trie *t = (struct fn_trie*)tb->tb_data;
+
+	return fn_flush_subtrie(&t->ft_root);
+}
+
+
+/* Walks the routes in prefix order for /proc and netlink dumps, which
+   restart after the number of routes they have already seen. */
+struct fn_trie_walker
+{
+	int		(*fn)(struct fn_trie_walker *w, struct tnode *n,
+			      struct fib_node *f);
+	int		skip;
+	int		pos;
+
+	struct fib_table	*tb;
+	struct sk_buff		*skb;
+	struct netlink_callback	*cb;
+	char			*buffer;
+	int			count;
+};
+
+static int fn_trie_walk(struct tnode *n, struct fn_trie_walker *w)
+{
+	struct fib_node *f;
+	int err;
+
+	for ( ; n; n = n->tn_child[1]) {
+		for (f = n->tn_routes; f; f = f->fn_next) {
+			if (w->pos++ < w->skip)
+				continue;
+			if ((err = w->fn(w, n, f)) != 0)
+				return err;
+		}
+		if ((err = fn_trie_walk(n->tn_child[0], w)) != 0)
+			return err;
+	}
+	return 0;
+}
+
+#ifdef CONFIG_PROC_FS
+
+static int fn_trie_get_info_one(struct fn_trie_walker *w, struct tnode *n,
+				struct fib_node *f)
+{
+	fib_node_get_info(f->fn_type, 0, FIB_INFO(f), f->fn_key,
+			  inet_make_mask(n->tn_plen), w->buffer);
+	w->buffer += 128;
+	return --w->count == 0;
+}
+
+static int fn_trie_get_info(struct fib_table *tb, char *buffer, int first, int count)
+{
+	struct fn_trie *t = (struct fn_trie*)tb->tb_data;
+	struct fn_trie_walker w;
+
+	if (count <= 0)
+		return 0;
+
+	w.fn = fn_trie_get_info_one;
+	w.skip = first;
+	w.pos = 0;
+	w.buffer = buffer;
+	w.count = count;
+
+	read_lock(&fib_trie_lock);
+	fn_trie_walk(t->ft_root, &w);
+	read_unlock(&fib_trie_lock);
+	return count - w.count;
+}
+#endif
+
+
+static int fn_trie_dump_one(struct fn_trie_walker *w, struct tnode *n,
+			    struct fib_node *f)
+{
+	struct netlink_callback *cb = w->cb;
+
+	if (fib_dump_info(w->skb, NETLINK_CB(cb->skb).pid, cb->nlh->nlmsg_seq,
+			  RTM_NEWROUTE, w->tb->tb_id, f->fn_type, f->fn_scope,
+			  &f->fn_key, n->tn_plen, f->fn_tos, f->fn_info) < 0) {
+		/* Retry this one next time */
+		w->pos--;
+		return -1;
+	}
+	return 0;
+}
+
+static int fn_trie_dump(struct fib_table *tb, struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct fn_trie *t = (struct fn_trie*)tb->tb_data;
+	struct fn_trie_walker w;
+	int err;
+
+	w.fn = fn_trie_dump_one;
+	w.skip = cb->args[1];
+	w.pos = 0;
+	w.tb = tb;
+	w.skb = skb;
+	w.cb = cb;
+
+	read_lock(&fib_trie_lock);
+	err = fn_trie_walk(t->ft_root, &w);
+	read_unlock(&fib_trie_lock);
+
+	cb->args[1] = w.pos;
+	return err < 0 ? -1 : skb->len;
+}
+
+static void rtmsg_fib(int event, struct fib_node* f, int z, int tb_id,
+		      struct nlmsghdr *n, struct netlink_skb_parms *req)
+{
+	struct sk_buff *skb;
+	u32 pid = req ? req->pid : 0;
+	int size = NLMSG_SPACE(sizeof(struct rtmsg)+256);
+
+	skb = alloc_skb(size, GFP_KERNEL);
+	if (!skb)
+		return;
+
+	if (fib_dump_info(skb, pid, n->nlmsg_seq, event, tb_id,
+			  f->fn_type, f->fn_scope, &f->fn_key, z, f->fn_tos,
+			  FIB_INFO(f)) < 0) {
+		kfree_skb(skb);
+		return;
+	}
+	NETLINK_CB(skb).dst_groups = RTMGRP_IPV4_ROUTE;
+	if (n->nlmsg_flags&NLM_F_ECHO)
+		atomic_inc(&skb->users);
+	netlink_broadcast(rtnl, skb, pid, RTMGRP_IPV4_ROUTE, GFP_KERNEL);
+	if (n->nlmsg_flags&NLM_F_ECHO)
+		netlink_unicast(rtnl, skb, pid, MSG_DONTWAIT);
+}
+
+/* Named as in fib_hash.c, so that fib_frontend.c takes either one */
+#ifdef CONFIG_IP_MULTIPLE_TABLES
+struct fib_table * fib_hash_init(int id)
+#else
+struct fib_table * __init fib_hash_init(int id)
+#endif
+{
+	struct fib_table *tb;
+
+	if (fn_node_kmem == NULL)
+		fn_node_kmem = kmem_cache_create("ip_fib_nodes",
+						 sizeof(struct fib_node),
+						 0, SLAB_HWCACHE_ALIGN,
+						 NULL, NULL);
+	if (fn_trie_kmem == NULL)
+		fn_trie_kmem = kmem_cache_create("ip_fib_trie",
+						 sizeof(struct tnode),
+						 0, SLAB_HWCACHE_ALIGN,
+						 NULL, NULL);
+
+	tb = kmalloc(sizeof(struct fib_table) + sizeof(struct fn_trie), GFP_KERNEL);
+	if (tb == NULL)
+		return NULL;
+
+	tb->tb_id = id;
+	tb->tb_lookup = fn_trie_lookup;
+	tb->tb_insert = fn_trie_insert;
+	tb->tb_delete = fn_trie_delete;
+	tb->tb_flush = fn_trie_flush;
+	tb->tb_select_default = fn_trie_select_default;
+	tb->tb_dump = fn_trie_dump;
+#ifdef CONFIG_PROC_FS
+	tb->tb_get_info = fn_trie_get_info;
+#endif
+	memset(tb->tb_data, 0, sizeof(struct fn_trie));
+	return tb;
+}
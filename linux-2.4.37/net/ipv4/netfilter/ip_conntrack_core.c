@@ -33,8 +33,9 @@
 /* For ERR_PTR().  Yeah, I know... --RR */
 #include <linux/fs.h>
 
-/* This rwlock protects the main hash table, protocol/helper/expected
-   registrations, conntrack timers*/
+/* This rwlock protects protocol/helper/expected registrations and the
+   unconfirmed list; the hash chains have their own striped locks, see
+   ip_conntrack_core.h */
 #define ASSERT_READ_LOCK(x) MUST_BE_READ_LOCKED(&ip_conntrack_lock)
 #define ASSERT_WRITE_LOCK(x) MUST_BE_WRITE_LOCKED(&ip_conntrack_lock)
 
@@ -54,6 +55,9 @@
 
 DECLARE_RWLOCK(ip_conntrack_lock);
 DECLARE_RWLOCK(ip_conntrack_expect_tuple_lock);
+rwlock_t ip_conntrack_hash_locks[IP_CT_HASH_LOCKS];
+/* Nests inside ip_conntrack_lock, outside the hash locks */
+static spinlock_t unconfirmed_lock = SPIN_LOCK_UNLOCKED;
 
 void (*ip_conntrack_destroyed)(struct ip_conntrack *conntrack) = NULL;
 LIST_HEAD(ip_conntrack_expect_list);
@@ -61,40 +65,31 @@ LIST_HEAD(protocol_list);
 static LIST_HEAD(helpers);
 unsigned int ip_conntrack_htable_size = 0;
 int ip_conntrack_max = 0;
-static atomic_t ip_conntrack_count = ATOMIC_INIT(0);
+atomic_t ip_conntrack_count = ATOMIC_INIT(0);
 struct list_head *ip_conntrack_hash;
 static kmem_cache_t *ip_conntrack_cachep;
 static LIST_HEAD(unconfirmed);
+struct ip_conntrack_protocol *ip_ct_protos[256];
+struct ip_conntrack_stat ip_conntrack_stat[NR_CPUS];
 
 extern struct ip_conntrack_protocol ip_conntrack_generic_protocol;
 
-static inline int proto_cmpfn(const struct ip_conntrack_protocol *curr,
-			      u_int8_t protocol)
-{
-	return protocol == curr->proto;
-}
-
 struct ip_conntrack_protocol *__ip_ct_find_proto(u_int8_t protocol)
 {
 	struct ip_conntrack_protocol *p;
 
-	MUST_BE_READ_LOCKED(&ip_conntrack_lock);
-	p = LIST_FIND(&protocol_list, proto_cmpfn,
-		      struct ip_conntrack_protocol *, protocol);
+	p = ip_ct_protos[protocol];
 	if (!p)
 		p = &ip_conntrack_generic_protocol;
 
 	return p;
 }
 
+/* No lock needed: unregistering clears the slot and then waits for
+   packets in flight with BR_NETPROTO_LOCK. */
 struct ip_conntrack_protocol *ip_ct_find_proto(u_int8_t protocol)
 {
-	struct ip_conntrack_protocol *p;
-
-	READ_LOCK(&ip_conntrack_lock);
-	p = __ip_ct_find_proto(protocol);
-	READ_UNLOCK(&ip_conntrack_lock);
-	return p;
+	return __ip_ct_find_proto(protocol);
 }
 
 inline void 
@@ -110,16 +105,74 @@ ip_conntrack_put(struct ip_conntrack *ct)
 static int ip_conntrack_hash_rnd_initted;
 static unsigned int ip_conntrack_hash_rnd;
 
+/* Independent of the table size; reduce it under a bucket lock */
 static u_int32_t
 hash_conntrack(const struct ip_conntrack_tuple *tuple)
 {
 #if 0
 	dump_tuple(tuple);
 #endif
-	return (jhash_3words(tuple->src.ip,
-	                     (tuple->dst.ip ^ tuple->dst.protonum),
-	                     (tuple->src.u.all | (tuple->dst.u.all << 16)),
-	                     ip_conntrack_hash_rnd) % ip_conntrack_htable_size);
+	return jhash_3words(tuple->src.ip,
+	                    (tuple->dst.ip ^ tuple->dst.protonum),
+	                    (tuple->src.u.all | (tuple->dst.u.all << 16)),
+	                    ip_conntrack_hash_rnd);
+}
+
+/* Read lock the bucket of a hash and return it.  The size is checked
+   again under the lock, since a resize holds all the bucket locks. */
+static unsigned int ip_ct_read_lock_hash(u_int32_t hash)
+{
+	unsigned int size, bucket;
+
+	for (;;) {
+		size = ip_conntrack_htable_size;
+		bucket = hash % size;
+		read_lock_bh(ip_ct_bucket_lock(bucket));
+		if (size == ip_conntrack_htable_size)
+			return bucket;
+		read_unlock_bh(ip_ct_bucket_lock(bucket));
+	}
+}
+
+/* Write lock the buckets of both directions of a connection. */
+static void ip_ct_write_lock_pair(u_int32_t hash, u_int32_t repl_hash,
+				  unsigned int *bucket,
+				  unsigned int *repl_bucket)
+{
+	unsigned int size;
+	rwlock_t *l1, *l2;
+
+	for (;;) {
+		size = ip_conntrack_htable_size;
+		*bucket = hash % size;
+		*repl_bucket = repl_hash % size;
+		l1 = ip_ct_bucket_lock(*bucket);
+		l2 = ip_ct_bucket_lock(*repl_bucket);
+		if (l1 > l2) {
+			rwlock_t *tmp = l1;
+			l1 = l2;
+			l2 = tmp;
+		}
+		write_lock_bh(l1);
+		if (l2 != l1)
+			write_lock(l2);
+		if (size == ip_conntrack_htable_size)
+			return;
+		if (l2 != l1)
+			write_unlock(l2);
+		write_unlock_bh(l1);
+	}
+}
+
+static void ip_ct_write_unlock_pair(unsigned int bucket,
+				    unsigned int repl_bucket)
+{
+	rwlock_t *l1 = ip_ct_bucket_lock(bucket);
+	rwlock_t *l2 = ip_ct_bucket_lock(repl_bucket);
+
+	if (l2 != l1)
+		write_unlock(l2);
+	write_unlock_bh(l1);
 }
 
 inline int
@@ -294,15 +347,22 @@ clean_from_lists(struct ip_conntrack *ct)
 	unsigned int ho, hr;
 	
 	DEBUGP("clean_from_lists(%p)\n", ct);
-	MUST_BE_WRITE_LOCKED(&ip_conntrack_lock);
 
-	ho = hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
-	hr = hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple);
-	LIST_DELETE(&ip_conntrack_hash[ho], &ct->tuplehash[IP_CT_DIR_ORIGINAL]);
-	LIST_DELETE(&ip_conntrack_hash[hr], &ct->tuplehash[IP_CT_DIR_REPLY]);
-
-	/* Destroy all un-established, pending expectations */
-	remove_expectations(ct, 1);
+	ip_ct_write_lock_pair(hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple),
+			      hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple),
+			      &ho, &hr);
+	list_del(&ct->tuplehash[IP_CT_DIR_ORIGINAL].list);
+	list_del(&ct->tuplehash[IP_CT_DIR_REPLY].list);
+	ip_ct_write_unlock_pair(ho, hr);
+
+	/* Destroy all un-established, pending expectations.  Most
+	   connections never had any, so they get by without the
+	   global lock. */
+	if (!list_empty(&ct->sibling_list)) {
+		WRITE_LOCK(&ip_conntrack_lock);
+		remove_expectations(ct, 1);
+		WRITE_UNLOCK(&ip_conntrack_lock);
+	}
 }
 
 static void
@@ -333,7 +393,9 @@ destroy_conntrack(struct nf_conntrack *nfct)
 	/* We overload first tuple to link into unconfirmed list. */
 	if (!is_confirmed(ct)) {
 		BUG_ON(list_empty(&ct->tuplehash[IP_CT_DIR_ORIGINAL].list));
+		spin_lock(&unconfirmed_lock);
 		list_del(&ct->tuplehash[IP_CT_DIR_ORIGINAL].list);
+		spin_unlock(&unconfirmed_lock);
 	}
 
 	/* Delete our master expectation */
@@ -360,9 +422,8 @@ static void death_by_timeout(unsigned long ul_conntrack)
 {
 	struct ip_conntrack *ct = (void *)ul_conntrack;
 
-	WRITE_LOCK(&ip_conntrack_lock);
 	clean_from_lists(ct);
-	WRITE_UNLOCK(&ip_conntrack_lock);
+	CONNTRACK_STAT_INC(delete);
 	ip_conntrack_put(ct);
 }
 
@@ -371,24 +432,27 @@ conntrack_tuple_cmp(const struct ip_conntrack_tuple_hash *i,
 		    const struct ip_conntrack_tuple *tuple,
 		    const struct ip_conntrack *ignored_conntrack)
 {
-	MUST_BE_READ_LOCKED(&ip_conntrack_lock);
 	return i->ctrack != ignored_conntrack
 		&& ip_ct_tuple_equal(tuple, &i->tuple);
 }
 
+/* Caller holds the lock of bucket. */
 static struct ip_conntrack_tuple_hash *
-__ip_conntrack_find(const struct ip_conntrack_tuple *tuple,
+__ip_conntrack_find(unsigned int bucket,
+		    const struct ip_conntrack_tuple *tuple,
 		    const struct ip_conntrack *ignored_conntrack)
 {
-	struct ip_conntrack_tuple_hash *h;
-	unsigned int hash = hash_conntrack(tuple);
+	struct list_head *i;
 
-	MUST_BE_READ_LOCKED(&ip_conntrack_lock);
-	h = LIST_FIND(&ip_conntrack_hash[hash],
-		      conntrack_tuple_cmp,
-		      struct ip_conntrack_tuple_hash *,
-		      tuple, ignored_conntrack);
-	return h;
+	list_for_each(i, &ip_conntrack_hash[bucket]) {
+		struct ip_conntrack_tuple_hash *h
+			= list_entry(i, struct ip_conntrack_tuple_hash, list);
+
+		CONNTRACK_STAT_INC(searched);
+		if (conntrack_tuple_cmp(h, tuple, ignored_conntrack))
+			return h;
+	}
+	return NULL;
 }
 
 /* Find a connection corresponding to a tuple. */
@@ -397,12 +461,16 @@ ip_conntrack_find_get(const struct ip_conntrack_tuple *tuple,
 		      const struct ip_conntrack *ignored_conntrack)
 {
 	struct ip_conntrack_tuple_hash *h;
+	unsigned int bucket;
 
-	READ_LOCK(&ip_conntrack_lock);
-	h = __ip_conntrack_find(tuple, ignored_conntrack);
-	if (h)
+	bucket = ip_ct_read_lock_hash(hash_conntrack(tuple));
+	CONNTRACK_STAT_INC(lookup);
+	h = __ip_conntrack_find(bucket, tuple, ignored_conntrack);
+	if (h) {
 		atomic_inc(&h->ctrack->ct_general.use);
-	READ_UNLOCK(&ip_conntrack_lock);
+		CONNTRACK_STAT_INC(found);
+	}
+	read_unlock_bh(ip_ct_bucket_lock(bucket));
 
 	return h;
 }
@@ -445,9 +513,6 @@ __ip_conntrack_confirm(struct nf_ct_info *nfct)
 	if (CTINFO2DIR(ctinfo) != IP_CT_DIR_ORIGINAL)
 		return NF_ACCEPT;
 
-	hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
-	repl_hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple);
-
 	/* We're not in hash table, and we refuse to set up related
 	   connections for unconfirmed conns.  But packet copies and
 	   REJECT will give spurious warnings here. */
@@ -458,25 +523,25 @@ __ip_conntrack_confirm(struct nf_ct_info *nfct)
 	IP_NF_ASSERT(!is_confirmed(ct));
 	DEBUGP("Confirming conntrack %p\n", ct);
 
-	WRITE_LOCK(&ip_conntrack_lock);
+	spin_lock_bh(&unconfirmed_lock);
+	ip_ct_write_lock_pair(hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple),
+			      hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple),
+			      &hash, &repl_hash);
 	/* See if there's one in the list already, including reverse:
            NAT could have grabbed it without realizing, since we're
            not in the hash.  If there is, we lost race. */
-	if (!LIST_FIND(&ip_conntrack_hash[hash],
-		       conntrack_tuple_cmp,
-		       struct ip_conntrack_tuple_hash *,
-		       &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple, NULL)
-	    && !LIST_FIND(&ip_conntrack_hash[repl_hash],
-			  conntrack_tuple_cmp,
-			  struct ip_conntrack_tuple_hash *,
-			  &ct->tuplehash[IP_CT_DIR_REPLY].tuple, NULL)) {
+	if (!__ip_conntrack_find(hash, &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple,
+				 NULL)
+	    && !__ip_conntrack_find(repl_hash,
+				    &ct->tuplehash[IP_CT_DIR_REPLY].tuple,
+				    NULL)) {
 		/* Remove from unconfirmed list */
 		list_del(&ct->tuplehash[IP_CT_DIR_ORIGINAL].list);
 
-		list_prepend(&ip_conntrack_hash[hash],
-			     &ct->tuplehash[IP_CT_DIR_ORIGINAL]);
-		list_prepend(&ip_conntrack_hash[repl_hash],
-			     &ct->tuplehash[IP_CT_DIR_REPLY]);
+		list_add(&ct->tuplehash[IP_CT_DIR_ORIGINAL].list,
+			 &ip_conntrack_hash[hash]);
+		list_add(&ct->tuplehash[IP_CT_DIR_REPLY].list,
+			 &ip_conntrack_hash[repl_hash]);
 		/* Timer relative to confirmation time, not original
 		   setting time, otherwise we'd get timer wrap in
 		   weird delay cases. */
@@ -484,11 +549,14 @@ __ip_conntrack_confirm(struct nf_ct_info *nfct)
 		add_timer(&ct->timeout);
 		atomic_inc(&ct->ct_general.use);
 		set_bit(IPS_CONFIRMED_BIT, &ct->status);
-		WRITE_UNLOCK(&ip_conntrack_lock);
+		ip_ct_write_unlock_pair(hash, repl_hash);
+		spin_unlock_bh(&unconfirmed_lock);
 		return NF_ACCEPT;
 	}
 
-	WRITE_UNLOCK(&ip_conntrack_lock);
+	ip_ct_write_unlock_pair(hash, repl_hash);
+	spin_unlock_bh(&unconfirmed_lock);
+	CONNTRACK_STAT_INC(insert_failed);
 	return NF_DROP;
 }
 
@@ -499,10 +567,12 @@ ip_conntrack_tuple_taken(const struct ip_conntrack_tuple *tuple,
 			 const struct ip_conntrack *ignored_conntrack)
 {
 	struct ip_conntrack_tuple_hash *h;
+	unsigned int bucket;
 
-	READ_LOCK(&ip_conntrack_lock);
-	h = __ip_conntrack_find(tuple, ignored_conntrack);
-	READ_UNLOCK(&ip_conntrack_lock);
+	bucket = ip_ct_read_lock_hash(hash_conntrack(tuple));
+	CONNTRACK_STAT_INC(lookup);
+	h = __ip_conntrack_find(bucket, tuple, ignored_conntrack);
+	read_unlock_bh(ip_ct_bucket_lock(bucket));
 
 	return h != NULL;
 }
@@ -604,23 +674,31 @@ static inline int unreplied(const struct ip_conntrack_tuple_hash *i)
 	return !(test_bit(IPS_ASSURED_BIT, &i->ctrack->status));
 }
 
-static int early_drop(struct list_head *chain)
+static int early_drop(u_int32_t hash)
 {
 	/* Traverse backwards: gives us oldest, which is roughly LRU */
-	struct ip_conntrack_tuple_hash *h;
+	struct ip_conntrack_tuple_hash *h = NULL;
+	struct list_head *i;
+	unsigned int bucket;
 	int dropped = 0;
 
-	READ_LOCK(&ip_conntrack_lock);
-	h = LIST_FIND_B(chain, unreplied, struct ip_conntrack_tuple_hash *);
+	bucket = ip_ct_read_lock_hash(hash);
+	list_for_each_prev(i, &ip_conntrack_hash[bucket]) {
+		h = list_entry(i, struct ip_conntrack_tuple_hash, list);
+		if (unreplied(h))
+			break;
+		h = NULL;
+	}
 	if (h)
 		atomic_inc(&h->ctrack->ct_general.use);
-	READ_UNLOCK(&ip_conntrack_lock);
+	read_unlock_bh(ip_ct_bucket_lock(bucket));
 
 	if (!h)
 		return dropped;
 
 	if (del_timer(&h->ctrack->timeout)) {
 		death_by_timeout((unsigned long)h->ctrack);
+		CONNTRACK_STAT_INC(early_drop);
 		dropped = 1;
 	}
 	ip_conntrack_put(h->ctrack);
@@ -649,7 +727,7 @@ init_conntrack(const struct ip_conntrack_tuple *tuple,
 {
 	struct ip_conntrack *conntrack;
 	struct ip_conntrack_tuple repl_tuple;
-	size_t hash;
+	u_int32_t hash;
 	struct ip_conntrack_expect *expected;
 	int i;
 	static unsigned int drop_next = 0;
@@ -666,10 +744,7 @@ init_conntrack(const struct ip_conntrack_tuple *tuple,
 		/* Try dropping from random chain, or else from the
                    chain about to put into (in case they're trying to
                    bomb one hash chain). */
-		unsigned int next = (drop_next++)%ip_conntrack_htable_size;
-
-		if (!early_drop(&ip_conntrack_hash[next])
-		    && !early_drop(&ip_conntrack_hash[hash])) {
+		if (!early_drop(drop_next++) && !early_drop(hash)) {
 			if (net_ratelimit())
 				printk(KERN_WARNING
 				       "ip_conntrack: table full, dropping"
@@ -747,11 +822,14 @@ init_conntrack(const struct ip_conntrack_tuple *tuple,
 		nf_conntrack_get(&master_ct(conntrack)->infos[0]);
 	}
 	/* Overload tuple linked list to put us in unconfirmed list. */
+	spin_lock(&unconfirmed_lock);
 	list_add(&conntrack->tuplehash[IP_CT_DIR_ORIGINAL].list,
 	         &unconfirmed);
+	spin_unlock(&unconfirmed_lock);
 
 	atomic_inc(&ip_conntrack_count);
 	WRITE_UNLOCK(&ip_conntrack_lock);
+	CONNTRACK_STAT_INC(new);
 
 	if (expected && expected->expectfn)
 		expected->expectfn(conntrack);
@@ -863,19 +941,24 @@ unsigned int ip_conntrack_in(unsigned int hooknum,
 	    && icmp_error_track(*pskb, &ctinfo, hooknum))
 		return NF_ACCEPT;
 
-	if (!(ct = resolve_normal_ct(*pskb, proto,&set_reply,hooknum,&ctinfo)))
+	if (!(ct = resolve_normal_ct(*pskb, proto,&set_reply,hooknum,&ctinfo))) {
 		/* Not valid part of a connection */
+		CONNTRACK_STAT_INC(invalid);
 		return NF_ACCEPT;
+	}
 
-	if (IS_ERR(ct))
+	if (IS_ERR(ct)) {
 		/* Too stressed to deal. */
+		CONNTRACK_STAT_INC(drop);
 		return NF_DROP;
+	}
 
 	IP_NF_ASSERT((*pskb)->nfct);
 
 	ret = proto->packet(ct, (*pskb)->nh.iph, (*pskb)->len, ctinfo);
 	if (ret == -1) {
 		/* Invalid */
+		CONNTRACK_STAT_INC(invalid);
 		nf_conntrack_put((*pskb)->nfct);
 		(*pskb)->nfct = NULL;
 		return NF_ACCEPT;
@@ -886,6 +969,7 @@ unsigned int ip_conntrack_in(unsigned int hooknum,
 				       ct, ctinfo);
 		if (ret == -1) {
 			/* Invalid */
+			CONNTRACK_STAT_INC(invalid);
 			nf_conntrack_put((*pskb)->nfct);
 			(*pskb)->nfct = NULL;
 			return NF_ACCEPT;
@@ -1120,7 +1204,7 @@ int ip_conntrack_alter_reply(struct ip_conntrack *conntrack,
 			     const struct ip_conntrack_tuple *newreply)
 {
 	WRITE_LOCK(&ip_conntrack_lock);
-	if (__ip_conntrack_find(newreply, conntrack)) {
+	if (ip_conntrack_tuple_taken(newreply, conntrack)) {
 		WRITE_UNLOCK(&ip_conntrack_lock);
 		return 0;
 	}
@@ -1170,10 +1254,15 @@ void ip_conntrack_helper_unregister(struct ip_conntrack_helper *me)
 	LIST_DELETE(&helpers, me);
 
 	/* Get rid of expecteds, set helpers to NULL. */
+	spin_lock(&unconfirmed_lock);
 	LIST_FIND_W(&unconfirmed, unhelp, struct ip_conntrack_tuple_hash*, me);
-	for (i = 0; i < ip_conntrack_htable_size; i++)
+	spin_unlock(&unconfirmed_lock);
+	for (i = 0; i < ip_conntrack_htable_size; i++) {
+		read_lock(ip_ct_bucket_lock(i));
 		LIST_FIND_W(&ip_conntrack_hash[i], unhelp,
 			    struct ip_conntrack_tuple_hash *, me);
+		read_unlock(ip_ct_bucket_lock(i));
+	}
 	WRITE_UNLOCK(&ip_conntrack_lock);
 
 	/* Someone could be still looking at the helper in a bh. */
@@ -1188,7 +1277,9 @@ void ip_ct_refresh(struct ip_conntrack *ct, unsigned long extra_jiffies)
 {
 	IP_NF_ASSERT(ct->timeout.data == (unsigned long)ct);
 
-	WRITE_LOCK(&ip_conntrack_lock);
+	/* No lock: an unconfirmed conntrack is only seen by the packet
+	   that created it, and confirmation publishes the timer under
+	   the bucket locks, before anyone else can find it. */
 	/* If not in hash table, timer will not be active yet */
 	if (!is_confirmed(ct))
 		ct->timeout.expires = extra_jiffies;
@@ -1199,7 +1290,6 @@ void ip_ct_refresh(struct ip_conntrack *ct, unsigned long extra_jiffies)
 			add_timer(&ct->timeout);
 		}
 	}
-	WRITE_UNLOCK(&ip_conntrack_lock);
 }
 
 /* Returns new sk_buff, or NULL */
@@ -1280,16 +1370,22 @@ get_next_corpse(int (*iter)(struct ip_conntrack *i, void *data),
 
 	WRITE_LOCK(&ip_conntrack_lock);
 	for (; *bucket < ip_conntrack_htable_size; (*bucket)++) {
+		read_lock(ip_ct_bucket_lock(*bucket));
 		h = LIST_FIND_W(&ip_conntrack_hash[*bucket], do_iter,
 		                struct ip_conntrack_tuple_hash *, iter, data);
 		if (h)
-			break;
+			atomic_inc(&h->ctrack->ct_general.use);
+		read_unlock(ip_ct_bucket_lock(*bucket));
+		if (h)
+			goto out;
 	}
-	if (!h)
-		h = LIST_FIND_W(&unconfirmed, do_iter,
-		                struct ip_conntrack_tuple_hash *, iter, data);
+	spin_lock(&unconfirmed_lock);
+	h = LIST_FIND_W(&unconfirmed, do_iter,
+	                struct ip_conntrack_tuple_hash *, iter, data);
 	if (h)
 		atomic_inc(&h->ctrack->ct_general.use);
+	spin_unlock(&unconfirmed_lock);
+out:
 	WRITE_UNLOCK(&ip_conntrack_lock);
 
 	return h;
@@ -1399,6 +1495,51 @@ void ip_conntrack_cleanup(void)
 	nf_unregister_sockopt(&so_getorigdst);
 }
 
+/* Move every connection into a new table of size buckets.  Nothing
+   can look at the hash meanwhile, but no flow is lost either. */
+int ip_conntrack_set_hashsize(unsigned int size)
+{
+	struct list_head *hash, *old;
+	unsigned int i, oldsize;
+
+	if (size < 16)
+		return -EINVAL;
+
+	hash = vmalloc(sizeof(struct list_head) * size);
+	if (!hash)
+		return -ENOMEM;
+	for (i = 0; i < size; i++)
+		INIT_LIST_HEAD(&hash[i]);
+
+	WRITE_LOCK(&ip_conntrack_lock);
+	for (i = 0; i < IP_CT_HASH_LOCKS; i++)
+		write_lock(&ip_conntrack_hash_locks[i]);
+
+	old = ip_conntrack_hash;
+	oldsize = ip_conntrack_htable_size;
+	for (i = 0; i < oldsize; i++) {
+		while (!list_empty(&old[i])) {
+			struct ip_conntrack_tuple_hash *h;
+
+			h = list_entry(old[i].next,
+				       struct ip_conntrack_tuple_hash, list);
+			list_del(&h->list);
+			/* Keep the chains oldest last for early_drop() */
+			list_add_tail(&h->list,
+				      &hash[hash_conntrack(&h->tuple) % size]);
+		}
+	}
+	ip_conntrack_hash = hash;
+	ip_conntrack_htable_size = size;
+
+	for (i = IP_CT_HASH_LOCKS; i-- > 0; )
+		write_unlock(&ip_conntrack_hash_locks[i]);
+	WRITE_UNLOCK(&ip_conntrack_lock);
+
+	vfree(old);
+	return 0;
+}
+
 static int hashsize = 0;
 MODULE_PARM(hashsize, "i");
 
@@ -1453,8 +1594,13 @@ int __init ip_conntrack_init(void)
 	list_append(&protocol_list, &ip_conntrack_protocol_tcp);
 	list_append(&protocol_list, &ip_conntrack_protocol_udp);
 	list_append(&protocol_list, &ip_conntrack_protocol_icmp);
+	ip_ct_protos[IPPROTO_TCP] = &ip_conntrack_protocol_tcp;
+	ip_ct_protos[IPPROTO_UDP] = &ip_conntrack_protocol_udp;
+	ip_ct_protos[IPPROTO_ICMP] = &ip_conntrack_protocol_icmp;
 	WRITE_UNLOCK(&ip_conntrack_lock);
 
+	for (i = 0; i < IP_CT_HASH_LOCKS; i++)
+		ip_conntrack_hash_locks[i] = RW_LOCK_UNLOCKED;
 	for (i = 0; i < ip_conntrack_htable_size; i++)
 		INIT_LIST_HEAD(&ip_conntrack_hash[i]);
 
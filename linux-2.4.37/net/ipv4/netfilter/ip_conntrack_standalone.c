@@ -152,9 +152,14 @@ list_conntracks(char *buffer, char **start, off_t offset, int length)
 	READ_LOCK(&ip_conntrack_lock);
 	/* Traverse hash; print originals then reply. */
 	for (i = 0; i < ip_conntrack_htable_size; i++) {
-		if (LIST_FIND(&ip_conntrack_hash[i], conntrack_iterate,
-			      struct ip_conntrack_tuple_hash *,
-			      buffer, offset, &upto, &len, length))
+		int full;
+
+		read_lock(ip_ct_bucket_lock(i));
+		full = LIST_FIND(&ip_conntrack_hash[i], conntrack_iterate,
+				 struct ip_conntrack_tuple_hash *,
+				 buffer, offset, &upto, &len, length) != NULL;
+		read_unlock(ip_ct_bucket_lock(i));
+		if (full)
 			goto finished;
 	}
 
@@ -182,6 +187,35 @@ list_conntracks(char *buffer, char **start, off_t offset, int length)
 	return len;
 }
 
+static int
+conntrack_stat_read(char *buffer, char **start, off_t offset, int length)
+{
+	unsigned int i;
+	int len;
+
+	len = sprintf(buffer, "entries  lookup   searched found    new      "
+		      "invalid  drop     early_drop insert_failed delete\n");
+	for (i = 0; i < smp_num_cpus; i++) {
+		struct ip_conntrack_stat *st
+			= &ip_conntrack_stat[cpu_logical_map(i)];
+
+		len += sprintf(buffer + len, "%08x %08x %08x %08x %08x "
+			       "%08x %08x %08x   %08x      %08x\n",
+			       atomic_read(&ip_conntrack_count),
+			       st->lookup, st->searched, st->found, st->new,
+			       st->invalid, st->drop, st->early_drop,
+			       st->insert_failed, st->delete);
+	}
+
+	len -= offset;
+	if (len > length)
+		len = length;
+	if (len < 0)
+		len = 0;
+	*start = buffer + offset;
+	return len;
+}
+
 static unsigned int ip_confirm(unsigned int hooknum,
 			       struct sk_buff **pskb,
 			       const struct net_device *in,
@@ -275,13 +309,28 @@ extern unsigned long ip_ct_generic_timeout;
 
 static struct ctl_table_header *ip_ct_sysctl_header;
 
+/* Writing ip_conntrack_buckets rehashes the table to the new size */
+static int ip_ct_sysctl_buckets(ctl_table *table, int write,
+				struct file *filp, void *buffer, size_t *lenp)
+{
+	unsigned int size = ip_conntrack_htable_size;
+	ctl_table tmp = *table;
+	int ret;
+
+	tmp.data = &size;
+	ret = proc_dointvec(&tmp, write, filp, buffer, lenp);
+	if (ret || !write || size == ip_conntrack_htable_size)
+		return ret;
+	return ip_conntrack_set_hashsize(size);
+}
+
 static ctl_table ip_ct_sysctl_table[] = {
 	{NET_IPV4_NF_CONNTRACK_MAX, "ip_conntrack_max",
 	 &ip_conntrack_max, sizeof(int), 0644, NULL,
 	 &proc_dointvec},
 	{NET_IPV4_NF_CONNTRACK_BUCKETS, "ip_conntrack_buckets",
-	 &ip_conntrack_htable_size, sizeof(unsigned int), 0444, NULL,
-	 &proc_dointvec},
+	 &ip_conntrack_htable_size, sizeof(unsigned int), 0644, NULL,
+	 &ip_ct_sysctl_buckets},
 	{NET_IPV4_NF_CONNTRACK_TCP_TIMEOUT_SYN_SENT, "ip_conntrack_tcp_timeout_syn_sent",
 	 &ip_ct_tcp_timeout_syn_sent, sizeof(unsigned int), 0644, NULL,
 	 &proc_dointvec_jiffies},
@@ -356,10 +405,14 @@ static int init_or_cleanup(int init)
 	if (!proc) goto cleanup_init;
 	proc->owner = THIS_MODULE;
 
+	proc = proc_net_create("ip_conntrack_stat", 0444, conntrack_stat_read);
+	if (!proc) goto cleanup_proc;
+	proc->owner = THIS_MODULE;
+
 	ret = nf_register_hook(&ip_conntrack_in_ops);
 	if (ret < 0) {
 		printk("ip_conntrack: can't register pre-routing hook.\n");
-		goto cleanup_proc;
+		goto cleanup_proc_stat;
 	}
 	ret = nf_register_hook(&ip_conntrack_local_out_ops);
 	if (ret < 0) {
@@ -397,6 +450,8 @@ static int init_or_cleanup(int init)
 	nf_unregister_hook(&ip_conntrack_local_out_ops);
  cleanup_inops:
 	nf_unregister_hook(&ip_conntrack_in_ops);
+ cleanup_proc_stat:
+	proc_net_remove("ip_conntrack_stat");
  cleanup_proc:
 	proc_net_remove("ip_conntrack");
  cleanup_init:
@@ -422,6 +477,7 @@ int ip_conntrack_protocol_register(struct ip_conntrack_protocol *proto)
 	}
 
 	list_prepend(&protocol_list, proto);
+	ip_ct_protos[proto->proto] = proto;
 	MOD_INC_USE_COUNT;
 
  out:
@@ -436,6 +492,7 @@ void ip_conntrack_protocol_unregister(struct ip_conntrack_protocol *proto)
 	/* ip_ct_find_proto() returns proto_generic in case there is no protocol 
 	 * helper. So this should be enough - HW */
 	LIST_DELETE(&protocol_list, proto);
+	ip_ct_protos[proto->proto] = NULL;
 	WRITE_UNLOCK(&ip_conntrack_lock);
 	
 	/* Somebody could be still looking at the proto in bh. */
@@ -486,5 +543,6 @@ EXPORT_SYMBOL(ip_conntrack_htable_size);
 EXPORT_SYMBOL(ip_conntrack_expect_list);
 EXPORT_SYMBOL(ip_conntrack_lock);
 EXPORT_SYMBOL(ip_conntrack_hash);
+EXPORT_SYMBOL(ip_conntrack_hash_locks);
 EXPORT_SYMBOL_GPL(ip_conntrack_find_get);
 EXPORT_SYMBOL_GPL(ip_conntrack_put);
@@ -286,9 +286,14 @@ masq_procinfo(char *buffer, char **start, off_t offset, int length)
 	READ_LOCK(&ip_conntrack_lock);
 	/* Traverse hash; print originals then reply. */
 	for (i = 0; i < ip_conntrack_htable_size; i++) {
-		if (LIST_FIND(&ip_conntrack_hash[i], masq_iterate,
-			      struct ip_conntrack_tuple_hash *,
-			      buffer, offset, &upto, &len, length))
+		int full;
+
+		read_lock(ip_ct_bucket_lock(i));
+		full = LIST_FIND(&ip_conntrack_hash[i], masq_iterate,
+				 struct ip_conntrack_tuple_hash *,
+				 buffer, offset, &upto, &len, length) != NULL;
+		read_unlock(ip_ct_bucket_lock(i));
+		if (full)
 			break;
 	}
 	READ_UNLOCK(&ip_conntrack_lock);
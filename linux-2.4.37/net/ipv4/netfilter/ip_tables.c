@@ -81,6 +81,54 @@ static DECLARE_MUTEX(ipt_mutex);
 
    Hence the start of any table is given by get_table() below.  */
 
+/* Rule index, built by ipt_build_index() when a table is loaded.
+
+   Runs of consecutive entries that mostly ask for one exact source
+   address, destination address or TCP/UDP destination port are hashed
+   on that key.  For a packet ipt_do_table() then only visits entries
+   of a run whose key equals the packet's, or that do not ask for the
+   key at all; every other entry is known not to match and is stepped
+   over without running any of its matches.  Entries outside of runs
+   are walked one by one as before. */
+#define IPT_KEY_SRC	0
+#define IPT_KEY_DST	1
+#define IPT_KEY_DPORT	2	/* proto << 16 | port */
+#define IPT_NR_KEYS	3
+
+#define IPT_RUN_MIN	8	/* fewer keyed entries are walked */
+#define IPT_HASH_MULT	0x9E370001U
+#define IPT_UNKNOWN	0xFFFFFFFF	/* entry number not looked up yet */
+
+struct ipt_slot
+{
+	u_int32_t key;
+	/* Entries with this key, ascending, in ipt_index.pool */
+	unsigned int first, count;
+};
+
+struct ipt_run
+{
+	/* Entries [start, end) */
+	unsigned int start, end;
+	unsigned int type;
+	/* Union of the nfcache bits of its entries */
+	unsigned int nfcache;
+	/* Entries that do not ask for the key, in ipt_index.pool */
+	unsigned int wild, nwild;
+	unsigned int hshift, hmask;
+	struct ipt_slot *hash;
+};
+
+struct ipt_index
+{
+	unsigned int number, nruns;
+	/* Offset of every entry, and the run it is in plus one, or 0 */
+	unsigned int *offset;
+	unsigned int *run;
+	struct ipt_run *runs;
+	unsigned int *pool;
+};
+
 /* The table itself */
 struct ipt_table_info
 {
@@ -95,6 +143,9 @@ struct ipt_table_info
 	unsigned int hook_entry[NF_IP_NUMHOOKS];
 	unsigned int underflow[NF_IP_NUMHOOKS];
 
+	/* Rule index shared by all CPUs, or NULL */
+	struct ipt_index *index;
+
 	/* ipt_entry tables: one per CPU */
 	char entries[0] ____cacheline_aligned;
 };
@@ -249,6 +300,96 @@ get_entry(void *base, unsigned int offset)
 	return (struct ipt_entry *)(base + offset);
 }
 
+/* Keys of a packet: have[] is 1 if it has one, 0 if no entry keyed
+ * on the type can match it, -1 if the index must not be used. */
+struct ipt_pktkeys
+{
+	int have[IPT_NR_KEYS];
+	u_int32_t key[IPT_NR_KEYS];
+};
+
+static inline void
+ipt_packet_keys(struct ipt_pktkeys *pk, const struct iphdr *ip,
+		const void *protohdr, u_int16_t datalen, u_int16_t offset)
+{
+	unsigned int hlen = 0;
+
+	pk->have[IPT_KEY_SRC] = 1;
+	pk->key[IPT_KEY_SRC] = ip->saddr;
+	pk->have[IPT_KEY_DST] = 1;
+	pk->key[IPT_KEY_DST] = ip->daddr;
+
+	/* Fragments and short headers go through the tcp and udp
+	 * matches, which have to drop some of them. */
+	if (ip->protocol == IPPROTO_TCP)
+		hlen = sizeof(struct tcphdr);
+	else if (ip->protocol == IPPROTO_UDP)
+		hlen = sizeof(struct udphdr);
+	if (!hlen)
+		pk->have[IPT_KEY_DPORT] = 0;
+	else if (offset || datalen < hlen)
+		pk->have[IPT_KEY_DPORT] = -1;
+	else {
+		pk->have[IPT_KEY_DPORT] = 1;
+		pk->key[IPT_KEY_DPORT] = ip->protocol << 16
+			| ntohs(((const u_int16_t *)protohdr)[1]);
+	}
+}
+
+/* First of the n ascending entry numbers in list that is >= i, or
+ * bound if there is none below it. */
+static inline unsigned int
+ipt_first_from(const unsigned int *list, unsigned int n,
+	       unsigned int i, unsigned int bound)
+{
+	unsigned int lo = 0, hi = n;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+
+		if (list[mid] < i)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < n && list[lo] < bound)
+		return list[lo];
+	return bound;
+}
+
+/* Entry number of the entry at offset */
+static inline unsigned int
+ipt_entry_number(const struct ipt_index *ix, unsigned int offset)
+{
+	return ipt_first_from(ix->offset, ix->number, offset, ix->number);
+}
+
+/* The next entry from i on that can match the packet */
+static inline unsigned int
+ipt_run_next(const struct ipt_index *ix, const struct ipt_run *r,
+	     const struct ipt_pktkeys *pk, unsigned int i)
+{
+	unsigned int next, h;
+	u_int32_t key;
+
+	if (pk->have[r->type] < 0)
+		return i;
+
+	next = ipt_first_from(ix->pool + r->wild, r->nwild, i, r->end);
+	if (!pk->have[r->type])
+		return next;
+
+	key = pk->key[r->type];
+	for (h = (key * IPT_HASH_MULT) >> r->hshift;
+	     r->hash[h].count;
+	     h = (h + 1) & r->hmask) {
+		if (r->hash[h].key == key)
+			return ipt_first_from(ix->pool + r->hash[h].first,
+					      r->hash[h].count, i, next);
+	}
+	return next;
+}
+
 /* Returns one of the generic firewall policies, like NF_ACCEPT. */
 unsigned int
 ipt_do_table(struct sk_buff **pskb,
@@ -269,6 +410,9 @@ ipt_do_table(struct sk_buff **pskb,
 	const char *indev, *outdev;
 	void *table_base;
 	struct ipt_entry *e, *back;
+	struct ipt_index *ix;
+	struct ipt_pktkeys pk;
+	unsigned int idx = IPT_UNKNOWN;
 
 	/* Initialization */
 	ip = (*pskb)->nh.iph;
@@ -290,6 +434,9 @@ ipt_do_table(struct sk_buff **pskb,
 		+ TABLE_OFFSET(table->private,
 			       cpu_number_map(smp_processor_id()));
 	e = get_entry(table_base, table->private->hook_entry[hook]);
+	ix = table->private->index;
+	if (ix)
+		ipt_packet_keys(&pk, ip, protohdr, datalen, offset);
 
 #ifdef CONFIG_NETFILTER_DEBUG
 	/* Check noone else using our table */
@@ -310,6 +457,26 @@ ipt_do_table(struct sk_buff **pskb,
 	do {
 		IP_NF_ASSERT(e);
 		IP_NF_ASSERT(back);
+		if (ix) {
+			unsigned int run, next;
+
+			if (idx == IPT_UNKNOWN)
+				idx = ipt_entry_number(ix,
+						       (void *)e - table_base);
+			run = ix->run[idx];
+			if (run) {
+				next = ipt_run_next(ix, &ix->runs[run - 1],
+						    &pk, idx);
+				if (next != idx) {
+					(*pskb)->nfcache
+						|= ix->runs[run - 1].nfcache;
+					idx = next;
+					e = get_entry(table_base,
+						      ix->offset[idx]);
+					continue;
+				}
+			}
+		}
 		(*pskb)->nfcache |= e->nfcache;
 		if (ip_packet_match(ip, indev, outdev, &e->ip, offset)) {
 			struct ipt_entry_target *t;
@@ -338,6 +505,7 @@ ipt_do_table(struct sk_buff **pskb,
 					e = back;
 					back = get_entry(table_base,
 							 back->comefrom);
+					idx = IPT_UNKNOWN;
 					continue;
 				}
 				if (table_base + v
@@ -352,6 +520,7 @@ ipt_do_table(struct sk_buff **pskb,
 				}
 
 				e = get_entry(table_base, v);
+				idx = IPT_UNKNOWN;
 			} else {
 				/* Targets which reenter must return
                                    abs. verdicts */
@@ -380,10 +549,14 @@ ipt_do_table(struct sk_buff **pskb,
 				ip = (*pskb)->nh.iph;
 				protohdr = (u_int32_t *)ip + ip->ihl;
 				datalen = (*pskb)->len - ip->ihl * 4;
+				if (ix)
+					ipt_packet_keys(&pk, ip, protohdr,
+							datalen, offset);
 
-				if (verdict == IPT_CONTINUE)
+				if (verdict == IPT_CONTINUE) {
 					e = (void *)e + e->next_offset;
-				else
+					idx++;
+				} else
 					/* Verdict */
 					break;
 			}
@@ -391,6 +564,7 @@ ipt_do_table(struct sk_buff **pskb,
 
 		no_match:
 			e = (void *)e + e->next_offset;
+			idx++;
 		}
 	} while (!hotdrop);
 
@@ -793,6 +967,218 @@ cleanup_entry(struct ipt_entry *e, unsigned int *i)
 
 /* Checks and translates the user-supplied table segment (held in
    newinfo) */
+static struct ipt_match tcp_matchstruct, udp_matchstruct;
+
+/* Keys an entry asks for.  The port counts only if the tcp or udp
+ * match comes first, so skipping the entry cannot skip another match
+ * with side effects. */
+struct ipt_rule_keys
+{
+	unsigned int keyed;
+	u_int32_t key[IPT_NR_KEYS];
+	unsigned int nfcache;
+};
+
+static void
+ipt_rule_keys(const struct ipt_entry *e, struct ipt_rule_keys *k)
+{
+	const struct ipt_ip *ip = &e->ip;
+	const struct ipt_entry_match *m = (void *)e->elems;
+
+	k->keyed = 0;
+	k->nfcache = e->nfcache;
+	if (ip->smsk.s_addr == 0xFFFFFFFF && !(ip->invflags & IPT_INV_SRCIP)) {
+		k->keyed |= 1 << IPT_KEY_SRC;
+		k->key[IPT_KEY_SRC] = ip->src.s_addr;
+	}
+	if (ip->dmsk.s_addr == 0xFFFFFFFF && !(ip->invflags & IPT_INV_DSTIP)) {
+		k->keyed |= 1 << IPT_KEY_DST;
+		k->key[IPT_KEY_DST] = ip->dst.s_addr;
+	}
+
+	if (e->target_offset <= sizeof(struct ipt_entry)
+	    || (ip->invflags & IPT_INV_PROTO))
+		return;
+	if (m->u.kernel.match == &tcp_matchstruct) {
+		const struct ipt_tcp *tcpinfo = (void *)m->data;
+
+		if (tcpinfo->dpts[0] != tcpinfo->dpts[1]
+		    || (tcpinfo->invflags & IPT_TCP_INV_DSTPT))
+			return;
+		k->key[IPT_KEY_DPORT] = IPPROTO_TCP << 16 | tcpinfo->dpts[0];
+	} else if (m->u.kernel.match == &udp_matchstruct) {
+		const struct ipt_udp *udpinfo = (void *)m->data;
+
+		if (udpinfo->dpts[0] != udpinfo->dpts[1]
+		    || (udpinfo->invflags & IPT_UDP_INV_DSTPT))
+			return;
+		k->key[IPT_KEY_DPORT] = IPPROTO_UDP << 16 | udpinfo->dpts[0];
+	} else
+		return;
+	k->keyed |= 1 << IPT_KEY_DPORT;
+}
+
+static inline int
+ipt_entry_keys(struct ipt_entry *e, struct ipt_rule_keys *keys,
+	       unsigned int *i)
+{
+	ipt_rule_keys(e, &keys[(*i)++]);
+	return 0;
+}
+
+static inline int
+ipt_entry_offset(struct ipt_entry *e, const void *base,
+		 unsigned int *offset, unsigned int *i)
+{
+	offset[(*i)++] = (void *)e - base;
+	return 0;
+}
+
+/* Find the longest run starting at entry i, keyed on one type and
+ * ending at a keyed entry.  Returns the number of keyed entries.
+ * The last entry is never in a run, so a run always ends at an entry. */
+static unsigned int
+ipt_find_run(const struct ipt_rule_keys *keys, unsigned int n,
+	     unsigned int i, struct ipt_run *r)
+{
+	unsigned int type, j, end, nkeyed, best = 0;
+
+	for (type = 0; type < IPT_NR_KEYS; type++) {
+		if (!(keys[i].keyed & (1 << type)))
+			continue;
+		nkeyed = 0;
+		for (j = end = i; j + 1 < n; j++) {
+			if (keys[j].keyed & (1 << type)) {
+				nkeyed++;
+				end = j + 1;
+			} else if (keys[j].keyed)
+				break;
+		}
+		if (nkeyed > best) {
+			best = nkeyed;
+			r->start = i;
+			r->end = end;
+			r->type = type;
+		}
+	}
+	return best;
+}
+
+/* Builds the rule index of a translated table.  Failure only costs
+ * speed, so it is not reported. */
+static void
+ipt_build_index(struct ipt_table_info *info)
+{
+	struct ipt_rule_keys *keys;
+	struct ipt_run *runs;
+	struct ipt_index *ix;
+	struct ipt_slot *slot;
+	unsigned int n = info->number, nruns = 0, nslots = 0;
+	unsigned int i, j, r, size, pos;
+
+	info->index = NULL;
+	keys = vmalloc(n * sizeof(*keys)
+		       + (n / IPT_RUN_MIN + 1) * sizeof(*runs));
+	if (!keys)
+		return;
+	runs = (void *)(keys + n);
+
+	i = 0;
+	IPT_ENTRY_ITERATE(info->entries, info->size,
+			  ipt_entry_keys, keys, &i);
+
+	for (i = 0; i < n; ) {
+		struct ipt_run *run = &runs[nruns];
+		unsigned int nkeyed = 0;
+
+		if (keys[i].keyed)
+			nkeyed = ipt_find_run(keys, n, i, run);
+		if (nkeyed < IPT_RUN_MIN) {
+			i++;
+			continue;
+		}
+		for (run->hshift = 32, run->hmask = 0;
+		     run->hmask + 1 < 2 * nkeyed;
+		     run->hshift--)
+			run->hmask = (run->hmask << 1) | 1;
+		nslots += run->hmask + 1;
+		nruns++;
+		i = run->end;
+	}
+	if (!nruns)
+		goto out;
+
+	size = sizeof(*ix) + nruns * sizeof(*runs) + nslots * sizeof(*slot)
+		+ 3 * n * sizeof(unsigned int);
+	ix = vmalloc(size);
+	if (!ix)
+		goto out;
+	memset(ix, 0, size);
+	ix->number = n;
+	ix->nruns = nruns;
+	ix->runs = (void *)(ix + 1);
+	slot = (void *)(ix->runs + nruns);
+	ix->offset = (void *)(slot + nslots);
+	ix->run = ix->offset + n;
+	ix->pool = ix->run + n;
+	memcpy(ix->runs, runs, nruns * sizeof(*runs));
+
+	pos = 0;
+	for (r = 0; r < nruns; r++) {
+		struct ipt_run *run = &ix->runs[r];
+		unsigned int type = run->type;
+
+		run->hash = slot;
+		slot += run->hmask + 1;
+		run->nwild = 0;
+		run->nfcache = 0;
+
+		/* Count the entries of every key, then lay them out
+		 * behind the wildcards. */
+		run->wild = pos;
+		for (i = run->start; i < run->end; i++) {
+			ix->run[i] = r + 1;
+			run->nfcache |= keys[i].nfcache;
+			if (!(keys[i].keyed & (1 << type))) {
+				ix->pool[pos++] = i;
+				run->nwild++;
+				continue;
+			}
+			j = (keys[i].key[type] * IPT_HASH_MULT) >> run->hshift;
+			while (run->hash[j].count
+			       && run->hash[j].key != keys[i].key[type])
+				j = (j + 1) & run->hmask;
+			run->hash[j].key = keys[i].key[type];
+			run->hash[j].count++;
+		}
+		for (j = 0; j <= run->hmask; j++) {
+			run->hash[j].first = pos;
+			pos += run->hash[j].count;
+			run->hash[j].count = 0;
+		}
+		for (i = run->start; i < run->end; i++) {
+			struct ipt_slot *s;
+
+			if (!(keys[i].keyed & (1 << type)))
+				continue;
+			j = (keys[i].key[type] * IPT_HASH_MULT) >> run->hshift;
+			while (run->hash[j].key != keys[i].key[type])
+				j = (j + 1) & run->hmask;
+			s = &run->hash[j];
+			ix->pool[s->first + s->count++] = i;
+		}
+	}
+
+	/* Entry offsets are the same in every CPU's copy */
+	i = 0;
+	IPT_ENTRY_ITERATE(info->entries, info->size,
+			  ipt_entry_offset, info->entries, ix->offset, &i);
+	info->index = ix;
+	duprintf("ipt_build_index: %u entries, %u runs\n", n, nruns);
+ out:
+	vfree(keys);
+}
+
 static int
 translate_table(const char *name,
 		unsigned int valid_hooks,
@@ -870,9 +1256,18 @@ translate_table(const char *name,
 		       SMP_ALIGN(newinfo->size));
 	}
 
+	ipt_build_index(newinfo);
 	return ret;
 }
 
+static void
+free_table_info(struct ipt_table_info *info)
+{
+	if (info->index)
+		vfree(info->index);
+	vfree(info);
+}
+
 static struct ipt_table_info *
 replace_table(struct ipt_table *table,
 	      unsigned int num_counters,
@@ -1081,6 +1476,7 @@ do_replace(void *user, unsigned int len)
 			  + SMP_ALIGN(tmp.size) * smp_num_cpus);
 	if (!newinfo)
 		return -ENOMEM;
+	newinfo->index = NULL;
 
 	if (copy_from_user(newinfo->entries, user + sizeof(tmp),
 			   tmp.size) != 0) {
@@ -1133,7 +1529,7 @@ do_replace(void *user, unsigned int len)
 	get_counters(oldinfo, counters);
 	/* Decrease module usage counts and free resource */
 	IPT_ENTRY_ITERATE(oldinfo->entries, oldinfo->size, cleanup_entry,NULL);
-	vfree(oldinfo);
+	free_table_info(oldinfo);
 	/* Silent error: too late now. */
 	copy_to_user(tmp.counters, counters,
 		     sizeof(struct ipt_counters) * tmp.num_counters);
@@ -1148,7 +1544,7 @@ do_replace(void *user, unsigned int len)
  free_newinfo_counters:
 	vfree(counters);
  free_newinfo:
-	vfree(newinfo);
+	free_table_info(newinfo);
 	return ret;
 }
 
@@ -1387,7 +1783,7 @@ int ipt_register_table(struct ipt_table *table)
 	int ret;
 	struct ipt_table_info *newinfo;
 	static struct ipt_table_info bootstrap
-		= { 0, 0, 0, { 0 }, { 0 }, { } };
+		= { 0, 0, 0, { 0 }, { 0 }, NULL, { } };
 
 	MOD_INC_USE_COUNT;
 	newinfo = vmalloc(sizeof(struct ipt_table_info)
@@ -1397,6 +1793,7 @@ int ipt_register_table(struct ipt_table *table)
 		MOD_DEC_USE_COUNT;
 		return ret;
 	}
+	newinfo->index = NULL;
 	memcpy(newinfo->entries, table->table->entries, table->table->size);
 
 	ret = translate_table(table->name, table->valid_hooks,
@@ -1405,14 +1802,14 @@ int ipt_register_table(struct ipt_table *table)
 			      table->table->hook_entry,
 			      table->table->underflow);
 	if (ret != 0) {
-		vfree(newinfo);
+		free_table_info(newinfo);
 		MOD_DEC_USE_COUNT;
 		return ret;
 	}
 
 	ret = down_interruptible(&ipt_mutex);
 	if (ret != 0) {
-		vfree(newinfo);
+		free_table_info(newinfo);
 		MOD_DEC_USE_COUNT;
 		return ret;
 	}
@@ -1442,7 +1839,7 @@ int ipt_register_table(struct ipt_table *table)
 	return ret;
 
  free_unlock:
-	vfree(newinfo);
+	free_table_info(newinfo);
 	MOD_DEC_USE_COUNT;
 	goto unlock;
 }
@@ -1456,7 +1853,7 @@ void ipt_unregister_table(struct ipt_table *table)
 	/* Decrease module usage counts and free resources */
 	IPT_ENTRY_ITERATE(table->private->entries, table->private->size,
 			  cleanup_entry, NULL);
-	vfree(table->private);
+	free_table_info(table->private);
 	MOD_DEC_USE_COUNT;
 }
 
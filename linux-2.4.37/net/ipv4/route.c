@@ -95,6 +95,8 @@
 #include <net/arp.h>
 #include <net/tcp.h>
 #include <net/icmp.h>
+#include <linux/tqueue.h>
+#include <asm/timex.h>
 #ifdef CONFIG_SYSCTL
 #include <linux/sysctl.h>
 #endif
@@ -119,6 +121,8 @@ int ip_rt_mtu_expires		= 10 * 60 * HZ;
 int ip_rt_min_pmtu		= 512 + 20 + 20;
 int ip_rt_min_advmss		= 256;
 int ip_rt_secret_interval	= 10 * 60 * HZ;
+int ip_rt_gc_quantum		= 16;
+int ip_rt_forward_nocache;
 static unsigned long rt_deadline;
 
 #define RTprint(a...)	printk(KERN_DEBUG a)
@@ -138,6 +142,7 @@ static void		 ipv4_dst_destroy(struct dst_entry *dst);
 static struct dst_entry *ipv4_negative_advice(struct dst_entry *dst);
 static void		 ipv4_link_failure(struct sk_buff *skb);
 static int rt_garbage_collect(void);
+static void rt_gc_worker(void *dummy);
 
 
 struct dst_ops ipv4_dst_ops = {
@@ -200,6 +205,14 @@ static unsigned int		rt_hash_rnd;
 
 struct rt_cache_stat rt_cache_stat[NR_CPUS];
 
+/* Shared by the synchronous and background collectors */
+static unsigned long rt_gc_expire = RT_GC_TIMEOUT;
+static int rt_gc_rover;
+
+static struct tq_struct rt_gc_tq = {
+	routine:	rt_gc_worker,
+};
+
 static int rt_intern_hash(unsigned hash, struct rtable *rth,
 				struct rtable **res);
 
@@ -284,11 +297,11 @@ static int rt_cache_stat_get_info(char *buffer, char **start, off_t offset, int
 	int i, lcpu;
 	int len = 0;
 
- 	len += sprintf(buffer+len, "entries  in_hit in_slow_tot in_slow_mc in_no_route in_brd in_martian_dst in_martian_src  out_hit out_slow_tot out_slow_mc  gc_total gc_ignored gc_goal_miss gc_dst_overflow in_hlist_search out_hlist_search\n");
+ 	len += sprintf(buffer+len, "entries  in_hit in_slow_tot in_slow_mc in_no_route in_brd in_martian_dst in_martian_src  out_hit out_slow_tot out_slow_mc  gc_total gc_ignored gc_goal_miss gc_dst_overflow in_hlist_search out_hlist_search  gc_sync_buckets gc_sync_freed gc_sync_cycles gc_bg_runs gc_bg_freed gc_chain_freed in_nocache\n");
         for (lcpu = 0; lcpu < smp_num_cpus; lcpu++) {
                 i = cpu_logical_map(lcpu);
 
-		len += sprintf(buffer+len, "%08x  %08x %08x %08x %08x %08x %08x %08x  %08x %08x %08x %08x %08x %08x %08x %08x %08x \n",
+		len += sprintf(buffer+len, "%08x  %08x %08x %08x %08x %08x %08x %08x  %08x %08x %08x %08x %08x %08x %08x %08x %08x  %08x %08x %08x %08x %08x %08x %08x \n",
 			       dst_entries,		       
 			       rt_cache_stat[i].in_hit,
 			       rt_cache_stat[i].in_slow_tot,
@@ -307,8 +320,15 @@ static int rt_cache_stat_get_info(char *buffer, char **start, off_t offset, int
 			       rt_cache_stat[i].gc_goal_miss,
 			       rt_cache_stat[i].gc_dst_overflow,
 			       rt_cache_stat[i].in_hlist_search,
-			       rt_cache_stat[i].out_hlist_search
-
+			       rt_cache_stat[i].out_hlist_search,
+
+			       rt_cache_stat[i].gc_sync_buckets,
+			       rt_cache_stat[i].gc_sync_freed,
+			       rt_cache_stat[i].gc_sync_cycles,
+			       rt_cache_stat[i].gc_bg_runs,
+			       rt_cache_stat[i].gc_bg_freed,
+			       rt_cache_stat[i].gc_chain_freed,
+			       rt_cache_stat[i].in_nocache
 			);
 	}
 	len -= offset;
@@ -521,21 +541,63 @@ static void rt_secret_rebuild(unsigned long dummy)
    at some equilibrium point, when number of aged off entries
    is kept approximately equal to newly generated ones.
 
-   Current expiration strength is variable "expire".
+   Current expiration strength is variable "rt_gc_expire".
    We try to adjust it dynamically, so that if networking
    is idle expires is large enough to keep enough of warm entries,
    and when load increases it reduces to limit cache size.
+
+   Only process context runs the full algorithm. A packet that
+   overflows gc_thresh in softirq sweeps a handful of buckets and
+   leaves the rest to keventd, so that a flood of new destinations
+   does not make every packet pay for a pass over the whole table.
  */
 
-static int rt_garbage_collect(void)
+/*
+ * Free what may expire in the next nbuckets buckets after the rover,
+ * stopping early once goal entries are gone. may_sleep is only set
+ * by the background collector, which holds no locks between buckets.
+ */
+static int rt_gc_sweep(int nbuckets, unsigned long expire, int goal,
+		       int may_sleep)
+{
+	struct rtable *rth, **rthp;
+	int k = rt_gc_rover;
+	int freed = 0;
+
+	while (nbuckets-- > 0) {
+		unsigned long tmo = expire;
+
+		k = (k + 1) & rt_hash_mask;
+		rthp = &rt_hash_table[k].chain;
+		write_lock_bh(&rt_hash_table[k].lock);
+		while ((rth = *rthp) != NULL) {
+			if (!rt_may_expire(rth, tmo, expire)) {
+				tmo >>= 1;
+				rthp = &rth->u.rt_next;
+				continue;
+			}
+			*rthp = rth->u.rt_next;
+			rt_free(rth);
+			freed++;
+		}
+		write_unlock_bh(&rt_hash_table[k].lock);
+		if (freed >= goal)
+			break;
+		if (may_sleep && current->need_resched) {
+			rt_gc_rover = k;
+			schedule();
+		}
+	}
+	rt_gc_rover = k;
+	return freed;
+}
+
+static int __rt_garbage_collect(int may_sleep)
 {
-	static unsigned long expire = RT_GC_TIMEOUT;
 	static unsigned long last_gc;
-	static int rover;
 	static int equilibrium;
-	struct rtable *rth, **rthp;
 	unsigned long now = jiffies;
-	int goal;
+	int goal, freed = 0;
 
 	/*
 	 * Garbage collection is pretty expensive,
@@ -578,29 +640,12 @@ static int rt_garbage_collect(void)
 	}
 
 	do {
-		int i, k;
+		int n;
 
-		for (i = rt_hash_mask, k = rover; i >= 0; i--) {
-			unsigned long tmo = expire;
-
-			k = (k + 1) & rt_hash_mask;
-			rthp = &rt_hash_table[k].chain;
-			write_lock_bh(&rt_hash_table[k].lock);
-			while ((rth = *rthp) != NULL) {
-				if (!rt_may_expire(rth, tmo, expire)) {
-					tmo >>= 1;
-					rthp = &rth->u.rt_next;
-					continue;
-				}
-				*rthp = rth->u.rt_next;
-				rt_free(rth);
-				goal--;
-			}
-			write_unlock_bh(&rt_hash_table[k].lock);
-			if (goal <= 0)
-				break;
-		}
-		rover = k;
+		n = rt_gc_sweep(rt_hash_mask + 1, rt_gc_expire, goal,
+				may_sleep);
+		freed += n;
+		goal -= n;
 
 		if (goal <= 0)
 			goto work_done;
@@ -616,13 +661,13 @@ static int rt_garbage_collect(void)
 
 		rt_cache_stat[smp_processor_id()].gc_goal_miss++;
 
-		if (expire == 0)
+		if (rt_gc_expire == 0)
 			break;
 
-		expire >>= 1;
+		rt_gc_expire >>= 1;
 #if RT_CACHE_DEBUG >= 2
-		printk(KERN_DEBUG "expire>> %u %d %d %d\n", expire,
-				atomic_read(&ipv4_dst_ops.entries), goal, i);
+		printk(KERN_DEBUG "expire>> %u %d %d\n", rt_gc_expire,
+				atomic_read(&ipv4_dst_ops.entries), goal);
 #endif
 
 		if (atomic_read(&ipv4_dst_ops.entries) < ip_rt_max_size)
@@ -634,18 +679,75 @@ static int rt_garbage_collect(void)
 	if (net_ratelimit())
 		printk(KERN_WARNING "dst cache overflow\n");
 	rt_cache_stat[smp_processor_id()].gc_dst_overflow++;
-	return 1;
+	return -1;
 
 work_done:
-	expire += ip_rt_gc_min_interval;
-	if (expire > ip_rt_gc_timeout ||
+	rt_gc_expire += ip_rt_gc_min_interval;
+	if (rt_gc_expire > ip_rt_gc_timeout ||
 	    atomic_read(&ipv4_dst_ops.entries) < ipv4_dst_ops.gc_thresh)
-		expire = ip_rt_gc_timeout;
+		rt_gc_expire = ip_rt_gc_timeout;
 #if RT_CACHE_DEBUG >= 2
-	printk(KERN_DEBUG "expire++ %u %d %d %d\n", expire,
-			atomic_read(&ipv4_dst_ops.entries), goal, rover);
+	printk(KERN_DEBUG "expire++ %u %d %d %d\n", rt_gc_expire,
+			atomic_read(&ipv4_dst_ops.entries), goal, rt_gc_rover);
 #endif
-out:	return 0;
+out:	return freed;
+}
+
+static void rt_gc_worker(void *dummy)
+{
+	int freed = __rt_garbage_collect(1);
+
+	rt_cache_stat[smp_processor_id()].gc_bg_runs++;
+	if (freed > 0)
+		rt_cache_stat[smp_processor_id()].gc_bg_freed += freed;
+}
+
+static int rt_garbage_collect(void)
+{
+	int cpu = smp_processor_id();
+	cycles_t t0;
+	int freed;
+
+	if (!in_softirq())
+		return __rt_garbage_collect(0) < 0;
+
+	t0 = get_cycles();
+	rt_cache_stat[cpu].gc_total++;
+	schedule_task(&rt_gc_tq);
+
+	freed = rt_gc_sweep(ip_rt_gc_quantum, rt_gc_expire, INT_MAX, 0);
+	rt_cache_stat[cpu].gc_sync_buckets += ip_rt_gc_quantum;
+	rt_cache_stat[cpu].gc_sync_freed += freed;
+	rt_cache_stat[cpu].gc_sync_cycles += get_cycles() - t0;
+
+	if (atomic_read(&ipv4_dst_ops.entries) < ip_rt_max_size)
+		return 0;
+	if (net_ratelimit())
+		printk(KERN_WARNING "dst cache overflow\n");
+	rt_cache_stat[cpu].gc_dst_overflow++;
+	return 1;
+}
+
+/*
+ * Forwarding without the cache: the packet gets a route of its own,
+ * which is never hashed. DST_NOCACHE makes the last dst_release()
+ * destroy it, so it neither goes through dst_lock and the garbage
+ * list nor counts against ip_rt_max_size once the skb is gone.
+ */
+static int rt_attach_uncached(struct rtable *rt, struct sk_buff *skb)
+{
+	if (rt->rt_type == RTN_UNICAST) {
+		int err = arp_bind_neighbour(&rt->u.dst);
+		if (err) {
+			rt_drop(rt);
+			return err;
+		}
+	}
+	rt->u.dst.obsolete = 2;
+	rt->u.dst.flags |= DST_NOCACHE;
+	skb->dst = &rt->u.dst;
+	rt_cache_stat[smp_processor_id()].in_nocache++;
+	return 0;
 }
 
 static int rt_intern_hash(unsigned hash, struct rtable *rt, struct rtable **rp)
@@ -684,6 +786,16 @@ restart:
 			return 0;
 		}
 
+		/* Whatever the collector would take anyway goes now, so
+		 * a bucket under a flood of new keys mostly cleans itself.
+		 */
+		if (rt_may_expire(rth, rt_gc_expire, ip_rt_gc_timeout)) {
+			*rthp = rth->u.rt_next;
+			rt_free(rth);
+			rt_cache_stat[smp_processor_id()].gc_chain_freed++;
+			continue;
+		}
+
 		if (!atomic_read(&rth->u.dst.__refcnt)) {
 			u32 score = rt_score(rth);
 
@@ -734,7 +846,7 @@ restart:
 				int saved_int = ip_rt_gc_min_interval;
 				ip_rt_gc_elasticity	= 1;
 				ip_rt_gc_min_interval	= 0;
-				rt_garbage_collect();
+				__rt_garbage_collect(0);
 				ip_rt_gc_min_interval	= saved_int;
 				ip_rt_gc_elasticity	= saved_elasticity;
 				goto restart;
@@ -1582,6 +1694,12 @@ int ip_route_input_slow(struct sk_buff *skb, u32 daddr, u32 saddr,
 	}
 #endif
 
+	if (ip_rt_forward_nocache &&
+	    !(rth->rt_flags & (RTCF_FAST|RTCF_DOREDIRECT))) {
+		err = rt_attach_uncached(rth, skb);
+		goto done;
+	}
+
 intern:
 	err = rt_intern_hash(hash, rth, (struct rtable**)&skb->dst);
 done:
@@ -2464,6 +2582,22 @@ ctl_table ipv4_route_table[] = {
 		mode:		0644,
 		proc_handler:	&proc_dointvec,
 	},
+	{
+		ctl_name:	NET_IPV4_ROUTE_GC_QUANTUM,
+		procname:	"gc_quantum",
+		data:		&ip_rt_gc_quantum,
+		maxlen:		sizeof(int),
+		mode:		0644,
+		proc_handler:	&proc_dointvec,
+	},
+	{
+		ctl_name:	NET_IPV4_ROUTE_FORWARD_NOCACHE,
+		procname:	"forward_nocache",
+		data:		&ip_rt_forward_nocache,
+		maxlen:		sizeof(int),
+		mode:		0644,
+		proc_handler:	&proc_dointvec,
+	},
 	{
 		ctl_name:	NET_IPV4_ROUTE_MTU_EXPIRES,
 		procname:	"mtu_expires",
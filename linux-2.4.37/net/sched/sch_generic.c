@@ -60,9 +60,12 @@ rwlock_t qdisc_tree_lock = RW_LOCK_UNLOCKED;
    dev->xmit_lock serializes accesses to device driver.
 
    dev->queue_lock and dev->xmit_lock are mutually exclusive,
-   if one is grabbed, another must be free.
+   if one is grabbed, another must be free. NETIF_F_LLTX drivers
+   do their own locking and dev->xmit_lock is not taken for them.
  */
 
+#define QDISC_TX_BATCH_MAX	32
+
 
 /* Kick device.
    Note, that this procedure can be called by a watchdog timer, so that
@@ -72,7 +75,8 @@ rwlock_t qdisc_tree_lock = RW_LOCK_UNLOCKED;
             >0  - queue is not empty, but throttled.
 	    <0  - queue is not empty. Device is throttled, if dev->tbusy != 0.
 
-   NOTE: Called under dev->queue_lock with locally disabled BH.
+   NOTE: Called under dev->queue_lock with locally disabled BH,
+   by the owner of __LINK_STATE_QDISC_RUNNING.
 */
 
 int qdisc_restart(struct net_device *dev)
@@ -81,33 +85,27 @@ int qdisc_restart(struct net_device *dev)
 	struct sk_buff *skb;
 
 	/* Dequeue packet */
-	if ((skb = q->dequeue(q)) != NULL) {
-		if (spin_trylock(&dev->xmit_lock)) {
-			/* Remember that the driver is grabbed by us. */
-			dev->xmit_lock_owner = smp_processor_id();
-
-			/* And release queue */
-			spin_unlock(&dev->queue_lock);
-
-			if (!netif_queue_stopped(dev)) {
-				if (netdev_nit)
-					dev_queue_xmit_nit(skb, dev);
+	if ((skb = q->dequeue(q)) != NULL)
+		return qdisc_xmit(dev, skb);
+	return q->q.qlen;
+}
 
-				if (dev->hard_start_xmit(skb, dev) == 0) {
-					dev->xmit_lock_owner = -1;
-					spin_unlock(&dev->xmit_lock);
+/* Give skb to the driver, together with up to netdev_tx_batch - 1
+   packets queued behind it, for one round trip through the locks.
+   skb has already left the queue. Same context and return value
+   as qdisc_restart().
+ */
 
-					spin_lock(&dev->queue_lock);
-					return -1;
-				}
-			}
+int qdisc_xmit(struct net_device *dev, struct sk_buff *skb)
+{
+	struct sk_buff *batch[QDISC_TX_BATCH_MAX];
+	struct Qdisc *q = dev->qdisc;
+	int nolock = dev->features & NETIF_F_LLTX;
+	int cpu = smp_processor_id();
+	int i, n, max, ret = NETDEV_TX_OK;
 
-			/* Release the driver */
-			dev->xmit_lock_owner = -1;
-			spin_unlock(&dev->xmit_lock);
-			spin_lock(&dev->queue_lock);
-			q = dev->qdisc;
-		} else {
+	if (!nolock) {
+		if (!spin_trylock(&dev->xmit_lock)) {
 			/* So, someone grabbed the driver. */
 
 			/* It may be transient configuration error,
@@ -115,30 +113,68 @@ int qdisc_restart(struct net_device *dev)
 			   it by checking xmit owner and drop the
 			   packet when deadloop is detected.
 			 */
-			if (dev->xmit_lock_owner == smp_processor_id()) {
+			if (dev->xmit_lock_owner == cpu) {
 				kfree_skb(skb);
 				if (net_ratelimit())
 					printk(KERN_DEBUG "Dead loop on netdevice %s, fix it urgently!\n", dev->name);
 				return -1;
 			}
-			netdev_rx_stat[smp_processor_id()].cpu_collision++;
+			netdev_rx_stat[cpu].cpu_collision++;
+			q->ops->requeue(skb, q);
+			netif_schedule(dev);
+			return 1;
 		}
+		/* Remember that the driver is grabbed by us. */
+		dev->xmit_lock_owner = cpu;
+	}
 
-		/* Device kicked us out :(
-		   This is possible in three cases:
-
-		   0. driver is locked
-		   1. fastroute is enabled
-		   2. device cannot determine busy state
-		      before start of transmission (f.e. dialout)
-		   3. device is buggy (ppp)
-		 */
+	/* Nobody else dequeues while we run the queue, so taking more
+	   than one packet here cannot reorder them. */
+	max = min_t(int, netdev_tx_batch, QDISC_TX_BATCH_MAX);
+	batch[0] = skb;
+	for (n = 1; n < max; n++)
+		if ((batch[n] = q->dequeue(q)) == NULL)
+			break;
+
+	/* And release queue */
+	spin_unlock(&dev->queue_lock);
+
+	for (i = 0; i < n; i++) {
+		if (netif_queue_stopped(dev))
+			break;
+		if (netdev_nit)
+			dev_queue_xmit_nit(batch[i], dev);
+		if ((ret = dev->hard_start_xmit(batch[i], dev)) != NETDEV_TX_OK)
+			break;
+	}
 
-		q->ops->requeue(skb, q);
-		netif_schedule(dev);
-		return 1;
+	if (!nolock) {
+		/* Release the driver */
+		dev->xmit_lock_owner = -1;
+		spin_unlock(&dev->xmit_lock);
 	}
-	return q->q.qlen;
+	spin_lock(&dev->queue_lock);
+	if (i == n)
+		return -1;
+	if (ret == NETDEV_TX_LOCKED)
+		netdev_rx_stat[cpu].cpu_collision++;
+
+	/* Device kicked us out :(
+	   This is possible in four cases:
+
+	   0. driver is locked
+	   1. fastroute is enabled
+	   2. device cannot determine busy state
+	      before start of transmission (f.e. dialout)
+	   3. device is buggy (ppp)
+	   4. the ring filled up partway through the batch
+	 */
+
+	q = dev->qdisc;
+	while (n > i)
+		q->ops->requeue(batch[--n], q);
+	netif_schedule(dev);
+	return 1;
 }
 
 static void dev_watchdog(unsigned long arg)
@@ -359,6 +395,7 @@ static int pfifo_fast_init(struct Qdisc *qdisc, struct rtattr *opt)
 	for (i=0; i<3; i++)
 		skb_queue_head_init(list+i);
 
+	qdisc->flags |= TCQ_F_CAN_BYPASS;
 	return 0;
 }
 
@@ -488,7 +525,8 @@ void dev_deactivate(struct net_device *dev)
 
 	dev_watchdog_down(dev);
 
-	while (test_bit(__LINK_STATE_SCHED, &dev->state))
+	while (test_bit(__LINK_STATE_SCHED, &dev->state) ||
+	       test_bit(__LINK_STATE_QDISC_RUNNING, &dev->state))
 		yield();
 
 	spin_unlock_wait(&dev->xmit_lock);
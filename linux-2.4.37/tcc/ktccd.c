@@ -0,0 +1,387 @@
+/*
+ * ktccd - persistent libtcc compile server for Kbuild.sh
+ *
+ * Each of the roughly thousand translation units listed in kfiles-2.4.*
+ * otherwise pays for exec'ing i386-tcc, dynamic linking, option parsing
+ * and libtcc setup. ktccd is started once per build and keeps libtcc
+ * mapped. The server parses the options of each request and keeps a
+ * TCCState set up with them, include paths and defines included, which
+ * is only rebuilt when the options change. All objects of one build use
+ * the same options. Every request is compiled in a forked child that
+ * inherits that state, so concurrent Kbuild.sh -j N jobs are served in
+ * parallel and a crash or leak inside libtcc cannot take down the server.
+ *
+ * tcc has no precompiled header support, its preprocessor state is reset
+ * for every translation unit, hence there is no parsed header state which
+ * could be shared between requests. Headers below include/ stay hot in
+ * page cache for the whole build instead. Header parsing is the bulk of
+ * the work per object, so the server saves process startup and setup
+ * only, not a multiple of the compile time.
+ *
+ *	ktccd -d socket				run server in foreground
+ *	ktccd -s socket [tcc options] -o file.o file.c	compile one object
+ *
+ * Request: working directory, the file for the compile times of the
+ * child or an empty string, followed by the arguments, each terminated
+ * by a NUL byte. Reply: one status byte followed by tcc diagnostics.
+ * The client takes that file from KTCCD_TIME, which Kbuild.sh -p sets
+ * because timing the client would only measure the socket round trip.
+ * Dependency output (-MD/-MF) is written by the tcc frontend and not by
+ * libtcc, Kbuild.sh therefore refuses incremental builds (-i) with -s.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <libtcc.h>
+
+#define REQ_MAX		65536
+#define REPLY_MAX	65536
+
+static const char *sockname;
+static char reply[REPLY_MAX];
+static int reply_len = 1;
+
+void die(const char *str)
+{
+	perror(str);
+	exit(1);
+}
+
+void usage(void)
+{
+	fprintf(stderr, "Usage: ktccd -d socket | -s socket [tcc options] -o file.o file.c\n");
+	exit(1);
+}
+
+static int sock_addr(struct sockaddr_un *addr, const char *name)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (strlen(name) >= sizeof(addr->sun_path))
+		return -1;
+	strcpy(addr->sun_path, name);
+	return 0;
+}
+
+static int write_all(int fd, const char *buf, int len)
+{
+	int n;
+
+	while (len > 0) {
+		n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int read_all(int fd, char *buf, int size)
+{
+	int n, len = 0;
+
+	while (len < size) {
+		n = read(fd, buf + len, size - len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (n == 0)
+			break;
+		len += n;
+	}
+	return len;
+}
+
+/* options taking a separate argument which must not be seen as source */
+static const char *opt_arg[] = { "-I", "-D", "-U", "-include", "-isystem", "-MF", NULL };
+
+static int has_arg(const char *opt)
+{
+	int i;
+
+	for (i = 0; opt_arg[i]; i++)
+		if (!strcmp(opt, opt_arg[i]))
+			return 1;
+	return 0;
+}
+
+static void error_func(void *opaque, const char *msg)
+{
+	int len = strlen(msg);
+
+	if (reply_len + len + 1 >= REPLY_MAX)
+		return;
+	memcpy(reply + reply_len, msg, len);
+	reply_len += len;
+	reply[reply_len++] = '\n';
+}
+
+/* set up from the options of the last request, inherited by every child */
+static TCCState *warm;
+static char warm_opts[REQ_MAX] = { 1 };
+
+/*
+ * Split a tcc command line without program name into -o, the source
+ * file and everything else, which goes through tcc_set_options()
+ * exactly like the tcc frontend does.
+ */
+static int parse_args(int argc, char **argv, char *opts, char **src, char **out)
+{
+	int i, len = 0;
+
+	opts[0] = 0;
+	*src = *out = NULL;
+	for (i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+			*out = argv[++i];
+			continue;
+		}
+		if (!strcmp(argv[i], "-c"))
+			continue;
+		if (argv[i][0] != '-') {
+			if (*src) {
+				error_func(NULL, "ktccd: only one source file per request");
+				return -1;
+			}
+			*src = argv[i];
+			continue;
+		}
+		len += snprintf(opts + len, REQ_MAX - len, " %s", argv[i]);
+		if (has_arg(argv[i]) && i + 1 < argc && len < REQ_MAX)
+			len += snprintf(opts + len, REQ_MAX - len, " %s", argv[++i]);
+		if (len >= REQ_MAX) {
+			error_func(NULL, "ktccd: command line too long");
+			return -1;
+		}
+	}
+	if (!*src || !*out) {
+		error_func(NULL, "ktccd: missing source or -o output file");
+		return -1;
+	}
+	return 0;
+}
+
+/* Runs in the server, the state is only built again when options change */
+static int warm_up(const char *opts)
+{
+	if (warm && !strcmp(opts, warm_opts))
+		return 0;
+	if (warm)
+		tcc_delete(warm);
+	warm = tcc_new();
+	if (!warm) {
+		warm_opts[0] = 1;
+		error_func(NULL, "ktccd: tcc_new failed");
+		return -1;
+	}
+	tcc_set_error_func(warm, NULL, error_func);
+	tcc_set_options(warm, opts);
+	tcc_set_output_type(warm, TCC_OUTPUT_OBJ);
+	strcpy(warm_opts, opts);
+	return 0;
+}
+
+/* Runs in the child on its copy of the warm state */
+static int compile(const char *dir, const char *src, const char *out)
+{
+	if (chdir(dir) < 0) {
+		error_func(NULL, "ktccd: cannot change to working directory");
+		return -1;
+	}
+	if (tcc_add_file(warm, src) == -1)
+		return -1;
+	return tcc_output_file(warm, out);
+}
+
+static double seconds(struct timeval *tv)
+{
+	return tv->tv_sec + tv->tv_usec / 1000000.0;
+}
+
+/*
+ * Runs in the child, writes wall, user and sys seconds and peak rss in
+ * kB like GNU time -f %e,%U,%S,%M. A forked child starts with zeroed
+ * cpu times, its peak rss includes the warm state it shares.
+ */
+static void write_times(const char *file, struct timeval *start)
+{
+	struct timeval now;
+	struct rusage ru;
+	FILE *f;
+
+	gettimeofday(&now, NULL);
+	getrusage(RUSAGE_SELF, &ru);
+	f = fopen(file, "w");
+	if (!f) {
+		error_func(NULL, "ktccd: cannot write time file");
+		return;
+	}
+	fprintf(f, "%.2f,%.2f,%.2f,%ld\n", seconds(&now) - seconds(start),
+		seconds(&ru.ru_utime), seconds(&ru.ru_stime), ru.ru_maxrss);
+	fclose(f);
+}
+
+/*
+ * Read one request and set up the state for it in the server, then
+ * fork the child which compiles and replies.
+ */
+static void serve(int fd, int listen_fd)
+{
+	static char req[REQ_MAX];
+	static char opts[REQ_MAX];
+	char *argv[REQ_MAX / 2];
+	char *src, *out;
+	struct timeval start;
+	int argc = 0, len, i;
+
+	len = read_all(fd, req, sizeof(req) - 1);
+	if (len <= 0)
+		return;
+	req[len] = 0;
+
+	/* working directory and time file of the client come first */
+	for (i = 0; i < len; i += strlen(req + i) + 1)
+		argv[argc++] = req + i;
+
+	reply[0] = 1;
+	reply_len = 1;
+	if (argc < 3) {
+		error_func(NULL, "ktccd: empty request");
+		goto fail;
+	}
+	if (parse_args(argc - 2, argv + 2, opts, &src, &out) < 0 ||
+	    warm_up(opts) < 0)
+		goto fail;
+
+	switch (fork()) {
+	case -1:
+		die("fork");
+	case 0:
+		close(listen_fd);
+		gettimeofday(&start, NULL);
+		if (compile(argv[0], src, out) == 0)
+			reply[0] = 0;
+		if (argv[1][0])
+			write_times(argv[1], &start);
+		write_all(fd, reply, reply_len);
+		_exit(0);
+	}
+	return;
+
+fail:
+	write_all(fd, reply, reply_len);
+}
+
+static void server_exit(int sig)
+{
+	unlink(sockname);
+	_exit(0);
+}
+
+static int server(void)
+{
+	struct sockaddr_un addr;
+	int fd, conn;
+
+	if (sock_addr(&addr, sockname) < 0)
+		usage();
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		die("socket");
+	unlink(sockname);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		die("bind");
+	if (listen(fd, 64) < 0)
+		die("listen");
+
+	/* children are never waited for */
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGTERM, server_exit);
+	signal(SIGINT, server_exit);
+
+	for (;;) {
+		conn = accept(fd, NULL, NULL);
+		if (conn < 0) {
+			if (errno == EINTR)
+				continue;
+			die("accept");
+		}
+		serve(conn, fd);
+		close(conn);
+	}
+}
+
+static int client(int argc, char **argv)
+{
+	struct sockaddr_un addr;
+	static char buf[REQ_MAX];
+	const char *times = getenv("KTCCD_TIME");
+	int fd, i, len;
+
+	if (!getcwd(buf, sizeof(buf)))
+		die("getcwd");
+	len = strlen(buf) + 1;
+	if (!times)
+		times = "";
+	if (len + strlen(times) + 1 >= sizeof(buf)) {
+		fprintf(stderr, "ktccd: time file name too long\n");
+		return 1;
+	}
+	strcpy(buf + len, times);
+	len += strlen(times) + 1;
+	for (i = 0; i < argc; i++) {
+		if (len + strlen(argv[i]) + 1 >= sizeof(buf)) {
+			fprintf(stderr, "ktccd: command line too long\n");
+			return 1;
+		}
+		strcpy(buf + len, argv[i]);
+		len += strlen(argv[i]) + 1;
+	}
+
+	if (sock_addr(&addr, sockname) < 0)
+		usage();
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		die("socket");
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		die(sockname);
+	if (write_all(fd, buf, len) < 0)
+		die("write");
+	shutdown(fd, SHUT_WR);
+
+	len = read_all(fd, reply, sizeof(reply));
+	if (len <= 0) {
+		fprintf(stderr, "ktccd: no reply from server\n");
+		return 1;
+	}
+	write_all(2, reply + 1, len - 1);
+	return reply[0];
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+		usage();
+	sockname = argv[2];
+	if (!strcmp(argv[1], "-d"))
+		return server();
+	if (!strcmp(argv[1], "-s"))
+		return client(argc - 3, argv + 3);
+	usage();
+	return 1;
+}
@@ -23,6 +23,7 @@
 #include <linux/idr.h>
 #include <linux/posix-timers.h>
 #include <linux/wait.h>
+#include <linux/hrtimer.h>
 
 #ifndef div_long_long_rem
 #include <asm/div64.h>
@@ -1183,6 +1184,31 @@ do_clock_nanosleep(clockid_t which_clock, int flags, struct timespec *tsave)
 			return 0;	/* Already passed */
 	}
 
+	/*
+	 * Relative sleeps go to the hrtimer. After a non-delivered signal
+	 * the rest is slept on the timer wheel from the restart block.
+	 */
+	if (!abs && !rq_time && hrtimer_available()) {
+		u64 ns = (u64) tsave->tv_sec * NSEC_PER_SEC + tsave->tv_nsec;
+		u64 ticks;
+
+		ns = hrtimer_nanosleep(ns);
+		if (!ns)
+			return 0;
+		ticks = ns + TICK_NSEC - 1;
+		do_div(ticks, TICK_NSEC);
+		rq_time = get_jiffies_64() + ticks;
+		tsave->tv_nsec = do_div(ns, NSEC_PER_SEC);
+		tsave->tv_sec = (time_t) ns;
+		restart_block->fn = clock_nanosleep_restart;
+		restart_block->arg0 = which_clock;
+		restart_block->arg1 = (unsigned long)tsave;
+		restart_block->arg2 = rq_time & 0xffffffffLL;
+		restart_block->arg3 = rq_time >> 32;
+
+		return -ERESTART_RESTARTBLOCK;
+	}
+
 	if (abs && (posix_clocks[which_clock].clock_get !=
 			    posix_clocks[CLOCK_MONOTONIC].clock_get))
 		add_wait_queue(&nanosleep_abs_wqueue, &abs_wqueue);